@@ -1,4 +1,9 @@
 #!/bin/sh
 glslangValidator -o shader.vert.spv -V shader.vert 
 glslangValidator -o shader.frag.spv -V shader.frag 
+glslangValidator -o shader_packed.vert.spv -V shader_packed.vert 
+glslangValidator -o shader_instanced.vert.spv -V shader_instanced.vert 
+glslangValidator -o shader_packed_instanced.vert.spv -V shader_packed_instanced.vert 
+glslangValidator -o cull.comp.spv -V cull.comp 
+glslangValidator -o meshlet_cull.comp.spv -V meshlet_cull.comp 
 
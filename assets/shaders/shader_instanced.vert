@@ -0,0 +1,19 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inColor;
+// per instance, the matrix takes locations 2 to 5
+layout(location = 2) in mat4 inModel;
+layout(location = 6) in vec4 inInstanceColor;
+
+layout(std140, push_constant) uniform Constants {
+  mat4 mvp;
+} constants;
+
+layout(location = 0) out vec3 fragColor;
+
+void main() {
+    gl_Position = constants.mvp * inModel * vec4(inPosition, 1.0);
+    fragColor = inColor * inInstanceColor.rgb;
+}
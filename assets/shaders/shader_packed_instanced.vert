@@ -0,0 +1,24 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// positions are unorm within the bounds of the mesh, so they arrive in [0, 1]
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inColor;
+// per instance, the matrix takes locations 2 to 5
+layout(location = 2) in mat4 inModel;
+layout(location = 6) in vec4 inInstanceColor;
+
+layout(std140, push_constant) uniform Constants {
+  mat4 mvp;
+  vec4 positionOffset;
+  vec4 positionScale;
+} constants;
+
+layout(location = 0) out vec3 fragColor;
+
+void main() {
+    vec3 position = constants.positionOffset.xyz +
+                    inPosition * constants.positionScale.xyz;
+    gl_Position = constants.mvp * inModel * vec4(position, 1.0);
+    fragColor = inColor * inInstanceColor.rgb;
+}
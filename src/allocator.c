@@ -0,0 +1,515 @@
+#include "allocator.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_alloc.h"
+
+// first node of the tree at `depth`
+static uint32_t levelStart(const uint32_t depth) {
+  return ((1u << depth) - 1);
+}
+
+static VkDeviceSize orderSize(const uint32_t order) {
+  return (ALLOCATOR_MIN_ALLOCATION_SIZE << order);
+}
+
+// after `node` changed, recompute the largest free range of its ancestors,
+// merging buddies that are both entirely free
+static void updateParents(AllocatorBlock *pBlock, uint32_t node,
+                          uint32_t order) {
+  uint8_t *pLongest = pBlock->pLongest;
+  while (node != 0) {
+    node = (node - 1) / 2;
+    order++;
+    uint8_t left = pLongest[node * 2 + 1];
+    uint8_t right = pLongest[node * 2 + 2];
+    if (left == order && right == order) {
+      pLongest[node] = (uint8_t)(order + 1);
+    } else {
+      pLongest[node] = left > right ? left : right;
+    }
+  }
+}
+
+static bool buddyAllocate(AllocatorBlock *pBlock, const uint32_t order,
+                          VkDeviceSize *pOffset) {
+  uint8_t *pLongest = pBlock->pLongest;
+  if (pLongest[0] < order + 1) {
+    return (false);
+  }
+  uint32_t node = 0;
+  for (uint32_t nodeOrder = pBlock->maxOrder; nodeOrder > order; nodeOrder--) {
+    uint32_t left = node * 2 + 1;
+    node = pLongest[left] >= order + 1 ? left : left + 1;
+  }
+  pLongest[node] = 0;
+  updateParents(pBlock, node, order);
+
+  uint32_t depth = pBlock->maxOrder - order;
+  *pOffset = (VkDeviceSize)(node - levelStart(depth)) * orderSize(order);
+  pBlock->usedBytes += orderSize(order);
+  return (true);
+}
+
+static void buddyFree(AllocatorBlock *pBlock, const VkDeviceSize offset,
+                      const uint32_t order) {
+  uint32_t depth = pBlock->maxOrder - order;
+  uint32_t node = levelStart(depth) + (uint32_t)(offset / orderSize(order));
+  pBlock->pLongest[node] = (uint8_t)(order + 1);
+  updateParents(pBlock, node, order);
+  pBlock->usedBytes -= orderSize(order);
+}
+
+static bool isHostVisible(const Allocator *pAllocator,
+                          const uint32_t memoryTypeIndex) {
+  return ((pAllocator->memoryProperties.memoryTypes[memoryTypeIndex]
+               .propertyFlags &
+           VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0);
+}
+
+static uint32_t heapOf(const Allocator *pAllocator,
+                       const uint32_t memoryTypeIndex) {
+  return (pAllocator->memoryProperties.memoryTypes[memoryTypeIndex].heapIndex);
+}
+
+static bool isOverThreshold(const AllocatorHeapBudget budget,
+                            const VkDeviceSize extraBytes) {
+  return ((budget.usage + extraBytes) * 100 >
+          budget.budget * ALLOCATOR_LOW_MEMORY_PERCENT);
+}
+
+// gives the callback a chance to free memory before `size` more bytes are
+// allocated from heap `heapIndex`
+static void checkBudget(Allocator *pAllocator, const uint32_t heapIndex,
+                        const VkDeviceSize size) {
+  if (pAllocator->lowMemoryCallback == NULL) {
+    return;
+  }
+  AllocatorHeapBudget budget;
+  getAllocatorHeapBudget(&budget, pAllocator, heapIndex);
+  if (isOverThreshold(budget, size)) {
+    pAllocator->lowMemoryCallback(pAllocator->pLowMemoryUserData, heapIndex,
+                                  budget);
+  }
+}
+
+// allocates and, if possible, maps a whole VkDeviceMemory
+static ErrVal allocateDeviceMemory(VkDeviceMemory *pMemory, void **ppMapped,
+                                   Allocator *pAllocator,
+                                   const VkDeviceSize size,
+                                   const uint32_t memoryTypeIndex) {
+  VkMemoryAllocateInfo allocateInfo = {0};
+  allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocateInfo.allocationSize = size;
+  allocateInfo.memoryTypeIndex = memoryTypeIndex;
+  VkResult res =
+      vkAllocateMemory(pAllocator->device, &allocateInfo,
+                       pVulkanAllocationCallbacks, pMemory);
+  if (res != VK_SUCCESS) {
+    LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "failed to allocate device memory: %s",
+                   vkstrerror(res));
+    return (ERR_ALLOCFAIL);
+  }
+
+  // memory can only be mapped once, so it stays mapped for its whole life
+  *ppMapped = NULL;
+  if (isHostVisible(pAllocator, memoryTypeIndex)) {
+    res = vkMapMemory(pAllocator->device, *pMemory, 0, VK_WHOLE_SIZE, 0,
+                      ppMapped);
+    if (res != VK_SUCCESS) {
+      LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "failed to map device memory: %s",
+                     vkstrerror(res));
+      vkFreeMemory(pAllocator->device, *pMemory, pVulkanAllocationCallbacks);
+      *pMemory = VK_NULL_HANDLE;
+      return (ERR_MEMORY);
+    }
+  }
+  pAllocator->pReservedBytes[heapOf(pAllocator, memoryTypeIndex)] += size;
+  return (ERR_OK);
+}
+
+// returns the index of an empty block slot with its memory allocated
+static ErrVal new_AllocatorBlock(uint32_t *pBlockIndex, Allocator *pAllocator,
+                                 const uint32_t memoryTypeIndex) {
+  AllocatorMemoryType *pType = &pAllocator->pMemoryTypes[memoryTypeIndex];
+  // before any block is touched, since the callback may free some
+  checkBudget(pAllocator, heapOf(pAllocator, memoryTypeIndex),
+              orderSize(pType->maxOrder));
+
+  // reuse the slot of a block that was freed
+  uint32_t blockIndex = pType->blockCount;
+  for (uint32_t i = 0; i < pType->blockCount; i++) {
+    if (pType->pBlocks[i].memory == VK_NULL_HANDLE) {
+      blockIndex = i;
+      break;
+    }
+  }
+  if (blockIndex == pType->blockCount) {
+    AllocatorBlock *pBlocks = realloc(
+        pType->pBlocks, (pType->blockCount + 1) * sizeof(AllocatorBlock));
+    if (!pBlocks) {
+      LOG_ERROR_ARGS(ERR_LEVEL_FATAL, "could not grow allocator: %s",
+                     strerror(errno));
+      PANIC();
+    }
+    pType->pBlocks = pBlocks;
+    pType->blockCount++;
+  }
+  pType->pBlocks[blockIndex].memory = VK_NULL_HANDLE;
+
+  AllocatorBlock *pBlock = &pType->pBlocks[blockIndex];
+  pBlock->maxOrder = pType->maxOrder;
+  pBlock->usedBytes = 0;
+  pBlock->pLongest = malloc((2u << pBlock->maxOrder) - 1);
+  if (!pBlock->pLongest) {
+    LOG_ERROR_ARGS(ERR_LEVEL_FATAL, "could not allocate block tree: %s",
+                   strerror(errno));
+    PANIC();
+  }
+  // every node starts out entirely free
+  for (uint32_t depth = 0; depth <= pBlock->maxOrder; depth++) {
+    memset(&pBlock->pLongest[levelStart(depth)],
+           (int)(pBlock->maxOrder - depth + 1), 1u << depth);
+  }
+
+  ErrVal retVal =
+      allocateDeviceMemory(&pBlock->memory, &pBlock->pMapped, pAllocator,
+                           orderSize(pBlock->maxOrder), memoryTypeIndex);
+  if (retVal != ERR_OK) {
+    free(pBlock->pLongest);
+    pBlock->pLongest = NULL;
+    pBlock->memory = VK_NULL_HANDLE;
+    return (retVal);
+  }
+  *pBlockIndex = blockIndex;
+  return (ERR_OK);
+}
+
+static void delete_AllocatorBlock(AllocatorBlock *pBlock,
+                                  Allocator *pAllocator,
+                                  const uint32_t memoryTypeIndex) {
+  // freeing memory also unmaps it
+  vkFreeMemory(pAllocator->device, pBlock->memory, pVulkanAllocationCallbacks);
+  pAllocator->pReservedBytes[heapOf(pAllocator, memoryTypeIndex)] -=
+      orderSize(pBlock->maxOrder);
+  pBlock->memory = VK_NULL_HANDLE;
+  pBlock->pMapped = NULL;
+  free(pBlock->pLongest);
+  pBlock->pLongest = NULL;
+}
+
+ErrVal new_Allocator(Allocator *pAllocator,
+                     const VkPhysicalDevice physicalDevice,
+                     const VkDevice device, const bool memoryBudgetEnabled) {
+  memset(pAllocator, 0, sizeof(Allocator));
+  pAllocator->device = device;
+  pAllocator->physicalDevice = physicalDevice;
+  pAllocator->memoryBudgetEnabled = memoryBudgetEnabled;
+  vkGetPhysicalDeviceMemoryProperties(physicalDevice,
+                                      &pAllocator->memoryProperties);
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+  pAllocator->bufferImageGranularity = properties.limits.bufferImageGranularity;
+
+  for (uint32_t i = 0; i < pAllocator->memoryProperties.memoryTypeCount; i++) {
+    // small heaps, like the 256MiB BAR heap, get smaller blocks
+    VkDeviceSize heapSize =
+        pAllocator->memoryProperties.memoryHeaps[heapOf(pAllocator, i)].size;
+    VkDeviceSize blockSize = ALLOCATOR_BLOCK_SIZE;
+    if (heapSize / 8 < blockSize) {
+      blockSize = heapSize / 8;
+    }
+    uint32_t maxOrder = 0;
+    while (orderSize(maxOrder + 1) <= blockSize) {
+      maxOrder++;
+    }
+    pAllocator->pMemoryTypes[i].maxOrder = maxOrder;
+  }
+  allocatorUpdateBudget(pAllocator);
+  return (ERR_OK);
+}
+
+void delete_Allocator(Allocator *pAllocator) {
+  for (uint32_t i = 0; i < pAllocator->memoryProperties.memoryHeapCount; i++) {
+    if (pAllocator->pLiveAllocationCounts[i] != 0) {
+      LOG_ERROR_ARGS(ERR_LEVEL_WARN, "%u allocations leaked in heap %u",
+                     pAllocator->pLiveAllocationCounts[i], i);
+    }
+  }
+  for (uint32_t i = 0; i < pAllocator->memoryProperties.memoryTypeCount; i++) {
+    AllocatorMemoryType *pType = &pAllocator->pMemoryTypes[i];
+    for (uint32_t j = 0; j < pType->blockCount; j++) {
+      if (pType->pBlocks[j].memory != VK_NULL_HANDLE) {
+        delete_AllocatorBlock(&pType->pBlocks[j], pAllocator, i);
+      }
+    }
+    free(pType->pBlocks);
+    pType->pBlocks = NULL;
+    pType->blockCount = 0;
+  }
+}
+
+ErrVal selectMemoryType(uint32_t *pMemoryTypeIndex,
+                        const VkPhysicalDeviceMemoryProperties *pProperties,
+                        const uint32_t memoryTypeBits,
+                        const VkMemoryPropertyFlags requiredProperties,
+                        const VkMemoryPropertyFlags preferredProperties) {
+  uint32_t bestIndex = UINT32_MAX;
+  int bestScore = 0;
+  VkDeviceSize bestHeapSize = 0;
+  for (uint32_t i = 0; i < pProperties->memoryTypeCount; i++) {
+    VkMemoryPropertyFlags flags = pProperties->memoryTypes[i].propertyFlags;
+    if (!(memoryTypeBits & (1u << i)) ||
+        (flags & requiredProperties) != requiredProperties) {
+      continue;
+    }
+    int score = __builtin_popcount(flags & preferredProperties);
+    VkDeviceSize heapSize =
+        pProperties->memoryHeaps[pProperties->memoryTypes[i].heapIndex].size;
+    if (bestIndex == UINT32_MAX || score > bestScore ||
+        (score == bestScore && heapSize > bestHeapSize)) {
+      bestIndex = i;
+      bestScore = score;
+      bestHeapSize = heapSize;
+    }
+  }
+  if (bestIndex == UINT32_MAX) {
+    LOG_ERROR(ERR_LEVEL_ERROR, "failed to find suitable memory type");
+    return (ERR_MEMORY);
+  }
+  *pMemoryTypeIndex = bestIndex;
+  return (ERR_OK);
+}
+
+ErrVal new_Allocation(Allocation *pAllocation, Allocator *pAllocator,
+                      const VkMemoryRequirements requirements,
+                      const VkMemoryPropertyFlags requiredProperties,
+                      const VkMemoryPropertyFlags preferredProperties) {
+  uint32_t memoryTypeIndex;
+  ErrVal retVal = selectMemoryType(
+      &memoryTypeIndex, &pAllocator->memoryProperties,
+      requirements.memoryTypeBits, requiredProperties, preferredProperties);
+  if (retVal != ERR_OK) {
+    return (retVal);
+  }
+  AllocatorMemoryType *pType = &pAllocator->pMemoryTypes[memoryTypeIndex];
+  uint32_t heapIndex = heapOf(pAllocator, memoryTypeIndex);
+
+  // buddy ranges are aligned to their own size, so rounding the size up to the
+  // alignment and granularity is enough to satisfy both
+  VkDeviceSize minSize = requirements.size;
+  if (requirements.alignment > minSize) {
+    minSize = requirements.alignment;
+  }
+  if (pAllocator->bufferImageGranularity > minSize) {
+    minSize = pAllocator->bufferImageGranularity;
+  }
+  uint32_t order = 0;
+  while (orderSize(order) < minSize && order <= pType->maxOrder) {
+    order++;
+  }
+
+  pAllocation->size = requirements.size;
+  pAllocation->memoryTypeIndex = memoryTypeIndex;
+  pAllocation->order = order;
+
+  // big resources would waste most of a block, so they get their own memory
+  if (order >= pType->maxOrder) {
+    checkBudget(pAllocator, heapIndex, requirements.size);
+    retVal = allocateDeviceMemory(&pAllocation->memory, &pAllocation->pMapped,
+                                  pAllocator, requirements.size,
+                                  memoryTypeIndex);
+    if (retVal != ERR_OK) {
+      return (retVal);
+    }
+    pAllocation->offset = 0;
+    pAllocation->blockIndex = ALLOCATOR_DEDICATED;
+    pAllocator->pDedicatedBytes[heapIndex] += requirements.size;
+    pAllocator->pDedicatedCounts[heapIndex]++;
+  } else {
+    VkDeviceSize offset = 0;
+    uint32_t blockIndex = 0;
+    while (blockIndex < pType->blockCount &&
+           (pType->pBlocks[blockIndex].memory == VK_NULL_HANDLE ||
+            !buddyAllocate(&pType->pBlocks[blockIndex], order, &offset))) {
+      blockIndex++;
+    }
+    if (blockIndex == pType->blockCount) {
+      retVal = new_AllocatorBlock(&blockIndex, pAllocator, memoryTypeIndex);
+      if (retVal != ERR_OK) {
+        return (retVal);
+      }
+      buddyAllocate(&pType->pBlocks[blockIndex], order, &offset);
+    }
+    AllocatorBlock *pBlock = &pType->pBlocks[blockIndex];
+    pAllocation->memory = pBlock->memory;
+    pAllocation->offset = offset;
+    pAllocation->pMapped =
+        pBlock->pMapped ? (uint8_t *)pBlock->pMapped + offset : NULL;
+    pAllocation->blockIndex = blockIndex;
+  }
+
+  pAllocator->pLiveBytes[heapIndex] += requirements.size;
+  pAllocator->pLiveAllocationCounts[heapIndex]++;
+  return (ERR_OK);
+}
+
+void delete_Allocation(Allocation *pAllocation, Allocator *pAllocator) {
+  uint32_t heapIndex = heapOf(pAllocator, pAllocation->memoryTypeIndex);
+  if (pAllocation->blockIndex == ALLOCATOR_DEDICATED) {
+    vkFreeMemory(pAllocator->device, pAllocation->memory,
+                 pVulkanAllocationCallbacks);
+    pAllocator->pReservedBytes[heapIndex] -= pAllocation->size;
+    pAllocator->pDedicatedBytes[heapIndex] -= pAllocation->size;
+    pAllocator->pDedicatedCounts[heapIndex]--;
+  } else {
+    AllocatorMemoryType *pType =
+        &pAllocator->pMemoryTypes[pAllocation->memoryTypeIndex];
+    AllocatorBlock *pBlock = &pType->pBlocks[pAllocation->blockIndex];
+    buddyFree(pBlock, pAllocation->offset, pAllocation->order);
+    // keep the first block around so that a single resource being recreated
+    // doesn't allocate and free a block every time
+    if (pBlock->usedBytes == 0 && pAllocation->blockIndex != 0) {
+      delete_AllocatorBlock(pBlock, pAllocator, pAllocation->memoryTypeIndex);
+    }
+  }
+  pAllocator->pLiveBytes[heapIndex] -= pAllocation->size;
+  pAllocator->pLiveAllocationCounts[heapIndex]--;
+
+  pAllocation->memory = VK_NULL_HANDLE;
+  pAllocation->pMapped = NULL;
+}
+
+void getAllocatorHeapStats(AllocatorHeapStats *pStats,
+                           const Allocator *pAllocator,
+                           const uint32_t heapIndex) {
+  memset(pStats, 0, sizeof(AllocatorHeapStats));
+  pStats->liveBytes = pAllocator->pLiveBytes[heapIndex];
+  pStats->liveAllocationCount = pAllocator->pLiveAllocationCounts[heapIndex];
+  pStats->usedBytes = pAllocator->pDedicatedBytes[heapIndex];
+  pStats->reservedBytes = pAllocator->pDedicatedBytes[heapIndex];
+  pStats->deviceMemoryCount = pAllocator->pDedicatedCounts[heapIndex];
+
+  for (uint32_t i = 0; i < pAllocator->memoryProperties.memoryTypeCount; i++) {
+    if (heapOf(pAllocator, i) != heapIndex) {
+      continue;
+    }
+    const AllocatorMemoryType *pType = &pAllocator->pMemoryTypes[i];
+    for (uint32_t j = 0; j < pType->blockCount; j++) {
+      const AllocatorBlock *pBlock = &pType->pBlocks[j];
+      if (pBlock->memory == VK_NULL_HANDLE) {
+        continue;
+      }
+      VkDeviceSize blockSize = orderSize(pBlock->maxOrder);
+      pStats->usedBytes += pBlock->usedBytes;
+      pStats->reservedBytes += blockSize;
+      pStats->freeBytes += blockSize - pBlock->usedBytes;
+      pStats->deviceMemoryCount++;
+      if (pBlock->pLongest[0] != 0 &&
+          orderSize(pBlock->pLongest[0] - 1u) > pStats->largestFreeRange) {
+        pStats->largestFreeRange = orderSize(pBlock->pLongest[0] - 1u);
+      }
+    }
+  }
+}
+
+void allocatorPrintStats(const Allocator *pAllocator) {
+  printf("%-6s %12s %12s %12s %8s %8s %8s\n", "heap", "live_kib",
+         "used_kib", "reserved_kib", "allocs", "vk_mems", "frag");
+  for (uint32_t i = 0; i < pAllocator->memoryProperties.memoryHeapCount; i++) {
+    AllocatorHeapStats stats;
+    getAllocatorHeapStats(&stats, pAllocator, i);
+    if (stats.reservedBytes == 0) {
+      continue;
+    }
+    // the share of free memory that can't be handed out as one range
+    double fragmentation = 0.0;
+    if (stats.freeBytes != 0) {
+      fragmentation = 1.0 - (double)stats.largestFreeRange /
+                                (double)stats.freeBytes;
+    }
+    printf("%-6u %12llu %12llu %12llu %8u %8u %8.3f\n", i,
+           (unsigned long long)(stats.liveBytes / 1024),
+           (unsigned long long)(stats.usedBytes / 1024),
+           (unsigned long long)(stats.reservedBytes / 1024),
+           stats.liveAllocationCount, stats.deviceMemoryCount, fragmentation);
+  }
+}
+
+void allocatorUpdateBudget(Allocator *pAllocator) {
+  const VkPhysicalDeviceMemoryProperties *pProperties =
+      &pAllocator->memoryProperties;
+  if (pAllocator->memoryBudgetEnabled) {
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties = {0};
+    budgetProperties.sType =
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+    VkPhysicalDeviceMemoryProperties2 properties = {0};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+    properties.pNext = &budgetProperties;
+    vkGetPhysicalDeviceMemoryProperties2(pAllocator->physicalDevice,
+                                         &properties);
+    for (uint32_t i = 0; i < pProperties->memoryHeapCount; i++) {
+      pAllocator->pBudgets[i].budget = budgetProperties.heapBudget[i];
+      pAllocator->pBudgets[i].usage = budgetProperties.heapUsage[i];
+    }
+  } else {
+    for (uint32_t i = 0; i < pProperties->memoryHeapCount; i++) {
+      pAllocator->pBudgets[i].budget = pProperties->memoryHeaps[i].size /
+                                       100 * ALLOCATOR_DEFAULT_BUDGET_PERCENT;
+      pAllocator->pBudgets[i].usage = pAllocator->pReservedBytes[i];
+    }
+  }
+  memcpy(pAllocator->pReservedBytesAtBudget, pAllocator->pReservedBytes,
+         sizeof(pAllocator->pReservedBytes));
+
+  if (pAllocator->lowMemoryCallback == NULL) {
+    return;
+  }
+  for (uint32_t i = 0; i < pProperties->memoryHeapCount; i++) {
+    if (isOverThreshold(pAllocator->pBudgets[i], 0)) {
+      pAllocator->lowMemoryCallback(pAllocator->pLowMemoryUserData, i,
+                                    pAllocator->pBudgets[i]);
+    }
+  }
+}
+
+void getAllocatorHeapBudget(AllocatorHeapBudget *pBudget,
+                            const Allocator *pAllocator,
+                            const uint32_t heapIndex) {
+  *pBudget = pAllocator->pBudgets[heapIndex];
+  // the driver may count memory differently, so only adjust by the change
+  VkDeviceSize reserved = pAllocator->pReservedBytes[heapIndex];
+  VkDeviceSize reservedAtBudget = pAllocator->pReservedBytesAtBudget[heapIndex];
+  if (reserved >= reservedAtBudget) {
+    pBudget->usage += reserved - reservedAtBudget;
+  } else if (pBudget->usage > reservedAtBudget - reserved) {
+    pBudget->usage -= reservedAtBudget - reserved;
+  } else {
+    pBudget->usage = 0;
+  }
+}
+
+void allocatorSetLowMemoryCallback(Allocator *pAllocator,
+                                   const AllocatorLowMemoryCallback callback,
+                                   void *pUserData) {
+  pAllocator->lowMemoryCallback = callback;
+  pAllocator->pLowMemoryUserData = pUserData;
+}
+
+void allocatorPrintBudget(const Allocator *pAllocator) {
+  printf("memory budget:");
+  for (uint32_t i = 0; i < pAllocator->memoryProperties.memoryHeapCount; i++) {
+    AllocatorHeapBudget budget;
+    getAllocatorHeapBudget(&budget, pAllocator, i);
+    printf(" heap %u %llu/%llu MiB (%llu MiB ours)", i,
+           (unsigned long long)(budget.usage / (1024 * 1024)),
+           (unsigned long long)(budget.budget / (1024 * 1024)),
+           (unsigned long long)(pAllocator->pReservedBytes[i] / (1024 * 1024)));
+  }
+  printf("\n");
+}
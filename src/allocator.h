@@ -0,0 +1,205 @@
+#ifndef SRC_ALLOCATOR_H_
+#define SRC_ALLOCATOR_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+#include "errors.h"
+
+// size of the device memory blocks that allocations are carved out of
+// smaller heaps use an eighth of the heap instead
+#define ALLOCATOR_BLOCK_SIZE ((VkDeviceSize)64 * 1024 * 1024)
+// smallest piece a block is split into, every allocation is rounded up to a
+// power of two at least this big
+#define ALLOCATOR_MIN_ALLOCATION_SIZE ((VkDeviceSize)256)
+// marks an allocation that got its own VkDeviceMemory instead of a block
+#define ALLOCATOR_DEDICATED UINT32_MAX
+// the low memory callback is called once usage passes this share of the
+// budget, in percent
+#define ALLOCATOR_LOW_MEMORY_PERCENT 90
+// without VK_EXT_memory_budget, the budget is this share of the heap size, in
+// percent
+#define ALLOCATOR_DEFAULT_BUDGET_PERCENT 80
+
+// A range of device memory owned by a buffer or image
+typedef struct {
+  VkDeviceMemory memory;
+  VkDeviceSize offset;
+  // the size that was requested, the range reserved may be bigger
+  VkDeviceSize size;
+  // if the memory is host visible, a pointer to `offset` that stays mapped for
+  // the lifetime of the allocation, otherwise NULL
+  void *pMapped;
+  uint32_t memoryTypeIndex;
+  // the block it was carved out of, or ALLOCATOR_DEDICATED
+  uint32_t blockIndex;
+  // the range reserved in the block is ALLOCATOR_MIN_ALLOCATION_SIZE << order
+  uint32_t order;
+} Allocation;
+
+// One VkDeviceMemory split up with a buddy allocator
+typedef struct {
+  VkDeviceMemory memory;
+  // NULL unless the memory type is host visible
+  void *pMapped;
+  // the block is ALLOCATOR_MIN_ALLOCATION_SIZE << maxOrder bytes
+  uint32_t maxOrder;
+  // a complete binary tree over the block, pLongest[node] is one more than the
+  // order of the largest free range under node, or 0 if there is none
+  uint8_t *pLongest;
+  // bytes currently handed out, after rounding
+  VkDeviceSize usedBytes;
+} AllocatorBlock;
+
+// The blocks allocated for one memory type
+typedef struct {
+  AllocatorBlock *pBlocks;
+  uint32_t blockCount;
+  uint32_t maxOrder;
+} AllocatorMemoryType;
+
+// Usage of a single memory heap
+typedef struct {
+  // bytes requested by live allocations
+  VkDeviceSize liveBytes;
+  // bytes reserved for live allocations, after rounding up
+  VkDeviceSize usedBytes;
+  // bytes allocated from vulkan, in blocks and dedicated allocations
+  VkDeviceSize reservedBytes;
+  // free bytes in blocks, and the largest free range of any block
+  VkDeviceSize freeBytes;
+  VkDeviceSize largestFreeRange;
+  uint32_t liveAllocationCount;
+  // number of live vkAllocateMemory calls made for this heap
+  uint32_t deviceMemoryCount;
+} AllocatorHeapStats;
+
+// How much of a heap the process may use, and how much it uses
+typedef struct {
+  VkDeviceSize budget;
+  // includes other allocations of this process, such as swapchain images
+  VkDeviceSize usage;
+} AllocatorHeapBudget;
+
+// Called when a heap is about to pass ALLOCATOR_LOW_MEMORY_PERCENT of its
+// budget, so that caches can be evicted before allocations start failing
+// It may delete allocations, but must not create any
+typedef void (*AllocatorLowMemoryCallback)(void *pUserData,
+                                           const uint32_t heapIndex,
+                                           const AllocatorHeapBudget budget);
+
+// Sub-allocates device memory out of a few large blocks per memory type
+// Not thread safe
+typedef struct {
+  VkDevice device;
+  VkPhysicalDevice physicalDevice;
+  VkPhysicalDeviceMemoryProperties memoryProperties;
+  // allocations are rounded up to at least this, so linear and optimal
+  // resources never share a page
+  VkDeviceSize bufferImageGranularity;
+  AllocatorMemoryType pMemoryTypes[VK_MAX_MEMORY_TYPES];
+  // live bytes and allocation counts, per heap
+  VkDeviceSize pLiveBytes[VK_MAX_MEMORY_HEAPS];
+  uint32_t pLiveAllocationCounts[VK_MAX_MEMORY_HEAPS];
+  // dedicated allocations, per heap
+  VkDeviceSize pDedicatedBytes[VK_MAX_MEMORY_HEAPS];
+  uint32_t pDedicatedCounts[VK_MAX_MEMORY_HEAPS];
+  // bytes allocated from vulkan, per heap
+  VkDeviceSize pReservedBytes[VK_MAX_MEMORY_HEAPS];
+  // the last budget query, and pReservedBytes when it was made, so usage can
+  // be estimated in between queries
+  bool memoryBudgetEnabled;
+  AllocatorHeapBudget pBudgets[VK_MAX_MEMORY_HEAPS];
+  VkDeviceSize pReservedBytesAtBudget[VK_MAX_MEMORY_HEAPS];
+  AllocatorLowMemoryCallback lowMemoryCallback;
+  void *pLowMemoryUserData;
+} Allocator;
+
+/// Creates a new allocator with no blocks
+/// --- PRECONDITIONS ---
+/// * `pAllocator` is a valid pointer
+/// * `device` was created from `physicalDevice`
+/// * `memoryBudgetEnabled` is true only if `device` was created with
+/// VK_EXT_memory_budget
+/// --- POSTCONDITIONS ---
+/// * returns error status
+/// --- CLEANUP ---
+/// * call `delete_Allocator` after every allocation has been deleted
+ErrVal new_Allocator(Allocator *pAllocator,
+                     const VkPhysicalDevice physicalDevice,
+                     const VkDevice device, const bool memoryBudgetEnabled);
+
+/// Frees every block, warning about allocations that were never deleted
+void delete_Allocator(Allocator *pAllocator);
+
+/// Picks the memory type in `memoryTypeBits` for a resource
+/// --- POSTCONDITIONS ---
+/// * returns ERR_MEMORY if no memory type has all of `requiredProperties`
+/// * otherwise, of the types with all of `requiredProperties`, picks the one
+/// with the most of `preferredProperties`, then the one with the biggest heap,
+/// then the lowest index
+ErrVal selectMemoryType(uint32_t *pMemoryTypeIndex,
+                        const VkPhysicalDeviceMemoryProperties *pProperties,
+                        const uint32_t memoryTypeBits,
+                        const VkMemoryPropertyFlags requiredProperties,
+                        const VkMemoryPropertyFlags preferredProperties);
+
+/// Allocates memory that satisfies `requirements` with the given properties
+/// --- PRECONDITIONS ---
+/// * `pAllocation` is a valid pointer
+/// * `pAllocator` was created by `new_Allocator`
+/// --- POSTCONDITIONS ---
+/// * returns error status
+/// * the memory type is picked by `selectMemoryType`
+/// * returns ERR_MEMORY if no memory type has `requiredProperties`
+/// * returns ERR_ALLOCFAIL if vulkan is out of memory
+/// * on success, `pAllocation` can be bound at `pAllocation->offset`
+/// * requests bigger than half a block get their own VkDeviceMemory
+/// --- CLEANUP ---
+/// * call `delete_Allocation`
+ErrVal new_Allocation(Allocation *pAllocation, Allocator *pAllocator,
+                      const VkMemoryRequirements requirements,
+                      const VkMemoryPropertyFlags requiredProperties,
+                      const VkMemoryPropertyFlags preferredProperties);
+
+/// Returns an allocation to its block
+/// --- PRECONDITIONS ---
+/// * `pAllocation` was created by `new_Allocation` from `pAllocator`
+/// * the GPU is no longer using it
+/// --- POSTCONDITIONS ---
+/// * `pAllocation->memory` is set to VK_NULL_HANDLE
+void delete_Allocation(Allocation *pAllocation, Allocator *pAllocator);
+
+/// Gets the usage and fragmentation of heap `heapIndex`
+void getAllocatorHeapStats(AllocatorHeapStats *pStats,
+                           const Allocator *pAllocator,
+                           const uint32_t heapIndex);
+
+/// Prints live bytes and fragmentation of every heap to stdout
+void allocatorPrintStats(const Allocator *pAllocator);
+
+/// Queries the budget and usage of every heap from VK_EXT_memory_budget
+/// Without it, the budget is ALLOCATOR_DEFAULT_BUDGET_PERCENT of the heap,
+/// and the usage is what this allocator has reserved
+/// --- POSTCONDITIONS ---
+/// * calls the low memory callback for every heap over its threshold
+void allocatorUpdateBudget(Allocator *pAllocator);
+
+/// Gets the budget of heap `heapIndex`, with the usage estimated from the
+/// last query and the allocations made since
+void getAllocatorHeapBudget(AllocatorHeapBudget *pBudget,
+                            const Allocator *pAllocator,
+                            const uint32_t heapIndex);
+
+/// Sets the function called when a heap is running out of budget
+/// Pass NULL to remove it
+void allocatorSetLowMemoryCallback(Allocator *pAllocator,
+                                   const AllocatorLowMemoryCallback callback,
+                                   void *pUserData);
+
+/// Prints the usage and budget of every heap on a single line to stdout
+void allocatorPrintBudget(const Allocator *pAllocator);
+
+#endif // SRC_ALLOCATOR_H_
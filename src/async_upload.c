@@ -0,0 +1,416 @@
+#include "async_upload.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+#include "vulkan_utils.h"
+
+ErrVal new_AsyncUploader(AsyncUploader *pUploader, Allocator *pAllocator,
+                         const VkDeviceSize stagingSize, const VkDevice device,
+                         const VkQueue queue, const uint32_t queueFamilyIndex,
+                         const uint32_t graphicsQueueFamilyIndex) {
+  ErrVal retVal =
+      new_StagingRing(&pUploader->stagingRing, pAllocator, stagingSize);
+  if (retVal != ERR_OK) {
+    return (retVal);
+  }
+  retVal = new_CommandPool(&pUploader->commandPool, device, queueFamilyIndex);
+  if (retVal != ERR_OK) {
+    delete_StagingRing(&pUploader->stagingRing, pAllocator);
+    return (retVal);
+  }
+  VkCommandBuffer pCommandBuffers[ASYNC_UPLOAD_MAX_SUBMISSIONS];
+  retVal = new_CommandBuffers(pCommandBuffers, ASYNC_UPLOAD_MAX_SUBMISSIONS,
+                              pUploader->commandPool, device);
+  if (retVal != ERR_OK) {
+    delete_CommandPool(&pUploader->commandPool, device);
+    delete_StagingRing(&pUploader->stagingRing, pAllocator);
+    return (retVal);
+  }
+  retVal = new_TimelineSemaphore(&pUploader->timeline, 0, device);
+  if (retVal != ERR_OK) {
+    delete_CommandBuffers(pCommandBuffers, ASYNC_UPLOAD_MAX_SUBMISSIONS,
+                          pUploader->commandPool, device);
+    delete_CommandPool(&pUploader->commandPool, device);
+    delete_StagingRing(&pUploader->stagingRing, pAllocator);
+    return (retVal);
+  }
+
+  for (uint32_t i = 0; i < ASYNC_UPLOAD_MAX_SUBMISSIONS; i++) {
+    pUploader->pSubmissions[i].commandBuffer = pCommandBuffers[i];
+    pUploader->pSubmissions[i].ticket = 0;
+    pUploader->pSubmissions[i].stagingEnd = 0;
+  }
+  pUploader->device = device;
+  pUploader->queue = queue;
+  pUploader->queueFamilyIndex = queueFamilyIndex;
+  pUploader->graphicsQueueFamilyIndex = graphicsQueueFamilyIndex;
+  pUploader->lastTicket = 0;
+  pUploader->pCopies = NULL;
+  pUploader->copyCount = 0;
+  pUploader->copyCapacity = 0;
+  pUploader->batchBytes = 0;
+  pUploader->batchStartNs = 0;
+  pUploader->pAcquires = NULL;
+  pUploader->acquireCount = 0;
+  pUploader->acquireCapacity = 0;
+  pUploader->acquiredTicket = 0;
+  pUploader->acquiredStageMask = 0;
+  return (ERR_OK);
+}
+
+void delete_AsyncUploader(AsyncUploader *pUploader, Allocator *pAllocator) {
+  asyncUploaderFlush(pUploader);
+  asyncUploaderWait(pUploader, pUploader->lastTicket);
+  for (uint32_t i = 0; i < ASYNC_UPLOAD_MAX_SUBMISSIONS; i++) {
+    delete_CommandBuffers(&pUploader->pSubmissions[i].commandBuffer, 1,
+                          pUploader->commandPool, pUploader->device);
+  }
+  delete_Semaphore(&pUploader->timeline, pUploader->device);
+  delete_CommandPool(&pUploader->commandPool, pUploader->device);
+  delete_StagingRing(&pUploader->stagingRing, pAllocator);
+  free(pUploader->pCopies);
+  pUploader->pCopies = NULL;
+  free(pUploader->pAcquires);
+  pUploader->pAcquires = NULL;
+}
+
+// frees the submission slots and staging space of finished batches
+static void retireFinished(AsyncUploader *pUploader) {
+  uint64_t completed;
+  VkResult ret = vkGetSemaphoreCounterValue(
+      pUploader->device, pUploader->timeline, &completed);
+  if (ret != VK_SUCCESS) {
+    LOG_ERROR_ARGS(ERR_LEVEL_FATAL, "failed to get upload progress: %s",
+                   vkstrerror(ret));
+    PANIC();
+  }
+  for (uint32_t i = 0; i < ASYNC_UPLOAD_MAX_SUBMISSIONS; i++) {
+    AsyncUploadSubmission *pSubmission = &pUploader->pSubmissions[i];
+    if (pSubmission->ticket != 0 && pSubmission->ticket <= completed) {
+      stagingRingRetireTo(&pUploader->stagingRing, pSubmission->stagingEnd);
+      pSubmission->ticket = 0;
+    }
+  }
+  // once every acquired upload has finished, graphics submissions have
+  // nothing left to wait on, and the stages start over empty
+  if (pUploader->acquiredTicket != 0 &&
+      pUploader->acquiredTicket <= completed) {
+    pUploader->acquiredTicket = 0;
+    pUploader->acquiredStageMask = 0;
+  }
+}
+
+void asyncUploaderPoll(AsyncUploader *pUploader) {
+  retireFinished(pUploader);
+  if (pUploader->copyCount != 0 &&
+      getTimeNs() - pUploader->batchStartNs >= ASYNC_UPLOAD_FLUSH_NS) {
+    asyncUploaderFlush(pUploader);
+  }
+}
+
+void asyncUploaderWait(AsyncUploader *pUploader, const uint64_t ticket) {
+  if (ticket == 0) {
+    return;
+  }
+  if (ticket > pUploader->lastTicket) {
+    asyncUploaderFlush(pUploader);
+  }
+  waitTimelineSemaphore(pUploader->timeline, ticket, pUploader->device);
+  retireFinished(pUploader);
+}
+
+// the lowest ticket still in flight, or 0 if nothing is
+static uint64_t oldestTicket(const AsyncUploader *pUploader) {
+  uint64_t oldest = 0;
+  for (uint32_t i = 0; i < ASYNC_UPLOAD_MAX_SUBMISSIONS; i++) {
+    uint64_t ticket = pUploader->pSubmissions[i].ticket;
+    if (ticket != 0 && (oldest == 0 || ticket < oldest)) {
+      oldest = ticket;
+    }
+  }
+  return (oldest);
+}
+
+static AsyncUploadSubmission *getFreeSubmission(AsyncUploader *pUploader) {
+  retireFinished(pUploader);
+  for (;;) {
+    for (uint32_t i = 0; i < ASYNC_UPLOAD_MAX_SUBMISSIONS; i++) {
+      if (pUploader->pSubmissions[i].ticket == 0) {
+        return (&pUploader->pSubmissions[i]);
+      }
+    }
+    asyncUploaderWait(pUploader, oldestTicket(pUploader));
+  }
+}
+
+static void pushAcquire(AsyncUploader *pUploader,
+                        const AsyncUploadAcquire acquire) {
+  if (pUploader->acquireCount == pUploader->acquireCapacity) {
+    uint32_t capacity =
+        pUploader->acquireCapacity == 0 ? 16 : pUploader->acquireCapacity * 2;
+    AsyncUploadAcquire *pAcquires = realloc(
+        pUploader->pAcquires, capacity * sizeof(AsyncUploadAcquire));
+    if (!pAcquires) {
+      LOG_ERROR_ARGS(ERR_LEVEL_FATAL, "failed to queue upload acquire: %s",
+                     strerror(errno));
+      PANIC();
+    }
+    pUploader->pAcquires = pAcquires;
+    pUploader->acquireCapacity = capacity;
+  }
+  pUploader->pAcquires[pUploader->acquireCount++] = acquire;
+}
+
+// adds a copy to the open batch, extending the last one if they're adjacent
+static void pushCopy(AsyncUploader *pUploader, const AsyncUploadCopy copy) {
+  if (pUploader->copyCount != 0) {
+    AsyncUploadCopy *pLast = &pUploader->pCopies[pUploader->copyCount - 1];
+    if (pLast->buffer == copy.buffer &&
+        pLast->dstStageMask == copy.dstStageMask &&
+        pLast->dstAccessMask == copy.dstAccessMask &&
+        pLast->region.srcOffset + pLast->region.size == copy.region.srcOffset &&
+        pLast->region.dstOffset + pLast->region.size == copy.region.dstOffset) {
+      pLast->region.size += copy.region.size;
+      return;
+    }
+  } else {
+    pUploader->batchStartNs = getTimeNs();
+  }
+
+  if (pUploader->copyCount == pUploader->copyCapacity) {
+    uint32_t capacity =
+        pUploader->copyCapacity == 0 ? 64 : pUploader->copyCapacity * 2;
+    AsyncUploadCopy *pCopies =
+        realloc(pUploader->pCopies, capacity * sizeof(AsyncUploadCopy));
+    if (!pCopies) {
+      LOG_ERROR_ARGS(ERR_LEVEL_FATAL, "failed to queue upload copy: %s",
+                     strerror(errno));
+      PANIC();
+    }
+    pUploader->pCopies = pCopies;
+    pUploader->copyCapacity = capacity;
+  }
+  pUploader->pCopies[pUploader->copyCount++] = copy;
+}
+
+void asyncUploaderFlush(AsyncUploader *pUploader) {
+  if (pUploader->copyCount == 0) {
+    return;
+  }
+  AsyncUploadSubmission *pSubmission = getFreeSubmission(pUploader);
+  const uint32_t copyCount = pUploader->copyCount;
+  const AsyncUploadCopy *pCopies = pUploader->pCopies;
+
+  VkCommandBuffer commandBuffer = pSubmission->commandBuffer;
+  VkCommandBufferBeginInfo beginInfo = {0};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  VkResult beginRet = vkBeginCommandBuffer(commandBuffer, &beginInfo);
+  if (beginRet != VK_SUCCESS) {
+    LOG_ERROR_ARGS(ERR_LEVEL_FATAL, "failed to begin upload command buffer: %s",
+                   vkstrerror(beginRet));
+    PANIC();
+  }
+
+  VkBufferCopy *pRegions = malloc(copyCount * sizeof(VkBufferCopy));
+  VkBufferMemoryBarrier *pBarriers =
+      malloc(copyCount * sizeof(VkBufferMemoryBarrier));
+  if (!pRegions || !pBarriers) {
+    LOG_ERROR_ARGS(ERR_LEVEL_FATAL, "failed to record upload batch: %s",
+                   strerror(errno));
+    PANIC();
+  }
+
+  // one command for each run of copies into the same buffer
+  uint32_t runStart = 0;
+  for (uint32_t i = 0; i < copyCount; i++) {
+    pRegions[i] = pCopies[i].region;
+    if (i + 1 == copyCount || pCopies[i + 1].buffer != pCopies[i].buffer) {
+      vkCmdCopyBuffer(commandBuffer, pUploader->stagingRing.buffer,
+                      pCopies[i].buffer, i + 1 - runStart,
+                      &pRegions[runStart]);
+      runStart = i + 1;
+    }
+  }
+
+  // release the ranges to the graphics family, which acquires them when
+  // they're first used
+  if (pUploader->queueFamilyIndex != pUploader->graphicsQueueFamilyIndex) {
+    for (uint32_t i = 0; i < copyCount; i++) {
+      VkBufferMemoryBarrier barrier = {0};
+      barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+      barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+      barrier.dstAccessMask = 0;
+      barrier.srcQueueFamilyIndex = pUploader->queueFamilyIndex;
+      barrier.dstQueueFamilyIndex = pUploader->graphicsQueueFamilyIndex;
+      barrier.buffer = pCopies[i].buffer;
+      barrier.offset = pCopies[i].region.dstOffset;
+      barrier.size = pCopies[i].region.size;
+      pBarriers[i] = barrier;
+    }
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL,
+                         copyCount, pBarriers, 0, NULL);
+  }
+  free(pBarriers);
+  free(pRegions);
+
+  VkResult endRet = vkEndCommandBuffer(commandBuffer);
+  if (endRet != VK_SUCCESS) {
+    LOG_ERROR_ARGS(ERR_LEVEL_FATAL, "failed to end upload command buffer: %s",
+                   vkstrerror(endRet));
+    PANIC();
+  }
+
+  uint64_t ticket = pUploader->lastTicket + 1;
+  VkTimelineSemaphoreSubmitInfo timelineInfo = {0};
+  timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+  timelineInfo.signalSemaphoreValueCount = 1;
+  timelineInfo.pSignalSemaphoreValues = &ticket;
+
+  VkSubmitInfo submitInfo = {0};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submitInfo.pNext = &timelineInfo;
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &commandBuffer;
+  submitInfo.signalSemaphoreCount = 1;
+  submitInfo.pSignalSemaphores = &pUploader->timeline;
+  VkResult submitRet =
+      vkQueueSubmit(pUploader->queue, 1, &submitInfo, VK_NULL_HANDLE);
+  if (submitRet != VK_SUCCESS) {
+    LOG_ERROR_ARGS(ERR_LEVEL_FATAL, "failed to submit upload batch: %s",
+                   vkstrerror(submitRet));
+    PANIC();
+  }
+
+  for (uint32_t i = 0; i < copyCount; i++) {
+    pushAcquire(pUploader,
+                (AsyncUploadAcquire){.buffer = pCopies[i].buffer,
+                                     .offset = pCopies[i].region.dstOffset,
+                                     .size = pCopies[i].region.size,
+                                     .dstStageMask = pCopies[i].dstStageMask,
+                                     .dstAccessMask = pCopies[i].dstAccessMask,
+                                     .ticket = ticket});
+  }
+
+  pUploader->lastTicket = ticket;
+  pSubmission->ticket = ticket;
+  // everything staged so far belongs to this batch or an earlier one
+  pSubmission->stagingEnd = pUploader->stagingRing.head;
+  pUploader->copyCount = 0;
+  pUploader->batchBytes = 0;
+}
+
+ErrVal asyncUploadBuffer(AsyncUploader *pUploader,
+                         const VkBuffer destinationBuffer,
+                         const VkDeviceSize destinationOffset,
+                         const void *pData, const VkDeviceSize size,
+                         const VkPipelineStageFlags dstStageMask,
+                         const VkAccessFlags dstAccessMask, uint64_t *pTicket) {
+  const uint8_t *pSource = (const uint8_t *)pData;
+  // half the ring always fits once everything in flight has retired
+  const VkDeviceSize maxChunkSize = pUploader->stagingRing.size / 2;
+  uint64_t ticket = pUploader->lastTicket;
+  for (VkDeviceSize uploaded = 0; uploaded < size;) {
+    VkDeviceSize chunkSize = size - uploaded;
+    if (chunkSize > maxChunkSize) {
+      chunkSize = maxChunkSize;
+    }
+
+    VkDeviceSize stagingOffset;
+    void *pStaging;
+    while (stagingRingAllocate(&pUploader->stagingRing, chunkSize, 4,
+                               &stagingOffset, &pStaging) != ERR_OK) {
+      uint64_t oldest = oldestTicket(pUploader);
+      if (pUploader->copyCount != 0) {
+        // the open batch's space is only freed once it has been submitted
+        asyncUploaderFlush(pUploader);
+      } else if (oldest != 0) {
+        asyncUploaderWait(pUploader, oldest);
+      } else {
+        // nothing is in flight, so nothing is using the ring
+        stagingRingRetireAll(&pUploader->stagingRing);
+      }
+    }
+    memcpy(pStaging, pSource + uploaded, (size_t)chunkSize);
+
+    pushCopy(pUploader,
+             (AsyncUploadCopy){
+                 .buffer = destinationBuffer,
+                 .region = {.srcOffset = stagingOffset,
+                            .dstOffset = destinationOffset + uploaded,
+                            .size = chunkSize},
+                 .dstStageMask = dstStageMask,
+                 .dstAccessMask = dstAccessMask,
+             });
+    pUploader->batchBytes += chunkSize;
+    ticket = pUploader->lastTicket + 1;
+
+    if (pUploader->batchBytes >= ASYNC_UPLOAD_FLUSH_BYTES ||
+        getTimeNs() - pUploader->batchStartNs >= ASYNC_UPLOAD_FLUSH_NS) {
+      asyncUploaderFlush(pUploader);
+    }
+    uploaded += chunkSize;
+  }
+
+  if (pTicket != NULL) {
+    *pTicket = ticket;
+  }
+  return (ERR_OK);
+}
+
+void asyncUploaderRecordAcquires(AsyncUploader *pUploader,
+                                 const VkCommandBuffer commandBuffer) {
+  if (pUploader == NULL) {
+    return;
+  }
+  // the releases have to be submitted before they can be acquired
+  asyncUploaderFlush(pUploader);
+  if (pUploader->acquireCount == 0) {
+    return;
+  }
+
+  VkPipelineStageFlags dstStageMask = 0;
+  for (uint32_t i = 0; i < pUploader->acquireCount; i++) {
+    const AsyncUploadAcquire *pAcquire = &pUploader->pAcquires[i];
+    dstStageMask |= pAcquire->dstStageMask;
+    if (pAcquire->ticket > pUploader->acquiredTicket) {
+      pUploader->acquiredTicket = pAcquire->ticket;
+    }
+  }
+  pUploader->acquiredStageMask |= dstStageMask;
+
+  // within one family, waiting on the timeline semaphore makes the writes
+  // visible, only a transfer between families needs a barrier
+  if (pUploader->queueFamilyIndex != pUploader->graphicsQueueFamilyIndex) {
+    VkBufferMemoryBarrier *pBarriers =
+        malloc(pUploader->acquireCount * sizeof(VkBufferMemoryBarrier));
+    if (!pBarriers) {
+      LOG_ERROR_ARGS(ERR_LEVEL_FATAL, "failed to record upload acquires: %s",
+                     strerror(errno));
+      PANIC();
+    }
+    for (uint32_t i = 0; i < pUploader->acquireCount; i++) {
+      const AsyncUploadAcquire *pAcquire = &pUploader->pAcquires[i];
+      VkBufferMemoryBarrier barrier = {0};
+      barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+      barrier.srcAccessMask = 0;
+      barrier.dstAccessMask = pAcquire->dstAccessMask;
+      barrier.srcQueueFamilyIndex = pUploader->queueFamilyIndex;
+      barrier.dstQueueFamilyIndex = pUploader->graphicsQueueFamilyIndex;
+      barrier.buffer = pAcquire->buffer;
+      barrier.offset = pAcquire->offset;
+      barrier.size = pAcquire->size;
+      pBarriers[i] = barrier;
+    }
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                         dstStageMask, 0, 0, NULL, pUploader->acquireCount,
+                         pBarriers, 0, NULL);
+    free(pBarriers);
+  }
+  pUploader->acquireCount = 0;
+}
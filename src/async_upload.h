@@ -0,0 +1,150 @@
+#ifndef SRC_ASYNC_UPLOAD_H_
+#define SRC_ASYNC_UPLOAD_H_
+
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+#include "allocator.h"
+#include "errors.h"
+#include "staging_ring.h"
+
+// most batches that can be in flight at once, any more wait for the oldest
+#define ASYNC_UPLOAD_MAX_SUBMISSIONS 8
+// the open batch is submitted once it stages this many bytes, or once its
+// first copy is this old
+#define ASYNC_UPLOAD_FLUSH_BYTES ((VkDeviceSize)4 * 1024 * 1024)
+#define ASYNC_UPLOAD_FLUSH_NS ((uint64_t)2 * 1000 * 1000)
+
+// A batch of copies submitted to the transfer queue
+typedef struct {
+  VkCommandBuffer commandBuffer;
+  // the timeline value signaled once it finishes, or 0 if the slot is free
+  uint64_t ticket;
+  // the staging ring head after it was recorded
+  uint64_t stagingEnd;
+} AsyncUploadSubmission;
+
+// A copy waiting in the open batch
+typedef struct {
+  VkBuffer buffer;
+  VkBufferCopy region;
+  VkPipelineStageFlags dstStageMask;
+  VkAccessFlags dstAccessMask;
+} AsyncUploadCopy;
+
+// A range that still has to be acquired by the graphics queue
+typedef struct {
+  VkBuffer buffer;
+  VkDeviceSize offset;
+  VkDeviceSize size;
+  VkPipelineStageFlags dstStageMask;
+  VkAccessFlags dstAccessMask;
+  uint64_t ticket;
+} AsyncUploadAcquire;
+
+// Uploads buffers on a transfer queue without blocking the caller
+// Copies are collected into a batch, where neighbouring copies into the same
+// buffer are merged, and the whole batch is recorded into one command buffer
+// and submitted at once. Each batch signals the next value of a timeline
+// semaphore, the ticket of every upload in it.
+// Frames record the acquire side of the ownership transfer with
+// `asyncUploaderRecordAcquires` and wait on the ticket in their submission, so
+// the only wait is on the GPU, right before the data is first used.
+// Not thread safe
+typedef struct {
+  VkDevice device;
+  VkQueue queue;
+  uint32_t queueFamilyIndex;
+  uint32_t graphicsQueueFamilyIndex;
+  VkCommandPool commandPool;
+  StagingRing stagingRing;
+  VkSemaphore timeline;
+  // the last ticket submitted, the open batch will signal the next one
+  uint64_t lastTicket;
+  AsyncUploadSubmission pSubmissions[ASYNC_UPLOAD_MAX_SUBMISSIONS];
+  // the open batch
+  AsyncUploadCopy *pCopies;
+  uint32_t copyCount;
+  uint32_t copyCapacity;
+  VkDeviceSize batchBytes;
+  uint64_t batchStartNs;
+  AsyncUploadAcquire *pAcquires;
+  uint32_t acquireCount;
+  uint32_t acquireCapacity;
+  // the highest ticket acquired and not yet finished, and every stage that
+  // first uses one, graphics submissions wait on these; reset once the
+  // ticket has finished
+  uint64_t acquiredTicket;
+  VkPipelineStageFlags acquiredStageMask;
+} AsyncUploader;
+
+/// Creates a new uploader submitting to `queue`
+/// --- PRECONDITIONS ---
+/// * `pUploader` is a valid pointer
+/// * `pAllocator` was created by `new_Allocator` from `device`
+/// * `queue` belongs to `queueFamilyIndex`, which may be the graphics family
+/// * `device` was created by `new_Device`, so timeline semaphores are enabled
+/// --- POSTCONDITIONS ---
+/// * returns error status
+/// * uploads are staged through a ring of `stagingSize` bytes
+/// --- CLEANUP ---
+/// * call `delete_AsyncUploader`
+ErrVal new_AsyncUploader(AsyncUploader *pUploader, Allocator *pAllocator,
+                         const VkDeviceSize stagingSize, const VkDevice device,
+                         const VkQueue queue, const uint32_t queueFamilyIndex,
+                         const uint32_t graphicsQueueFamilyIndex);
+
+/// Waits for every upload to finish, then frees the uploader
+void delete_AsyncUploader(AsyncUploader *pUploader, Allocator *pAllocator);
+
+/// Stages `size` bytes from `pData`, and adds a copy from there into
+/// `destinationBuffer` to the open batch
+/// --- PRECONDITIONS ---
+/// * `destinationBuffer` was created with VK_BUFFER_USAGE_TRANSFER_DST_BIT and
+/// exclusive sharing, and isn't being used by the GPU
+/// * `dstStageMask` and `dstAccessMask` describe its first use on the
+/// graphics queue
+/// --- POSTCONDITIONS ---
+/// * returns error status
+/// * `pData` has been copied and may be freed
+/// * if `pTicket` is not NULL, it is set to the timeline value signaled once
+/// the copy finishes
+/// * the batch is submitted if it reached ASYNC_UPLOAD_FLUSH_BYTES or
+/// ASYNC_UPLOAD_FLUSH_NS
+/// * the buffer may only be used after `asyncUploaderRecordAcquires` has been
+/// recorded before the use, in a submission waiting on the ticket
+/// * blocks only if all submission slots or the staging ring are in use
+ErrVal asyncUploadBuffer(AsyncUploader *pUploader,
+                         const VkBuffer destinationBuffer,
+                         const VkDeviceSize destinationOffset,
+                         const void *pData, const VkDeviceSize size,
+                         const VkPipelineStageFlags dstStageMask,
+                         const VkAccessFlags dstAccessMask, uint64_t *pTicket);
+
+/// Submits the open batch, if it has any copies
+void asyncUploaderFlush(AsyncUploader *pUploader);
+
+/// Frees the submission slots and staging space of finished uploads, stops
+/// graphics submissions waiting on acquired uploads once they have all
+/// finished, and submits the open batch if it is older than
+/// ASYNC_UPLOAD_FLUSH_NS
+void asyncUploaderPoll(AsyncUploader *pUploader);
+
+/// Submits the open batch if it holds `ticket`, then blocks until the upload
+/// with `ticket` has finished
+void asyncUploaderWait(AsyncUploader *pUploader, const uint64_t ticket);
+
+/// Submits the open batch, then records the acquire barriers for every upload
+/// not yet acquired
+/// If `pUploader` is NULL, does nothing
+/// --- PRECONDITIONS ---
+/// * `commandBuffer` is recording for the graphics queue, outside a render
+/// pass
+/// --- POSTCONDITIONS ---
+/// * `pUploader->acquiredTicket` and `pUploader->acquiredStageMask` cover the
+/// acquired uploads, and must be waited on by the submission
+void asyncUploaderRecordAcquires(AsyncUploader *pUploader,
+                                 const VkCommandBuffer commandBuffer);
+
+#endif // SRC_ASYNC_UPLOAD_H_
@@ -0,0 +1,163 @@
+#include "bench.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *phaseNames[BENCH_PHASE_COUNT] = {
+    "frame", "fence_wait", "acquire", "record", "submit",
+};
+
+// summary statistics for one phase, in milliseconds
+typedef struct {
+  double mean;
+  double p50;
+  double p95;
+  double p99;
+  double max;
+} BenchSummary;
+
+ErrVal new_Bench(Bench *pBench, const uint32_t warmupFrameCount,
+                 const uint32_t measuredFrameCount) {
+  pBench->warmupFrameCount = warmupFrameCount;
+  pBench->measuredFrameCount = measuredFrameCount;
+  pBench->frameIndex = 0;
+  for (uint32_t i = 0; i < BENCH_PHASE_COUNT; i++) {
+    pBench->pSamples[i] = NULL;
+    if (measuredFrameCount == 0) {
+      continue;
+    }
+    pBench->pSamples[i] = calloc(measuredFrameCount, sizeof(uint64_t));
+    if (!pBench->pSamples[i]) {
+      LOG_ERROR_ARGS(ERR_LEVEL_FATAL, "could not allocate benchmark: %s",
+                     strerror(errno));
+      PANIC();
+    }
+  }
+  return (ERR_OK);
+}
+
+void delete_Bench(Bench *pBench) {
+  for (uint32_t i = 0; i < BENCH_PHASE_COUNT; i++) {
+    free(pBench->pSamples[i]);
+    pBench->pSamples[i] = NULL;
+  }
+  pBench->measuredFrameCount = 0;
+}
+
+void benchRecord(Bench *pBench, const BenchPhase phase,
+                 const uint64_t nanoseconds) {
+  if (pBench->frameIndex < pBench->warmupFrameCount || benchFinished(pBench)) {
+    return;
+  }
+  uint32_t sample = pBench->frameIndex - pBench->warmupFrameCount;
+  pBench->pSamples[phase][sample] += nanoseconds;
+}
+
+void benchEndFrame(Bench *pBench) { pBench->frameIndex++; }
+
+bool benchFinished(const Bench *pBench) {
+  return (pBench->frameIndex >=
+          pBench->warmupFrameCount + pBench->measuredFrameCount);
+}
+
+static int compareUint64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return ((x > y) - (x < y));
+}
+
+// nearest rank percentile of sorted samples
+static double percentileMs(const uint64_t *pSorted, const uint32_t count,
+                           const uint32_t percent) {
+  uint32_t rank = (uint32_t)(((uint64_t)count * percent + 99) / 100);
+  if (rank == 0) {
+    rank = 1;
+  }
+  return ((double)pSorted[rank - 1] / 1e6);
+}
+
+static void summarize(BenchSummary *pSummary, const uint64_t *pSamples,
+                      const uint32_t count) {
+  uint64_t *pSorted = malloc(count * sizeof(uint64_t));
+  if (!pSorted) {
+    LOG_ERROR_ARGS(ERR_LEVEL_FATAL, "could not summarize benchmark: %s",
+                   strerror(errno));
+    PANIC();
+  }
+  memcpy(pSorted, pSamples, count * sizeof(uint64_t));
+  qsort(pSorted, count, sizeof(uint64_t), compareUint64);
+
+  double total = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    total += (double)pSorted[i];
+  }
+  pSummary->mean = total / count / 1e6;
+  pSummary->p50 = percentileMs(pSorted, count, 50);
+  pSummary->p95 = percentileMs(pSorted, count, 95);
+  pSummary->p99 = percentileMs(pSorted, count, 99);
+  pSummary->max = (double)pSorted[count - 1] / 1e6;
+  free(pSorted);
+}
+
+static bool hasSuffix(const char *str, const char *suffix) {
+  size_t strLength = strlen(str);
+  size_t suffixLength = strlen(suffix);
+  return (strLength >= suffixLength &&
+          strcmp(str + strLength - suffixLength, suffix) == 0);
+}
+
+ErrVal writeBenchReport(const Bench *pBench, const char *path,
+                        const char *deviceName) {
+  if (pBench->measuredFrameCount == 0 || !benchFinished(pBench)) {
+    LOG_ERROR(ERR_LEVEL_WARN, "benchmark did not complete, no report written");
+    return (ERR_BADARGS);
+  }
+
+  FILE *fp = stdout;
+  if (path != NULL) {
+    fp = fopen(path, "w");
+    if (!fp) {
+      LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "could not open %s: %s", path,
+                     strerror(errno));
+      return (ERR_UNKNOWN);
+    }
+  }
+
+  BenchSummary summaries[BENCH_PHASE_COUNT];
+  for (uint32_t i = 0; i < BENCH_PHASE_COUNT; i++) {
+    summarize(&summaries[i], pBench->pSamples[i], pBench->measuredFrameCount);
+  }
+
+  if (path != NULL && hasSuffix(path, ".csv")) {
+    fprintf(fp, "phase,mean_ms,p50_ms,p95_ms,p99_ms,max_ms\n");
+    for (uint32_t i = 0; i < BENCH_PHASE_COUNT; i++) {
+      BenchSummary s = summaries[i];
+      fprintf(fp, "%s,%.4f,%.4f,%.4f,%.4f,%.4f\n", phaseNames[i], s.mean,
+              s.p50, s.p95, s.p99, s.max);
+    }
+  } else {
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"device\": \"%s\",\n", deviceName);
+    fprintf(fp, "  \"warmup_frames\": %u,\n", pBench->warmupFrameCount);
+    fprintf(fp, "  \"frames\": %u,\n", pBench->measuredFrameCount);
+    fprintf(fp, "  \"phases\": {\n");
+    for (uint32_t i = 0; i < BENCH_PHASE_COUNT; i++) {
+      BenchSummary s = summaries[i];
+      fprintf(fp,
+              "    \"%s\": {\"mean_ms\": %.4f, \"p50_ms\": %.4f, "
+              "\"p95_ms\": %.4f, \"p99_ms\": %.4f, \"max_ms\": %.4f}%s\n",
+              phaseNames[i], s.mean, s.p50, s.p95, s.p99, s.max,
+              i + 1 < BENCH_PHASE_COUNT ? "," : "");
+    }
+    fprintf(fp, "  }\n");
+    fprintf(fp, "}\n");
+  }
+
+  if (fp != stdout) {
+    fclose(fp);
+  }
+  return (ERR_OK);
+}
@@ -0,0 +1,75 @@
+#ifndef SRC_BENCH_H_
+#define SRC_BENCH_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "errors.h"
+
+// The parts of a frame that are timed separately
+typedef enum {
+  // the whole iteration of the render loop
+  BENCH_PHASE_FRAME = 0,
+  // waitAndResetFence
+  BENCH_PHASE_FENCE_WAIT = 1,
+  // getNextSwapchainImage, zero in headless mode
+  BENCH_PHASE_ACQUIRE = 2,
+  // recordVertexDisplayCommandBuffer
+  BENCH_PHASE_RECORD = 3,
+  // drawFrame or drawOffscreenFrame
+  BENCH_PHASE_SUBMIT = 4,
+  BENCH_PHASE_COUNT = 5,
+} BenchPhase;
+
+// Collects per frame CPU timings after a number of warmup frames
+typedef struct {
+  // frames that are run but not recorded
+  uint32_t warmupFrameCount;
+  // frames that are recorded, 0 if benchmarking is disabled
+  uint32_t measuredFrameCount;
+  // frames that have been ended so far, including warmup
+  uint32_t frameIndex;
+  // pSamples[phase][i] is the time in nanoseconds spent in phase during the
+  // i'th measured frame
+  uint64_t *pSamples[BENCH_PHASE_COUNT];
+} Bench;
+
+/// Creates a new benchmark
+/// --- PRECONDITIONS ---
+/// * `pBench` is a valid pointer
+/// --- POSTCONDITIONS ---
+/// * returns error status
+/// * if `measuredFrameCount` is 0, the benchmark is disabled and recording
+/// into it does nothing
+/// --- PANICS ---
+/// * panics if memory allocation fails
+/// --- CLEANUP ---
+/// * call `delete_Bench`
+ErrVal new_Bench(Bench *pBench, const uint32_t warmupFrameCount,
+                 const uint32_t measuredFrameCount);
+
+void delete_Bench(Bench *pBench);
+
+/// Adds `nanoseconds` to the time spent in `phase` during the current frame
+/// Does nothing during warmup, or if the benchmark is disabled
+void benchRecord(Bench *pBench, const BenchPhase phase,
+                 const uint64_t nanoseconds);
+
+/// Moves on to the next frame
+void benchEndFrame(Bench *pBench);
+
+/// Returns whether every measured frame has been recorded
+bool benchFinished(const Bench *pBench);
+
+/// Writes a summary with mean, p50, p95, p99 and max for each phase
+/// --- PRECONDITIONS ---
+/// * `pBench` has finished
+/// * `path` is NULL for stdout, otherwise a file path. Files ending in ".csv"
+/// are written as CSV, everything else as JSON
+/// * `deviceName` is the name of the physical device benchmarked
+/// --- POSTCONDITIONS ---
+/// * returns error status
+ErrVal writeBenchReport(const Bench *pBench, const char *path,
+                        const char *deviceName);
+
+#endif // SRC_BENCH_H_
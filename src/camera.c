@@ -47,36 +47,36 @@ void resizeCamera(Camera *camera, const VkExtent2D dimensions) {
   calculate_projection_matrix(camera->projection, dimensions);
 }
 
-void updateCamera(Camera *camera, GLFWwindow *pWindow) {
+void updateCamera(Camera *camera, const InputState input) {
   float movscale = 0.01f;
 
-  if (glfwGetKey(pWindow, GLFW_KEY_W) == GLFW_PRESS) {
+  if (input & INPUT_KEY_W) {
       vec3 delta_pos;
       vec3_scale(delta_pos, camera->basis.front, -movscale);
       vec3_add(camera->pos, camera->pos, delta_pos);
 
   }
-  if (glfwGetKey(pWindow, GLFW_KEY_S) == GLFW_PRESS) {
+  if (input & INPUT_KEY_S) {
       vec3 delta_pos;
       vec3_scale(delta_pos, camera->basis.front, movscale);
       vec3_add(camera->pos, camera->pos, delta_pos);
   }
-  if (glfwGetKey(pWindow, GLFW_KEY_A) == GLFW_PRESS) {
+  if (input & INPUT_KEY_A) {
       vec3 delta_pos;
       vec3_scale(delta_pos, camera->basis.right, movscale);
       vec3_add(camera->pos, camera->pos, delta_pos);
   }
-  if (glfwGetKey(pWindow, GLFW_KEY_D) == GLFW_PRESS) {
+  if (input & INPUT_KEY_D) {
       vec3 delta_pos;
       vec3_scale(delta_pos, camera->basis.right, -movscale);
       vec3_add(camera->pos, camera->pos, delta_pos);
   }
-  if (glfwGetKey(pWindow, GLFW_KEY_Q) == GLFW_PRESS) {
+  if (input & INPUT_KEY_Q) {
       vec3 delta_pos;
       vec3_scale(delta_pos, camera->basis.up, movscale);
       vec3_add(camera->pos, camera->pos, delta_pos);
   }
-  if (glfwGetKey(pWindow, GLFW_KEY_E) == GLFW_PRESS) {
+  if (input & INPUT_KEY_E) {
       vec3 delta_pos;
       vec3_scale(delta_pos, camera->basis.up, -movscale);
       vec3_add(camera->pos, camera->pos, delta_pos);
@@ -84,16 +84,16 @@ void updateCamera(Camera *camera, GLFWwindow *pWindow) {
 
   float rotscale = 0.02f;
 
-  if (glfwGetKey(pWindow, GLFW_KEY_UP) == GLFW_PRESS) {
+  if (input & INPUT_KEY_UP) {
     camera->pitch += rotscale;
   }
-  if (glfwGetKey(pWindow, GLFW_KEY_DOWN) == GLFW_PRESS) {
+  if (input & INPUT_KEY_DOWN) {
     camera-> pitch -= rotscale;
   }
-  if (glfwGetKey(pWindow, GLFW_KEY_LEFT) == GLFW_PRESS) {
+  if (input & INPUT_KEY_LEFT) {
     camera->yaw -= rotscale;
   }
-  if (glfwGetKey(pWindow, GLFW_KEY_RIGHT) == GLFW_PRESS) {
+  if (input & INPUT_KEY_RIGHT) {
       camera->yaw += rotscale;
   }
 
@@ -117,3 +117,15 @@ void getMvpCamera(mat4x4 mvp, const Camera *camera) {
     // now set mvp to proj * view
     mat4x4_mul(mvp, camera->projection, view);
 }
+
+void getFrustumCamera(Frustum *pFrustum, const Camera *camera) {
+  mat4x4 mvp;
+  getMvpCamera(mvp, camera);
+  getFrustum(pFrustum, mvp);
+}
+
+float getPixelsPerUnitCamera(const Camera *camera,
+                             const VkExtent2D dimensions) {
+  // the projection scales y by 1 / tan(fov / 2), onto a 2 unit tall screen
+  return (camera->projection[1][1] * (float)dimensions.height / 2.0f);
+}
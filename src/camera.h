@@ -7,6 +7,9 @@
 
 #include <linmath.h>
 
+#include "frustum_cull.h"
+#include "input.h"
+
 // A set of 3 vectors forming a right handed orthonormal basis for the camera
 typedef struct {
   vec3 front;
@@ -30,7 +33,14 @@ typedef struct {
 Camera new_Camera(const vec3 pos, const VkExtent2D dimensions);
 
 void resizeCamera(Camera *camera, const VkExtent2D dimensions);
-void updateCamera(Camera *camera, GLFWwindow *pWindow);
+// moves the camera by a fixed step for every key held in `input`, so the same
+// inputs always produce the same camera path
+void updateCamera(Camera *camera, const InputState input);
 void getMvpCamera(mat4x4 mvp, const Camera *camera);
+// the planes of everything getMvpCamera's matrix keeps on screen
+void getFrustumCamera(Frustum *pFrustum, const Camera *camera);
+// how many pixels tall something one unit tall and one unit in front of the
+// camera is drawn, things twice as far are drawn half as tall
+float getPixelsPerUnitCamera(const Camera *camera, const VkExtent2D dimensions);
 
 #endif // SRC_CAMERA_H_
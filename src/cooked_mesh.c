@@ -0,0 +1,159 @@
+#include "cooked_mesh.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+// the header is written as it is in memory, so it can't have any padding
+static_assert(sizeof(CookedMeshHeader) == 72, "CookedMeshHeader is padded");
+
+static uint32_t getVertexStride(const VertexFormat vertexFormat) {
+  return (vertexFormat == VERTEX_FORMAT_PACKED ? sizeof(PackedVertex)
+                                               : sizeof(Vertex));
+}
+
+static uint64_t alignCookedOffset(const uint64_t offset) {
+  return ((offset + COOKED_MESH_ALIGNMENT - 1) &
+          ~(uint64_t)(COOKED_MESH_ALIGNMENT - 1));
+}
+
+bool isCookedMeshPath(const char *path) {
+  size_t pathLength = strlen(path);
+  size_t extensionLength = strlen(COOKED_MESH_EXTENSION);
+  return (pathLength >= extensionLength &&
+          strcasecmp(path + pathLength - extensionLength,
+                     COOKED_MESH_EXTENSION) == 0);
+}
+
+// writes `size` bytes of `pData` at `offset`, zero filling the gap before it
+static bool writeAt(FILE *fp, uint64_t *pPosition, const uint64_t offset,
+                    const void *pData, const size_t size) {
+  static const uint8_t pZeros[COOKED_MESH_ALIGNMENT] = {0};
+  size_t padding = (size_t)(offset - *pPosition);
+  *pPosition = offset + size;
+  return (fwrite(pZeros, 1, padding, fp) == padding &&
+          fwrite(pData, 1, size, fp) == size);
+}
+
+ErrVal writeCookedMesh(const char *path, const void *pVertices,
+                       const uint32_t vertexCount,
+                       const VertexFormat vertexFormat,
+                       const VertexQuantization *pQuantization,
+                       const uint32_t *pIndices, const uint32_t indexCount) {
+  CookedMeshHeader header = {0};
+  header.magic = COOKED_MESH_MAGIC;
+  header.version = COOKED_MESH_VERSION;
+  header.vertexFormat = vertexFormat;
+  header.vertexStride = getVertexStride(vertexFormat);
+  header.vertexCount = vertexCount;
+  header.indexCount = indexCount;
+  header.vertexOffset = alignCookedOffset(sizeof(CookedMeshHeader));
+  header.indexOffset = alignCookedOffset(
+      header.vertexOffset + (uint64_t)vertexCount * header.vertexStride);
+  if (vertexFormat == VERTEX_FORMAT_PACKED) {
+    header.quantization = *pQuantization;
+  }
+
+  FILE *fp = fopen(path, "wb");
+  if (!fp) {
+    LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "could not open %s: %s", path,
+                   strerror(errno));
+    return (ERR_BADARGS);
+  }
+  uint64_t position = 0;
+  bool written =
+      writeAt(fp, &position, 0, &header, sizeof(header)) &&
+      writeAt(fp, &position, header.vertexOffset, pVertices,
+              (size_t)vertexCount * header.vertexStride) &&
+      writeAt(fp, &position, header.indexOffset, pIndices,
+              (size_t)indexCount * sizeof(uint32_t));
+  if (fclose(fp) != 0) {
+    written = false;
+  }
+  if (!written) {
+    LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "could not write %s: %s", path,
+                   strerror(errno));
+    return (ERR_BADARGS);
+  }
+  return (ERR_OK);
+}
+
+ErrVal new_CookedMesh(CookedMesh *pMesh, const char *path) {
+  ErrVal retVal = new_MappedFile(&pMesh->file, path);
+  if (retVal != ERR_OK) {
+    return (retVal);
+  }
+
+  CookedMeshHeader header;
+  if (pMesh->file.size < sizeof(header)) {
+    LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "%s is not a cooked mesh", path);
+    delete_MappedFile(&pMesh->file);
+    return (ERR_BADARGS);
+  }
+  memcpy(&header, pMesh->file.pData, sizeof(header));
+  if (header.magic != COOKED_MESH_MAGIC) {
+    LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "%s is not a cooked mesh", path);
+    delete_MappedFile(&pMesh->file);
+    return (ERR_BADARGS);
+  }
+  if (header.version != COOKED_MESH_VERSION) {
+    LOG_ERROR_ARGS(ERR_LEVEL_ERROR,
+                   "%s is cooked mesh version %u, expected %u, cook it again",
+                   path, header.version, COOKED_MESH_VERSION);
+    delete_MappedFile(&pMesh->file);
+    return (ERR_NOTSUPPORTED);
+  }
+
+  // offsets are checked so the payloads are aligned and inside the file,
+  // sizes are computed in 64 bits so they can't wrap around
+  const uint64_t vertexBytes =
+      (uint64_t)header.vertexCount * header.vertexStride;
+  const uint64_t indexBytes = (uint64_t)header.indexCount * sizeof(uint32_t);
+  if ((header.vertexFormat != VERTEX_FORMAT_FLOAT &&
+       header.vertexFormat != VERTEX_FORMAT_PACKED) ||
+      header.vertexStride != getVertexStride(header.vertexFormat) ||
+      header.indexCount % 3 != 0 ||
+      header.vertexOffset % COOKED_MESH_ALIGNMENT != 0 ||
+      header.indexOffset % COOKED_MESH_ALIGNMENT != 0 ||
+      header.vertexOffset < sizeof(header) ||
+      header.vertexOffset > pMesh->file.size ||
+      vertexBytes > pMesh->file.size - header.vertexOffset ||
+      header.indexOffset > pMesh->file.size ||
+      indexBytes > pMesh->file.size - header.indexOffset) {
+    LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "%s is truncated or corrupt", path);
+    delete_MappedFile(&pMesh->file);
+    return (ERR_BADARGS);
+  }
+
+  // the GPU would read out of bounds otherwise; this also brings the indices
+  // into the page cache ahead of the upload
+  const uint32_t *pIndices =
+      (const uint32_t *)(const void *)(pMesh->file.pData + header.indexOffset);
+  uint32_t maxIndex = 0;
+  for (uint32_t i = 0; i < header.indexCount; i++) {
+    maxIndex = pIndices[i] > maxIndex ? pIndices[i] : maxIndex;
+  }
+  if (header.indexCount != 0 && maxIndex >= header.vertexCount) {
+    LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "%s has an index out of range", path);
+    delete_MappedFile(&pMesh->file);
+    return (ERR_BADARGS);
+  }
+
+  pMesh->vertexFormat = (VertexFormat)header.vertexFormat;
+  pMesh->quantization = header.quantization;
+  pMesh->pVertices = pMesh->file.pData + header.vertexOffset;
+  pMesh->vertexBytes = vertexBytes;
+  pMesh->vertexCount = header.vertexCount;
+  pMesh->pIndices = pIndices;
+  pMesh->indexCount = header.indexCount;
+  return (ERR_OK);
+}
+
+void delete_CookedMesh(CookedMesh *pMesh) {
+  delete_MappedFile(&pMesh->file);
+  pMesh->pVertices = NULL;
+  pMesh->pIndices = NULL;
+}
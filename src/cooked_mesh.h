@@ -0,0 +1,84 @@
+#ifndef SRC_COOKED_MESH_H_
+#define SRC_COOKED_MESH_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "errors.h"
+#include "utils.h"
+#include "vulkan_utils.h"
+
+// "VTMC" in a little endian file
+#define COOKED_MESH_MAGIC 0x434D5456u
+// bumped whenever the layout changes, older files have to be cooked again
+#define COOKED_MESH_VERSION 1u
+// payloads start on a multiple of this, so they can be copied as they are
+#define COOKED_MESH_ALIGNMENT 64u
+// extension of cooked mesh files
+#define COOKED_MESH_EXTENSION ".vtmesh"
+
+// The start of a cooked mesh file, everything is little endian
+// The vertices and indices follow, in exactly the layout the vertex and index
+// buffers have, so loading only copies them
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  // a VertexFormat
+  uint32_t vertexFormat;
+  uint32_t vertexStride;
+  uint32_t vertexCount;
+  // uint32_t indices, three per triangle
+  uint32_t indexCount;
+  // from the start of the file
+  uint64_t vertexOffset;
+  uint64_t indexOffset;
+  // how packed positions are unpacked, zero for float vertices
+  VertexQuantization quantization;
+} CookedMeshHeader;
+
+// A mapped cooked mesh file
+typedef struct {
+  MappedFile file;
+  VertexFormat vertexFormat;
+  VertexQuantization quantization;
+  // point into the mapping
+  const void *pVertices;
+  uint64_t vertexBytes;
+  uint32_t vertexCount;
+  const uint32_t *pIndices;
+  uint32_t indexCount;
+} CookedMesh;
+
+/// Returns true if `path` has the cooked mesh extension
+bool isCookedMeshPath(const char *path);
+
+/// Writes an indexed mesh to a cooked mesh file
+/// --- PRECONDITIONS ---
+/// * `pVertices` holds `vertexCount` vertices in `vertexFormat`
+/// * `pQuantization` is not NULL if `vertexFormat` is VERTEX_FORMAT_PACKED
+/// * every index is less than `vertexCount`
+/// --- POSTCONDITIONS ---
+/// * returns error status
+/// * returns ERR_BADARGS if the file can't be written
+ErrVal writeCookedMesh(const char *path, const void *pVertices,
+                       const uint32_t vertexCount,
+                       const VertexFormat vertexFormat,
+                       const VertexQuantization *pQuantization,
+                       const uint32_t *pIndices, const uint32_t indexCount);
+
+/// Maps a cooked mesh file, without copying its contents
+/// --- PRECONDITIONS ---
+/// * `pMesh` is a valid pointer
+/// --- POSTCONDITIONS ---
+/// * returns error status
+/// * returns ERR_NOTSUPPORTED if the file has a different version, and
+/// ERR_BADARGS if it isn't a cooked mesh, is truncated or has an index out
+/// of range
+/// * on success, `pMesh` points to the vertices and indices in the mapping
+/// --- CLEANUP ---
+/// * call `delete_CookedMesh` once the contents have been uploaded
+ErrVal new_CookedMesh(CookedMesh *pMesh, const char *path);
+
+void delete_CookedMesh(CookedMesh *pMesh);
+
+#endif // SRC_COOKED_MESH_H_
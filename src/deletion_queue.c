@@ -0,0 +1,138 @@
+#include "deletion_queue.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vulkan_utils.h"
+
+ErrVal new_DeletionQueue(DeletionQueue *pQueue, const uint32_t frameCount,
+                         Allocator *pAllocator, const VkDevice device) {
+  pQueue->pFrames = calloc(frameCount, sizeof(DeletionFrame));
+  if (!pQueue->pFrames) {
+    LOG_ERROR_ARGS(ERR_LEVEL_FATAL, "failed to create deletion queue: %s",
+                   strerror(errno));
+    PANIC();
+  }
+  pQueue->device = device;
+  pQueue->pAllocator = pAllocator;
+  pQueue->frameCount = frameCount;
+  pQueue->currentFrame = 0;
+  return (ERR_OK);
+}
+
+void delete_DeletionQueue(DeletionQueue *pQueue) {
+  deletionQueueFlush(pQueue);
+  for (uint32_t i = 0; i < pQueue->frameCount; i++) {
+    free(pQueue->pFrames[i].pEntries);
+  }
+  free(pQueue->pFrames);
+  pQueue->pFrames = NULL;
+}
+
+static void destroyEntry(DeletionQueue *pQueue, DeletionEntry *pEntry) {
+  switch (pEntry->kind) {
+  case DELETION_BUFFER:
+    delete_Buffer(&pEntry->buffer, pQueue->device);
+    break;
+  case DELETION_ALLOCATION:
+    delete_Allocation(&pEntry->allocation, pQueue->pAllocator);
+    break;
+  case DELETION_IMAGE:
+    delete_Image(&pEntry->image, pQueue->device);
+    break;
+  case DELETION_IMAGE_VIEW:
+    delete_ImageView(&pEntry->imageView, pQueue->device);
+    break;
+  case DELETION_FRAMEBUFFER:
+    delete_Framebuffer(&pEntry->framebuffer, pQueue->device);
+    break;
+  case DELETION_PIPELINE:
+    delete_Pipeline(&pEntry->pipeline, pQueue->device);
+    break;
+  case DELETION_SWAPCHAIN:
+    delete_Swapchain(&pEntry->swapchain, pQueue->device);
+    break;
+  }
+}
+
+static void destroyFrame(DeletionQueue *pQueue, DeletionFrame *pFrame) {
+  // destroy in push order, callers push handles before what they depend on
+  for (uint32_t i = 0; i < pFrame->count; i++) {
+    destroyEntry(pQueue, &pFrame->pEntries[i]);
+  }
+  pFrame->count = 0;
+}
+
+void deletionQueueBeginFrame(DeletionQueue *pQueue, const uint32_t frameIndex) {
+  destroyFrame(pQueue, &pQueue->pFrames[frameIndex]);
+  pQueue->currentFrame = frameIndex;
+}
+
+void deletionQueueFlush(DeletionQueue *pQueue) {
+  for (uint32_t i = 0; i < pQueue->frameCount; i++) {
+    destroyFrame(pQueue, &pQueue->pFrames[i]);
+  }
+}
+
+static void push(DeletionQueue *pQueue, const DeletionEntry entry) {
+  DeletionFrame *pFrame = &pQueue->pFrames[pQueue->currentFrame];
+  if (pFrame->count == pFrame->capacity) {
+    uint32_t capacity = pFrame->capacity == 0 ? 16 : pFrame->capacity * 2;
+    DeletionEntry *pEntries =
+        realloc(pFrame->pEntries, capacity * sizeof(DeletionEntry));
+    if (!pEntries) {
+      LOG_ERROR_ARGS(ERR_LEVEL_FATAL, "failed to queue deletion: %s",
+                     strerror(errno));
+      PANIC();
+    }
+    pFrame->pEntries = pEntries;
+    pFrame->capacity = capacity;
+  }
+  pFrame->pEntries[pFrame->count++] = entry;
+}
+
+void deletionQueuePushBuffer(DeletionQueue *pQueue, VkBuffer *pBuffer) {
+  push(pQueue, (DeletionEntry){.kind = DELETION_BUFFER, .buffer = *pBuffer});
+  *pBuffer = VK_NULL_HANDLE;
+}
+
+void deletionQueuePushAllocation(DeletionQueue *pQueue,
+                                 Allocation *pAllocation) {
+  push(pQueue, (DeletionEntry){.kind = DELETION_ALLOCATION,
+                               .allocation = *pAllocation});
+  *pAllocation = (Allocation){0};
+}
+
+void deletionQueuePushImage(DeletionQueue *pQueue, VkImage *pImage) {
+  push(pQueue, (DeletionEntry){.kind = DELETION_IMAGE, .image = *pImage});
+  *pImage = VK_NULL_HANDLE;
+}
+
+void deletionQueuePushImageView(DeletionQueue *pQueue,
+                                VkImageView *pImageView) {
+  push(pQueue,
+       (DeletionEntry){.kind = DELETION_IMAGE_VIEW, .imageView = *pImageView});
+  *pImageView = VK_NULL_HANDLE;
+}
+
+void deletionQueuePushFramebuffer(DeletionQueue *pQueue,
+                                  VkFramebuffer *pFramebuffer) {
+  push(pQueue, (DeletionEntry){.kind = DELETION_FRAMEBUFFER,
+                               .framebuffer = *pFramebuffer});
+  *pFramebuffer = VK_NULL_HANDLE;
+}
+
+void deletionQueuePushPipeline(DeletionQueue *pQueue, VkPipeline *pPipeline) {
+  push(pQueue,
+       (DeletionEntry){.kind = DELETION_PIPELINE, .pipeline = *pPipeline});
+  *pPipeline = VK_NULL_HANDLE;
+}
+
+void deletionQueuePushSwapchain(DeletionQueue *pQueue,
+                                VkSwapchainKHR *pSwapchain) {
+  push(pQueue,
+       (DeletionEntry){.kind = DELETION_SWAPCHAIN, .swapchain = *pSwapchain});
+  *pSwapchain = VK_NULL_HANDLE;
+}
@@ -0,0 +1,105 @@
+#ifndef SRC_DELETION_QUEUE_H_
+#define SRC_DELETION_QUEUE_H_
+
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+#include "allocator.h"
+#include "errors.h"
+
+typedef enum {
+  DELETION_BUFFER,
+  DELETION_ALLOCATION,
+  DELETION_IMAGE,
+  DELETION_IMAGE_VIEW,
+  DELETION_FRAMEBUFFER,
+  DELETION_PIPELINE,
+  DELETION_SWAPCHAIN,
+} DeletionKind;
+
+// A handle waiting to be destroyed
+typedef struct {
+  DeletionKind kind;
+  union {
+    VkBuffer buffer;
+    Allocation allocation;
+    VkImage image;
+    VkImageView imageView;
+    VkFramebuffer framebuffer;
+    VkPipeline pipeline;
+    VkSwapchainKHR swapchain;
+  };
+} DeletionEntry;
+
+// Everything pushed while one frame in flight was being recorded
+typedef struct {
+  DeletionEntry *pEntries;
+  uint32_t count;
+  uint32_t capacity;
+} DeletionFrame;
+
+// Destroys handles once the GPU is done with them, without waiting for it
+// Handles pushed while recording frame in flight i may still be used by any
+// frame submitted before, so they're destroyed the next time the fence of
+// frame i has been waited on. Submissions to the graphics queue finish in
+// order, so by then every frame that could have used them is done.
+// Not thread safe
+typedef struct {
+  VkDevice device;
+  Allocator *pAllocator;
+  DeletionFrame *pFrames;
+  uint32_t frameCount;
+  // the frame in flight that handles are currently pushed to
+  uint32_t currentFrame;
+} DeletionQueue;
+
+/// Creates a new deletion queue
+/// --- PRECONDITIONS ---
+/// * `pQueue` is a valid pointer
+/// * `frameCount` is the number of frames in flight
+/// * `pAllocator` was created by `new_Allocator` from `device`, and outlives
+/// the queue
+/// --- POSTCONDITIONS ---
+/// * returns error status
+/// --- CLEANUP ---
+/// * call `delete_DeletionQueue`
+ErrVal new_DeletionQueue(DeletionQueue *pQueue, const uint32_t frameCount,
+                         Allocator *pAllocator, const VkDevice device);
+
+/// Destroys every handle still queued, then frees the queue
+/// --- PRECONDITIONS ---
+/// * every frame in flight has finished
+void delete_DeletionQueue(DeletionQueue *pQueue);
+
+/// Destroys the handles pushed the last time `frameIndex` was recorded, and
+/// pushes further handles to it
+/// --- PRECONDITIONS ---
+/// * the fence of frame in flight `frameIndex` has just been waited on
+void deletionQueueBeginFrame(DeletionQueue *pQueue, const uint32_t frameIndex);
+
+/// Destroys every queued handle
+/// --- PRECONDITIONS ---
+/// * every frame in flight has finished
+void deletionQueueFlush(DeletionQueue *pQueue);
+
+/// Each of these takes over the handle and sets it to VK_NULL_HANDLE, like the
+/// matching `delete_*` function from `vulkan_utils.h`
+/// Handles pushed to the same frame are destroyed in the order they were
+/// pushed, so push a handle before anything it was created from, e.g. a
+/// framebuffer before its views, and a view before its image and the image's
+/// memory
+/// --- PRECONDITIONS ---
+/// * the handle is no longer used by frames recorded from now on
+void deletionQueuePushBuffer(DeletionQueue *pQueue, VkBuffer *pBuffer);
+void deletionQueuePushAllocation(DeletionQueue *pQueue,
+                                 Allocation *pAllocation);
+void deletionQueuePushImage(DeletionQueue *pQueue, VkImage *pImage);
+void deletionQueuePushImageView(DeletionQueue *pQueue, VkImageView *pImageView);
+void deletionQueuePushFramebuffer(DeletionQueue *pQueue,
+                                  VkFramebuffer *pFramebuffer);
+void deletionQueuePushPipeline(DeletionQueue *pQueue, VkPipeline *pPipeline);
+void deletionQueuePushSwapchain(DeletionQueue *pQueue,
+                                VkSwapchainKHR *pSwapchain);
+
+#endif // SRC_DELETION_QUEUE_H_
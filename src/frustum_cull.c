@@ -0,0 +1,407 @@
+#include "frustum_cull.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// bytes the component arrays are aligned to, enough for the widest loads
+#define FRUSTUM_CULL_ALIGNMENT 32
+
+void getFrustum(Frustum *pFrustum, const mat4x4 viewProjection) {
+  // linmath matrices are column major, so row r of the matrix is m[c][r]
+  vec4 rows[4];
+  for (uint32_t r = 0; r < 4; r++) {
+    for (uint32_t c = 0; c < 4; c++) {
+      rows[r][c] = viewProjection[c][r];
+    }
+  }
+  for (uint32_t c = 0; c < 4; c++) {
+    pFrustum->planes[0][c] = rows[3][c] + rows[0][c];
+    pFrustum->planes[1][c] = rows[3][c] - rows[0][c];
+    pFrustum->planes[2][c] = rows[3][c] + rows[1][c];
+    pFrustum->planes[3][c] = rows[3][c] - rows[1][c];
+    pFrustum->planes[4][c] = rows[2][c];
+    pFrustum->planes[5][c] = rows[3][c] - rows[2][c];
+  }
+  for (uint32_t p = 0; p < 6; p++) {
+    float length = sqrtf(pFrustum->planes[p][0] * pFrustum->planes[p][0] +
+                         pFrustum->planes[p][1] * pFrustum->planes[p][1] +
+                         pFrustum->planes[p][2] * pFrustum->planes[p][2]);
+    if (length > 0.0f) {
+      vec4_scale(pFrustum->planes[p], pFrustum->planes[p], 1.0f / length);
+    }
+  }
+}
+
+// allocates `arrayCount` float arrays of `capacity` rounded up to a multiple
+// of FRUSTUM_CULL_LANES in one block, zeroed so the padding is harmless
+static ErrVal new_ComponentArrays(float **ppArrays, const uint32_t arrayCount,
+                                  uint32_t *pCapacity) {
+  uint32_t capacity =
+      (*pCapacity + FRUSTUM_CULL_LANES - 1) / FRUSTUM_CULL_LANES *
+      FRUSTUM_CULL_LANES;
+  // aligned_alloc needs a multiple of the alignment
+  size_t arraySize = ((size_t)capacity * sizeof(float) +
+                      FRUSTUM_CULL_ALIGNMENT - 1) /
+                     FRUSTUM_CULL_ALIGNMENT * FRUSTUM_CULL_ALIGNMENT;
+  if (arraySize == 0) {
+    arraySize = FRUSTUM_CULL_ALIGNMENT;
+  }
+  uint8_t *pBlock =
+      aligned_alloc(FRUSTUM_CULL_ALIGNMENT, arraySize * arrayCount);
+  if (!pBlock) {
+    LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "could not allocate %u bounds: %s",
+                   capacity, strerror(errno));
+    return (ERR_ALLOCFAIL);
+  }
+  memset(pBlock, 0, arraySize * arrayCount);
+  for (uint32_t i = 0; i < arrayCount; i++) {
+    ppArrays[i] = (float *)(void *)(pBlock + arraySize * i);
+  }
+  *pCapacity = capacity;
+  return (ERR_OK);
+}
+
+ErrVal new_BoundingSpheres(BoundingSpheres *pSpheres,
+                           const uint32_t capacity) {
+  float *ppArrays[4];
+  uint32_t paddedCapacity = capacity;
+  ErrVal retVal = new_ComponentArrays(ppArrays, 4, &paddedCapacity);
+  if (retVal != ERR_OK) {
+    return (retVal);
+  }
+  pSpheres->pCenterX = ppArrays[0];
+  pSpheres->pCenterY = ppArrays[1];
+  pSpheres->pCenterZ = ppArrays[2];
+  pSpheres->pRadius = ppArrays[3];
+  pSpheres->count = 0;
+  pSpheres->capacity = paddedCapacity;
+  return (ERR_OK);
+}
+
+void delete_BoundingSpheres(BoundingSpheres *pSpheres) {
+  // every array lives in the first one's block
+  free(pSpheres->pCenterX);
+  pSpheres->pCenterX = NULL;
+  pSpheres->pCenterY = NULL;
+  pSpheres->pCenterZ = NULL;
+  pSpheres->pRadius = NULL;
+  pSpheres->count = 0;
+  pSpheres->capacity = 0;
+}
+
+ErrVal new_BoundingBoxes(BoundingBoxes *pBoxes, const uint32_t capacity) {
+  float *ppArrays[6];
+  uint32_t paddedCapacity = capacity;
+  ErrVal retVal = new_ComponentArrays(ppArrays, 6, &paddedCapacity);
+  if (retVal != ERR_OK) {
+    return (retVal);
+  }
+  pBoxes->pCenterX = ppArrays[0];
+  pBoxes->pCenterY = ppArrays[1];
+  pBoxes->pCenterZ = ppArrays[2];
+  pBoxes->pExtentX = ppArrays[3];
+  pBoxes->pExtentY = ppArrays[4];
+  pBoxes->pExtentZ = ppArrays[5];
+  pBoxes->count = 0;
+  pBoxes->capacity = paddedCapacity;
+  return (ERR_OK);
+}
+
+void delete_BoundingBoxes(BoundingBoxes *pBoxes) {
+  // every array lives in the first one's block
+  free(pBoxes->pCenterX);
+  pBoxes->pCenterX = NULL;
+  pBoxes->pCenterY = NULL;
+  pBoxes->pCenterZ = NULL;
+  pBoxes->pExtentX = NULL;
+  pBoxes->pExtentY = NULL;
+  pBoxes->pExtentZ = NULL;
+  pBoxes->count = 0;
+  pBoxes->capacity = 0;
+}
+
+#if FRUSTUM_CULL_LANES > 1
+
+#if defined(__AVX2__)
+typedef __m256 Lanes;
+static inline Lanes lanesLoad(const float *p) { return (_mm256_load_ps(p)); }
+static inline Lanes lanesSet(const float f) { return (_mm256_set1_ps(f)); }
+static inline Lanes lanesAdd(const Lanes a, const Lanes b) {
+  return (_mm256_add_ps(a, b));
+}
+static inline Lanes lanesMin(const Lanes a, const Lanes b) {
+  return (_mm256_min_ps(a, b));
+}
+// a * b + c, fused where the target has FMA
+static inline Lanes lanesMulAdd(const Lanes a, const Lanes b, const Lanes c) {
+#ifdef __FMA__
+  return (_mm256_fmadd_ps(a, b, c));
+#else
+  return (_mm256_add_ps(_mm256_mul_ps(a, b), c));
+#endif
+}
+// a bit per lane that is >= 0
+static inline uint32_t lanesNonNegative(const Lanes a) {
+  return ((uint32_t)_mm256_movemask_ps(
+      _mm256_cmp_ps(a, _mm256_setzero_ps(), _CMP_GE_OQ)));
+}
+// stores `base` plus each of the lane numbers packed 4 bits apart in `lanes`
+static inline void lanesStoreIndices(uint32_t *p, const uint32_t lanes,
+                                     const uint32_t base) {
+  __m256i unpacked = _mm256_and_si256(
+      _mm256_srlv_epi32(_mm256_set1_epi32((int)lanes),
+                        _mm256_setr_epi32(0, 4, 8, 12, 16, 20, 24, 28)),
+      _mm256_set1_epi32(0xF));
+  _mm256_storeu_si256(
+      (__m256i *)(void *)p,
+      _mm256_add_epi32(unpacked, _mm256_set1_epi32((int)base)));
+}
+#else
+typedef __m128 Lanes;
+static inline Lanes lanesLoad(const float *p) { return (_mm_load_ps(p)); }
+static inline Lanes lanesSet(const float f) { return (_mm_set1_ps(f)); }
+static inline Lanes lanesAdd(const Lanes a, const Lanes b) {
+  return (_mm_add_ps(a, b));
+}
+static inline Lanes lanesMin(const Lanes a, const Lanes b) {
+  return (_mm_min_ps(a, b));
+}
+// a * b + c
+static inline Lanes lanesMulAdd(const Lanes a, const Lanes b, const Lanes c) {
+  return (_mm_add_ps(_mm_mul_ps(a, b), c));
+}
+// a bit per lane that is >= 0
+static inline uint32_t lanesNonNegative(const Lanes a) {
+  return ((uint32_t)_mm_movemask_ps(_mm_cmpge_ps(a, _mm_setzero_ps())));
+}
+// stores `base` plus each of the lane numbers packed 4 bits apart in `lanes`
+static inline void lanesStoreIndices(uint32_t *p, const uint32_t lanes,
+                                     const uint32_t base) {
+  // SSE2 has no per lane shifts, and these are cheap next to the store
+  __m128i unpacked =
+      _mm_setr_epi32((int)(lanes & 0xF), (int)((lanes >> 4) & 0xF),
+                     (int)((lanes >> 8) & 0xF), (int)((lanes >> 12) & 0xF));
+  _mm_storeu_si128((__m128i *)(void *)p,
+                   _mm_add_epi32(unpacked, _mm_set1_epi32((int)base)));
+}
+#endif
+
+// for every mask of visible lanes, the visible lane numbers packed to the
+// front, 4 bits each starting from the lowest; the lanes past them are 0 and
+// get overwritten by the next batch
+#if FRUSTUM_CULL_LANES == 8
+static const uint32_t compactionTable[1u << FRUSTUM_CULL_LANES] = {
+    0x00000000, 0x00000000, 0x00000001, 0x00000010, 0x00000002, 0x00000020,
+    0x00000021, 0x00000210, 0x00000003, 0x00000030, 0x00000031, 0x00000310,
+    0x00000032, 0x00000320, 0x00000321, 0x00003210, 0x00000004, 0x00000040,
+    0x00000041, 0x00000410, 0x00000042, 0x00000420, 0x00000421, 0x00004210,
+    0x00000043, 0x00000430, 0x00000431, 0x00004310, 0x00000432, 0x00004320,
+    0x00004321, 0x00043210, 0x00000005, 0x00000050, 0x00000051, 0x00000510,
+    0x00000052, 0x00000520, 0x00000521, 0x00005210, 0x00000053, 0x00000530,
+    0x00000531, 0x00005310, 0x00000532, 0x00005320, 0x00005321, 0x00053210,
+    0x00000054, 0x00000540, 0x00000541, 0x00005410, 0x00000542, 0x00005420,
+    0x00005421, 0x00054210, 0x00000543, 0x00005430, 0x00005431, 0x00054310,
+    0x00005432, 0x00054320, 0x00054321, 0x00543210, 0x00000006, 0x00000060,
+    0x00000061, 0x00000610, 0x00000062, 0x00000620, 0x00000621, 0x00006210,
+    0x00000063, 0x00000630, 0x00000631, 0x00006310, 0x00000632, 0x00006320,
+    0x00006321, 0x00063210, 0x00000064, 0x00000640, 0x00000641, 0x00006410,
+    0x00000642, 0x00006420, 0x00006421, 0x00064210, 0x00000643, 0x00006430,
+    0x00006431, 0x00064310, 0x00006432, 0x00064320, 0x00064321, 0x00643210,
+    0x00000065, 0x00000650, 0x00000651, 0x00006510, 0x00000652, 0x00006520,
+    0x00006521, 0x00065210, 0x00000653, 0x00006530, 0x00006531, 0x00065310,
+    0x00006532, 0x00065320, 0x00065321, 0x00653210, 0x00000654, 0x00006540,
+    0x00006541, 0x00065410, 0x00006542, 0x00065420, 0x00065421, 0x00654210,
+    0x00006543, 0x00065430, 0x00065431, 0x00654310, 0x00065432, 0x00654320,
+    0x00654321, 0x06543210, 0x00000007, 0x00000070, 0x00000071, 0x00000710,
+    0x00000072, 0x00000720, 0x00000721, 0x00007210, 0x00000073, 0x00000730,
+    0x00000731, 0x00007310, 0x00000732, 0x00007320, 0x00007321, 0x00073210,
+    0x00000074, 0x00000740, 0x00000741, 0x00007410, 0x00000742, 0x00007420,
+    0x00007421, 0x00074210, 0x00000743, 0x00007430, 0x00007431, 0x00074310,
+    0x00007432, 0x00074320, 0x00074321, 0x00743210, 0x00000075, 0x00000750,
+    0x00000751, 0x00007510, 0x00000752, 0x00007520, 0x00007521, 0x00075210,
+    0x00000753, 0x00007530, 0x00007531, 0x00075310, 0x00007532, 0x00075320,
+    0x00075321, 0x00753210, 0x00000754, 0x00007540, 0x00007541, 0x00075410,
+    0x00007542, 0x00075420, 0x00075421, 0x00754210, 0x00007543, 0x00075430,
+    0x00075431, 0x00754310, 0x00075432, 0x00754320, 0x00754321, 0x07543210,
+    0x00000076, 0x00000760, 0x00000761, 0x00007610, 0x00000762, 0x00007620,
+    0x00007621, 0x00076210, 0x00000763, 0x00007630, 0x00007631, 0x00076310,
+    0x00007632, 0x00076320, 0x00076321, 0x00763210, 0x00000764, 0x00007640,
+    0x00007641, 0x00076410, 0x00007642, 0x00076420, 0x00076421, 0x00764210,
+    0x00007643, 0x00076430, 0x00076431, 0x00764310, 0x00076432, 0x00764320,
+    0x00764321, 0x07643210, 0x00000765, 0x00007650, 0x00007651, 0x00076510,
+    0x00007652, 0x00076520, 0x00076521, 0x00765210, 0x00007653, 0x00076530,
+    0x00076531, 0x00765310, 0x00076532, 0x00765320, 0x00765321, 0x07653210,
+    0x00007654, 0x00076540, 0x00076541, 0x00765410, 0x00076542, 0x00765420,
+    0x00765421, 0x07654210, 0x00076543, 0x00765430, 0x00765431, 0x07654310,
+    0x00765432, 0x07654320, 0x07654321, 0x76543210,
+};
+#else
+static const uint32_t compactionTable[1u << FRUSTUM_CULL_LANES] = {
+    0x00000000, 0x00000000, 0x00000001, 0x00000010, 0x00000002, 0x00000020,
+    0x00000021, 0x00000210, 0x00000003, 0x00000030, 0x00000031, 0x00000310,
+    0x00000032, 0x00000320, 0x00000321, 0x00003210,
+};
+#endif
+
+// appends `base` plus the position of every set bit of `mask`, dropping the
+// lanes past `count`
+// A whole batch of indices is stored every time and only the visible ones are
+// kept, since branching on each lane mispredicts whenever visibility is mixed
+static inline uint32_t appendVisible(uint32_t *pVisible, uint32_t visibleCount,
+                                     uint32_t mask, const uint32_t base,
+                                     const uint32_t count) {
+  if (count - base < FRUSTUM_CULL_LANES) {
+    mask &= (1u << (count - base)) - 1u;
+  }
+  lanesStoreIndices(pVisible + visibleCount, compactionTable[mask], base);
+  return (visibleCount + (uint32_t)__builtin_popcount(mask));
+}
+
+uint32_t frustumCullSpheres(uint32_t *pVisible, const BoundingSpheres *pSpheres,
+                            const Frustum *pFrustum) {
+  Lanes planes[6][4];
+  for (uint32_t p = 0; p < 6; p++) {
+    for (uint32_t c = 0; c < 4; c++) {
+      planes[p][c] = lanesSet(pFrustum->planes[p][c]);
+    }
+  }
+
+  uint32_t visibleCount = 0;
+  for (uint32_t i = 0; i < pSpheres->count; i += FRUSTUM_CULL_LANES) {
+    Lanes x = lanesLoad(pSpheres->pCenterX + i);
+    Lanes y = lanesLoad(pSpheres->pCenterY + i);
+    Lanes z = lanesLoad(pSpheres->pCenterZ + i);
+    Lanes radius = lanesLoad(pSpheres->pRadius + i);
+    // the smallest signed distance plus the radius, over every plane
+    Lanes nearest = lanesSet(INFINITY);
+    for (uint32_t p = 0; p < 6; p++) {
+      Lanes distance = lanesAdd(planes[p][3], radius);
+      distance = lanesMulAdd(planes[p][0], x, distance);
+      distance = lanesMulAdd(planes[p][1], y, distance);
+      distance = lanesMulAdd(planes[p][2], z, distance);
+      nearest = lanesMin(nearest, distance);
+    }
+    visibleCount = appendVisible(pVisible, visibleCount,
+                                 lanesNonNegative(nearest), i, pSpheres->count);
+  }
+  return (visibleCount);
+}
+
+uint32_t frustumCullBoxes(uint32_t *pVisible, const BoundingBoxes *pBoxes,
+                          const Frustum *pFrustum) {
+  // a box reaches as far past its center as its extents along the absolute
+  // plane normal
+  Lanes planes[6][4];
+  Lanes absNormals[6][3];
+  for (uint32_t p = 0; p < 6; p++) {
+    for (uint32_t c = 0; c < 4; c++) {
+      planes[p][c] = lanesSet(pFrustum->planes[p][c]);
+    }
+    for (uint32_t c = 0; c < 3; c++) {
+      absNormals[p][c] = lanesSet(fabsf(pFrustum->planes[p][c]));
+    }
+  }
+
+  uint32_t visibleCount = 0;
+  for (uint32_t i = 0; i < pBoxes->count; i += FRUSTUM_CULL_LANES) {
+    Lanes x = lanesLoad(pBoxes->pCenterX + i);
+    Lanes y = lanesLoad(pBoxes->pCenterY + i);
+    Lanes z = lanesLoad(pBoxes->pCenterZ + i);
+    Lanes ex = lanesLoad(pBoxes->pExtentX + i);
+    Lanes ey = lanesLoad(pBoxes->pExtentY + i);
+    Lanes ez = lanesLoad(pBoxes->pExtentZ + i);
+    Lanes nearest = lanesSet(INFINITY);
+    for (uint32_t p = 0; p < 6; p++) {
+      Lanes distance = lanesMulAdd(planes[p][0], x, planes[p][3]);
+      distance = lanesMulAdd(planes[p][1], y, distance);
+      distance = lanesMulAdd(planes[p][2], z, distance);
+      distance = lanesMulAdd(absNormals[p][0], ex, distance);
+      distance = lanesMulAdd(absNormals[p][1], ey, distance);
+      distance = lanesMulAdd(absNormals[p][2], ez, distance);
+      nearest = lanesMin(nearest, distance);
+    }
+    visibleCount = appendVisible(pVisible, visibleCount,
+                                 lanesNonNegative(nearest), i, pBoxes->count);
+  }
+  return (visibleCount);
+}
+
+#else
+
+uint32_t frustumCullSpheres(uint32_t *pVisible, const BoundingSpheres *pSpheres,
+                            const Frustum *pFrustum) {
+  uint32_t visibleCount = 0;
+  for (uint32_t i = 0; i < pSpheres->count; i++) {
+    bool inside = true;
+    for (uint32_t p = 0; p < 6; p++) {
+      const float *plane = pFrustum->planes[p];
+      float distance = plane[0] * pSpheres->pCenterX[i] +
+                       plane[1] * pSpheres->pCenterY[i] +
+                       plane[2] * pSpheres->pCenterZ[i] + plane[3];
+      inside = inside && distance + pSpheres->pRadius[i] >= 0.0f;
+    }
+    // written every time, so there's no branch to mispredict
+    pVisible[visibleCount] = i;
+    visibleCount += inside ? 1 : 0;
+  }
+  return (visibleCount);
+}
+
+uint32_t frustumCullBoxes(uint32_t *pVisible, const BoundingBoxes *pBoxes,
+                          const Frustum *pFrustum) {
+  uint32_t visibleCount = 0;
+  for (uint32_t i = 0; i < pBoxes->count; i++) {
+    bool inside = true;
+    for (uint32_t p = 0; p < 6; p++) {
+      const float *plane = pFrustum->planes[p];
+      float distance = plane[0] * pBoxes->pCenterX[i] +
+                       plane[1] * pBoxes->pCenterY[i] +
+                       plane[2] * pBoxes->pCenterZ[i] + plane[3];
+      float reach = fabsf(plane[0]) * pBoxes->pExtentX[i] +
+                    fabsf(plane[1]) * pBoxes->pExtentY[i] +
+                    fabsf(plane[2]) * pBoxes->pExtentZ[i];
+      inside = inside && distance + reach >= 0.0f;
+    }
+    pVisible[visibleCount] = i;
+    visibleCount += inside ? 1 : 0;
+  }
+  return (visibleCount);
+}
+
+#endif
+
+void frustumCullStatsRecord(FrustumCullStats *pStats,
+                            const uint32_t objectCount,
+                            const uint32_t visibleCount,
+                            const uint64_t timeNs) {
+  pStats->passCount++;
+  pStats->objectCount += objectCount;
+  pStats->visibleCount += visibleCount;
+  pStats->timeNs += timeNs;
+}
+
+void printFrustumCullStats(const FrustumCullStats *pStats) {
+  if (pStats->passCount == 0 || pStats->objectCount == 0) {
+    return;
+  }
+  double passCount = (double)pStats->passCount;
+  printf("frustum culling (%s): %llu passes, %.1f objects, %.1f visible, "
+         "%.1f culled per pass\n",
+         FRUSTUM_CULL_ISA, (unsigned long long)pStats->passCount,
+         (double)pStats->objectCount / passCount,
+         (double)pStats->visibleCount / passCount,
+         (double)(pStats->objectCount - pStats->visibleCount) / passCount);
+  printf("frustum culling: %.3f ns/object, %.3f ms/pass\n",
+         (double)pStats->timeNs / (double)pStats->objectCount,
+         (double)pStats->timeNs / passCount / 1e6);
+}
@@ -0,0 +1,122 @@
+#ifndef SRC_FRUSTUM_CULL_H_
+#define SRC_FRUSTUM_CULL_H_
+
+#include <stdint.h>
+
+#include <linmath.h>
+
+#include "errors.h"
+
+// objects tested per instruction, bounds are allocated in multiples of it
+#if defined(__AVX2__)
+#define FRUSTUM_CULL_LANES 8
+#define FRUSTUM_CULL_ISA "avx2"
+#elif defined(__SSE2__)
+#define FRUSTUM_CULL_LANES 4
+#define FRUSTUM_CULL_ISA "sse2"
+#else
+#define FRUSTUM_CULL_LANES 1
+#define FRUSTUM_CULL_ISA "scalar"
+#endif
+
+// The clip volume of a camera as six world space planes: left, right, bottom,
+// top, near and far
+// A point p is inside a plane when dot(plane.xyz, p) + plane.w >= 0, and the
+// normals have unit length, so that is its distance to the plane
+typedef struct {
+  vec4 planes[6];
+} Frustum;
+
+// Bounding spheres of many objects, one array per component
+typedef struct {
+  float *pCenterX;
+  float *pCenterY;
+  float *pCenterZ;
+  float *pRadius;
+  uint32_t count;
+  // a multiple of FRUSTUM_CULL_LANES
+  uint32_t capacity;
+} BoundingSpheres;
+
+// Axis aligned bounding boxes of many objects as centers and half extents,
+// one array per component
+typedef struct {
+  float *pCenterX;
+  float *pCenterY;
+  float *pCenterZ;
+  float *pExtentX;
+  float *pExtentY;
+  float *pExtentZ;
+  uint32_t count;
+  // a multiple of FRUSTUM_CULL_LANES
+  uint32_t capacity;
+} BoundingBoxes;
+
+// Totals over every culling pass, for reporting
+typedef struct {
+  uint64_t passCount;
+  uint64_t objectCount;
+  uint64_t visibleCount;
+  uint64_t timeNs;
+} FrustumCullStats;
+
+/// Sets `pFrustum` to the clip volume of `viewProjection`
+/// Vulkan clips to -w <= x <= w, -w <= y <= w and 0 <= z <= w
+void getFrustum(Frustum *pFrustum, const mat4x4 viewProjection);
+
+/// Allocates room for `capacity` spheres, with `count` set to 0
+/// --- PRECONDITIONS ---
+/// * `pSpheres` is a valid pointer
+/// --- POSTCONDITIONS ---
+/// * returns error status
+/// * the arrays are aligned for the widest loads used by `frustumCullSpheres`
+/// --- CLEANUP ---
+/// * call `delete_BoundingSpheres`
+ErrVal new_BoundingSpheres(BoundingSpheres *pSpheres, const uint32_t capacity);
+
+void delete_BoundingSpheres(BoundingSpheres *pSpheres);
+
+/// Allocates room for `capacity` boxes, with `count` set to 0
+/// --- PRECONDITIONS ---
+/// * `pBoxes` is a valid pointer
+/// --- POSTCONDITIONS ---
+/// * returns error status
+/// --- CLEANUP ---
+/// * call `delete_BoundingBoxes`
+ErrVal new_BoundingBoxes(BoundingBoxes *pBoxes, const uint32_t capacity);
+
+void delete_BoundingBoxes(BoundingBoxes *pBoxes);
+
+/// Writes the index of every sphere that is at least partly inside
+/// `pFrustum` to `pVisible`, in increasing order
+/// --- PRECONDITIONS ---
+/// * `pVisible` has room for `pSpheres->capacity` indices, since whole
+/// batches are stored
+/// --- POSTCONDITIONS ---
+/// * returns the number of visible spheres
+/// * tests FRUSTUM_CULL_LANES spheres at a time
+uint32_t frustumCullSpheres(uint32_t *pVisible, const BoundingSpheres *pSpheres,
+                            const Frustum *pFrustum);
+
+/// Writes the index of every box that is at least partly inside `pFrustum` to
+/// `pVisible`, in increasing order
+/// Boxes near the frustum's corners may be kept although they're outside
+/// --- PRECONDITIONS ---
+/// * `pVisible` has room for `pBoxes->capacity` indices, since whole batches
+/// are stored
+/// --- POSTCONDITIONS ---
+/// * returns the number of visible boxes
+/// * tests FRUSTUM_CULL_LANES boxes at a time
+uint32_t frustumCullBoxes(uint32_t *pVisible, const BoundingBoxes *pBoxes,
+                          const Frustum *pFrustum);
+
+/// Adds one pass over `objectCount` objects to `pStats`
+void frustumCullStatsRecord(FrustumCullStats *pStats,
+                            const uint32_t objectCount,
+                            const uint32_t visibleCount,
+                            const uint64_t timeNs);
+
+/// Prints the average visible and culled counts, and the time per object
+void printFrustumCullStats(const FrustumCullStats *pStats);
+
+#endif // SRC_FRUSTUM_CULL_H_
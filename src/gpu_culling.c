@@ -0,0 +1,299 @@
+#include "gpu_culling.h"
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_alloc.h"
+#include "vulkan_utils.h"
+
+// what a dispatch of cull.comp does, its PASS_ defines
+typedef enum {
+  GPU_CULL_PASS_COUNT = 0,
+  GPU_CULL_PASS_SCAN = 1,
+  GPU_CULL_PASS_SCATTER = 2,
+} GpuCullPass;
+
+// laid out like the push constants of cull.comp
+typedef struct {
+  mat4x4 viewProjection;
+  vec4 boundingSphere;
+  uint32_t instanceCount;
+  uint32_t indexCount;
+  uint32_t pass;
+} GpuCullConstants;
+
+// laid out like Draws in cull.comp
+typedef struct {
+  VkDrawIndexedIndirectCommand draw;
+  uint32_t drawCount;
+} GpuCullDraws;
+
+static void delete_GpuCullFrame(GpuCullFrame *pFrame, Allocator *pAllocator,
+                                const VkDevice device) {
+  delete_Buffer(&pFrame->visibleBuffer, device);
+  delete_Allocation(&pFrame->visibleAllocation, pAllocator);
+  delete_Buffer(&pFrame->drawBuffer, device);
+  delete_Allocation(&pFrame->drawAllocation, pAllocator);
+  delete_Buffer(&pFrame->offsetBuffer, device);
+  delete_Allocation(&pFrame->offsetAllocation, pAllocator);
+}
+
+static ErrVal new_GpuCullFrame(GpuCullFrame *pFrame, const GpuCuller *pCuller) {
+  const VkDeviceSize visibleSize =
+      (VkDeviceSize)pCuller->capacity * sizeof(InstanceData);
+  const VkDeviceSize drawSize = sizeof(GpuCullDraws);
+  const VkDeviceSize offsetSize =
+      (VkDeviceSize)pCuller->capacity * sizeof(uint32_t);
+
+  ErrVal retVal = new_Buffer_Allocation(
+      &pFrame->visibleBuffer, &pFrame->visibleAllocation, pCuller->pAllocator,
+      visibleSize,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0);
+  if (retVal != ERR_OK) {
+    return (retVal);
+  }
+  retVal = new_Buffer_Allocation(
+      &pFrame->drawBuffer, &pFrame->drawAllocation, pCuller->pAllocator,
+      drawSize,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0);
+  if (retVal != ERR_OK) {
+    delete_Buffer(&pFrame->visibleBuffer, pCuller->device);
+    delete_Allocation(&pFrame->visibleAllocation, pCuller->pAllocator);
+    return (retVal);
+  }
+  retVal = new_Buffer_Allocation(
+      &pFrame->offsetBuffer, &pFrame->offsetAllocation, pCuller->pAllocator,
+      offsetSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0);
+  if (retVal != ERR_OK) {
+    delete_Buffer(&pFrame->visibleBuffer, pCuller->device);
+    delete_Allocation(&pFrame->visibleAllocation, pCuller->pAllocator);
+    delete_Buffer(&pFrame->drawBuffer, pCuller->device);
+    delete_Allocation(&pFrame->drawAllocation, pCuller->pAllocator);
+    return (retVal);
+  }
+
+  // the input instances are only known when a cull is recorded
+  const VkBuffer pBuffers[4] = {pFrame->visibleBuffer, pFrame->visibleBuffer,
+                                pFrame->drawBuffer, pFrame->offsetBuffer};
+  const VkDeviceSize pSizes[4] = {visibleSize, visibleSize, drawSize,
+                                  offsetSize};
+  for (uint32_t i = 0; i < 4; i++) {
+    retVal = new_ComputeBufferDescriptorSet(
+        &pFrame->pDescriptorSets[i], pBuffers[i], pSizes[i],
+        pCuller->descriptorSetLayout, pCuller->descriptorPool,
+        pCuller->device);
+    if (retVal != ERR_OK) {
+      delete_GpuCullFrame(pFrame, pCuller->pAllocator, pCuller->device);
+      return (retVal);
+    }
+  }
+  return (ERR_OK);
+}
+
+ErrVal new_GpuCuller(                      //
+    GpuCuller *pCuller,                    //
+    const uint32_t frameCount,             //
+    const uint32_t capacity,               //
+    const uint32_t indexCount,             //
+    const vec4 boundingSphere,             //
+    const VkShaderModule shaderModule,     //
+    Allocator *pAllocator,                 //
+    const VkPhysicalDevice physicalDevice, //
+    const VkDevice device                  //
+) {
+  pCuller->device = device;
+  pCuller->pAllocator = pAllocator;
+  pCuller->frameCount = frameCount;
+  pCuller->currentFrame = 0;
+  pCuller->capacity = capacity;
+  pCuller->indexCount = indexCount;
+  memcpy(pCuller->boundingSphere, boundingSphere, sizeof(vec4));
+  // new_Device enables these features whenever they're supported
+  pCuller->drawIndirectCount = isDrawIndirectCountSupported(physicalDevice);
+
+  ErrVal retVal = new_ComputeStorageDescriptorSetLayout(
+      &pCuller->descriptorSetLayout, device);
+  if (retVal != ERR_OK) {
+    return (retVal);
+  }
+
+  // every set holds a single storage buffer, so one layout serves all four
+  VkDescriptorSetLayout pSetLayouts[4] = {
+      pCuller->descriptorSetLayout, pCuller->descriptorSetLayout,
+      pCuller->descriptorSetLayout, pCuller->descriptorSetLayout};
+  VkPushConstantRange pushConstantRange = {0};
+  pushConstantRange.offset = 0;
+  pushConstantRange.size = sizeof(GpuCullConstants);
+  pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+  VkPipelineLayoutCreateInfo pipelineLayoutInfo = {0};
+  pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pipelineLayoutInfo.setLayoutCount = 4;
+  pipelineLayoutInfo.pSetLayouts = pSetLayouts;
+  pipelineLayoutInfo.pushConstantRangeCount = 1;
+  pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+  VkResult res = vkCreatePipelineLayout(device, &pipelineLayoutInfo,
+                                        pVulkanAllocationCallbacks,
+                                        &pCuller->pipelineLayout);
+  if (res != VK_SUCCESS) {
+    LOG_ERROR_ARGS(ERR_LEVEL_ERROR,
+                   "failed to create culling pipeline layout: %s",
+                   vkstrerror(res));
+    delete_DescriptorSetLayout(&pCuller->descriptorSetLayout, device);
+    return (ERR_UNKNOWN);
+  }
+
+  retVal = new_ComputePipeline(&pCuller->pipeline, pCuller->pipelineLayout,
+                               shaderModule, device);
+  if (retVal != ERR_OK) {
+    delete_PipelineLayout(&pCuller->pipelineLayout, device);
+    delete_DescriptorSetLayout(&pCuller->descriptorSetLayout, device);
+    return (retVal);
+  }
+
+  retVal = new_DescriptorPool(&pCuller->descriptorPool,
+                              VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                              4 * frameCount, device);
+  if (retVal != ERR_OK) {
+    delete_Pipeline(&pCuller->pipeline, device);
+    delete_PipelineLayout(&pCuller->pipelineLayout, device);
+    delete_DescriptorSetLayout(&pCuller->descriptorSetLayout, device);
+    return (retVal);
+  }
+
+  pCuller->pFrames = malloc(frameCount * sizeof(GpuCullFrame));
+  if (!pCuller->pFrames) {
+    LOG_ERROR_ARGS(ERR_LEVEL_FATAL, "failed to create gpu culler: %s",
+                   strerror(errno));
+    PANIC();
+  }
+  for (uint32_t i = 0; i < frameCount; i++) {
+    retVal = new_GpuCullFrame(&pCuller->pFrames[i], pCuller);
+    if (retVal != ERR_OK) {
+      LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "could not cull %u instances",
+                     capacity);
+      pCuller->frameCount = i;
+      delete_GpuCuller(pCuller);
+      return (retVal);
+    }
+  }
+  return (ERR_OK);
+}
+
+void delete_GpuCuller(GpuCuller *pCuller) {
+  for (uint32_t i = 0; i < pCuller->frameCount; i++) {
+    delete_GpuCullFrame(&pCuller->pFrames[i], pCuller->pAllocator,
+                        pCuller->device);
+  }
+  free(pCuller->pFrames);
+  pCuller->pFrames = NULL;
+  pCuller->frameCount = 0;
+  // the descriptor sets are freed along with their pool
+  delete_DescriptorPool(&pCuller->descriptorPool, pCuller->device);
+  delete_Pipeline(&pCuller->pipeline, pCuller->device);
+  delete_PipelineLayout(&pCuller->pipelineLayout, pCuller->device);
+  delete_DescriptorSetLayout(&pCuller->descriptorSetLayout, pCuller->device);
+}
+
+void gpuCullerBeginFrame(GpuCuller *pCuller, const uint32_t frameIndex) {
+  pCuller->currentFrame = frameIndex;
+}
+
+// makes the writes of one pass visible to the next
+static void recordGpuCullPassBarrier(const VkCommandBuffer commandBuffer) {
+  VkMemoryBarrier passBarrier = {0};
+  passBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  passBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  passBarrier.dstAccessMask =
+      VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+                       &passBarrier, 0, NULL, 0, NULL);
+}
+
+void gpuCullerRecordCull(GpuCuller *pCuller,
+                         const VkCommandBuffer commandBuffer,
+                         const VkBuffer instanceBuffer,
+                         const uint32_t instanceCount,
+                         const mat4x4 viewProjection) {
+  GpuCullFrame *pFrame = &pCuller->pFrames[pCuller->currentFrame];
+  const uint32_t cullCount =
+      instanceCount < pCuller->capacity ? instanceCount : pCuller->capacity;
+
+  // the instance buffer may have been replaced since this frame last ran,
+  // and the set isn't in use anymore, so it's cheapest to always rewrite it
+  updateComputeBufferDescriptorSet(
+      pFrame->pDescriptorSets[0], instanceBuffer,
+      (VkDeviceSize)(cullCount != 0 ? cullCount : 1) * sizeof(InstanceData),
+      pCuller->device);
+
+  GpuCullConstants constants = {0};
+  memcpy(constants.viewProjection, viewProjection, sizeof(mat4x4));
+  memcpy(constants.boundingSphere, pCuller->boundingSphere, sizeof(vec4));
+  constants.instanceCount = cullCount;
+  constants.indexCount = pCuller->indexCount;
+
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                    pCuller->pipeline);
+  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                          pCuller->pipelineLayout, 0, 4,
+                          pFrame->pDescriptorSets, 0, NULL);
+
+  // one thread per instance
+  const uint32_t groupCount =
+      (cullCount + GPU_CULL_WORKGROUP_SIZE - 1) / GPU_CULL_WORKGROUP_SIZE;
+  constants.pass = GPU_CULL_PASS_COUNT;
+  vkCmdPushConstants(commandBuffer, pCuller->pipelineLayout,
+                     VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants),
+                     &constants);
+  vkCmdDispatch(commandBuffer, groupCount, 1, 1);
+  recordGpuCullPassBarrier(commandBuffer);
+
+  // the scan also writes the draws, so nothing needs resetting beforehand
+  constants.pass = GPU_CULL_PASS_SCAN;
+  vkCmdPushConstants(commandBuffer, pCuller->pipelineLayout,
+                     VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants),
+                     &constants);
+  vkCmdDispatch(commandBuffer, 1, 1, 1);
+  recordGpuCullPassBarrier(commandBuffer);
+
+  constants.pass = GPU_CULL_PASS_SCATTER;
+  vkCmdPushConstants(commandBuffer, pCuller->pipelineLayout,
+                     VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants),
+                     &constants);
+  vkCmdDispatch(commandBuffer, groupCount, 1, 1);
+
+  VkMemoryBarrier cullBarrier = {0};
+  cullBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  cullBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  cullBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT |
+                              VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+                           VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                       0, 1, &cullBarrier, 0, NULL, 0, NULL);
+}
+
+void gpuCullerRecordDraw(GpuCuller *pCuller,
+                         const VkCommandBuffer commandBuffer) {
+  GpuCullFrame *pFrame = &pCuller->pFrames[pCuller->currentFrame];
+  VkDeviceSize offset = 0;
+  vkCmdBindVertexBuffers(commandBuffer, 1, 1, &pFrame->visibleBuffer,
+                         &offset);
+  // the visible instances are contiguous, so one instanced draw covers them
+  if (pCuller->drawIndirectCount) {
+    vkCmdDrawIndexedIndirectCount(
+        commandBuffer, pFrame->drawBuffer, offsetof(GpuCullDraws, draw),
+        pFrame->drawBuffer, offsetof(GpuCullDraws, drawCount), 1,
+        sizeof(VkDrawIndexedIndirectCommand));
+  } else {
+    vkCmdDrawIndexedIndirect(commandBuffer, pFrame->drawBuffer,
+                             offsetof(GpuCullDraws, draw), 1,
+                             sizeof(VkDrawIndexedIndirectCommand));
+  }
+}
@@ -0,0 +1,113 @@
+#ifndef SRC_GPU_CULLING_H_
+#define SRC_GPU_CULLING_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+#include <linmath.h>
+
+#include "allocator.h"
+#include "errors.h"
+
+// threads per workgroup of cull.comp, which tests an instance per thread,
+// then scans the results with a single workgroup and copies the visible
+// instances a thread each
+#define GPU_CULL_WORKGROUP_SIZE 64
+
+// The buffers one frame in flight culls into
+typedef struct {
+  // the instances that passed, compacted, read as the instance binding
+  VkBuffer visibleBuffer;
+  Allocation visibleAllocation;
+  // a single command drawing every visible instance, then the draw count
+  VkBuffer drawBuffer;
+  Allocation drawAllocation;
+  // where each visible instance goes, a prefix sum over the instances so they
+  // stay in order from frame to frame
+  VkBuffer offsetBuffer;
+  Allocation offsetAllocation;
+  // sets 0 to 3 of cull.comp: the input instances, the visible instances, the
+  // draws and the offsets
+  VkDescriptorSet pDescriptorSets[4];
+} GpuCullFrame;
+
+// Frustum culls instances in a compute pass, so the draw that follows only
+// gets the visible ones, without the CPU looking at any instance
+typedef struct {
+  VkDevice device;
+  Allocator *pAllocator;
+  VkDescriptorSetLayout descriptorSetLayout;
+  VkDescriptorPool descriptorPool;
+  VkPipelineLayout pipelineLayout;
+  VkPipeline pipeline;
+  GpuCullFrame *pFrames;
+  uint32_t frameCount;
+  // the frame in flight being recorded
+  uint32_t currentFrame;
+  // most instances that can be culled at once
+  uint32_t capacity;
+  uint32_t indexCount;
+  // bounds every instance's mesh in model space, radius in w
+  vec4 boundingSphere;
+  // false if the command is drawn even when no instance is visible
+  bool drawIndirectCount;
+} GpuCuller;
+
+/// Creates the culling pipeline, and the buffers for every frame in flight
+/// --- PRECONDITIONS ---
+/// * `pCuller` is a valid pointer
+/// * `shaderModule` holds cull.comp
+/// * `device` was created by `new_Device` from `physicalDevice`
+/// * `boundingSphere` contains the mesh drawn from `indexCount` indices
+/// --- POSTCONDITIONS ---
+/// * returns error status
+/// * the visible instances are drawn in the order they were given, with a
+/// single instanced indirect command, through `vkCmdDrawIndexedIndirectCount`
+/// if `isDrawIndirectCountSupported` so it is skipped when none are visible
+/// --- CLEANUP ---
+/// * call `delete_GpuCuller` once no frame in flight uses it
+ErrVal new_GpuCuller(                      //
+    GpuCuller *pCuller,                    //
+    const uint32_t frameCount,             //
+    const uint32_t capacity,               //
+    const uint32_t indexCount,             //
+    const vec4 boundingSphere,             //
+    const VkShaderModule shaderModule,     //
+    Allocator *pAllocator,                 //
+    const VkPhysicalDevice physicalDevice, //
+    const VkDevice device                  //
+);
+
+void delete_GpuCuller(GpuCuller *pCuller);
+
+/// Makes `frameIndex` the frame in flight that the next cull is recorded into
+/// --- PRECONDITIONS ---
+/// * that frame's fence has been waited on
+void gpuCullerBeginFrame(GpuCuller *pCuller, const uint32_t frameIndex);
+
+/// Records the culling pass over `instanceCount` InstanceData in
+/// `instanceBuffer` against the clip volume of `viewProjection`
+/// --- PRECONDITIONS ---
+/// * `commandBuffer` is recording and is not inside a render pass
+/// * `instanceBuffer` was created with storage buffer usage, and its writes
+/// are visible to the compute stage
+/// --- POSTCONDITIONS ---
+/// * at most `capacity` instances are culled
+/// * the results are made visible to indirect draws and vertex input
+void gpuCullerRecordCull(GpuCuller *pCuller,
+                         const VkCommandBuffer commandBuffer,
+                         const VkBuffer instanceBuffer,
+                         const uint32_t instanceCount,
+                         const mat4x4 viewProjection);
+
+/// Draws the visible instances with one instanced indirect draw
+/// --- PRECONDITIONS ---
+/// * `gpuCullerRecordCull` was recorded earlier in `commandBuffer`
+/// * `commandBuffer` is inside a render pass with an instanced pipeline bound,
+/// and the mesh bound to vertex binding 0 and as the index buffer
+void gpuCullerRecordDraw(GpuCuller *pCuller,
+                         const VkCommandBuffer commandBuffer);
+
+#endif // SRC_GPU_CULLING_H_
@@ -0,0 +1,387 @@
+#include "gpu_profiler.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_alloc.h"
+
+// in the order vulkan writes them, which is the order of the flag bits
+static const char *statisticNames[GPU_STATISTIC_COUNT] = {
+    "ia_vertices",      "ia_primitives",   "vs_invocations",
+    "clip_invocations", "clip_primitives", "fs_invocations",
+};
+
+static const VkQueryPipelineStatisticFlags statisticFlags =
+    VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+
+// opens `path` for writing and writes `header` to it, or returns NULL
+static FILE *openCsv(const char *path, const char *header) {
+  if (path == NULL) {
+    return (NULL);
+  }
+  FILE *fp = fopen(path, "w");
+  if (!fp) {
+    LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "could not open %s: %s", path,
+                   strerror(errno));
+    return (NULL);
+  }
+  fprintf(fp, "%s\n", header);
+  return (fp);
+}
+
+ErrVal new_GpuProfiler(                    //
+    GpuProfiler *pProfiler,                //
+    const uint32_t frameCount,             //
+    const VkPhysicalDevice physicalDevice, //
+    const uint32_t queueFamilyIndex,       //
+    const VkDevice device,                 //
+    const char *pStreamPath,               //
+    const bool pipelineStatistics,         //
+    const char *pStatisticsStreamPath      //
+) {
+  /* check that the queue can write timestamps at all */
+  uint32_t queueFamilyCount = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount,
+                                           NULL);
+  VkQueueFamilyProperties *pFamilyProperties =
+      malloc(queueFamilyCount * sizeof(VkQueueFamilyProperties));
+  if (!pFamilyProperties) {
+    LOG_ERROR_ARGS(ERR_LEVEL_FATAL, "failed to create gpu profiler: %s",
+                   strerror(errno));
+    PANIC();
+  }
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount,
+                                           pFamilyProperties);
+  uint32_t validBits = 0;
+  if (queueFamilyIndex < queueFamilyCount) {
+    validBits = pFamilyProperties[queueFamilyIndex].timestampValidBits;
+  }
+  free(pFamilyProperties);
+  if (validBits == 0) {
+    LOG_ERROR(ERR_LEVEL_WARN,
+              "queue family does not support timestamps, gpu profiling off");
+    return (ERR_NOTSUPPORTED);
+  }
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+  pProfiler->frameCount = frameCount;
+  pProfiler->currentFrame = 0;
+  pProfiler->timestampPeriod = (double)properties.limits.timestampPeriod;
+  pProfiler->timestampMask =
+      validBits >= 64 ? UINT64_MAX : (((uint64_t)1 << validBits) - 1);
+  pProfiler->statCount = 0;
+  pProfiler->pStream = NULL;
+  pProfiler->pStatisticsStream = NULL;
+  pProfiler->statisticsFrameCount = 0;
+  memset(pProfiler->pStatisticsTotals, 0, sizeof(pProfiler->pStatisticsTotals));
+  memset(pProfiler->pStatisticsMaxes, 0, sizeof(pProfiler->pStatisticsMaxes));
+
+  // new_Device enables pipelineStatisticsQuery whenever it's supported
+  pProfiler->pipelineStatistics = false;
+  if (pipelineStatistics) {
+    VkPhysicalDeviceFeatures features;
+    vkGetPhysicalDeviceFeatures(physicalDevice, &features);
+    if (features.pipelineStatisticsQuery) {
+      pProfiler->pipelineStatistics = true;
+    } else {
+      LOG_ERROR(ERR_LEVEL_WARN,
+                "device does not support pipeline statistics queries");
+    }
+  }
+
+  pProfiler->pFrames = calloc(frameCount, sizeof(GpuProfilerFrame));
+  if (!pProfiler->pFrames) {
+    LOG_ERROR_ARGS(ERR_LEVEL_FATAL, "failed to create gpu profiler: %s",
+                   strerror(errno));
+    PANIC();
+  }
+
+  for (uint32_t i = 0; i < frameCount; i++) {
+    VkQueryPoolCreateInfo createInfo = {0};
+    createInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    createInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    createInfo.queryCount = GPU_PROFILER_MAX_SCOPES * 2;
+    VkResult res = vkCreateQueryPool(device, &createInfo,
+                                     pVulkanAllocationCallbacks,
+                                     &pProfiler->pFrames[i].queryPool);
+    if (res != VK_SUCCESS) {
+      LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "failed to create query pool: %s",
+                     vkstrerror(res));
+      pProfiler->frameCount = i;
+      delete_GpuProfiler(pProfiler, device);
+      return (ERR_UNKNOWN);
+    }
+    pProfiler->pFrames[i].scopeCount = 0;
+    pProfiler->pFrames[i].frameNumber = -1;
+    pProfiler->pFrames[i].statisticsQueryPool = VK_NULL_HANDLE;
+    pProfiler->pFrames[i].statisticsRecorded = false;
+
+    if (pProfiler->pipelineStatistics) {
+      VkQueryPoolCreateInfo statisticsCreateInfo = {0};
+      statisticsCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+      statisticsCreateInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+      statisticsCreateInfo.queryCount = 1;
+      statisticsCreateInfo.pipelineStatistics = statisticFlags;
+      res = vkCreateQueryPool(device, &statisticsCreateInfo,
+                              pVulkanAllocationCallbacks,
+                              &pProfiler->pFrames[i].statisticsQueryPool);
+      if (res != VK_SUCCESS) {
+        LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "failed to create query pool: %s",
+                       vkstrerror(res));
+        pProfiler->pFrames[i].statisticsQueryPool = VK_NULL_HANDLE;
+        pProfiler->frameCount = i + 1;
+        delete_GpuProfiler(pProfiler, device);
+        return (ERR_UNKNOWN);
+      }
+    }
+  }
+
+  pProfiler->pStream = openCsv(pStreamPath, "frame,scope,gpu_ms");
+  if (pProfiler->pipelineStatistics) {
+    pProfiler->pStatisticsStream = openCsv(
+        pStatisticsStreamPath, "frame,ia_vertices,ia_primitives,vs_invocations,"
+                               "clip_invocations,clip_primitives,fs_invocations");
+  }
+  return (ERR_OK);
+}
+
+void delete_GpuProfiler(GpuProfiler *pProfiler, const VkDevice device) {
+  for (uint32_t i = 0; i < pProfiler->frameCount; i++) {
+    vkDestroyQueryPool(device, pProfiler->pFrames[i].queryPool,
+                       pVulkanAllocationCallbacks);
+    vkDestroyQueryPool(device, pProfiler->pFrames[i].statisticsQueryPool,
+                       pVulkanAllocationCallbacks);
+  }
+  free(pProfiler->pFrames);
+  pProfiler->pFrames = NULL;
+  pProfiler->frameCount = 0;
+  if (pProfiler->pStream != NULL) {
+    fclose(pProfiler->pStream);
+    pProfiler->pStream = NULL;
+  }
+  if (pProfiler->pStatisticsStream != NULL) {
+    fclose(pProfiler->pStatisticsStream);
+    pProfiler->pStatisticsStream = NULL;
+  }
+}
+
+// finds or creates the summary for scopes called `name`
+static GpuProfilerStat *getStat(GpuProfiler *pProfiler, const char *name) {
+  for (uint32_t i = 0; i < pProfiler->statCount; i++) {
+    GpuProfilerStat *pStat = &pProfiler->pStats[i];
+    if (pStat->name == name || strcmp(pStat->name, name) == 0) {
+      return (pStat);
+    }
+  }
+  if (pProfiler->statCount == GPU_PROFILER_MAX_SCOPES) {
+    return (NULL);
+  }
+  GpuProfilerStat *pStat = &pProfiler->pStats[pProfiler->statCount++];
+  pStat->name = name;
+  pStat->count = 0;
+  pStat->totalMs = 0;
+  pStat->maxMs = 0;
+  return (pStat);
+}
+
+// reads back the pipeline statistics of a frame whose command buffers have
+// completed
+static void resolveStatistics(GpuProfiler *pProfiler, GpuProfilerFrame *pFrame,
+                              const VkDevice device) {
+  if (!pFrame->statisticsRecorded) {
+    return;
+  }
+
+  uint64_t pCounters[GPU_STATISTIC_COUNT];
+  VkResult res = vkGetQueryPoolResults(
+      device, pFrame->statisticsQueryPool, 0, 1, sizeof(pCounters), pCounters,
+      sizeof(pCounters), VK_QUERY_RESULT_64_BIT);
+  if (res != VK_SUCCESS) {
+    LOG_ERROR_ARGS(ERR_LEVEL_WARN, "dropping pipeline statistics: %s",
+                   vkstrerror(res));
+    return;
+  }
+
+  pProfiler->lastStatistics.frameNumber = pFrame->frameNumber;
+  pProfiler->statisticsFrameCount++;
+  for (uint32_t i = 0; i < GPU_STATISTIC_COUNT; i++) {
+    pProfiler->lastStatistics.pCounters[i] = pCounters[i];
+    pProfiler->pStatisticsTotals[i] += pCounters[i];
+    if (pCounters[i] > pProfiler->pStatisticsMaxes[i]) {
+      pProfiler->pStatisticsMaxes[i] = pCounters[i];
+    }
+  }
+
+  if (pProfiler->pStatisticsStream != NULL) {
+    fprintf(pProfiler->pStatisticsStream, "%lld",
+            (long long)pFrame->frameNumber);
+    for (uint32_t i = 0; i < GPU_STATISTIC_COUNT; i++) {
+      fprintf(pProfiler->pStatisticsStream, ",%llu",
+              (unsigned long long)pCounters[i]);
+    }
+    fprintf(pProfiler->pStatisticsStream, "\n");
+  }
+}
+
+// reads back all scopes in a frame whose command buffers have completed
+static void resolveFrame(GpuProfiler *pProfiler, GpuProfilerFrame *pFrame,
+                         const VkDevice device) {
+  resolveStatistics(pProfiler, pFrame, device);
+  pFrame->statisticsRecorded = false;
+
+  if (pFrame->scopeCount == 0) {
+    return;
+  }
+
+  uint64_t pTimestamps[GPU_PROFILER_MAX_SCOPES * 2];
+  uint32_t queryCount = pFrame->scopeCount * 2;
+  // no WAIT bit: the frame's fence has signaled, so this never stalls
+  VkResult res = vkGetQueryPoolResults(
+      device, pFrame->queryPool, 0, queryCount, sizeof(pTimestamps),
+      pTimestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+  if (res != VK_SUCCESS) {
+    LOG_ERROR_ARGS(ERR_LEVEL_WARN, "dropping gpu timestamps: %s",
+                   vkstrerror(res));
+    return;
+  }
+
+  for (uint32_t i = 0; i < pFrame->scopeCount; i++) {
+    uint64_t ticks = (pTimestamps[i * 2 + 1] - pTimestamps[i * 2]) &
+                     pProfiler->timestampMask;
+    double ms = (double)ticks * pProfiler->timestampPeriod / 1e6;
+
+    GpuProfilerStat *pStat = getStat(pProfiler, pFrame->pScopeNames[i]);
+    if (pStat != NULL) {
+      pStat->count++;
+      pStat->totalMs += ms;
+      if (ms > pStat->maxMs) {
+        pStat->maxMs = ms;
+      }
+    }
+
+    if (pProfiler->pStream != NULL) {
+      fprintf(pProfiler->pStream, "%lld,%s,%.6f\n",
+              (long long)pFrame->frameNumber, pFrame->pScopeNames[i], ms);
+    }
+  }
+}
+
+void gpuProfilerBeginFrame(GpuProfiler *pProfiler, const uint32_t frameIndex,
+                           const uint32_t frameNumber, const VkDevice device) {
+  if (pProfiler == NULL) {
+    return;
+  }
+  GpuProfilerFrame *pFrame = &pProfiler->pFrames[frameIndex];
+  resolveFrame(pProfiler, pFrame, device);
+  pFrame->scopeCount = 0;
+  pFrame->frameNumber = frameNumber;
+  pProfiler->currentFrame = frameIndex;
+}
+
+void gpuProfilerResolveAll(GpuProfiler *pProfiler, const VkDevice device) {
+  if (pProfiler == NULL) {
+    return;
+  }
+  for (uint32_t i = 0; i < pProfiler->frameCount; i++) {
+    resolveFrame(pProfiler, &pProfiler->pFrames[i], device);
+    pProfiler->pFrames[i].scopeCount = 0;
+  }
+}
+
+uint32_t gpuProfilerBeginScope(GpuProfiler *pProfiler,
+                               const VkCommandBuffer commandBuffer,
+                               const char *name) {
+  if (pProfiler == NULL) {
+    return (GPU_PROFILER_NO_SCOPE);
+  }
+  GpuProfilerFrame *pFrame = &pProfiler->pFrames[pProfiler->currentFrame];
+  if (pFrame->scopeCount == GPU_PROFILER_MAX_SCOPES) {
+    LOG_ERROR_ARGS(ERR_LEVEL_WARN, "out of gpu profiler scopes, skipping %s",
+                   name);
+    return (GPU_PROFILER_NO_SCOPE);
+  }
+  uint32_t scope = pFrame->scopeCount++;
+  pFrame->pScopeNames[scope] = name;
+
+  // each scope resets its own pair of queries, so no host reset is needed and
+  // scopes can go in any command buffer
+  vkCmdResetQueryPool(commandBuffer, pFrame->queryPool, scope * 2, 2);
+  vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                      pFrame->queryPool, scope * 2);
+  return (scope);
+}
+
+void gpuProfilerEndScope(GpuProfiler *pProfiler,
+                         const VkCommandBuffer commandBuffer,
+                         const uint32_t scope) {
+  if (pProfiler == NULL || scope == GPU_PROFILER_NO_SCOPE) {
+    return;
+  }
+  GpuProfilerFrame *pFrame = &pProfiler->pFrames[pProfiler->currentFrame];
+  vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                      pFrame->queryPool, scope * 2 + 1);
+}
+
+void gpuProfilerBeginStatistics(GpuProfiler *pProfiler,
+                                const VkCommandBuffer commandBuffer) {
+  if (pProfiler == NULL || !pProfiler->pipelineStatistics) {
+    return;
+  }
+  GpuProfilerFrame *pFrame = &pProfiler->pFrames[pProfiler->currentFrame];
+  vkCmdResetQueryPool(commandBuffer, pFrame->statisticsQueryPool, 0, 1);
+  vkCmdBeginQuery(commandBuffer, pFrame->statisticsQueryPool, 0, 0);
+}
+
+void gpuProfilerEndStatistics(GpuProfiler *pProfiler,
+                              const VkCommandBuffer commandBuffer) {
+  if (pProfiler == NULL || !pProfiler->pipelineStatistics) {
+    return;
+  }
+  GpuProfilerFrame *pFrame = &pProfiler->pFrames[pProfiler->currentFrame];
+  vkCmdEndQuery(commandBuffer, pFrame->statisticsQueryPool, 0);
+  pFrame->statisticsRecorded = true;
+}
+
+ErrVal gpuProfilerGetStatistics(const GpuProfiler *pProfiler,
+                                GpuPipelineStatistics *pStatistics) {
+  if (pProfiler == NULL || pProfiler->statisticsFrameCount == 0) {
+    return (ERR_NOTSUPPORTED);
+  }
+  *pStatistics = pProfiler->lastStatistics;
+  return (ERR_OK);
+}
+
+void gpuProfilerPrintSummary(const GpuProfiler *pProfiler) {
+  if (pProfiler == NULL) {
+    return;
+  }
+  printf("%-24s %10s %12s %12s\n", "gpu scope", "count", "mean_ms", "max_ms");
+  for (uint32_t i = 0; i < pProfiler->statCount; i++) {
+    const GpuProfilerStat *pStat = &pProfiler->pStats[i];
+    printf("%-24s %10llu %12.4f %12.4f\n", pStat->name,
+           (unsigned long long)pStat->count,
+           pStat->totalMs / (double)pStat->count, pStat->maxMs);
+  }
+
+  if (pProfiler->statisticsFrameCount == 0) {
+    return;
+  }
+  printf("%-24s %10s %12s %12s\n", "pipeline statistic", "frames", "mean",
+         "max");
+  for (uint32_t i = 0; i < GPU_STATISTIC_COUNT; i++) {
+    printf("%-24s %10llu %12.1f %12llu\n", statisticNames[i],
+           (unsigned long long)pProfiler->statisticsFrameCount,
+           (double)pProfiler->pStatisticsTotals[i] /
+               (double)pProfiler->statisticsFrameCount,
+           (unsigned long long)pProfiler->pStatisticsMaxes[i]);
+  }
+}
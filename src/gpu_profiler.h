@@ -0,0 +1,187 @@
+#ifndef SRC_GPU_PROFILER_H_
+#define SRC_GPU_PROFILER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <vulkan/vulkan.h>
+
+#include "errors.h"
+
+// maximum number of scopes that can be opened per frame in flight
+#define GPU_PROFILER_MAX_SCOPES 64
+
+// returned by gpuProfilerBeginScope when the scope isn't recorded
+#define GPU_PROFILER_NO_SCOPE UINT32_MAX
+
+// The pipeline statistics counted for each frame
+typedef enum {
+  GPU_STATISTIC_INPUT_ASSEMBLY_VERTICES = 0,
+  GPU_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES = 1,
+  GPU_STATISTIC_VERTEX_SHADER_INVOCATIONS = 2,
+  GPU_STATISTIC_CLIPPING_INVOCATIONS = 3,
+  GPU_STATISTIC_CLIPPING_PRIMITIVES = 4,
+  GPU_STATISTIC_FRAGMENT_SHADER_INVOCATIONS = 5,
+  GPU_STATISTIC_COUNT = 6,
+} GpuStatistic;
+
+// Counters for all the work done between gpuProfilerBeginStatistics and
+// gpuProfilerEndStatistics in one frame
+typedef struct {
+  // the frame number the counters were recorded in
+  int64_t frameNumber;
+  uint64_t pCounters[GPU_STATISTIC_COUNT];
+} GpuPipelineStatistics;
+
+// Timestamp queries written during one frame in flight
+typedef struct {
+  // holds a begin and end timestamp for every scope
+  VkQueryPool queryPool;
+  // number of scopes opened since this frame was last resolved
+  uint32_t scopeCount;
+  // the name of each scope, must be string literals or otherwise outlive the
+  // profiler
+  const char *pScopeNames[GPU_PROFILER_MAX_SCOPES];
+  // the frame number the scopes were recorded in, -1 before the first frame
+  int64_t frameNumber;
+  // holds a single pipeline statistics query, VK_NULL_HANDLE if disabled
+  VkQueryPool statisticsQueryPool;
+  // whether the statistics query was written since this frame was last resolved
+  bool statisticsRecorded;
+} GpuProfilerFrame;
+
+// Accumulated GPU time for every scope with the same name
+typedef struct {
+  const char *name;
+  uint64_t count;
+  double totalMs;
+  double maxMs;
+} GpuProfilerStat;
+
+// Measures the GPU time between pairs of points in command buffers
+typedef struct {
+  // one per frame in flight
+  GpuProfilerFrame *pFrames;
+  uint32_t frameCount;
+  // the frame that new scopes are recorded into
+  uint32_t currentFrame;
+  // nanoseconds per timestamp tick
+  double timestampPeriod;
+  // timestamps only have this many valid bits
+  uint64_t timestampMask;
+  // summary of every resolved scope
+  GpuProfilerStat pStats[GPU_PROFILER_MAX_SCOPES];
+  uint32_t statCount;
+  // if not NULL, every resolved scope is written here as a CSV row
+  FILE *pStream;
+  // whether pipeline statistics are being collected
+  bool pipelineStatistics;
+  // counters of the most recently resolved frame
+  GpuPipelineStatistics lastStatistics;
+  // sum and max of every resolved frame's counters
+  uint64_t statisticsFrameCount;
+  uint64_t pStatisticsTotals[GPU_STATISTIC_COUNT];
+  uint64_t pStatisticsMaxes[GPU_STATISTIC_COUNT];
+  // if not NULL, every resolved frame's counters are written here as CSV
+  FILE *pStatisticsStream;
+} GpuProfiler;
+
+/// Creates a new GPU profiler with one timestamp query pool per frame in
+/// flight
+/// --- PRECONDITIONS ---
+/// * `pProfiler` is a valid pointer
+/// * `queueFamilyIndex` is the queue family that profiled command buffers are
+/// submitted to
+/// * `pStreamPath` is NULL or a path to write per frame results to as CSV
+/// * if `pipelineStatistics` is true, `device` was created by `new_Device`
+/// * `pStatisticsStreamPath` is NULL or a path to write per frame pipeline
+/// statistics to as CSV
+/// --- POSTCONDITIONS ---
+/// * returns error status
+/// * returns ERR_NOTSUPPORTED if the queue family can't write timestamps
+/// * if the device doesn't support pipeline statistics queries, they are left
+/// disabled with a warning
+/// --- CLEANUP ---
+/// * call `delete_GpuProfiler`
+ErrVal new_GpuProfiler(                    //
+    GpuProfiler *pProfiler,                //
+    const uint32_t frameCount,             //
+    const VkPhysicalDevice physicalDevice, //
+    const uint32_t queueFamilyIndex,       //
+    const VkDevice device,                 //
+    const char *pStreamPath,               //
+    const bool pipelineStatistics,         //
+    const char *pStatisticsStreamPath      //
+);
+
+void delete_GpuProfiler(GpuProfiler *pProfiler, const VkDevice device);
+
+/// Reads back the timestamps written the last time `frameIndex` was used, and
+/// starts recording new scopes into it
+/// --- PRECONDITIONS ---
+/// * `pProfiler` is NULL or was created by `new_GpuProfiler`
+/// * every command buffer that recorded scopes into `frameIndex` has finished
+/// executing, i.e. that frame's fence has been waited on
+/// --- POSTCONDITIONS ---
+/// * never waits on the GPU
+/// * does nothing if `pProfiler` is NULL
+void gpuProfilerBeginFrame(GpuProfiler *pProfiler, const uint32_t frameIndex,
+                           const uint32_t frameNumber, const VkDevice device);
+
+/// Writes the starting timestamp of a named scope into `commandBuffer`
+/// --- PRECONDITIONS ---
+/// * `pProfiler` is NULL or was created by `new_GpuProfiler`
+/// * `commandBuffer` is recording and is not inside a render pass
+/// * `name` outlives the profiler
+/// --- POSTCONDITIONS ---
+/// * returns the scope to pass to `gpuProfilerEndScope`, or
+/// GPU_PROFILER_NO_SCOPE if `pProfiler` is NULL or out of scopes
+uint32_t gpuProfilerBeginScope(GpuProfiler *pProfiler,
+                               const VkCommandBuffer commandBuffer,
+                               const char *name);
+
+/// Writes the ending timestamp of a scope into `commandBuffer`
+/// --- PRECONDITIONS ---
+/// * `scope` was returned by `gpuProfilerBeginScope` during the current frame
+/// * `commandBuffer` is the one passed to `gpuProfilerBeginScope`, or is
+/// submitted after it to the same queue
+void gpuProfilerEndScope(GpuProfiler *pProfiler,
+                         const VkCommandBuffer commandBuffer,
+                         const uint32_t scope);
+
+/// Starts counting pipeline statistics for the current frame
+/// --- PRECONDITIONS ---
+/// * `pProfiler` is NULL or was created by `new_GpuProfiler`
+/// * `commandBuffer` is recording and is not inside a render pass
+/// * called at most once per frame
+/// --- POSTCONDITIONS ---
+/// * does nothing if `pProfiler` is NULL or statistics are disabled
+void gpuProfilerBeginStatistics(GpuProfiler *pProfiler,
+                                const VkCommandBuffer commandBuffer);
+
+/// Stops counting pipeline statistics for the current frame
+/// --- PRECONDITIONS ---
+/// * `commandBuffer` is the one passed to `gpuProfilerBeginStatistics`, and is
+/// not inside a render pass
+void gpuProfilerEndStatistics(GpuProfiler *pProfiler,
+                              const VkCommandBuffer commandBuffer);
+
+/// Gets the pipeline statistics of the most recently resolved frame
+/// --- POSTCONDITIONS ---
+/// * returns ERR_NOTSUPPORTED if `pProfiler` is NULL, statistics are disabled,
+/// or no frame has been resolved yet
+/// * on success, sets `*pStatistics` to the counters of that frame
+ErrVal gpuProfilerGetStatistics(const GpuProfiler *pProfiler,
+                                GpuPipelineStatistics *pStatistics);
+
+/// Reads back every frame that still has unresolved scopes
+/// --- PRECONDITIONS ---
+/// * all profiled command buffers have finished, e.g. after vkDeviceWaitIdle
+void gpuProfilerResolveAll(GpuProfiler *pProfiler, const VkDevice device);
+
+/// Prints count, mean and max GPU time of every scope to stdout, followed by
+/// the mean and max of every pipeline statistic per frame
+void gpuProfilerPrintSummary(const GpuProfiler *pProfiler);
+
+#endif // SRC_GPU_PROFILER_H_
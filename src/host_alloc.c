@@ -0,0 +1,173 @@
+#include "host_alloc.h"
+
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+const VkAllocationCallbacks *pVulkanAllocationCallbacks = NULL;
+
+static const char *pScopeNames[HOST_ALLOC_SCOPE_COUNT] = {
+    "command", "object", "cache", "device", "instance"};
+
+// stored right before every allocation, so frees know what to subtract
+typedef struct {
+  void *pBase;
+  size_t size;
+  size_t scope;
+} HostAllocHeader;
+
+static HostAllocScopeStats *scopeStats(HostAllocTracker *pTracker,
+                                       const VkSystemAllocationScope scope) {
+  return (&pTracker->pScopes[(uint32_t)scope < HOST_ALLOC_SCOPE_COUNT
+                                 ? (uint32_t)scope
+                                 : HOST_ALLOC_SCOPE_COUNT - 1]);
+}
+
+static void recordAllocation(HostAllocScopeStats *pStats, const size_t size) {
+  __atomic_fetch_add(&pStats->allocationCount, 1, __ATOMIC_RELAXED);
+  uint64_t live =
+      __atomic_add_fetch(&pStats->liveBytes, (uint64_t)size, __ATOMIC_RELAXED);
+  uint64_t peak = __atomic_load_n(&pStats->peakBytes, __ATOMIC_RELAXED);
+  while (live > peak &&
+         !__atomic_compare_exchange_n(&pStats->peakBytes, &peak, live, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+  }
+}
+
+static void recordFree(HostAllocScopeStats *pStats, const size_t size) {
+  __atomic_fetch_add(&pStats->freeCount, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_sub(&pStats->liveBytes, (uint64_t)size, __ATOMIC_RELAXED);
+}
+
+static HostAllocHeader *headerOf(void *pMemory) {
+  return ((HostAllocHeader *)pMemory - 1);
+}
+
+static VKAPI_ATTR void *VKAPI_CALL
+trackedAllocation(void *pUserData, size_t size, size_t alignment,
+                  VkSystemAllocationScope scope) {
+  // the header sits right before the aligned pointer, so it needs its own
+  // alignment too
+  if (alignment < alignof(max_align_t)) {
+    alignment = alignof(max_align_t);
+  }
+  uint8_t *pBase = malloc(sizeof(HostAllocHeader) + alignment - 1 + size);
+  if (!pBase) {
+    return (NULL);
+  }
+  uintptr_t start = (uintptr_t)(pBase + sizeof(HostAllocHeader));
+  void *pMemory =
+      (void *)((start + alignment - 1) & ~(uintptr_t)(alignment - 1));
+
+  HostAllocHeader *pHeader = headerOf(pMemory);
+  pHeader->pBase = pBase;
+  pHeader->size = size;
+  pHeader->scope = (size_t)scope;
+  recordAllocation(scopeStats(pUserData, scope), size);
+  return (pMemory);
+}
+
+static VKAPI_ATTR void VKAPI_CALL trackedFree(void *pUserData, void *pMemory) {
+  if (pMemory == NULL) {
+    return;
+  }
+  HostAllocHeader *pHeader = headerOf(pMemory);
+  recordFree(scopeStats(pUserData, (VkSystemAllocationScope)pHeader->scope),
+             pHeader->size);
+  free(pHeader->pBase);
+}
+
+static VKAPI_ATTR void *VKAPI_CALL
+trackedReallocation(void *pUserData, void *pOriginal, size_t size,
+                    size_t alignment, VkSystemAllocationScope scope) {
+  if (pOriginal == NULL) {
+    return (trackedAllocation(pUserData, size, alignment, scope));
+  }
+  if (size == 0) {
+    trackedFree(pUserData, pOriginal);
+    return (NULL);
+  }
+  // the alignment has to be kept, which realloc can't promise
+  void *pMemory = trackedAllocation(pUserData, size, alignment, scope);
+  if (!pMemory) {
+    return (NULL);
+  }
+  size_t originalSize = headerOf(pOriginal)->size;
+  memcpy(pMemory, pOriginal, originalSize < size ? originalSize : size);
+  trackedFree(pUserData, pOriginal);
+  return (pMemory);
+}
+
+static VKAPI_ATTR void VKAPI_CALL
+trackedInternalAllocation(void *pUserData, size_t size,
+                          UNUSED VkInternalAllocationType allocationType,
+                          UNUSED VkSystemAllocationScope scope) {
+  HostAllocTracker *pTracker = pUserData;
+  __atomic_fetch_add(&pTracker->internalBytes, (uint64_t)size,
+                     __ATOMIC_RELAXED);
+}
+
+static VKAPI_ATTR void VKAPI_CALL
+trackedInternalFree(void *pUserData, size_t size,
+                    UNUSED VkInternalAllocationType allocationType,
+                    UNUSED VkSystemAllocationScope scope) {
+  HostAllocTracker *pTracker = pUserData;
+  __atomic_fetch_sub(&pTracker->internalBytes, (uint64_t)size,
+                     __ATOMIC_RELAXED);
+}
+
+ErrVal new_HostAllocTracker(HostAllocTracker *pTracker) {
+  *pTracker = (HostAllocTracker){0};
+  pTracker->callbacks.pUserData = pTracker;
+  pTracker->callbacks.pfnAllocation = trackedAllocation;
+  pTracker->callbacks.pfnReallocation = trackedReallocation;
+  pTracker->callbacks.pfnFree = trackedFree;
+  pTracker->callbacks.pfnInternalAllocation = trackedInternalAllocation;
+  pTracker->callbacks.pfnInternalFree = trackedInternalFree;
+  return (ERR_OK);
+}
+
+void hostAllocTrackerEnable(HostAllocTracker *pTracker) {
+  pVulkanAllocationCallbacks = &pTracker->callbacks;
+}
+
+void hostAllocTrackerPrintFrame(HostAllocTracker *pTracker,
+                                const uint64_t frameNumber) {
+  uint64_t frames = frameNumber > pTracker->reportedFrame
+                        ? frameNumber - pTracker->reportedFrame
+                        : 1;
+  printf("host allocations per frame:");
+  for (uint32_t i = 0; i < HOST_ALLOC_SCOPE_COUNT; i++) {
+    uint64_t count = __atomic_load_n(&pTracker->pScopes[i].allocationCount,
+                                     __ATOMIC_RELAXED);
+    uint64_t live =
+        __atomic_load_n(&pTracker->pScopes[i].liveBytes, __ATOMIC_RELAXED);
+    printf(" %s %.1f (%llu KiB live)", pScopeNames[i],
+           (double)(count - pTracker->pReportedAllocationCounts[i]) /
+               (double)frames,
+           (unsigned long long)(live / 1024));
+    pTracker->pReportedAllocationCounts[i] = count;
+  }
+  printf(" internal %llu KiB\n",
+         (unsigned long long)(__atomic_load_n(&pTracker->internalBytes,
+                                              __ATOMIC_RELAXED) /
+                              1024));
+  pTracker->reportedFrame = frameNumber;
+}
+
+void hostAllocTrackerPrintSummary(const HostAllocTracker *pTracker) {
+  printf("host allocations:\n");
+  for (uint32_t i = 0; i < HOST_ALLOC_SCOPE_COUNT; i++) {
+    const HostAllocScopeStats *pStats = &pTracker->pScopes[i];
+    printf("  %-8s %10llu allocations %10llu frees %8llu KiB live %8llu KiB "
+           "peak\n",
+           pScopeNames[i], (unsigned long long)pStats->allocationCount,
+           (unsigned long long)pStats->freeCount,
+           (unsigned long long)(pStats->liveBytes / 1024),
+           (unsigned long long)(pStats->peakBytes / 1024));
+  }
+}
@@ -0,0 +1,61 @@
+#ifndef SRC_HOST_ALLOC_H_
+#define SRC_HOST_ALLOC_H_
+
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+#include "errors.h"
+
+// one per VkSystemAllocationScope, from command to instance
+#define HOST_ALLOC_SCOPE_COUNT 5
+
+// passed to every vkCreate*, vkDestroy*, vkAllocateMemory and vkFreeMemory
+// NULL unless hostAllocTrackerEnable has been called, so the driver allocates
+// on its own
+extern const VkAllocationCallbacks *pVulkanAllocationCallbacks;
+
+// Host memory the driver has allocated in one scope
+typedef struct {
+  // allocations and reallocations
+  uint64_t allocationCount;
+  uint64_t freeCount;
+  uint64_t liveBytes;
+  uint64_t peakBytes;
+} HostAllocScopeStats;
+
+// Tracks the host memory the driver allocates through VkAllocationCallbacks
+// Drivers may allocate from any thread, so counters are updated atomically.
+typedef struct {
+  VkAllocationCallbacks callbacks;
+  HostAllocScopeStats pScopes[HOST_ALLOC_SCOPE_COUNT];
+  // memory the driver allocated itself and told us about, e.g. executable code
+  uint64_t internalBytes;
+  // allocation counts of each scope as of the last report
+  uint64_t pReportedAllocationCounts[HOST_ALLOC_SCOPE_COUNT];
+  uint64_t reportedFrame;
+} HostAllocTracker;
+
+/// Creates a new tracker
+/// --- PRECONDITIONS ---
+/// * `pTracker` is a valid pointer
+/// --- POSTCONDITIONS ---
+/// * returns error status
+/// * `pTracker->callbacks` allocate from the C heap and record into it
+ErrVal new_HostAllocTracker(HostAllocTracker *pTracker);
+
+/// Makes `pVulkanAllocationCallbacks` point to the tracker's callbacks
+/// --- PRECONDITIONS ---
+/// * called before the instance is created, and the tracker outlives it, since
+/// every object must be freed with the callbacks it was created with
+void hostAllocTrackerEnable(HostAllocTracker *pTracker);
+
+/// Prints the allocations made in every scope since the last report, averaged
+/// over the frames in between, and the live bytes of every scope
+void hostAllocTrackerPrintFrame(HostAllocTracker *pTracker,
+                                const uint64_t frameNumber);
+
+/// Prints the total allocations and peak bytes of every scope
+void hostAllocTrackerPrintSummary(const HostAllocTracker *pTracker);
+
+#endif // SRC_HOST_ALLOC_H_
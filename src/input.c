@@ -0,0 +1,129 @@
+#include "input.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+// input logs start with this, followed by a little endian uint16 version and
+// a reserved uint16, then (state, run length) pairs of uint16s
+static const char inputLogMagic[4] = {'V', 'T', 'I', 'N'};
+#define INPUT_LOG_VERSION 1
+
+// maps each InputKey to the GLFW key it comes from
+static const struct {
+  InputKey key;
+  int glfwKey;
+} inputKeyBindings[] = {
+    {INPUT_KEY_W, GLFW_KEY_W},       {INPUT_KEY_S, GLFW_KEY_S},
+    {INPUT_KEY_A, GLFW_KEY_A},       {INPUT_KEY_D, GLFW_KEY_D},
+    {INPUT_KEY_Q, GLFW_KEY_Q},       {INPUT_KEY_E, GLFW_KEY_E},
+    {INPUT_KEY_UP, GLFW_KEY_UP},     {INPUT_KEY_DOWN, GLFW_KEY_DOWN},
+    {INPUT_KEY_LEFT, GLFW_KEY_LEFT}, {INPUT_KEY_RIGHT, GLFW_KEY_RIGHT},
+};
+
+InputState pollInputState(GLFWwindow *pWindow) {
+  InputState state = 0;
+  for (size_t i = 0; i < sizeof(inputKeyBindings) / sizeof(inputKeyBindings[0]);
+       i++) {
+    if (glfwGetKey(pWindow, inputKeyBindings[i].glfwKey) == GLFW_PRESS) {
+      state |= (InputState)inputKeyBindings[i].key;
+    }
+  }
+  return (state);
+}
+
+// the log is little endian regardless of platform
+static void writeUint16(FILE *fp, const uint16_t value) {
+  uint8_t bytes[2] = {(uint8_t)(value & 0xFF), (uint8_t)(value >> 8)};
+  fwrite(bytes, 1, 2, fp);
+}
+
+static bool readUint16(FILE *fp, uint16_t *pValue) {
+  uint8_t bytes[2];
+  if (fread(bytes, 1, 2, fp) != 2) {
+    return (false);
+  }
+  *pValue = (uint16_t)(bytes[0] | (bytes[1] << 8));
+  return (true);
+}
+
+ErrVal new_InputRecorder(InputRecorder *pRecorder, const char *path) {
+  pRecorder->fp = fopen(path, "wb");
+  if (!pRecorder->fp) {
+    LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "could not open %s: %s", path,
+                   strerror(errno));
+    return (ERR_UNKNOWN);
+  }
+  fwrite(inputLogMagic, 1, sizeof(inputLogMagic), pRecorder->fp);
+  writeUint16(pRecorder->fp, INPUT_LOG_VERSION);
+  writeUint16(pRecorder->fp, 0);
+  pRecorder->runState = 0;
+  pRecorder->runLength = 0;
+  return (ERR_OK);
+}
+
+static void flushRun(InputRecorder *pRecorder) {
+  if (pRecorder->runLength == 0) {
+    return;
+  }
+  writeUint16(pRecorder->fp, pRecorder->runState);
+  writeUint16(pRecorder->fp, pRecorder->runLength);
+  pRecorder->runLength = 0;
+}
+
+void delete_InputRecorder(InputRecorder *pRecorder) {
+  flushRun(pRecorder);
+  fclose(pRecorder->fp);
+  pRecorder->fp = NULL;
+}
+
+void inputRecorderPush(InputRecorder *pRecorder, const InputState state) {
+  if (state != pRecorder->runState || pRecorder->runLength == UINT16_MAX) {
+    flushRun(pRecorder);
+    pRecorder->runState = state;
+  }
+  pRecorder->runLength++;
+}
+
+ErrVal new_InputReplayer(InputReplayer *pReplayer, const char *path) {
+  pReplayer->fp = fopen(path, "rb");
+  if (!pReplayer->fp) {
+    LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "could not open %s: %s", path,
+                   strerror(errno));
+    return (ERR_UNKNOWN);
+  }
+  char magic[4];
+  uint16_t version;
+  uint16_t reserved;
+  if (fread(magic, 1, sizeof(magic), pReplayer->fp) != sizeof(magic) ||
+      memcmp(magic, inputLogMagic, sizeof(magic)) != 0 ||
+      !readUint16(pReplayer->fp, &version) ||
+      !readUint16(pReplayer->fp, &reserved) || version != INPUT_LOG_VERSION) {
+    LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "%s is not an input log", path);
+    fclose(pReplayer->fp);
+    pReplayer->fp = NULL;
+    return (ERR_BADARGS);
+  }
+  pReplayer->runState = 0;
+  pReplayer->runLength = 0;
+  return (ERR_OK);
+}
+
+void delete_InputReplayer(InputReplayer *pReplayer) {
+  fclose(pReplayer->fp);
+  pReplayer->fp = NULL;
+}
+
+bool inputReplayerNext(InputReplayer *pReplayer, InputState *pState) {
+  while (pReplayer->runLength == 0) {
+    if (!readUint16(pReplayer->fp, &pReplayer->runState) ||
+        !readUint16(pReplayer->fp, &pReplayer->runLength)) {
+      pReplayer->runLength = 0;
+      *pState = 0;
+      return (false);
+    }
+  }
+  pReplayer->runLength--;
+  *pState = pReplayer->runState;
+  return (true);
+}
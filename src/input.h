@@ -0,0 +1,84 @@
+#ifndef SRC_INPUT_H_
+#define SRC_INPUT_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <vulkan/vulkan.h>
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include "errors.h"
+
+// The keys that control the app, as bits of an InputState
+typedef enum {
+  INPUT_KEY_W = 1 << 0,
+  INPUT_KEY_S = 1 << 1,
+  INPUT_KEY_A = 1 << 2,
+  INPUT_KEY_D = 1 << 3,
+  INPUT_KEY_Q = 1 << 4,
+  INPUT_KEY_E = 1 << 5,
+  INPUT_KEY_UP = 1 << 6,
+  INPUT_KEY_DOWN = 1 << 7,
+  INPUT_KEY_LEFT = 1 << 8,
+  INPUT_KEY_RIGHT = 1 << 9,
+} InputKey;
+
+// The set of InputKeys held down during one frame
+typedef uint16_t InputState;
+
+// Writes one InputState per frame to a file
+// Runs of identical frames are stored once, so held keys and idle stretches
+// take up 4 bytes each
+typedef struct {
+  FILE *fp;
+  // the state being repeated, and how many frames it has been repeated for
+  InputState runState;
+  uint16_t runLength;
+} InputRecorder;
+
+// Reads back the InputStates written by an InputRecorder
+typedef struct {
+  FILE *fp;
+  InputState runState;
+  // frames left in the current run
+  uint16_t runLength;
+} InputReplayer;
+
+/// Returns the InputKeys currently held down in `pWindow`
+InputState pollInputState(GLFWwindow *pWindow);
+
+/// Creates a new input recorder that writes to `path`
+/// --- PRECONDITIONS ---
+/// * `pRecorder` is a valid pointer
+/// --- POSTCONDITIONS ---
+/// * returns error status
+/// --- CLEANUP ---
+/// * call `delete_InputRecorder`, which also finishes writing the file
+ErrVal new_InputRecorder(InputRecorder *pRecorder, const char *path);
+
+void delete_InputRecorder(InputRecorder *pRecorder);
+
+/// Appends the state of the next frame
+void inputRecorderPush(InputRecorder *pRecorder, const InputState state);
+
+/// Creates a new input replayer reading from `path`
+/// --- PRECONDITIONS ---
+/// * `pReplayer` is a valid pointer
+/// --- POSTCONDITIONS ---
+/// * returns error status
+/// * returns ERR_BADARGS if `path` was not written by an InputRecorder
+/// --- CLEANUP ---
+/// * call `delete_InputReplayer`
+ErrVal new_InputReplayer(InputReplayer *pReplayer, const char *path);
+
+void delete_InputReplayer(InputReplayer *pReplayer);
+
+/// Reads the state of the next frame
+/// --- POSTCONDITIONS ---
+/// * returns whether there was a frame left in the recording
+/// * if not, sets `*pState` to no keys held
+bool inputReplayerNext(InputReplayer *pReplayer, InputState *pState);
+
+#endif // SRC_INPUT_H_
@@ -0,0 +1,147 @@
+#include "instances.h"
+
+#include <math.h>
+#include <stdint.h>
+
+// gap between neighbouring copies, as a fraction of the mesh size
+#define INSTANCE_GRID_SPACING 1.5f
+
+ErrVal new_InstanceBuffer(InstanceBuffer *pInstances,
+                          const InstanceData *pData,
+                          const uint32_t instanceCount, Allocator *pAllocator,
+                          AsyncUploader *pUploader) {
+  ErrVal retVal = new_Buffer_Upload(
+      &pInstances->buffer, &pInstances->allocation, pAllocator, pUploader,
+      pData, sizeof(InstanceData) * instanceCount,
+      VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+      VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_SHADER_READ_BIT, NULL);
+  if (retVal != ERR_OK) {
+    LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "could not upload %u instances",
+                   instanceCount);
+    return (retVal);
+  }
+  pInstances->instanceCount = instanceCount;
+  return (ERR_OK);
+}
+
+ErrVal instanceBufferUpdate(InstanceBuffer *pInstances,
+                            const InstanceData *pData,
+                            const uint32_t instanceCount,
+                            Allocator *pAllocator, AsyncUploader *pUploader,
+                            DeletionQueue *pDeletionQueue) {
+  // an empty buffer can't be created, but nothing is read from it either
+  if (instanceCount == 0) {
+    pInstances->instanceCount = 0;
+    return (ERR_OK);
+  }
+  InstanceBuffer replacement;
+  ErrVal retVal = new_InstanceBuffer(&replacement, pData, instanceCount,
+                                     pAllocator, pUploader);
+  if (retVal != ERR_OK) {
+    return (retVal);
+  }
+  deletionQueuePushBuffer(pDeletionQueue, &pInstances->buffer);
+  deletionQueuePushAllocation(pDeletionQueue, &pInstances->allocation);
+  *pInstances = replacement;
+  return (ERR_OK);
+}
+
+void delete_InstanceBuffer(InstanceBuffer *pInstances, Allocator *pAllocator,
+                           const VkDevice device) {
+  delete_Buffer(&pInstances->buffer, device);
+  delete_Allocation(&pInstances->allocation, pAllocator);
+  pInstances->instanceCount = 0;
+}
+
+void getInstanceGrid(InstanceData *pInstances, const uint32_t instanceCount,
+                     const VertexQuantization *pBounds, const float angle) {
+  float size = fmaxf(pBounds->scale[0], fmaxf(pBounds->scale[1],
+                                              pBounds->scale[2]));
+  float spacing = (size > 0.0f ? size : 1.0f) * INSTANCE_GRID_SPACING;
+  uint32_t side = (uint32_t)ceilf(sqrtf((float)instanceCount));
+  float halfWidth = (float)(side - 1) * spacing / 2.0f;
+  vec3 center;
+  for (uint32_t j = 0; j < 3; j++) {
+    center[j] = pBounds->offset[j] + pBounds->scale[j] / 2.0f;
+  }
+
+  for (uint32_t i = 0; i < instanceCount; i++) {
+    uint32_t x = i % side;
+    uint32_t z = i / side;
+    // move the copy's center to its cell, turning it around that center
+    mat4x4 toCell;
+    mat4x4_translate(toCell, (float)x * spacing - halfWidth, 0.0f,
+                     (float)z * spacing - halfWidth);
+    mat4x4 turned;
+    mat4x4_rotate_Y(turned, toCell, angle + (float)i * 0.5f);
+    mat4x4 fromCenter;
+    mat4x4_translate(fromCenter, -center[0], -center[1], -center[2]);
+    mat4x4_mul(pInstances[i].model, turned, fromCenter);
+
+    float u = side > 1 ? (float)x / (float)(side - 1) : 0.5f;
+    float v = side > 1 ? (float)z / (float)(side - 1) : 0.5f;
+    pInstances[i].color[0] = 0.5f + 0.5f * u;
+    pInstances[i].color[1] = 1.0f - 0.5f * u * v;
+    pInstances[i].color[2] = 0.5f + 0.5f * v;
+    pInstances[i].color[3] = 1.0f;
+  }
+}
+
+void getBoundingSphere(vec4 sphere, const VertexQuantization *pBounds) {
+  vec3 halfExtent;
+  for (uint32_t j = 0; j < 3; j++) {
+    halfExtent[j] = pBounds->scale[j] / 2.0f;
+    sphere[j] = pBounds->offset[j] + halfExtent[j];
+  }
+  sphere[3] = vec3_len(halfExtent);
+}
+
+void getInstanceSpheres(BoundingSpheres *pSpheres,
+                        const InstanceData *pInstances,
+                        const uint32_t instanceCount, const vec4 sphere) {
+  const vec4 center = {sphere[0], sphere[1], sphere[2], 1.0f};
+  for (uint32_t i = 0; i < instanceCount; i++) {
+    vec4 worldCenter;
+    mat4x4_mul_vec4(worldCenter, pInstances[i].model, center);
+    // the sphere grows with the largest scale of the model matrix
+    float scale = 0.0f;
+    for (uint32_t j = 0; j < 3; j++) {
+      scale = fmaxf(scale, vec3_len(pInstances[i].model[j]));
+    }
+    pSpheres->pCenterX[i] = worldCenter[0];
+    pSpheres->pCenterY[i] = worldCenter[1];
+    pSpheres->pCenterZ[i] = worldCenter[2];
+    pSpheres->pRadius[i] = sphere[3] * scale;
+  }
+  pSpheres->count = instanceCount;
+}
+
+void getInstanceBoxes(BoundingBoxes *pBoxes, const InstanceData *pInstances,
+                      const uint32_t instanceCount,
+                      const VertexQuantization *pBounds) {
+  vec4 center = {0.0f, 0.0f, 0.0f, 1.0f};
+  vec3 halfExtent;
+  for (uint32_t j = 0; j < 3; j++) {
+    halfExtent[j] = pBounds->scale[j] / 2.0f;
+    center[j] = pBounds->offset[j] + halfExtent[j];
+  }
+  for (uint32_t i = 0; i < instanceCount; i++) {
+    vec4 worldCenter;
+    mat4x4_mul_vec4(worldCenter, pInstances[i].model, center);
+    // each world axis gets the reach of every model axis along it
+    vec3 worldExtent = {0.0f, 0.0f, 0.0f};
+    for (uint32_t j = 0; j < 3; j++) {
+      for (uint32_t k = 0; k < 3; k++) {
+        worldExtent[k] += fabsf(pInstances[i].model[j][k]) * halfExtent[j];
+      }
+    }
+    pBoxes->pCenterX[i] = worldCenter[0];
+    pBoxes->pCenterY[i] = worldCenter[1];
+    pBoxes->pCenterZ[i] = worldCenter[2];
+    pBoxes->pExtentX[i] = worldExtent[0];
+    pBoxes->pExtentY[i] = worldExtent[1];
+    pBoxes->pExtentZ[i] = worldExtent[2];
+  }
+  pBoxes->count = instanceCount;
+}
@@ -0,0 +1,94 @@
+#ifndef SRC_INSTANCES_H_
+#define SRC_INSTANCES_H_
+
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+#include "allocator.h"
+#include "async_upload.h"
+#include "deletion_queue.h"
+#include "errors.h"
+#include "frustum_cull.h"
+#include "vulkan_utils.h"
+
+// Copies of one mesh drawn by a single instanced draw call
+typedef struct {
+  VkBuffer buffer;
+  Allocation allocation;
+  uint32_t instanceCount;
+} InstanceBuffer;
+
+/// Uploads `instanceCount` instances into a new instance buffer
+/// --- PRECONDITIONS ---
+/// * `pInstances` is a valid pointer
+/// * `pAllocator` and `pUploader` were created from the same device
+/// --- POSTCONDITIONS ---
+/// * returns error status
+/// * the upload goes through `new_Buffer_Upload`, so the buffer may only be
+/// drawn with in a frame that records the uploader's acquires
+/// * the buffer can also be read as a storage buffer by compute shaders
+/// --- CLEANUP ---
+/// * call `delete_InstanceBuffer`
+ErrVal new_InstanceBuffer(InstanceBuffer *pInstances,
+                          const InstanceData *pData,
+                          const uint32_t instanceCount, Allocator *pAllocator,
+                          AsyncUploader *pUploader);
+
+/// Replaces every instance with `instanceCount` new ones
+/// Frames still in flight may be drawing the old instances, so they go into
+/// a new buffer, and the old one is handed to `pDeletionQueue`
+/// An empty update keeps the old buffer, and draws none of it
+/// --- PRECONDITIONS ---
+/// * `pInstances` was created with `new_InstanceBuffer`
+/// * `deletionQueueBeginFrame` was called for the frame that will draw the
+/// new instances
+/// --- POSTCONDITIONS ---
+/// * returns error status
+/// * on failure, `pInstances` still holds the old instances
+ErrVal instanceBufferUpdate(InstanceBuffer *pInstances,
+                            const InstanceData *pData,
+                            const uint32_t instanceCount,
+                            Allocator *pAllocator, AsyncUploader *pUploader,
+                            DeletionQueue *pDeletionQueue);
+
+/// Frees the buffer right away
+/// --- PRECONDITIONS ---
+/// * the GPU has finished every frame drawing it
+void delete_InstanceBuffer(InstanceBuffer *pInstances, Allocator *pAllocator,
+                           const VkDevice device);
+
+/// Lays out `instanceCount` copies of a mesh on a square grid in the XZ plane,
+/// centered on the origin
+/// --- PRECONDITIONS ---
+/// * `pInstances` points to at least `instanceCount` elements
+/// * `pBounds` holds the bounding box of the mesh, as its minimum in `offset`
+/// and its extent in `scale`, like `getVertexQuantization` computes
+/// --- POSTCONDITIONS ---
+/// * each copy is turned by `angle` radians around the Y axis through its
+/// center, plus a fixed offset per instance, and gets its own tint
+void getInstanceGrid(InstanceData *pInstances, const uint32_t instanceCount,
+                     const VertexQuantization *pBounds, const float angle);
+
+/// Sets `sphere` to the sphere around the bounding box `pBounds`, with the
+/// radius in w
+void getBoundingSphere(vec4 sphere, const VertexQuantization *pBounds);
+
+/// Sets `pSpheres` to the world space bounding sphere of each instance of a
+/// mesh bounded by `sphere`
+/// --- PRECONDITIONS ---
+/// * `pSpheres` has a capacity of at least `instanceCount`
+void getInstanceSpheres(BoundingSpheres *pSpheres,
+                        const InstanceData *pInstances,
+                        const uint32_t instanceCount, const vec4 sphere);
+
+/// Sets `pBoxes` to the world space axis aligned bounding box of each instance
+/// of a mesh bounded by `pBounds`
+/// --- PRECONDITIONS ---
+/// * `pBoxes` has a capacity of at least `instanceCount`
+/// * `pBounds` is laid out like for `getInstanceGrid`
+void getInstanceBoxes(BoundingBoxes *pBoxes, const InstanceData *pInstances,
+                      const uint32_t instanceCount,
+                      const VertexQuantization *pBounds);
+
+#endif // SRC_INSTANCES_H_
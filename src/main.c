@@ -10,15 +10,36 @@
 
 #define APPNAME "Vulkan Triangle"
 
+#include "bench.h"
 #include "camera.h"
+#include "cooked_mesh.h"
+#include "deletion_queue.h"
+#include "frustum_cull.h"
+#include "gpu_culling.h"
+#include "gpu_profiler.h"
+#include "host_alloc.h"
+#include "instances.h"
+#include "mesh.h"
+#include "mesh_loader.h"
+#include "mesh_lod.h"
+#include "meshlet_culling.h"
+#include "packed_vertex.h"
+#include "options.h"
+#include "trace.h"
 #include "utils.h"
 #include "vulkan_utils.h"
+#include "workload.h"
 
 #include "errors.h"
 
 #define WINDOW_HEIGHT 500
 #define WINDOW_WIDTH 500
 #define MAX_FRAMES_IN_FLIGHT 2
+// host visible memory that uploads are staged in
+#define UPLOAD_STAGING_SIZE ((VkDeviceSize)32 * 1024 * 1024)
+#define MAX_PATH_LENGTH 4096
+// frames between queries of the memory budget
+#define MEMORY_BUDGET_UPDATE_INTERVAL 60
 
 static uint32_t vertexCount = 6;
 static Vertex vertexData[] = {
@@ -30,8 +51,135 @@ static Vertex vertexData[] = {
     (Vertex){.position = {1.0, 0.0, 1.0}, .color = {0.0, 0.0, 1.0}},
 };
 
-int main(void) {
-  glfwInit();
+static void onLowMemory(UNUSED void *pUserData, const uint32_t heapIndex,
+                        const AllocatorHeapBudget budget) {
+  LOG_ERROR_ARGS(ERR_LEVEL_WARN, "heap %u is at %llu of %llu MiB budget",
+                 heapIndex, (unsigned long long)(budget.usage / (1024 * 1024)),
+                 (unsigned long long)(budget.budget / (1024 * 1024)));
+}
+
+// copies a finished offscreen frame to the host and writes it to
+// `<dir>/frame_<n>.ppm`
+static void dumpFrame(const char *dir, const uint32_t frameNumber,
+                      const VkImage image, const VkBuffer dumpBuffer,
+                      const VkDeviceMemory dumpBufferMemory,
+                      const VkExtent2D extent, const VkCommandPool commandPool,
+                      const VkQueue queue, const VkDevice device) {
+  copyImageToBuffer(dumpBuffer, image, extent, commandPool, queue, device);
+
+  void *pPixels;
+  VkResult mapResult =
+      vkMapMemory(device, dumpBufferMemory, 0, VK_WHOLE_SIZE, 0, &pPixels);
+  if (mapResult != VK_SUCCESS) {
+    LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "failed to map frame dump buffer: %s",
+                   vkstrerror(mapResult));
+    return;
+  }
+
+  char filename[MAX_PATH_LENGTH];
+  snprintf(filename, MAX_PATH_LENGTH, "%s/frame_%05u.ppm", dir, frameNumber);
+  writePPM(filename, pPixels, extent.width, extent.height);
+
+  vkUnmapMemory(device, dumpBufferMemory);
+}
+
+// builds the welded and cache optimized mesh to draw, out of the default
+// triangles, a generated scene or a mesh file, followed by its levels of
+// detail with --lod
+static void buildMesh(Mesh *pMesh, MeshLodChain *pLodChain,
+                      const AppOptions *pOptions) {
+  // replace the hardcoded triangles with a generated stress scene
+  Vertex *pVertices = vertexData;
+  if (pOptions->workloadTriangleCount != 0) {
+    WorkloadParams workloadParams = {
+        .triangleCount = pOptions->workloadTriangleCount,
+        .distribution = pOptions->workloadLayered
+                            ? WORKLOAD_DISTRIBUTION_LAYERS
+                            : WORKLOAD_DISTRIBUTION_UNIFORM,
+        .triangleSize = pOptions->workloadTriangleSize,
+        .layerCount = pOptions->workloadLayerCount,
+        .seed = pOptions->workloadSeed,
+    };
+    if (new_WorkloadVertices(&pVertices, &vertexCount, &workloadParams) !=
+        ERR_OK) {
+      PANIC();
+    }
+  } else if (pOptions->pMeshPath != NULL) {
+    MeshLoadStats loadStats;
+    if (new_MeshFileVertices(&pVertices, &vertexCount, pOptions->pMeshPath,
+                             pOptions->meshLoaderThreadCount,
+                             &loadStats) != ERR_OK) {
+      PANIC();
+    }
+    printMeshLoadStats(pOptions->pMeshPath, vertexCount, &loadStats);
+  }
+
+  // shared vertices are only stored and shaded once
+  if (new_Mesh(pMesh, pVertices, vertexCount) != ERR_OK) {
+    PANIC();
+  }
+
+  // the vertices have been copied, so they can go
+  if (pOptions->workloadTriangleCount != 0) {
+    delete_WorkloadVertices(&pVertices);
+  } else if (pOptions->pMeshPath != NULL) {
+    delete_MeshFileVertices(&pVertices);
+  }
+
+  float weldedAcmr = 0.0f;
+  if (pOptions->meshStats) {
+    getMeshAcmr(&weldedAcmr, pMesh->pIndices, pMesh->indexCount,
+                pMesh->vertexCount);
+  }
+  // if these run out of memory the mesh is still valid, just slower to draw
+  meshOptimizeVertexCache(pMesh);
+  meshOptimizeVertexFetch(pMesh);
+  if (pOptions->meshStats) {
+    float optimizedAcmr;
+    getMeshAcmr(&optimizedAcmr, pMesh->pIndices, pMesh->indexCount,
+                pMesh->vertexCount);
+    // without indices every vertex is shaded, an ACMR of 3
+    printf("mesh: %u vertices welded to %u, ACMR 3.00 unindexed, %.2f welded, "
+           "%.2f optimized\n",
+           vertexCount, pMesh->vertexCount, (double)weldedAcmr,
+           (double)optimizedAcmr);
+  }
+
+  // without levels of detail, only the full mesh is drawn
+  getMeshLodChainFull(pLodChain, pMesh->indexCount);
+  if (pOptions->lod) {
+    uint64_t lodStart = getTimeNs();
+    if (meshBuildLods(pMesh, pLodChain) == ERR_OK) {
+      printf("lod: built %u levels in %.1f ms\n", pLodChain->levelCount,
+             (double)(getTimeNs() - lodStart) / 1e6);
+      printMeshLodChain(pLodChain);
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  AppOptions options;
+  if (parseAppOptions(&options, argc, argv) != ERR_OK) {
+    return (EXIT_FAILURE);
+  }
+  const bool headless = options.headless;
+
+  if (options.pTracePath != NULL) {
+    traceEnable();
+  }
+
+  // has to outlive the instance, since objects are freed with the callbacks
+  // they were created with
+  HostAllocTracker hostAllocTracker;
+  new_HostAllocTracker(&hostAllocTracker);
+  if (options.hostAllocInterval != 0) {
+    hostAllocTrackerEnable(&hostAllocTracker);
+  }
+
+  // without a window we don't need GLFW at all
+  if (!headless) {
+    glfwInit();
+  }
 
   const uint32_t validationLayerCount = 1;
   const char *ppValidationLayerNames[1] = {"VK_LAYER_KHRONOS_validation"};
@@ -39,7 +187,7 @@ int main(void) {
   /* Create instance */
   VkInstance instance;
   new_Instance(&instance, validationLayerCount, ppValidationLayerNames, 0, NULL,
-               true, true, APPNAME);
+               !headless, true, APPNAME);
 
   /* Enable vulkan logging to stdout */
   VkDebugUtilsMessengerEXT callback;
@@ -48,25 +196,40 @@ int main(void) {
   /* get physical device */
   VkPhysicalDevice physicalDevice;
   getPhysicalDevice(&physicalDevice, instance);
+  VkPhysicalDeviceProperties physicalDeviceProperties;
+  vkGetPhysicalDeviceProperties(physicalDevice, &physicalDeviceProperties);
 
   /* Create window and surface */
-  GLFWwindow *pWindow;
-  new_GlfwWindow(&pWindow, APPNAME,
-                 (VkExtent2D){.width = WINDOW_WIDTH, .height = WINDOW_HEIGHT});
-  VkSurfaceKHR surface;
-  new_SurfaceFromGLFW(&surface, pWindow, instance);
+  GLFWwindow *pWindow = NULL;
+  VkSurfaceKHR surface = VK_NULL_HANDLE;
+  if (!headless) {
+    new_GlfwWindow(&pWindow, APPNAME,
+                   (VkExtent2D){.width = WINDOW_WIDTH, .height = WINDOW_HEIGHT});
+    new_SurfaceFromGLFW(&surface, pWindow, instance);
+  }
 
   /* find queues on graphics device */
   uint32_t graphicsIndex;
   uint32_t computeIndex;
   uint32_t presentIndex;
+  uint32_t transferIndex;
   {
     uint32_t ret1 = getQueueFamilyIndexByCapability(
         &graphicsIndex, physicalDevice, VK_QUEUE_GRAPHICS_BIT);
     uint32_t ret2 = getQueueFamilyIndexByCapability(
         &computeIndex, physicalDevice, VK_QUEUE_COMPUTE_BIT);
-    uint32_t ret3 =
-        getPresentQueueFamilyIndex(&presentIndex, physicalDevice, surface);
+    // offscreen images are never presented, so any queue will do
+    uint32_t ret3 = ERR_OK;
+    if (headless) {
+      presentIndex = graphicsIndex;
+    } else {
+      ret3 = getPresentQueueFamilyIndex(&presentIndex, physicalDevice, surface);
+    }
+    // uploads fall back to the graphics family without a dedicated one
+    if (getTransferQueueFamilyIndex(&transferIndex, physicalDevice) !=
+        ERR_OK) {
+      transferIndex = graphicsIndex;
+    }
     /* Panic if indices are unavailable */
     if (ret1 != VK_SUCCESS || ret2 != VK_SUCCESS || ret3 != VK_SUCCESS) {
       LOG_ERROR(ERR_LEVEL_FATAL, "unable to acquire indices\n");
@@ -75,17 +238,34 @@ int main(void) {
   }
 
   /* Set extent (for now just window width and height) */
-  VkExtent2D swapchainExtent;
-  getExtentWindow(&swapchainExtent, pWindow);
+  VkExtent2D swapchainExtent = {.width = WINDOW_WIDTH, .height = WINDOW_HEIGHT};
+  if (!headless) {
+    getExtentWindow(&swapchainExtent, pWindow);
+  }
 
   /* we want to use swapchains to reduce tearing */
-  const uint32_t deviceExtensionCount = 1;
-  const char *ppDeviceExtensionNames[] = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+  uint32_t deviceExtensionCount = 0;
+  const char *ppDeviceExtensionNames[2];
+  if (!headless) {
+    ppDeviceExtensionNames[deviceExtensionCount++] =
+        VK_KHR_SWAPCHAIN_EXTENSION_NAME;
+  }
+  // lets the allocator see how close we are to running out of memory
+  const bool memoryBudgetEnabled = isDeviceExtensionSupported(
+      physicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+  if (memoryBudgetEnabled) {
+    ppDeviceExtensionNames[deviceExtensionCount++] =
+        VK_EXT_MEMORY_BUDGET_EXTENSION_NAME;
+  }
 
   /*create device */
   VkDevice device;
-  new_Device(&device, physicalDevice, graphicsIndex, deviceExtensionCount,
-             ppDeviceExtensionNames);
+  const uint32_t pQueueFamilyIndices[] = {graphicsIndex, computeIndex,
+                                          presentIndex, transferIndex};
+  if (new_Device(&device, physicalDevice, 4, pQueueFamilyIndices,
+                 deviceExtensionCount, ppDeviceExtensionNames) != ERR_OK) {
+    PANIC();
+  }
 
   VkQueue graphicsQueue;
   getQueue(&graphicsQueue, device, graphicsIndex);
@@ -93,39 +273,91 @@ int main(void) {
   getQueue(&computeQueue, device, computeIndex);
   VkQueue presentQueue;
   getQueue(&presentQueue, device, presentIndex);
+  VkQueue transferQueue;
+  getQueue(&transferQueue, device, transferIndex);
+
+  // buffers share a few large blocks of device memory
+  Allocator allocator;
+  new_Allocator(&allocator, physicalDevice, device, memoryBudgetEnabled);
+  // nothing is cached yet, so all we can do is warn
+  allocatorSetLowMemoryCallback(&allocator, onLowMemory, NULL);
+
+  // uploads run on the transfer queue, and are waited for by the first frame
+  // that uses them
+  AsyncUploader uploader;
+  if (new_AsyncUploader(&uploader, &allocator, UPLOAD_STAGING_SIZE, device,
+                        transferQueue, transferIndex,
+                        graphicsIndex) != ERR_OK) {
+    PANIC();
+  }
 
   /* We can create command buffers from the command pool */
   VkCommandPool commandPool;
   new_CommandPool(&commandPool, device, graphicsIndex);
 
-  /* get preferred format of screen*/
-  VkSurfaceFormatKHR surfaceFormat;
-  getPreferredSurfaceFormat(&surfaceFormat, physicalDevice, surface);
-
-  /* Create swap chain */
-  VkSwapchainKHR swapchain;
-  uint32_t swapchainImageCount;
-  new_Swapchain(&swapchain, &swapchainImageCount, VK_NULL_HANDLE, surfaceFormat,
-                physicalDevice, device, surface, swapchainExtent, graphicsIndex,
-                presentIndex);
-
-  // there are swapchainImageCount swapchainImages
-  VkImage *pSwapchainImages = malloc(swapchainImageCount * sizeof(VkImage));
-  getSwapchainImages(pSwapchainImages, swapchainImageCount, device, swapchain);
-
-  // there are swapchainImageCount swapchainImageViews
-  VkImageView *pSwapchainImageViews =
-      malloc(swapchainImageCount * sizeof(VkImageView));
-  new_SwapchainImageViews(pSwapchainImageViews, pSwapchainImages,
-                          swapchainImageCount, device, surfaceFormat.format);
-
-  /* Create depth buffer */
-  VkDeviceMemory depthImageMemory;
-  VkImage depthImage;
-  new_DepthImage(&depthImage, &depthImageMemory, swapchainExtent,
-                 physicalDevice, device);
-  VkImageView depthImageView;
-  new_DepthImageView(&depthImageView, device, depthImage);
+  /* get preferred format of screen, offscreen we just pick one */
+  VkSurfaceFormatKHR surfaceFormat = {
+      .format = VK_FORMAT_B8G8R8A8_UNORM,
+      .colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR};
+  if (!headless) {
+    getPreferredSurfaceFormat(&surfaceFormat, physicalDevice, surface);
+  }
+
+  VkSwapchainKHR swapchain = VK_NULL_HANDLE;
+  uint32_t swapchainImageCount = 0;
+  VkImage *pSwapchainImages = NULL;
+  VkImageView *pSwapchainImageViews = NULL;
+  Allocation depthImageAllocation = {0};
+  VkImage depthImage = VK_NULL_HANDLE;
+  VkImageView depthImageView = VK_NULL_HANDLE;
+  // the extent the depth image was created with, which may be larger than the
+  // swapchain, see `resizeDepthImageCapacity`
+  VkExtent2D depthImageCapacity = {0};
+
+  // in headless mode every frame in flight gets its own color and depth image
+  VkImage pOffscreenImages[MAX_FRAMES_IN_FLIGHT];
+  Allocation pOffscreenImageAllocations[MAX_FRAMES_IN_FLIGHT];
+  VkImageView pOffscreenImageViews[MAX_FRAMES_IN_FLIGHT];
+  VkImage pOffscreenDepthImages[MAX_FRAMES_IN_FLIGHT];
+  Allocation pOffscreenDepthImageAllocations[MAX_FRAMES_IN_FLIGHT];
+  VkImageView pOffscreenDepthImageViews[MAX_FRAMES_IN_FLIGHT];
+
+  if (headless) {
+    new_OffscreenImages(pOffscreenImages, pOffscreenImageAllocations,
+                        MAX_FRAMES_IN_FLIGHT, swapchainExtent,
+                        surfaceFormat.format, &allocator);
+    new_SwapchainImageViews(pOffscreenImageViews, pOffscreenImages,
+                            MAX_FRAMES_IN_FLIGHT, device, surfaceFormat.format);
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+      new_DepthImage(&pOffscreenDepthImages[i],
+                     &pOffscreenDepthImageAllocations[i], swapchainExtent,
+                     &allocator);
+      new_DepthImageView(&pOffscreenDepthImageViews[i], device,
+                         pOffscreenDepthImages[i]);
+    }
+  } else {
+    /* Create swap chain */
+    new_Swapchain(&swapchain, &swapchainImageCount, VK_NULL_HANDLE,
+                  surfaceFormat, physicalDevice, device, surface,
+                  swapchainExtent, graphicsIndex, presentIndex);
+
+    // there are swapchainImageCount swapchainImages
+    pSwapchainImages = malloc(swapchainImageCount * sizeof(VkImage));
+    getSwapchainImages(pSwapchainImages, swapchainImageCount, device,
+                       swapchain);
+
+    // there are swapchainImageCount swapchainImageViews
+    pSwapchainImageViews = malloc(swapchainImageCount * sizeof(VkImageView));
+    new_SwapchainImageViews(pSwapchainImageViews, pSwapchainImages,
+                            swapchainImageCount, device, surfaceFormat.format);
+
+    /* Create depth buffer */
+    resizeDepthImageCapacity(&depthImageCapacity, swapchainExtent,
+                             physicalDevice);
+    new_DepthImage(&depthImage, &depthImageAllocation, depthImageCapacity,
+                   &allocator);
+    new_DepthImageView(&depthImageView, device, depthImage);
+  }
 
   VkShaderModule fragShaderModule;
   {
@@ -138,39 +370,332 @@ int main(void) {
     free(fragShaderFileContents);
   }
 
+  // a cooked mesh is mapped up front, since its vertex format picks the
+  // vertex shader and pipeline
+  CookedMesh cookedMesh = {0};
+  const bool cooked =
+      options.pMeshPath != NULL && isCookedMeshPath(options.pMeshPath);
+  const uint64_t cookedLoadStart = getTimeNs();
+  if (cooked && new_CookedMesh(&cookedMesh, options.pMeshPath) != ERR_OK) {
+    PANIC();
+  }
+  VertexFormat vertexFormat =
+      options.packedVertices ? VERTEX_FORMAT_PACKED : VERTEX_FORMAT_FLOAT;
+  if (cooked) {
+    vertexFormat = cookedMesh.vertexFormat;
+  }
+
   VkShaderModule vertShaderModule;
   {
     uint32_t *vertShaderFileContents;
     uint32_t vertShaderFileLength;
-    readShaderFile("assets/shaders/shader.vert.spv", &vertShaderFileLength,
-                   &vertShaderFileContents);
+    const char *pVertShaderPaths[2][2] = {
+        {"assets/shaders/shader.vert.spv",
+         "assets/shaders/shader_instanced.vert.spv"},
+        {"assets/shaders/shader_packed.vert.spv",
+         "assets/shaders/shader_packed_instanced.vert.spv"},
+    };
+    readShaderFile(pVertShaderPaths[vertexFormat == VERTEX_FORMAT_PACKED]
+                                   [options.instanceCount != 0],
+                   &vertShaderFileLength, &vertShaderFileContents);
     new_ShaderModule(&vertShaderModule, device, vertShaderFileLength,
                      vertShaderFileContents);
     free(vertShaderFileContents);
   }
 
+  // offscreen images are left ready to be copied out instead of presented
+  const VkImageLayout colorFinalLayout =
+      headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+               : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
   /* Create graphics pipeline */
   VkRenderPass renderPass;
-  new_VertexDisplayRenderPass(&renderPass, device, surfaceFormat.format);
+  new_VertexDisplayRenderPass(&renderPass, device, surfaceFormat.format,
+                              colorFinalLayout);
 
   VkPipelineLayout graphicsPipelineLayout;
   new_VertexDisplayPipelineLayout(&graphicsPipelineLayout, device);
 
+  // meshlets facing away are culled exactly when their faces would be
+  const VkCullModeFlags cullMode =
+      options.backfaceCull ? VK_CULL_MODE_BACK_BIT : VK_CULL_MODE_NONE;
+
   VkPipeline graphicsPipeline;
   new_VertexDisplayPipeline(&graphicsPipeline, device, vertShaderModule,
-                            fragShaderModule, swapchainExtent, renderPass,
-                            graphicsPipelineLayout);
+                            fragShaderModule, renderPass,
+                            graphicsPipelineLayout, vertexFormat,
+                            options.instanceCount != 0, cullMode);
+
+  VkFramebuffer *pSwapchainFramebuffers = NULL;
+  VkFramebuffer pOffscreenFramebuffers[MAX_FRAMES_IN_FLIGHT];
+  if (headless) {
+    new_OffscreenFramebuffers(pOffscreenFramebuffers, device, renderPass,
+                              swapchainExtent, MAX_FRAMES_IN_FLIGHT,
+                              pOffscreenDepthImageViews, pOffscreenImageViews);
+  } else {
+    pSwapchainFramebuffers =
+        malloc(swapchainImageCount * sizeof(VkFramebuffer));
+    new_SwapchainFramebuffers(pSwapchainFramebuffers, device, renderPass,
+                              swapchainExtent, swapchainImageCount,
+                              depthImageView, pSwapchainImageViews);
+  }
+
+  // host visible buffer that rendered frames are copied into before writing,
+  // coherent so the copies don't need invalidating before they're read
+  VkBuffer frameDumpBuffer = VK_NULL_HANDLE;
+  VkDeviceMemory frameDumpBufferMemory = VK_NULL_HANDLE;
+  const VkDeviceSize frameDumpSize =
+      (VkDeviceSize)swapchainExtent.width * swapchainExtent.height * 4;
+  if (options.pFrameDumpDir != NULL) {
+    new_Buffer_DeviceMemory(&frameDumpBuffer, &frameDumpBufferMemory,
+                            frameDumpSize, physicalDevice, device,
+                            VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  }
+
+  // stays NULL unless --gpu-profile was passed and timestamps are supported
+  GpuProfiler gpuProfiler;
+  GpuProfiler *pGpuProfiler = NULL;
+  if (options.gpuProfile &&
+      new_GpuProfiler(&gpuProfiler, MAX_FRAMES_IN_FLIGHT, physicalDevice,
+                      graphicsIndex, device, options.pGpuProfileStreamPath,
+                      options.pipelineStatistics,
+                      options.pPipelineStatisticsStreamPath) == ERR_OK) {
+    pGpuProfiler = &gpuProfiler;
+  }
+
+  // stays NULL for float vertices
+  VertexQuantization quantization;
+  const VertexQuantization *pQuantization = NULL;
+  // what is uploaded, laid out exactly like the vertex and index buffers
+  const void *pUploadVertices;
+  VkDeviceSize uploadVertexBytes;
+  uint32_t uploadVertexCount;
+  const uint32_t *pUploadIndices;
+  uint32_t uploadIndexCount;
+  // the full mesh, which the levels of detail follow in the index buffer
+  uint32_t indexCount;
+  MeshLodChain lodChain;
+  Mesh mesh = {0};
+  Meshlets meshlets = {0};
+  PackedVertex *pPackedVertices = NULL;
+  if (cooked) {
+    // no parsing or packing left to do, the mapping is uploaded as it is
+    pUploadVertices = cookedMesh.pVertices;
+    uploadVertexBytes = cookedMesh.vertexBytes;
+    uploadVertexCount = cookedMesh.vertexCount;
+    pUploadIndices = cookedMesh.pIndices;
+    uploadIndexCount = cookedMesh.indexCount;
+    if (options.lod) {
+      LOG_ERROR(ERR_LEVEL_WARN,
+                "cooked meshes have no levels of detail, ignoring --lod");
+    }
+    getMeshLodChainFull(&lodChain, uploadIndexCount);
+    if (options.meshlets) {
+      LOG_ERROR(ERR_LEVEL_WARN,
+                "cooked meshes have no meshlets, ignoring --meshlets");
+    }
+    if (vertexFormat == VERTEX_FORMAT_PACKED) {
+      quantization = cookedMesh.quantization;
+      pQuantization = &quantization;
+    }
+  } else {
+    buildMesh(&mesh, &lodChain, &options);
+    if (options.meshlets) {
+      if (new_Meshlets(&meshlets, &mesh) != ERR_OK) {
+        PANIC();
+      }
+      printf("meshlets: %u, %.1f vertices and %.1f triangles each\n",
+             meshlets.meshletCount,
+             (double)meshlets.vertexCount / (double)meshlets.meshletCount,
+             (double)meshlets.indexCount / 3.0 /
+                 (double)meshlets.meshletCount);
+    }
+    pUploadVertices = mesh.pVertices;
+    uploadVertexBytes = sizeof(Vertex) * mesh.vertexCount;
+    uploadVertexCount = mesh.vertexCount;
+    pUploadIndices = mesh.pIndices;
+    uploadIndexCount = mesh.indexCount;
+    if (vertexFormat == VERTEX_FORMAT_PACKED) {
+      getVertexQuantization(&quantization, mesh.pVertices, mesh.vertexCount);
+      pPackedVertices =
+          malloc((size_t)mesh.vertexCount * sizeof(PackedVertex));
+      if (!pPackedVertices) {
+        LOG_ERROR_ARGS(ERR_LEVEL_FATAL, "could not pack %u vertices: %s",
+                       mesh.vertexCount, strerror(errno));
+        PANIC();
+      }
+      packVertices(pPackedVertices, mesh.pVertices, mesh.vertexCount,
+                   &quantization);
+      pUploadVertices = pPackedVertices;
+      uploadVertexBytes = sizeof(PackedVertex) * mesh.vertexCount;
+      pQuantization = &quantization;
+    }
+  }
+  indexCount = lodChain.pLevels[0].indexCount;
+  const bool lod = lodChain.levelCount > 1;
 
-  VkFramebuffer *pSwapchainFramebuffers =
-      malloc(swapchainImageCount * sizeof(VkFramebuffer));
-  new_SwapchainFramebuffers(pSwapchainFramebuffers, device, renderPass,
-                            swapchainExtent, swapchainImageCount,
-                            depthImageView, pSwapchainImageViews);
+  // a failed cook is reported, but the mesh can still be drawn
+  if (options.pCookPath != NULL) {
+    writeCookedMesh(options.pCookPath, pUploadVertices, uploadVertexCount,
+                    vertexFormat, pQuantization, pUploadIndices, indexCount);
+  }
 
   VkBuffer vertexBuffer;
-  VkDeviceMemory vertexBufferMemory;
-  new_VertexBuffer(&vertexBuffer, &vertexBufferMemory, vertexData, vertexCount,
-                   device, physicalDevice, commandPool, graphicsQueue);
+  Allocation vertexBufferAllocation;
+  new_Buffer_Upload(&vertexBuffer, &vertexBufferAllocation, &allocator,
+                    &uploader, pUploadVertices, uploadVertexBytes,
+                    VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                    VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                    VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, NULL);
+
+  VkBuffer indexBuffer;
+  Allocation indexBufferAllocation;
+  new_Buffer_Upload(&indexBuffer, &indexBufferAllocation, &allocator,
+                    &uploader, pUploadIndices,
+                    sizeof(uint32_t) * uploadIndexCount,
+                    VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+                    VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                    VK_ACCESS_INDEX_READ_BIT, NULL);
+
+  // copies of the mesh are laid out around its bounding box
+  InstanceData *pInstanceData = NULL;
+  InstanceBuffer instances = {0};
+  VertexQuantization meshBounds = {0};
+  vec4 meshSphere = {0.0f, 0.0f, 0.0f, 0.0f};
+  if (options.instanceCount != 0 || lod) {
+    if (pQuantization != NULL) {
+      meshBounds = *pQuantization;
+    } else {
+      getVertexQuantization(&meshBounds, pUploadVertices, uploadVertexCount);
+    }
+    getBoundingSphere(meshSphere, &meshBounds);
+  }
+  if (options.instanceCount != 0) {
+    pInstanceData =
+        malloc((size_t)options.instanceCount * sizeof(InstanceData));
+    if (!pInstanceData) {
+      LOG_ERROR_ARGS(ERR_LEVEL_FATAL, "could not allocate %u instances: %s",
+                     options.instanceCount, strerror(errno));
+      PANIC();
+    }
+    getInstanceGrid(pInstanceData, options.instanceCount, &meshBounds, 0.0f);
+    if (new_InstanceBuffer(&instances, pInstanceData, options.instanceCount,
+                           &allocator, &uploader) != ERR_OK) {
+      PANIC();
+    }
+  }
+
+  // stays NULL unless --gpu-cull was passed
+  GpuCuller gpuCuller;
+  GpuCuller *pGpuCuller = NULL;
+  if (options.gpuCull) {
+    uint32_t *cullShaderFileContents;
+    uint32_t cullShaderFileLength;
+    readShaderFile("assets/shaders/cull.comp.spv", &cullShaderFileLength,
+                   &cullShaderFileContents);
+    VkShaderModule cullShaderModule;
+    new_ShaderModule(&cullShaderModule, device, cullShaderFileLength,
+                     cullShaderFileContents);
+    free(cullShaderFileContents);
+
+    if (new_GpuCuller(&gpuCuller, MAX_FRAMES_IN_FLIGHT, options.instanceCount,
+                      indexCount, meshSphere, cullShaderModule,
+                      &allocator, physicalDevice, device) != ERR_OK) {
+      PANIC();
+    }
+    // the pipeline keeps what it needs of the shader
+    delete_ShaderModule(&cullShaderModule, device);
+    pGpuCuller = &gpuCuller;
+  }
+
+  // stays NULL unless --meshlets was passed with a mesh that isn't cooked
+  MeshletCuller meshletCuller;
+  MeshletCuller *pMeshletCuller = NULL;
+  if (meshlets.meshletCount != 0) {
+    uint32_t *meshletCullShaderFileContents;
+    uint32_t meshletCullShaderFileLength;
+    readShaderFile("assets/shaders/meshlet_cull.comp.spv",
+                   &meshletCullShaderFileLength,
+                   &meshletCullShaderFileContents);
+    VkShaderModule meshletCullShaderModule;
+    new_ShaderModule(&meshletCullShaderModule, device,
+                     meshletCullShaderFileLength,
+                     meshletCullShaderFileContents);
+    free(meshletCullShaderFileContents);
+
+    if (new_MeshletCuller(&meshletCuller, MAX_FRAMES_IN_FLIGHT, &meshlets,
+                          meshletCullShaderModule, cullMode,
+                          &allocator, &uploader, device) != ERR_OK) {
+      PANIC();
+    }
+    delete_ShaderModule(&meshletCullShaderModule, device);
+    pMeshletCuller = &meshletCuller;
+  }
+
+  // with --cpu-cull, the instance buffer only ever holds the visible copies
+  // tested as spheres, or as boxes with --cull-boxes
+  BoundingSpheres instanceSpheres = {0};
+  BoundingBoxes instanceBoxes = {0};
+  uint32_t *pVisibleIndices = NULL;
+  InstanceData *pVisibleInstanceData = NULL;
+  FrustumCullStats frustumCullStats = {0};
+  if (options.cpuCull) {
+    // whole batches of indices are stored, up to the padded capacity
+    uint32_t cullCapacity;
+    if (options.cullBoxes) {
+      if (new_BoundingBoxes(&instanceBoxes, options.instanceCount) != ERR_OK) {
+        PANIC();
+      }
+      getInstanceBoxes(&instanceBoxes, pInstanceData, options.instanceCount,
+                       &meshBounds);
+      cullCapacity = instanceBoxes.capacity;
+    } else {
+      if (new_BoundingSpheres(&instanceSpheres, options.instanceCount) !=
+          ERR_OK) {
+        PANIC();
+      }
+      getInstanceSpheres(&instanceSpheres, pInstanceData,
+                         options.instanceCount, meshSphere);
+      cullCapacity = instanceSpheres.capacity;
+    }
+    pVisibleIndices = malloc(cullCapacity * sizeof(uint32_t));
+    pVisibleInstanceData =
+        malloc((size_t)options.instanceCount * sizeof(InstanceData));
+    if (!pVisibleIndices || !pVisibleInstanceData) {
+      LOG_ERROR_ARGS(ERR_LEVEL_FATAL, "could not allocate %u instances: %s",
+                     options.instanceCount, strerror(errno));
+      PANIC();
+    }
+  }
+
+  // with --lod, the instance buffer holds the copies sorted by level
+  InstanceData *pLodInstanceData = NULL;
+  uint8_t *pLodLevels = NULL;
+  MeshLodStats lodStats = {0};
+  if (lod && options.instanceCount != 0) {
+    pLodInstanceData =
+        malloc((size_t)options.instanceCount * sizeof(InstanceData));
+    pLodLevels = malloc(options.instanceCount * sizeof(uint8_t));
+    if (!pLodInstanceData || !pLodLevels) {
+      LOG_ERROR_ARGS(ERR_LEVEL_FATAL, "could not allocate %u instances: %s",
+                     options.instanceCount, strerror(errno));
+      PANIC();
+    }
+  }
+
+  // the mesh has been staged, so it can go as well
+  if (cooked) {
+    printf("loaded %s: %u vertices, %u triangles, %.1f MiB in %.1f ms\n",
+           options.pMeshPath, uploadVertexCount, indexCount / 3,
+           (double)cookedMesh.file.size / (1024.0 * 1024.0),
+           (double)(getTimeNs() - cookedLoadStart) / 1e6);
+  }
+  delete_CookedMesh(&cookedMesh);
+  free(pPackedVertices);
+  delete_Mesh(&mesh);
+  delete_Meshlets(&meshlets);
 
   VkCommandBuffer pVertexDisplayCommandBuffers[MAX_FRAMES_IN_FLIGHT];
   new_CommandBuffers(pVertexDisplayCommandBuffers, MAX_FRAMES_IN_FLIGHT, commandPool, device);
@@ -184,6 +709,10 @@ int main(void) {
   new_Fences(pInFlightFences, MAX_FRAMES_IN_FLIGHT, device,
              true); // fences start off signaled
 
+  // handles replaced while running are destroyed once no frame can use them
+  DeletionQueue deletionQueue;
+  new_DeletionQueue(&deletionQueue, MAX_FRAMES_IN_FLIGHT, &allocator, device);
+
   // create camera
   vec3 loc = {0.0f, 0.0f, 0.0f};
   Camera camera = new_Camera(loc, swapchainExtent);
@@ -192,120 +721,416 @@ int main(void) {
   // up to MAX_FRAMES_IN_FLIGHT, at whcich points it resets to 0
   uint32_t currentFrame = 0;
 
-  /*wait till close*/
-  while (!glfwWindowShouldClose(pWindow)) {
-    glfwPollEvents();
+  // total number of frames submitted so far
+  uint32_t frameNumber = 0;
+
+  InputRecorder inputRecorder;
+  if (options.pRecordInputPath != NULL &&
+      new_InputRecorder(&inputRecorder, options.pRecordInputPath) != ERR_OK) {
+    PANIC();
+  }
+  InputReplayer inputReplayer;
+  if (options.pReplayInputPath != NULL &&
+      new_InputReplayer(&inputReplayer, options.pReplayInputPath) != ERR_OK) {
+    PANIC();
+  }
+
+  // does nothing unless --bench was passed
+  Bench bench;
+  new_Bench(&bench, options.benchWarmupFrameCount, options.benchFrameCount);
+
+  // throughput is measured over the same frames as the benchmark
+  const uint32_t throughputFirstFrame =
+      options.benchFrameCount != 0 ? options.benchWarmupFrameCount : 0;
+  uint64_t throughputStart = getTimeNs();
+  // summed over those frames, since culling and levels change it every frame
+  uint64_t throughputTriangleCount = 0;
+
+  /*wait till close, or until we've rendered enough frames*/
+  while (options.frameCount == 0 || frameNumber < options.frameCount) {
+    uint64_t frameStart = getTimeNs();
+    uint64_t phaseStart;
+    if (frameNumber == throughputFirstFrame) {
+      throughputStart = frameStart;
+    }
+
+    if (!headless) {
+      if (glfwWindowShouldClose(pWindow)) {
+        break;
+      }
+      TRACE_BEGIN("glfwPollEvents");
+      glfwPollEvents();
+      TRACE_END("glfwPollEvents");
+    }
 
     // wait for last frame to finish
+    phaseStart = getTimeNs();
+    TRACE_BEGIN("waitAndResetFence");
     waitAndResetFence(pInFlightFences[currentFrame], device);
+    TRACE_END("waitAndResetFence");
+    benchRecord(&bench, BENCH_PHASE_FENCE_WAIT, getTimeNs() - phaseStart);
+
+    // per frame bookkeeping, only counted in the whole frame's time
+    deletionQueueBeginFrame(&deletionQueue, currentFrame);
+    if (pGpuCuller != NULL) {
+      gpuCullerBeginFrame(pGpuCuller, currentFrame);
+    }
+    if (pMeshletCuller != NULL) {
+      meshletCullerBeginFrame(pMeshletCuller, currentFrame);
+    }
+    asyncUploaderPoll(&uploader);
+    // in between queries, usage is estimated from our own allocations
+    if (frameNumber % MEMORY_BUDGET_UPDATE_INTERVAL == 0) {
+      allocatorUpdateBudget(&allocator);
+    }
+    if (options.memoryBudgetInterval != 0 &&
+        frameNumber % options.memoryBudgetInterval == 0) {
+      allocatorPrintBudget(&allocator);
+    }
+    if (options.hostAllocInterval != 0 && frameNumber != 0 &&
+        frameNumber % options.hostAllocInterval == 0) {
+      hostAllocTrackerPrintFrame(&hostAllocTracker, frameNumber);
+    }
+
+    // the fence has signaled, so this slot's timestamps are ready to read
+    gpuProfilerBeginFrame(pGpuProfiler, currentFrame, frameNumber, device);
+
+    // the frame that last used this slot is now done, so we can read it back
+    if (options.pFrameDumpDir != NULL && frameNumber >= MAX_FRAMES_IN_FLIGHT) {
+      dumpFrame(options.pFrameDumpDir, frameNumber - MAX_FRAMES_IN_FLIGHT,
+                pOffscreenImages[currentFrame], frameDumpBuffer,
+                frameDumpBufferMemory, swapchainExtent, commandPool,
+                graphicsQueue, device);
+    }
 
     // the imageIndex is the index of the swapchain framebuffer that is
     // available next
-    uint32_t imageIndex;
-    // this function will return immediately,
-    //  so we use the semaphore to tell us when the image is actually available,
-    //  (ready for rendering to)
-    ErrVal result =
+    uint32_t imageIndex = 0;
+    VkFramebuffer framebuffer;
+    if (headless) {
+      framebuffer = pOffscreenFramebuffers[currentFrame];
+    } else {
+      // this function will return immediately,
+      //  so we use the semaphore to tell us when the image is actually available,
+      //  (ready for rendering to)
+      phaseStart = getTimeNs();
+      TRACE_BEGIN("getNextSwapchainImage");
+      ErrVal result =
+          getNextSwapchainImage(&imageIndex, swapchain, device,
+                                pImageAvailableSemaphores[currentFrame]);
+      TRACE_END("getNextSwapchainImage");
+      benchRecord(&bench, BENCH_PHASE_ACQUIRE, getTimeNs() - phaseStart);
+
+      // if the window is resized
+      if (result == ERR_OUTOFDATE) {
+        TRACE_BEGIN("recreateSwapchain");
+        // the render pass and pipeline don't depend on the window size, so only
+        // the swapchain and its attachments are rebuilt. Frames still in
+        // flight may use the old ones, so they're destroyed once those finish.
+        for (uint32_t i = 0; i < swapchainImageCount; i++) {
+          deletionQueuePushFramebuffer(&deletionQueue,
+                                       &pSwapchainFramebuffers[i]);
+          deletionQueuePushImageView(&deletionQueue, &pSwapchainImageViews[i]);
+        }
+        free(pSwapchainFramebuffers);
+        free(pSwapchainImageViews);
+        free(pSwapchainImages);
+
+        // get new window size
+        getExtentWindow(&swapchainExtent, pWindow);
+        resizeCamera(&camera, swapchainExtent);
+
+        /* recreate swap chain, handing over the old one before deleting it */
+        VkSwapchainKHR oldSwapchain = swapchain;
+        new_Swapchain(&swapchain, &swapchainImageCount, oldSwapchain,
+                      surfaceFormat, physicalDevice, device, surface,
+                      swapchainExtent, graphicsIndex, presentIndex);
+        deletionQueuePushSwapchain(&deletionQueue, &oldSwapchain);
+
+        pSwapchainImages = malloc(swapchainImageCount * sizeof(VkImage));
+        getSwapchainImages(pSwapchainImages, swapchainImageCount, device,
+                           swapchain);
+
+        pSwapchainImageViews = malloc(swapchainImageCount * sizeof(VkImageView));
+        new_SwapchainImageViews(pSwapchainImageViews, pSwapchainImages,
+                                swapchainImageCount, device,
+                                surfaceFormat.format);
+
+        // the depth image is only recreated once the window outgrows it, or
+        // shrinks far below it
+        if (resizeDepthImageCapacity(&depthImageCapacity, swapchainExtent,
+                                     physicalDevice)) {
+          deletionQueuePushImageView(&deletionQueue, &depthImageView);
+          deletionQueuePushImage(&deletionQueue, &depthImage);
+          deletionQueuePushAllocation(&deletionQueue, &depthImageAllocation);
+          new_DepthImage(&depthImage, &depthImageAllocation,
+                         depthImageCapacity, &allocator);
+          new_DepthImageView(&depthImageView, device, depthImage);
+        }
+
+        pSwapchainFramebuffers =
+            malloc(swapchainImageCount * sizeof(VkFramebuffer));
+        new_SwapchainFramebuffers(pSwapchainFramebuffers, device, renderPass,
+                                  swapchainExtent, swapchainImageCount,
+                                  depthImageView, pSwapchainImageViews);
+
+        // finally we can retry getting the swapchain
         getNextSwapchainImage(&imageIndex, swapchain, device,
                               pImageAvailableSemaphores[currentFrame]);
+        TRACE_END("recreateSwapchain");
+      }
 
-    // if the window is resized
-    if (result == ERR_OUTOFDATE) {
-      vkDeviceWaitIdle(device);
-
-      delete_SwapchainFramebuffers(pSwapchainFramebuffers, swapchainImageCount,
-                                   device);
-      free(pSwapchainFramebuffers);
-      delete_Pipeline(&graphicsPipeline, device);
-      delete_PipelineLayout(&graphicsPipelineLayout, device);
-      delete_RenderPass(&renderPass, device);
-      delete_SwapchainImageViews(pSwapchainImageViews, swapchainImageCount,
-                                 device);
-      free(pSwapchainImageViews);
-      free(pSwapchainImages);
-      delete_Swapchain(&swapchain, device);
-
-      // delete depth buffer
-      delete_ImageView(&depthImageView, device);
-      delete_Image(&depthImage, device);
-      delete_DeviceMemory(&depthImageMemory, device);
-
-      // get new window size
-      getExtentWindow(&swapchainExtent, pWindow);
-      resizeCamera(&camera, swapchainExtent);
-
-      /* recreate swap chain */
-      new_Swapchain(&swapchain, &swapchainImageCount, swapchain, surfaceFormat,
-                    physicalDevice, device, surface, swapchainExtent,
-                    graphicsIndex, presentIndex);
-
-      pSwapchainImages = malloc(swapchainImageCount * sizeof(VkImage));
-      getSwapchainImages(pSwapchainImages, swapchainImageCount, device,
-                         swapchain);
-
-      pSwapchainImageViews = malloc(swapchainImageCount * sizeof(VkImageView));
-      new_SwapchainImageViews(pSwapchainImageViews, pSwapchainImages,
-                              swapchainImageCount, device,
-                              surfaceFormat.format);
-
-      // Create depth image
-      new_DepthImage(&depthImage, &depthImageMemory, swapchainExtent,
-                     physicalDevice, device);
-      new_DepthImageView(&depthImageView, device, depthImage);
-
-      /* Create graphics pipeline */
-      new_VertexDisplayRenderPass(&renderPass, device, surfaceFormat.format);
-      new_VertexDisplayPipelineLayout(&graphicsPipelineLayout, device);
-      new_VertexDisplayPipeline(&graphicsPipeline, device, vertShaderModule,
-                                fragShaderModule, swapchainExtent, renderPass,
-                                graphicsPipelineLayout);
-      pSwapchainFramebuffers =
-          malloc(swapchainImageCount * sizeof(VkFramebuffer));
-      new_SwapchainFramebuffers(pSwapchainFramebuffers, device, renderPass,
-                                swapchainExtent, swapchainImageCount,
-                                depthImageView, pSwapchainImageViews);
-
-      // finally we can retry getting the swapchain
-      getNextSwapchainImage(&imageIndex, swapchain, device,
-                            pImageAvailableSemaphores[currentFrame]);
+
+      framebuffer = pSwapchainFramebuffers[imageIndex];
+    }
+
+    // a replay overrides the keyboard, so every run takes the same path
+    InputState input = 0;
+    if (!headless) {
+      input = pollInputState(pWindow);
+    }
+    if (options.pReplayInputPath != NULL) {
+      inputReplayerNext(&inputReplayer, &input);
+    }
+    if (options.pRecordInputPath != NULL) {
+      inputRecorderPush(&inputRecorder, input);
     }
 
     // update camera
-    updateCamera(&camera, pWindow);
+    TRACE_BEGIN("updateCamera");
+    updateCamera(&camera, input);
+    TRACE_END("updateCamera");
+
     mat4x4 mvp;
     getMvpCamera(mvp, &camera);
 
+    // the turn only depends on the frame number, so recorded runs repeat
+    const InstanceData *pUploadInstanceData = pInstanceData;
+    uint32_t uploadInstanceCount = options.instanceCount;
+    if (options.animateInstances) {
+      getInstanceGrid(pInstanceData, options.instanceCount, &meshBounds,
+                      (float)frameNumber * 0.01f);
+      if (options.cpuCull && options.cullBoxes) {
+        getInstanceBoxes(&instanceBoxes, pInstanceData, options.instanceCount,
+                         &meshBounds);
+      } else if (options.cpuCull) {
+        getInstanceSpheres(&instanceSpheres, pInstanceData,
+                           options.instanceCount, meshSphere);
+      }
+    }
+    if (options.cpuCull) {
+      TRACE_BEGIN("frustumCull");
+      Frustum frustum;
+      getFrustumCamera(&frustum, &camera);
+      uint64_t cullStart = getTimeNs();
+      uint32_t visibleCount =
+          options.cullBoxes
+              ? frustumCullBoxes(pVisibleIndices, &instanceBoxes, &frustum)
+              : frustumCullSpheres(pVisibleIndices, &instanceSpheres,
+                                   &frustum);
+      frustumCullStatsRecord(&frustumCullStats, options.instanceCount,
+                             visibleCount, getTimeNs() - cullStart);
+      for (uint32_t i = 0; i < visibleCount; i++) {
+        pVisibleInstanceData[i] = pInstanceData[pVisibleIndices[i]];
+      }
+      pUploadInstanceData = pVisibleInstanceData;
+      uploadInstanceCount = visibleCount;
+      TRACE_END("frustumCull");
+    }
+    // each copy is drawn at the coarsest level that is still accurate enough
+    // from where the camera is
+    IndexedDraw pLodDraws[MESH_LOD_MAX_LEVELS];
+    uint32_t lodDrawCount = 0;
+    if (lod) {
+      TRACE_BEGIN("selectLods");
+      const float pixelsPerUnit =
+          getPixelsPerUnitCamera(&camera, swapchainExtent);
+      if (options.instanceCount != 0) {
+        lodDrawCount = getInstanceLodDraws(
+            pLodDraws, pLodInstanceData, pLodLevels, pUploadInstanceData,
+            uploadInstanceCount, &lodChain, meshSphere, camera.pos,
+            pixelsPerUnit, options.lodThreshold);
+        pUploadInstanceData = pLodInstanceData;
+      } else {
+        vec3 offset;
+        vec3_sub(offset, meshSphere, camera.pos);
+        const MeshLod *pLevel = &lodChain.pLevels[selectMeshLod(
+            &lodChain, vec3_len(offset) - meshSphere[3], 1.0f, pixelsPerUnit,
+            options.lodThreshold)];
+        pLodDraws[0] = (IndexedDraw){
+            .indexCount = pLevel->indexCount,
+            .instanceCount = 1,
+            .firstIndex = pLevel->firstIndex,
+            .firstInstance = 0,
+        };
+        lodDrawCount = 1;
+      }
+      meshLodStatsRecord(&lodStats, &lodChain, pLodDraws, lodDrawCount);
+      TRACE_END("selectLods");
+    }
+    if (options.animateInstances || options.cpuCull ||
+        (lod && options.instanceCount != 0)) {
+      TRACE_BEGIN("instanceBufferUpdate");
+      instanceBufferUpdate(&instances, pUploadInstanceData,
+                           uploadInstanceCount, &allocator, &uploader,
+                           &deletionQueue);
+      TRACE_END("instanceBufferUpdate");
+    }
+
     // record buffer
-    recordVertexDisplayCommandBuffer(                //
-        pVertexDisplayCommandBuffers[currentFrame],  //
-        pSwapchainFramebuffers[imageIndex],          //
-        vertexBuffer,                                //
-        vertexCount,                                 //
-        renderPass,                                  //
-        graphicsPipelineLayout,                      //
-        graphicsPipeline,                            //
-        swapchainExtent,                             //
-        mvp,                                         //
-        (VkClearColorValue){.float32 = {0, 0, 0, 0}} //
+    phaseStart = getTimeNs();
+    TRACE_BEGIN("recordVertexDisplayCommandBuffer");
+    recordVertexDisplayCommandBuffer(                 //
+        pVertexDisplayCommandBuffers[currentFrame],   //
+        framebuffer,                                  //
+        vertexBuffer,                                 //
+        vertexCount,                                  //
+        indexBuffer,                                  //
+        indexCount,                                   //
+        instances.buffer,                             //
+        instances.instanceCount,                      //
+        renderPass,                                   //
+        graphicsPipelineLayout,                       //
+        graphicsPipeline,                             //
+        swapchainExtent,                              //
+        mvp,                                          //
+        pQuantization,                                //
+        (VkClearColorValue){.float32 = {0, 0, 0, 0}}, //
+        pGpuProfiler,                                 //
+        &uploader,                                    //
+        pGpuCuller,                                   //
+        lod ? pLodDraws : NULL,                       //
+        lodDrawCount,                                 //
+        pMeshletCuller,                               //
+        camera.pos                                    //
     );
+    TRACE_END("recordVertexDisplayCommandBuffer");
+    benchRecord(&bench, BENCH_PHASE_RECORD, getTimeNs() - phaseStart);
 
-    drawFrame(                                      //
-        pVertexDisplayCommandBuffers[currentFrame], //
-        swapchain,                                  //
-        imageIndex,                                 //
-        pImageAvailableSemaphores[currentFrame],    //
-        pRenderFinishedSemaphores[currentFrame],    //
-        pInFlightFences[currentFrame],              //
-        graphicsQueue,                              //
-        presentQueue                                //
-    );
+    // every instance uploaded this frame draws the whole mesh, unless levels
+    // were picked
+    if (frameNumber >= throughputFirstFrame) {
+      if (lod) {
+        for (uint32_t i = 0; i < lodDrawCount; i++) {
+          throughputTriangleCount += (uint64_t)(pLodDraws[i].indexCount / 3) *
+                                     pLodDraws[i].instanceCount;
+        }
+      } else {
+        throughputTriangleCount +=
+            (uint64_t)(indexCount / 3) *
+            (options.instanceCount != 0 ? instances.instanceCount : 1);
+      }
+    }
+
+    phaseStart = getTimeNs();
+    TRACE_BEGIN("drawFrame");
+    if (headless) {
+      drawOffscreenFrame(                             //
+          pVertexDisplayCommandBuffers[currentFrame], //
+          pInFlightFences[currentFrame],              //
+          graphicsQueue,                              //
+          &uploader                                   //
+      );
+    } else {
+      drawFrame(                                      //
+          pVertexDisplayCommandBuffers[currentFrame], //
+          swapchain,                                  //
+          imageIndex,                                 //
+          pImageAvailableSemaphores[currentFrame],    //
+          pRenderFinishedSemaphores[currentFrame],    //
+          pInFlightFences[currentFrame],              //
+          graphicsQueue,                              //
+          presentQueue,                               //
+          &uploader                                   //
+      );
+    }
+    TRACE_END("drawFrame");
+    benchRecord(&bench, BENCH_PHASE_SUBMIT, getTimeNs() - phaseStart);
 
     // increment frame
     currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+    frameNumber++;
+
+    benchRecord(&bench, BENCH_PHASE_FRAME, getTimeNs() - frameStart);
+    benchEndFrame(&bench);
+  }
+  // taken before any teardown, so shutdown isn't counted as frame time
+  const uint64_t throughputEnd = getTimeNs();
+
+  if (options.benchFrameCount != 0) {
+    writeBenchReport(&bench, options.pBenchReportPath,
+                     physicalDeviceProperties.deviceName);
+  }
+  delete_Bench(&bench);
+
+  if (options.pRecordInputPath != NULL) {
+    delete_InputRecorder(&inputRecorder);
+  }
+  if (options.pReplayInputPath != NULL) {
+    delete_InputReplayer(&inputReplayer);
+  }
+
+  if (options.pTracePath != NULL) {
+    writeTrace(options.pTracePath);
+    traceCleanup();
   }
 
   /*cleanup*/
-  vkDeviceWaitIdle(device);
+  // the uploader waits for its own queue when it is deleted, so only the
+  // frames in flight and presentation have to finish
+  vkWaitForFences(device, MAX_FRAMES_IN_FLIGHT, pInFlightFences, VK_TRUE,
+                  UINT64_MAX);
+  if (!headless) {
+    vkQueueWaitIdle(presentQueue);
+  }
+  delete_DeletionQueue(&deletionQueue);
+
+  gpuProfilerResolveAll(pGpuProfiler, device);
+
+  if (options.workloadTriangleCount != 0 && frameNumber > throughputFirstFrame) {
+    const uint32_t throughputFrameCount = frameNumber - throughputFirstFrame;
+    printWorkloadThroughput(throughputTriangleCount / throughputFrameCount,
+                            throughputFrameCount,
+                            throughputEnd - throughputStart, swapchainExtent,
+                            pGpuProfiler);
+  }
+
+  if (options.cpuCull) {
+    printFrustumCullStats(&frustumCullStats);
+  }
+
+  if (lod) {
+    printMeshLodStats(&lodStats, &lodChain);
+  }
+
+  if (options.memoryStats) {
+    allocatorPrintStats(&allocator);
+  }
+
+  if (options.hostAllocInterval != 0) {
+    hostAllocTrackerPrintSummary(&hostAllocTracker);
+  }
+
+  if (pGpuProfiler != NULL) {
+    gpuProfilerPrintSummary(pGpuProfiler);
+    delete_GpuProfiler(pGpuProfiler, device);
+  }
+
+  // write out the frames that were still in flight
+  if (options.pFrameDumpDir != NULL) {
+    uint32_t firstUndumped =
+        frameNumber > MAX_FRAMES_IN_FLIGHT ? frameNumber - MAX_FRAMES_IN_FLIGHT
+                                           : 0;
+    for (uint32_t i = firstUndumped; i < frameNumber; i++) {
+      dumpFrame(options.pFrameDumpDir, i,
+                pOffscreenImages[i % MAX_FRAMES_IN_FLIGHT], frameDumpBuffer,
+                frameDumpBufferMemory, swapchainExtent, commandPool,
+                graphicsQueue, device);
+    }
+    delete_Buffer(&frameDumpBuffer, device);
+    delete_DeviceMemory(&frameDumpBufferMemory, device);
+  }
+
   delete_ShaderModule(&fragShaderModule, device);
   delete_ShaderModule(&vertShaderModule, device);
 
@@ -317,26 +1142,70 @@ int main(void) {
                         commandPool, device);
   delete_CommandPool(&commandPool, device);
 
-  delete_SwapchainFramebuffers(pSwapchainFramebuffers, swapchainImageCount,
-                               device);
-  free(pSwapchainFramebuffers);
+  if (headless) {
+    delete_SwapchainFramebuffers(pOffscreenFramebuffers, MAX_FRAMES_IN_FLIGHT,
+                                 device);
+  } else {
+    delete_SwapchainFramebuffers(pSwapchainFramebuffers, swapchainImageCount,
+                                 device);
+    free(pSwapchainFramebuffers);
+  }
   delete_Pipeline(&graphicsPipeline, device);
   delete_PipelineLayout(&graphicsPipelineLayout, device);
   delete_Buffer(&vertexBuffer, device);
-  delete_DeviceMemory(&vertexBufferMemory, device);
+  delete_Allocation(&vertexBufferAllocation, &allocator);
+  delete_Buffer(&indexBuffer, device);
+  delete_Allocation(&indexBufferAllocation, &allocator);
+  if (options.instanceCount != 0) {
+    delete_InstanceBuffer(&instances, &allocator, device);
+    free(pInstanceData);
+  }
+  if (pGpuCuller != NULL) {
+    delete_GpuCuller(pGpuCuller);
+  }
+  if (pMeshletCuller != NULL) {
+    delete_MeshletCuller(pMeshletCuller);
+  }
+  if (options.cpuCull) {
+    delete_BoundingSpheres(&instanceSpheres);
+    delete_BoundingBoxes(&instanceBoxes);
+    free(pVisibleIndices);
+    free(pVisibleInstanceData);
+  }
+  free(pLodInstanceData);
+  free(pLodLevels);
   delete_RenderPass(&renderPass, device);
-  delete_SwapchainImageViews(pSwapchainImageViews, swapchainImageCount, device);
-  free(pSwapchainImageViews);
-  free(pSwapchainImages);
-  delete_Swapchain(&swapchain, device);
-  delete_ImageView(&depthImageView, device);
-  delete_Image(&depthImage, device);
-  delete_DeviceMemory(&depthImageMemory, device);
+  if (headless) {
+    delete_SwapchainImageViews(pOffscreenImageViews, MAX_FRAMES_IN_FLIGHT,
+                               device);
+    delete_OffscreenImages(pOffscreenImages, pOffscreenImageAllocations,
+                           MAX_FRAMES_IN_FLIGHT, &allocator);
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+      delete_ImageView(&pOffscreenDepthImageViews[i], device);
+      delete_Image(&pOffscreenDepthImages[i], device);
+      delete_Allocation(&pOffscreenDepthImageAllocations[i], &allocator);
+    }
+  } else {
+    delete_SwapchainImageViews(pSwapchainImageViews, swapchainImageCount,
+                               device);
+    free(pSwapchainImageViews);
+    free(pSwapchainImages);
+    delete_Swapchain(&swapchain, device);
+    delete_ImageView(&depthImageView, device);
+    delete_Image(&depthImage, device);
+    delete_Allocation(&depthImageAllocation, &allocator);
+  }
+  delete_AsyncUploader(&uploader, &allocator);
+  delete_Allocator(&allocator);
   delete_Device(&device);
-  delete_Surface(&surface, instance);
+  if (!headless) {
+    delete_Surface(&surface, instance);
+  }
   delete_DebugCallback(&callback, instance);
   delete_Instance(&instance);
 
-  glfwTerminate();
+  if (!headless) {
+    glfwTerminate();
+  }
   return (EXIT_SUCCESS);
 }
@@ -0,0 +1,419 @@
+#include "mesh.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MESH_NO_VERTEX UINT32_MAX
+
+// a meshlet whose triangles turn further from the axis than this cosine, about
+// 84 degrees, would only be culled from a sliver of directions, so its cone
+// isn't tested at all
+#define MESHLET_MIN_CONE_DOT 0.1f
+
+// FNV-1a over the bytes of the vertex
+static uint32_t hashVertex(const Vertex *pVertex) {
+  const uint8_t *pBytes = (const uint8_t *)pVertex;
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < sizeof(Vertex); i++) {
+    hash = (hash ^ pBytes[i]) * 16777619u;
+  }
+  return (hash);
+}
+
+ErrVal new_Mesh(Mesh *pMesh, const Vertex *pVertices,
+                const uint32_t vertexCount) {
+  // open addressing table of vertex indices, at most half full
+  size_t tableSize = 1;
+  while (tableSize < (size_t)vertexCount * 2) {
+    tableSize *= 2;
+  }
+
+  uint32_t *pTable = malloc(tableSize * sizeof(uint32_t));
+  Vertex *pWelded = malloc((size_t)vertexCount * sizeof(Vertex));
+  uint32_t *pIndices = malloc((size_t)vertexCount * sizeof(uint32_t));
+  if (!pTable || !pWelded || !pIndices) {
+    LOG_ERROR_ARGS(ERR_LEVEL_ERROR,
+                   "could not allocate mesh of %u vertices: %s", vertexCount,
+                   strerror(errno));
+    free(pTable);
+    free(pWelded);
+    free(pIndices);
+    return (ERR_ALLOCFAIL);
+  }
+  memset(pTable, 0xFF, tableSize * sizeof(uint32_t));
+
+  uint32_t weldedCount = 0;
+  for (uint32_t i = 0; i < vertexCount; i++) {
+    size_t slot = hashVertex(&pVertices[i]) & (tableSize - 1);
+    while (pTable[slot] != MESH_NO_VERTEX &&
+           memcmp(&pWelded[pTable[slot]], &pVertices[i], sizeof(Vertex))) {
+      slot = (slot + 1) & (tableSize - 1);
+    }
+    if (pTable[slot] == MESH_NO_VERTEX) {
+      pTable[slot] = weldedCount;
+      pWelded[weldedCount++] = pVertices[i];
+    }
+    pIndices[i] = pTable[slot];
+  }
+  free(pTable);
+
+  // give back what the merged vertices took up
+  if (weldedCount != 0) {
+    Vertex *pShrunk = realloc(pWelded, (size_t)weldedCount * sizeof(Vertex));
+    if (pShrunk) {
+      pWelded = pShrunk;
+    }
+  }
+  pMesh->pVertices = pWelded;
+  pMesh->vertexCount = weldedCount;
+  pMesh->pIndices = pIndices;
+  pMesh->indexCount = vertexCount;
+  return (ERR_OK);
+}
+
+void delete_Mesh(Mesh *pMesh) {
+  free(pMesh->pVertices);
+  free(pMesh->pIndices);
+  pMesh->pVertices = NULL;
+  pMesh->pIndices = NULL;
+}
+
+// in the dead end stack, finds a vertex that still has triangles left, and
+// failing that, the next one in index order
+static int64_t skipDeadEnd(const uint32_t *pLiveCounts,
+                           const uint32_t *pDeadEnds, uint32_t *pDeadEndCount,
+                           uint32_t *pCursor, const uint32_t vertexCount) {
+  while (*pDeadEndCount > 0) {
+    uint32_t vertex = pDeadEnds[--*pDeadEndCount];
+    if (pLiveCounts[vertex] > 0) {
+      return (vertex);
+    }
+  }
+  while (*pCursor < vertexCount) {
+    uint32_t vertex = (*pCursor)++;
+    if (pLiveCounts[vertex] > 0) {
+      return (vertex);
+    }
+  }
+  return (-1);
+}
+
+ErrVal meshOptimizeVertexCache(Mesh *pMesh) {
+  const uint32_t vertexCount = pMesh->vertexCount;
+  const uint32_t triangleCount = pMesh->indexCount / 3;
+  const uint32_t *pIndices = pMesh->pIndices;
+
+  // the triangles using each vertex, pAdjacency[pOffsets[v]..pOffsets[v+1]]
+  uint32_t *pOffsets = calloc((size_t)vertexCount + 1, sizeof(uint32_t));
+  uint32_t *pAdjacency = malloc((size_t)pMesh->indexCount * sizeof(uint32_t));
+  uint32_t *pLiveCounts = calloc(vertexCount, sizeof(uint32_t));
+  uint32_t *pCacheTimes = calloc(vertexCount, sizeof(uint32_t));
+  uint32_t *pDeadEnds = malloc((size_t)pMesh->indexCount * sizeof(uint32_t));
+  uint32_t *pCandidates = malloc((size_t)pMesh->indexCount * sizeof(uint32_t));
+  uint8_t *pEmitted = calloc(triangleCount, sizeof(uint8_t));
+  uint32_t *pOutput = malloc((size_t)pMesh->indexCount * sizeof(uint32_t));
+  if (!pOffsets || !pAdjacency || !pLiveCounts || !pCacheTimes || !pDeadEnds ||
+      !pCandidates || !pEmitted || !pOutput) {
+    LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "could not allocate cache optimizer: %s",
+                   strerror(errno));
+    free(pOffsets);
+    free(pAdjacency);
+    free(pLiveCounts);
+    free(pCacheTimes);
+    free(pDeadEnds);
+    free(pCandidates);
+    free(pEmitted);
+    free(pOutput);
+    return (ERR_ALLOCFAIL);
+  }
+
+  for (uint32_t i = 0; i < pMesh->indexCount; i++) {
+    pLiveCounts[pIndices[i]]++;
+  }
+  for (uint32_t v = 0; v < vertexCount; v++) {
+    pOffsets[v + 1] = pOffsets[v] + pLiveCounts[v];
+  }
+  // fill each vertex's list, using pCacheTimes as the fill cursor for now
+  for (uint32_t t = 0; t < triangleCount; t++) {
+    for (uint32_t j = 0; j < 3; j++) {
+      uint32_t v = pIndices[t * 3 + j];
+      pAdjacency[pOffsets[v] + pCacheTimes[v]++] = t;
+    }
+  }
+  memset(pCacheTimes, 0, vertexCount * sizeof(uint32_t));
+
+  uint32_t outputCount = 0;
+  uint32_t deadEndCount = 0;
+  uint32_t cursor = 1;
+  // a vertex is in the cache while time - pCacheTimes[v] <= cache size
+  uint32_t time = MESH_VERTEX_CACHE_SIZE + 1;
+  int64_t fanning = vertexCount > 0 ? 0 : -1;
+  while (fanning >= 0) {
+    const uint32_t f = (uint32_t)fanning;
+    uint32_t candidateCount = 0;
+
+    // emit every remaining triangle around the fanning vertex
+    for (uint32_t a = pOffsets[f]; a < pOffsets[f + 1]; a++) {
+      uint32_t t = pAdjacency[a];
+      if (pEmitted[t]) {
+        continue;
+      }
+      for (uint32_t j = 0; j < 3; j++) {
+        uint32_t v = pIndices[t * 3 + j];
+        pOutput[outputCount++] = v;
+        pDeadEnds[deadEndCount++] = v;
+        pCandidates[candidateCount++] = v;
+        pLiveCounts[v]--;
+        if (time - pCacheTimes[v] > MESH_VERTEX_CACHE_SIZE) {
+          pCacheTimes[v] = time++;
+        }
+      }
+      pEmitted[t] = 1;
+    }
+
+    // fan next around the vertex that will stay in the cache the longest
+    // while its remaining triangles are emitted
+    int64_t next = -1;
+    int64_t bestPriority = -1;
+    for (uint32_t c = 0; c < candidateCount; c++) {
+      uint32_t v = pCandidates[c];
+      if (pLiveCounts[v] == 0) {
+        continue;
+      }
+      int64_t priority = 0;
+      uint32_t age = time - pCacheTimes[v];
+      if (age + 2 * pLiveCounts[v] <= MESH_VERTEX_CACHE_SIZE) {
+        priority = age;
+      }
+      if (priority > bestPriority) {
+        bestPriority = priority;
+        next = v;
+      }
+    }
+    if (next == -1) {
+      next = skipDeadEnd(pLiveCounts, pDeadEnds, &deadEndCount, &cursor,
+                         vertexCount);
+    }
+    fanning = next;
+  }
+
+  free(pMesh->pIndices);
+  pMesh->pIndices = pOutput;
+
+  free(pOffsets);
+  free(pAdjacency);
+  free(pLiveCounts);
+  free(pCacheTimes);
+  free(pDeadEnds);
+  free(pCandidates);
+  free(pEmitted);
+  return (ERR_OK);
+}
+
+ErrVal meshOptimizeVertexFetch(Mesh *pMesh) {
+  uint32_t *pRemap = malloc((size_t)pMesh->vertexCount * sizeof(uint32_t));
+  Vertex *pVertices = malloc((size_t)pMesh->vertexCount * sizeof(Vertex));
+  if (!pRemap || !pVertices) {
+    LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "could not allocate fetch optimizer: %s",
+                   strerror(errno));
+    free(pRemap);
+    free(pVertices);
+    return (ERR_ALLOCFAIL);
+  }
+  memset(pRemap, 0xFF, pMesh->vertexCount * sizeof(uint32_t));
+
+  uint32_t vertexCount = 0;
+  for (uint32_t i = 0; i < pMesh->indexCount; i++) {
+    uint32_t v = pMesh->pIndices[i];
+    if (pRemap[v] == MESH_NO_VERTEX) {
+      pRemap[v] = vertexCount;
+      pVertices[vertexCount++] = pMesh->pVertices[v];
+    }
+    pMesh->pIndices[i] = pRemap[v];
+  }
+  free(pRemap);
+
+  free(pMesh->pVertices);
+  pMesh->pVertices = pVertices;
+  pMesh->vertexCount = vertexCount;
+  return (ERR_OK);
+}
+
+ErrVal getMeshAcmr(float *pAcmr, const uint32_t *pIndices,
+                   const uint32_t indexCount, const uint32_t vertexCount) {
+  uint32_t *pCacheTimes = calloc(vertexCount, sizeof(uint32_t));
+  if (!pCacheTimes) {
+    LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "could not allocate cache simulation: %s",
+                   strerror(errno));
+    return (ERR_ALLOCFAIL);
+  }
+
+  // same timestamp trick as the optimizer, which is exactly a FIFO
+  uint32_t time = MESH_VERTEX_CACHE_SIZE + 1;
+  uint32_t misses = 0;
+  for (uint32_t i = 0; i < indexCount; i++) {
+    uint32_t v = pIndices[i];
+    if (time - pCacheTimes[v] > MESH_VERTEX_CACHE_SIZE) {
+      pCacheTimes[v] = time++;
+      misses++;
+    }
+  }
+  free(pCacheTimes);
+
+  *pAcmr = indexCount >= 3 ? (float)misses / (float)(indexCount / 3) : 0.0f;
+  return (ERR_OK);
+}
+
+static void computeMeshletBounds(Meshlet *pMeshlet, const Vertex *pVertices,
+                                 const uint32_t *pIndices) {
+  const uint32_t *pMeshletIndices = &pIndices[pMeshlet->firstIndex];
+
+  // the sphere around the bounding box is close enough for a few dozen
+  // nearby vertices
+  vec3 lower;
+  vec3 upper;
+  vec3_dup(lower, pVertices[pMeshletIndices[0]].position);
+  vec3_dup(upper, lower);
+  for (uint32_t i = 1; i < pMeshlet->indexCount; i++) {
+    const float *p = pVertices[pMeshletIndices[i]].position;
+    for (uint32_t j = 0; j < 3; j++) {
+      lower[j] = fminf(lower[j], p[j]);
+      upper[j] = fmaxf(upper[j], p[j]);
+    }
+  }
+  vec3 center;
+  vec3_add(center, lower, upper);
+  vec3_scale(center, center, 0.5f);
+  float radius = 0.0f;
+  for (uint32_t i = 0; i < pMeshlet->indexCount; i++) {
+    vec3 offset;
+    vec3_sub(offset, pVertices[pMeshletIndices[i]].position, center);
+    radius = fmaxf(radius, vec3_len(offset));
+  }
+  pMeshlet->sphere[0] = center[0];
+  pMeshlet->sphere[1] = center[1];
+  pMeshlet->sphere[2] = center[2];
+  pMeshlet->sphere[3] = radius;
+
+  // the axis is the average facing, and the cone is as wide as the triangle
+  // that turns furthest from it
+  vec3 pNormals[MESHLET_MAX_TRIANGLES];
+  uint32_t normalCount = 0;
+  vec3 axis = {0.0f, 0.0f, 0.0f};
+  for (uint32_t i = 0; i < pMeshlet->indexCount; i += 3) {
+    const float *p0 = pVertices[pMeshletIndices[i + 0]].position;
+    vec3 e1;
+    vec3 e2;
+    vec3_sub(e1, pVertices[pMeshletIndices[i + 1]].position, p0);
+    vec3_sub(e2, pVertices[pMeshletIndices[i + 2]].position, p0);
+    vec3 normal;
+    vec3_mul_cross(normal, e1, e2);
+    const float length = vec3_len(normal);
+    // degenerate triangles face nowhere, and are never drawn anyway
+    if (length == 0.0f) {
+      continue;
+    }
+    vec3_scale(pNormals[normalCount], normal, 1.0f / length);
+    vec3_add(axis, axis, pNormals[normalCount]);
+    normalCount++;
+  }
+  const float axisLength = vec3_len(axis);
+  float minDot = -1.0f;
+  if (axisLength > 0.0f) {
+    vec3_scale(axis, axis, 1.0f / axisLength);
+    minDot = 1.0f;
+    for (uint32_t i = 0; i < normalCount; i++) {
+      minDot = fminf(minDot, vec3_mul_inner(pNormals[i], axis));
+    }
+  }
+  pMeshlet->cone[0] = axis[0];
+  pMeshlet->cone[1] = axis[1];
+  pMeshlet->cone[2] = axis[2];
+  // every triangle faces away once the camera is within 90 degrees minus the
+  // spread of the axis, seen from behind, so the cutoff is the sine of it
+  pMeshlet->cone[3] = minDot < MESHLET_MIN_CONE_DOT
+                          ? 1.0f
+                          : sqrtf(1.0f - minDot * minDot);
+}
+
+ErrVal new_Meshlets(Meshlets *pMeshlets, const Mesh *pMesh) {
+  const uint32_t triangleCount = pMesh->indexCount / 3;
+  // a meshlet is only closed early once it can't fit another 3 vertices, so
+  // every meshlet but the last has at least this many triangles
+  const uint32_t minTriangles = (MESHLET_MAX_VERTICES - 2) / 3;
+  const uint32_t maxMeshletCount = triangleCount / minTriangles + 1;
+
+  // the meshlet that last used each vertex
+  uint32_t *pVertexMeshlets = malloc(pMesh->vertexCount * sizeof(uint32_t));
+  Meshlet *pMeshletArray = calloc(maxMeshletCount, sizeof(Meshlet));
+  uint32_t *pIndices = malloc((size_t)pMesh->indexCount * sizeof(uint32_t));
+  if (!pVertexMeshlets || !pMeshletArray || !pIndices) {
+    LOG_ERROR_ARGS(ERR_LEVEL_ERROR,
+                   "could not allocate meshlets of %u triangles: %s",
+                   triangleCount, strerror(errno));
+    free(pVertexMeshlets);
+    free(pMeshletArray);
+    free(pIndices);
+    return (ERR_ALLOCFAIL);
+  }
+  memset(pVertexMeshlets, 0xFF, pMesh->vertexCount * sizeof(uint32_t));
+  memcpy(pIndices, pMesh->pIndices,
+         (size_t)pMesh->indexCount * sizeof(uint32_t));
+
+  // the last meshlet is open, and takes triangles until one doesn't fit
+  uint32_t meshletCount = triangleCount != 0 ? 1 : 0;
+  uint32_t meshletVertexCount = 0;
+  uint64_t vertexCount = 0;
+  for (uint32_t t = 0; t < triangleCount; t++) {
+    const uint32_t *pTriangle = &pIndices[t * 3];
+    uint32_t newVertexCount = 0;
+    for (uint32_t j = 0; j < 3; j++) {
+      newVertexCount += pVertexMeshlets[pTriangle[j]] != meshletCount - 1;
+    }
+    if (meshletVertexCount + newVertexCount > MESHLET_MAX_VERTICES ||
+        pMeshletArray[meshletCount - 1].indexCount ==
+            MESHLET_MAX_TRIANGLES * 3) {
+      pMeshletArray[meshletCount].firstIndex = t * 3;
+      meshletCount++;
+      meshletVertexCount = 0;
+    }
+    for (uint32_t j = 0; j < 3; j++) {
+      if (pVertexMeshlets[pTriangle[j]] != meshletCount - 1) {
+        pVertexMeshlets[pTriangle[j]] = meshletCount - 1;
+        meshletVertexCount++;
+        vertexCount++;
+      }
+    }
+    pMeshletArray[meshletCount - 1].indexCount += 3;
+  }
+  free(pVertexMeshlets);
+
+  for (uint32_t m = 0; m < meshletCount; m++) {
+    computeMeshletBounds(&pMeshletArray[m], pMesh->pVertices, pIndices);
+  }
+
+  // give back what the estimate overshot
+  if (meshletCount != 0) {
+    Meshlet *pShrunk =
+        realloc(pMeshletArray, meshletCount * sizeof(Meshlet));
+    if (pShrunk) {
+      pMeshletArray = pShrunk;
+    }
+  }
+  pMeshlets->pMeshlets = pMeshletArray;
+  pMeshlets->meshletCount = meshletCount;
+  pMeshlets->pIndices = pIndices;
+  pMeshlets->indexCount = triangleCount * 3;
+  pMeshlets->vertexCount = vertexCount;
+  return (ERR_OK);
+}
+
+void delete_Meshlets(Meshlets *pMeshlets) {
+  free(pMeshlets->pMeshlets);
+  free(pMeshlets->pIndices);
+  pMeshlets->pMeshlets = NULL;
+  pMeshlets->pIndices = NULL;
+}
@@ -0,0 +1,82 @@
+#ifndef SRC_MESH_H_
+#define SRC_MESH_H_
+
+#include <stdint.h>
+
+#include "errors.h"
+#include "vulkan_utils.h"
+
+// entries of the FIFO post-transform cache that meshes are optimized for and
+// that ACMR is measured with, about what current GPUs keep around
+#define MESH_VERTEX_CACHE_SIZE 16
+
+// An indexed triangle list
+typedef struct {
+  Vertex *pVertices;
+  uint32_t vertexCount;
+  uint32_t *pIndices;
+  uint32_t indexCount;
+} Mesh;
+
+/// Creates an indexed mesh from a non indexed triangle list, merging vertices
+/// that are exactly equal
+/// --- PRECONDITIONS ---
+/// * `pMesh` is a valid pointer
+/// * `vertexCount` is a multiple of 3
+/// --- POSTCONDITIONS ---
+/// * returns error status
+/// * on success, triangles keep their order and winding
+/// * returns ERR_ALLOCFAIL if there isn't enough memory
+/// --- CLEANUP ---
+/// * call `delete_Mesh`
+ErrVal new_Mesh(Mesh *pMesh, const Vertex *pVertices,
+                const uint32_t vertexCount);
+
+void delete_Mesh(Mesh *pMesh);
+
+/// Reorders triangles so that vertices are reused while still in the
+/// post-transform cache, using Tipsify (Sander et al. 2007), which runs in
+/// linear time
+/// --- POSTCONDITIONS ---
+/// * returns error status
+/// * the same triangles are drawn with the same winding
+/// * returns ERR_ALLOCFAIL if there isn't enough memory, leaving the mesh as
+/// it was
+ErrVal meshOptimizeVertexCache(Mesh *pMesh);
+
+/// Reorders vertices by first use in the index buffer, so vertex fetches walk
+/// through memory in order
+/// --- POSTCONDITIONS ---
+/// * returns error status
+/// * vertices no index refers to are dropped
+/// * returns ERR_ALLOCFAIL if there isn't enough memory, leaving the mesh as
+/// it was
+ErrVal meshOptimizeVertexFetch(Mesh *pMesh);
+
+/// Splits a mesh into meshlets of at most MESHLET_MAX_VERTICES vertices and
+/// MESHLET_MAX_TRIANGLES triangles, and computes their bounds
+/// Triangles are taken in index order, so a mesh optimized for the vertex
+/// cache gives compact meshlets
+/// Triangles face the side they wind counter-clockwise on
+/// --- PRECONDITIONS ---
+/// * `pMeshlets` is a valid pointer
+/// --- POSTCONDITIONS ---
+/// * returns error status
+/// * returns ERR_ALLOCFAIL if there isn't enough memory
+/// --- CLEANUP ---
+/// * call `delete_Meshlets`
+ErrVal new_Meshlets(Meshlets *pMeshlets, const Mesh *pMesh);
+
+void delete_Meshlets(Meshlets *pMeshlets);
+
+/// Computes the average cache miss ratio, the number of vertices shaded per
+/// triangle with a FIFO cache of MESH_VERTEX_CACHE_SIZE entries
+/// 3 means every vertex is shaded once per triangle, 0.5 is the ideal for
+/// large regular grids
+/// --- POSTCONDITIONS ---
+/// * returns error status
+/// * on success, `*pAcmr` is the ratio, or 0 if there are no triangles
+ErrVal getMeshAcmr(float *pAcmr, const uint32_t *pIndices,
+                   const uint32_t indexCount, const uint32_t vertexCount);
+
+#endif // SRC_MESH_H_
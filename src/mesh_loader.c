@@ -0,0 +1,1546 @@
+// needed for sysconf
+#define _POSIX_C_SOURCE 200809L
+
+#include "mesh_loader.h"
+
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include "utils.h"
+
+// files smaller than this many bytes per chunk aren't worth splitting further
+#define MESH_LOADER_MIN_CHUNK_SIZE (64 * 1024)
+// tasks expanding triangles take at least this many
+#define MESH_LOADER_MIN_TASK_TRIANGLES 4096
+// most buffers a .gltf may refer to
+#define MESH_LOADER_MAX_BUFFERS 16
+#define MESH_LOADER_MAX_JSON_DEPTH 64
+#define MESH_LOADER_MAX_PLY_ELEMENTS 8
+#define MESH_LOADER_MAX_PLY_PROPERTIES 32
+#define MESH_LOADER_MAX_PATH_LENGTH 4096
+
+// the most triangles whose vertices can be counted in a uint32_t
+#define MESH_LOADER_MAX_TRIANGLE_COUNT (UINT32_MAX / 3)
+
+// Tasks of one kind, taken in order by every thread until none are left
+typedef struct {
+  uint8_t *pTasks;
+  size_t taskSize;
+  uint32_t taskCount;
+  void (*pfnRun)(void *pTask);
+  uint32_t nextTask;
+} TaskQueue;
+
+static void *runTaskQueue(void *pArg) {
+  TaskQueue *pQueue = pArg;
+  for (;;) {
+    uint32_t i = __atomic_fetch_add(&pQueue->nextTask, 1, __ATOMIC_RELAXED);
+    if (i >= pQueue->taskCount) {
+      return (NULL);
+    }
+    pQueue->pfnRun(pQueue->pTasks + (size_t)i * pQueue->taskSize);
+  }
+}
+
+// runs every task on up to `threadCount` threads, including the calling one
+static void runTasks(void *pTasks, const size_t taskSize,
+                     const uint32_t taskCount, void (*pfnRun)(void *pTask),
+                     const uint32_t threadCount) {
+  TaskQueue queue = {.pTasks = pTasks,
+                     .taskSize = taskSize,
+                     .taskCount = taskCount,
+                     .pfnRun = pfnRun,
+                     .nextTask = 0};
+  pthread_t pThreads[MESH_LOADER_MAX_THREADS];
+  uint32_t startedCount = 0;
+  for (uint32_t i = 1; i < threadCount && i < taskCount; i++) {
+    // if a thread can't be started, the others take over its share
+    if (pthread_create(&pThreads[startedCount], NULL, runTaskQueue, &queue) !=
+        0) {
+      break;
+    }
+    startedCount++;
+  }
+  runTaskQueue(&queue);
+  for (uint32_t i = 0; i < startedCount; i++) {
+    pthread_join(pThreads[i], NULL);
+  }
+}
+
+typedef enum {
+  MESH_COMPONENT_FLOAT,
+  MESH_COMPONENT_UNORM8,
+  MESH_COMPONENT_UNORM16,
+  MESH_COMPONENT_UINT8,
+  MESH_COMPONENT_UINT16,
+  MESH_COMPONENT_UINT32,
+} MeshComponentType;
+
+// `count` elements of 3 or more components, `stride` bytes apart
+typedef struct {
+  // NULL if the attribute is missing
+  const uint8_t *pData;
+  size_t stride;
+  MeshComponentType type;
+  uint32_t count;
+} MeshAttribute;
+
+// Triangles in a file, in whatever layout the format has them
+typedef struct {
+  MeshAttribute positions;
+  MeshAttribute colors;
+  // index k of triangle t is at pIndices + t * triangleStride + k * indexStride
+  // NULL if every three vertices make a triangle
+  const uint8_t *pIndices;
+  size_t triangleStride;
+  size_t indexStride;
+  MeshComponentType indexType;
+  uint32_t triangleCount;
+  // where the triangles start in the output
+  uint32_t firstVertex;
+} MeshPrimitive;
+
+static float readComponent(const uint8_t *pElement,
+                           const MeshComponentType type, const uint32_t i) {
+  switch (type) {
+  case MESH_COMPONENT_FLOAT: {
+    float value;
+    memcpy(&value, pElement + i * sizeof(float), sizeof(float));
+    return (value);
+  }
+  case MESH_COMPONENT_UNORM8:
+    return ((float)pElement[i] / 255.0f);
+  case MESH_COMPONENT_UNORM16: {
+    uint16_t value;
+    memcpy(&value, pElement + i * sizeof(uint16_t), sizeof(uint16_t));
+    return ((float)value / 65535.0f);
+  }
+  default:
+    return (0.0f);
+  }
+}
+
+static uint32_t readIndex(const uint8_t *pIndex,
+                          const MeshComponentType type) {
+  switch (type) {
+  case MESH_COMPONENT_UINT8:
+    return (*pIndex);
+  case MESH_COMPONENT_UINT16: {
+    uint16_t index;
+    memcpy(&index, pIndex, sizeof(uint16_t));
+    return (index);
+  }
+  case MESH_COMPONENT_UINT32: {
+    uint32_t index;
+    memcpy(&index, pIndex, sizeof(uint32_t));
+    return (index);
+  }
+  default:
+    return (UINT32_MAX);
+  }
+}
+
+typedef struct {
+  const MeshPrimitive *pPrimitive;
+  uint32_t firstTriangle;
+  uint32_t triangleCount;
+  Vertex *pVertices;
+  ErrVal result;
+} ExpandTask;
+
+static void expandTriangles(void *pArg) {
+  ExpandTask *pTask = pArg;
+  const MeshPrimitive *pPrimitive = pTask->pPrimitive;
+  const MeshAttribute *pPositions = &pPrimitive->positions;
+  const MeshAttribute *pColors = &pPrimitive->colors;
+  pTask->result = ERR_OK;
+
+  for (uint32_t t = pTask->firstTriangle;
+       t < pTask->firstTriangle + pTask->triangleCount; t++) {
+    Vertex *pOut =
+        &pTask->pVertices[pPrimitive->firstVertex + (size_t)t * 3];
+    for (uint32_t k = 0; k < 3; k++) {
+      uint32_t index = t * 3 + k;
+      if (pPrimitive->pIndices != NULL) {
+        index = readIndex(pPrimitive->pIndices +
+                              (size_t)t * pPrimitive->triangleStride +
+                              k * pPrimitive->indexStride,
+                          pPrimitive->indexType);
+      }
+      if (index >= pPositions->count ||
+          (pColors->pData != NULL && index >= pColors->count)) {
+        pTask->result = ERR_BADARGS;
+        return;
+      }
+      const uint8_t *pPosition =
+          pPositions->pData + (size_t)index * pPositions->stride;
+      for (uint32_t j = 0; j < 3; j++) {
+        pOut[k].position[j] = readComponent(pPosition, pPositions->type, j);
+      }
+      if (pColors->pData != NULL) {
+        const uint8_t *pColor =
+            pColors->pData + (size_t)index * pColors->stride;
+        for (uint32_t j = 0; j < 3; j++) {
+          pOut[k].color[j] = readComponent(pColor, pColors->type, j);
+        }
+      }
+    }
+
+    // without colors, shade by which way the triangle faces
+    if (pColors->pData == NULL) {
+      vec3 edge1;
+      vec3 edge2;
+      vec3 normal;
+      vec3_sub(edge1, pOut[1].position, pOut[0].position);
+      vec3_sub(edge2, pOut[2].position, pOut[0].position);
+      vec3_mul_cross(normal, edge1, edge2);
+      float length = vec3_len(normal);
+      for (uint32_t j = 0; j < 3; j++) {
+        float color = length > 0.0f ? fabsf(normal[j]) / length : 1.0f;
+        for (uint32_t k = 0; k < 3; k++) {
+          pOut[k].color[j] = color;
+        }
+      }
+    }
+  }
+}
+
+// turns the triangles of every primitive into one triangle list
+static ErrVal expandPrimitives(Vertex **ppVertices, uint32_t *pVertexCount,
+                               MeshPrimitive *pPrimitives,
+                               const uint32_t primitiveCount,
+                               const uint32_t threadCount) {
+  uint64_t triangleCount = 0;
+  for (uint32_t i = 0; i < primitiveCount; i++) {
+    pPrimitives[i].firstVertex = (uint32_t)(triangleCount * 3);
+    triangleCount += pPrimitives[i].triangleCount;
+    if (triangleCount > MESH_LOADER_MAX_TRIANGLE_COUNT) {
+      LOG_ERROR(ERR_LEVEL_ERROR, "mesh has too many triangles");
+      return (ERR_NOTSUPPORTED);
+    }
+  }
+  if (triangleCount == 0) {
+    LOG_ERROR(ERR_LEVEL_ERROR, "mesh has no triangles");
+    return (ERR_BADARGS);
+  }
+
+  uint32_t trianglesPerTask = (uint32_t)(
+      triangleCount / (threadCount * MESH_LOADER_TASKS_PER_THREAD) + 1);
+  if (trianglesPerTask < MESH_LOADER_MIN_TASK_TRIANGLES) {
+    trianglesPerTask = MESH_LOADER_MIN_TASK_TRIANGLES;
+  }
+  uint32_t taskCount = 0;
+  for (uint32_t i = 0; i < primitiveCount; i++) {
+    taskCount += (pPrimitives[i].triangleCount + trianglesPerTask - 1) /
+                 trianglesPerTask;
+  }
+
+  Vertex *pVertices = malloc((size_t)triangleCount * 3 * sizeof(Vertex));
+  ExpandTask *pTasks = malloc((size_t)taskCount * sizeof(ExpandTask));
+  if ((!pVertices && triangleCount != 0) || (!pTasks && taskCount != 0)) {
+    LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "could not allocate %llu triangles: %s",
+                   (unsigned long long)triangleCount, strerror(errno));
+    free(pVertices);
+    free(pTasks);
+    return (ERR_ALLOCFAIL);
+  }
+
+  uint32_t task = 0;
+  for (uint32_t i = 0; i < primitiveCount; i++) {
+    for (uint32_t first = 0; first < pPrimitives[i].triangleCount;
+         first += trianglesPerTask) {
+      uint32_t count = pPrimitives[i].triangleCount - first;
+      pTasks[task++] = (ExpandTask){
+          .pPrimitive = &pPrimitives[i],
+          .firstTriangle = first,
+          .triangleCount = count < trianglesPerTask ? count : trianglesPerTask,
+          .pVertices = pVertices,
+      };
+    }
+  }
+  runTasks(pTasks, sizeof(ExpandTask), taskCount, expandTriangles,
+           threadCount);
+
+  ErrVal retVal = ERR_OK;
+  for (uint32_t i = 0; i < taskCount; i++) {
+    if (pTasks[i].result != ERR_OK) {
+      retVal = pTasks[i].result;
+    }
+  }
+  free(pTasks);
+  if (retVal != ERR_OK) {
+    LOG_ERROR(ERR_LEVEL_ERROR, "mesh has an out of range vertex index");
+    free(pVertices);
+    return (retVal);
+  }
+
+  *ppVertices = pVertices;
+  *pVertexCount = (uint32_t)(triangleCount * 3);
+  return (ERR_OK);
+}
+
+// OBJ
+
+// A range of lines of an OBJ file
+typedef struct {
+  const char *pBegin;
+  const char *pEnd;
+  // counted in the first pass
+  uint32_t positionCount;
+  uint64_t triangleCount;
+  // where the chunk's positions and triangles go, from the chunks before it
+  uint32_t firstPosition;
+  uint32_t firstTriangle;
+  uint32_t totalPositionCount;
+  // positions are stored as vertices, so colors can go right next to them
+  Vertex *pPositions;
+  uint32_t *pIndices;
+  bool hasColors;
+  ErrVal result;
+} ObjChunk;
+
+static const char *nextLine(const char *p, const char *pEnd) {
+  const char *pNewline = memchr(p, '\n', (size_t)(pEnd - p));
+  return (pNewline != NULL ? pNewline + 1 : pEnd);
+}
+
+static bool isObjSpace(const char c) { return (c == ' ' || c == '\t'); }
+
+static bool isObjLineEnd(const char c) {
+  return (c == '\n' || c == '\r' || c == '#');
+}
+
+static const char *skipObjSpace(const char *p, const char *pEnd) {
+  while (p < pEnd && isObjSpace(*p)) {
+    p++;
+  }
+  return (p);
+}
+
+static bool isObjCommand(const char *p, const char *pEnd, const char command) {
+  return (pEnd - p >= 2 && p[0] == command && isObjSpace(p[1]));
+}
+
+static const double pPowersOfTen[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+// parses a decimal number like strtod, without looking at the locale, and
+// returns a pointer past it, or NULL if there is none
+static const char *parseObjFloat(const char *p, const char *pEnd,
+                                 float *pValue) {
+  bool negative = false;
+  if (p < pEnd && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    p++;
+  }
+  uint64_t mantissa = 0;
+  int32_t exponent = 0;
+  uint32_t digitCount = 0;
+  for (; p < pEnd && *p >= '0' && *p <= '9'; p++, digitCount++) {
+    // digits past what a uint64_t holds only scale the number
+    if (mantissa < UINT64_MAX / 10 - 9) {
+      mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+    } else {
+      exponent++;
+    }
+  }
+  if (p < pEnd && *p == '.') {
+    for (p++; p < pEnd && *p >= '0' && *p <= '9'; p++, digitCount++) {
+      if (mantissa < UINT64_MAX / 10 - 9) {
+        mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+        exponent--;
+      }
+    }
+  }
+  if (digitCount == 0) {
+    return (NULL);
+  }
+  if (p < pEnd && (*p == 'e' || *p == 'E')) {
+    const char *pExponent = p + 1;
+    bool negativeExponent = false;
+    if (pExponent < pEnd && (*pExponent == '-' || *pExponent == '+')) {
+      negativeExponent = *pExponent == '-';
+      pExponent++;
+    }
+    int32_t value = 0;
+    const char *pDigits = pExponent;
+    for (; pExponent < pEnd && *pExponent >= '0' && *pExponent <= '9';
+         pExponent++) {
+      if (value < 100000) {
+        value = value * 10 + (*pExponent - '0');
+      }
+    }
+    if (pExponent != pDigits) {
+      exponent += negativeExponent ? -value : value;
+      p = pExponent;
+    }
+  }
+
+  double value = (double)mantissa;
+  int32_t magnitude = exponent < 0 ? -exponent : exponent;
+  double scale = magnitude <= 22 ? pPowersOfTen[magnitude]
+                                 : pow(10.0, (double)magnitude);
+  value = exponent < 0 ? value / scale : value * scale;
+  *pValue = (float)(negative ? -value : value);
+  return (p);
+}
+
+// parses a signed integer, returns a pointer past it or NULL if there is none
+static const char *parseObjInt(const char *p, const char *pEnd,
+                               int64_t *pValue) {
+  bool negative = false;
+  if (p < pEnd && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    p++;
+  }
+  const char *pDigits = p;
+  int64_t value = 0;
+  for (; p < pEnd && *p >= '0' && *p <= '9'; p++) {
+    if (value < INT64_MAX / 10 - 9) {
+      value = value * 10 + (*p - '0');
+    }
+  }
+  if (p == pDigits) {
+    return (NULL);
+  }
+  *pValue = negative ? -value : value;
+  return (p);
+}
+
+// counts the positions and triangles in a chunk
+static void countObjChunk(void *pArg) {
+  ObjChunk *pChunk = pArg;
+  for (const char *p = pChunk->pBegin; p < pChunk->pEnd;
+       p = nextLine(p, pChunk->pEnd)) {
+    if (isObjCommand(p, pChunk->pEnd, 'v')) {
+      pChunk->positionCount++;
+    } else if (isObjCommand(p, pChunk->pEnd, 'f')) {
+      uint32_t cornerCount = 0;
+      const char *q = skipObjSpace(p + 2, pChunk->pEnd);
+      while (q < pChunk->pEnd && !isObjLineEnd(*q)) {
+        cornerCount++;
+        while (q < pChunk->pEnd && !isObjSpace(*q) && !isObjLineEnd(*q)) {
+          q++;
+        }
+        q = skipObjSpace(q, pChunk->pEnd);
+      }
+      if (cornerCount >= 3) {
+        pChunk->triangleCount += cornerCount - 2;
+      }
+    }
+  }
+}
+
+// parses the positions of a chunk, and the indices of its faces
+static void parseObjChunk(void *pArg) {
+  ObjChunk *pChunk = pArg;
+  const char *pEnd = pChunk->pEnd;
+  uint32_t position = pChunk->firstPosition;
+  uint32_t *pIndices = pChunk->pIndices + (size_t)pChunk->firstTriangle * 3;
+  pChunk->result = ERR_OK;
+
+  for (const char *p = pChunk->pBegin; p < pEnd; p = nextLine(p, pEnd)) {
+    if (isObjCommand(p, pEnd, 'v')) {
+      // x y z, then either w or r g b
+      float pValues[6];
+      uint32_t valueCount = 0;
+      const char *q = skipObjSpace(p + 2, pEnd);
+      while (valueCount < 6 && q < pEnd && !isObjLineEnd(*q)) {
+        q = parseObjFloat(q, pEnd, &pValues[valueCount]);
+        if (q == NULL) {
+          pChunk->result = ERR_BADARGS;
+          return;
+        }
+        valueCount++;
+        q = skipObjSpace(q, pEnd);
+      }
+      if (valueCount < 3) {
+        pChunk->result = ERR_BADARGS;
+        return;
+      }
+      Vertex *pVertex = &pChunk->pPositions[position++];
+      memcpy(pVertex->position, pValues, sizeof(vec3));
+      if (valueCount == 6) {
+        memcpy(pVertex->color, pValues + 3, sizeof(vec3));
+        pChunk->hasColors = true;
+      } else {
+        pVertex->color[0] = 1.0f;
+        pVertex->color[1] = 1.0f;
+        pVertex->color[2] = 1.0f;
+      }
+    } else if (isObjCommand(p, pEnd, 'f')) {
+      // fan out from the first corner, keeping the winding
+      uint32_t cornerCount = 0;
+      uint32_t first = 0;
+      uint32_t previous = 0;
+      const char *q = skipObjSpace(p + 2, pEnd);
+      while (q < pEnd && !isObjLineEnd(*q)) {
+        int64_t index;
+        q = parseObjInt(q, pEnd, &index);
+        if (q == NULL) {
+          pChunk->result = ERR_BADARGS;
+          return;
+        }
+        // negative indices count back from the last position so far
+        int64_t resolved = index < 0 ? (int64_t)position + index : index - 1;
+        if (index == 0 || resolved < 0 ||
+            resolved >= pChunk->totalPositionCount) {
+          pChunk->result = ERR_BADARGS;
+          return;
+        }
+        // skip the texture coordinate and normal indices
+        while (q < pEnd && !isObjSpace(*q) && !isObjLineEnd(*q)) {
+          q++;
+        }
+        q = skipObjSpace(q, pEnd);
+
+        uint32_t corner = (uint32_t)resolved;
+        if (cornerCount == 0) {
+          first = corner;
+        } else if (cornerCount >= 2) {
+          *pIndices++ = first;
+          *pIndices++ = previous;
+          *pIndices++ = corner;
+        }
+        previous = corner;
+        cornerCount++;
+      }
+    }
+  }
+}
+
+static ErrVal loadObj(Vertex **ppVertices, uint32_t *pVertexCount,
+                      const MappedFile *pFile, const uint32_t threadCount) {
+  const char *pBegin = (const char *)pFile->pData;
+  const char *pEnd = pBegin + pFile->size;
+
+  uint64_t chunkCount = (uint64_t)threadCount * MESH_LOADER_TASKS_PER_THREAD;
+  if (chunkCount > pFile->size / MESH_LOADER_MIN_CHUNK_SIZE) {
+    chunkCount = pFile->size / MESH_LOADER_MIN_CHUNK_SIZE + 1;
+  }
+  ObjChunk *pChunks = calloc((size_t)chunkCount, sizeof(ObjChunk));
+  if (!pChunks) {
+    LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "could not allocate OBJ chunks: %s",
+                   strerror(errno));
+    return (ERR_ALLOCFAIL);
+  }
+
+  // chunks start right after a newline, so no line is split
+  const char *pChunkBegin = pBegin;
+  for (uint64_t i = 0; i < chunkCount; i++) {
+    const char *pChunkEnd = pBegin + pFile->size * (i + 1) / chunkCount;
+    if (pChunkEnd < pChunkBegin) {
+      pChunkEnd = pChunkBegin;
+    }
+    if (pChunkEnd != pEnd && pChunkEnd != pBegin && pChunkEnd[-1] != '\n') {
+      pChunkEnd = nextLine(pChunkEnd, pEnd);
+    }
+    pChunks[i].pBegin = pChunkBegin;
+    pChunks[i].pEnd = pChunkEnd;
+    pChunkBegin = pChunkEnd;
+  }
+
+  runTasks(pChunks, sizeof(ObjChunk), (uint32_t)chunkCount, countObjChunk,
+           threadCount);
+
+  uint64_t positionCount = 0;
+  uint64_t triangleCount = 0;
+  for (uint64_t i = 0; i < chunkCount; i++) {
+    pChunks[i].firstPosition = (uint32_t)positionCount;
+    pChunks[i].firstTriangle = (uint32_t)triangleCount;
+    positionCount += pChunks[i].positionCount;
+    triangleCount += pChunks[i].triangleCount;
+    if (positionCount > UINT32_MAX ||
+        triangleCount > MESH_LOADER_MAX_TRIANGLE_COUNT) {
+      LOG_ERROR(ERR_LEVEL_ERROR, "OBJ has too many vertices or triangles");
+      free(pChunks);
+      return (ERR_NOTSUPPORTED);
+    }
+  }
+
+  Vertex *pPositions = malloc((size_t)positionCount * sizeof(Vertex));
+  uint32_t *pIndices = malloc((size_t)triangleCount * 3 * sizeof(uint32_t));
+  if ((!pPositions && positionCount != 0) ||
+      (!pIndices && triangleCount != 0)) {
+    LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "could not allocate OBJ contents: %s",
+                   strerror(errno));
+    free(pPositions);
+    free(pIndices);
+    free(pChunks);
+    return (ERR_ALLOCFAIL);
+  }
+  for (uint64_t i = 0; i < chunkCount; i++) {
+    pChunks[i].totalPositionCount = (uint32_t)positionCount;
+    pChunks[i].pPositions = pPositions;
+    pChunks[i].pIndices = pIndices;
+  }
+
+  runTasks(pChunks, sizeof(ObjChunk), (uint32_t)chunkCount, parseObjChunk,
+           threadCount);
+
+  ErrVal retVal = ERR_OK;
+  bool hasColors = false;
+  for (uint64_t i = 0; i < chunkCount; i++) {
+    if (pChunks[i].result != ERR_OK) {
+      retVal = pChunks[i].result;
+    }
+    hasColors = hasColors || pChunks[i].hasColors;
+  }
+  free(pChunks);
+
+  if (retVal != ERR_OK) {
+    LOG_ERROR(ERR_LEVEL_ERROR, "malformed OBJ");
+  } else {
+    MeshPrimitive primitive = {
+        .positions = {.pData = (const uint8_t *)pPositions,
+                      .stride = sizeof(Vertex),
+                      .type = MESH_COMPONENT_FLOAT,
+                      .count = (uint32_t)positionCount},
+        .pIndices = (const uint8_t *)pIndices,
+        .triangleStride = 3 * sizeof(uint32_t),
+        .indexStride = sizeof(uint32_t),
+        .indexType = MESH_COMPONENT_UINT32,
+        .triangleCount = (uint32_t)triangleCount,
+    };
+    if (hasColors) {
+      primitive.colors = primitive.positions;
+      primitive.colors.pData = (const uint8_t *)pPositions->color;
+    }
+    retVal = expandPrimitives(ppVertices, pVertexCount, &primitive, 1,
+                              threadCount);
+  }
+  free(pPositions);
+  free(pIndices);
+  return (retVal);
+}
+
+// PLY
+
+typedef struct {
+  char name[32];
+  uint32_t size;
+  MeshComponentType type;
+  bool isFloat;
+  bool isList;
+  // for lists, the size of the count and of each item
+  uint32_t countSize;
+  uint32_t itemSize;
+  uint32_t offset;
+} PlyProperty;
+
+typedef struct {
+  char name[32];
+  uint64_t count;
+  PlyProperty pProperties[MESH_LOADER_MAX_PLY_PROPERTIES];
+  uint32_t propertyCount;
+  // bytes per element, if it has no lists
+  uint32_t stride;
+} PlyElement;
+
+// gets the size of a PLY scalar type, or 0 if it isn't one
+static uint32_t getPlyTypeSize(const char *pType, MeshComponentType *pIndexType,
+                               bool *pIsFloat) {
+  static const struct {
+    const char *name;
+    uint32_t size;
+    bool isFloat;
+  } pTypes[] = {
+      {"char", 1, false},    {"uchar", 1, false},   {"int8", 1, false},
+      {"uint8", 1, false},   {"short", 2, false},   {"ushort", 2, false},
+      {"int16", 2, false},   {"uint16", 2, false},  {"int", 4, false},
+      {"uint", 4, false},    {"int32", 4, false},   {"uint32", 4, false},
+      {"float", 4, true},    {"float32", 4, true},  {"double", 8, true},
+      {"float64", 8, true},
+  };
+  for (size_t i = 0; i < sizeof(pTypes) / sizeof(pTypes[0]); i++) {
+    if (strcmp(pType, pTypes[i].name) == 0) {
+      *pIsFloat = pTypes[i].isFloat;
+      *pIndexType = pTypes[i].size == 1   ? MESH_COMPONENT_UINT8
+                    : pTypes[i].size == 2 ? MESH_COMPONENT_UINT16
+                                          : MESH_COMPONENT_UINT32;
+      return (pTypes[i].size);
+    }
+  }
+  return (0);
+}
+
+static PlyProperty *findPlyProperty(PlyElement *pElement, const char *name) {
+  for (uint32_t i = 0; i < pElement->propertyCount; i++) {
+    if (strcmp(pElement->pProperties[i].name, name) == 0) {
+      return (&pElement->pProperties[i]);
+    }
+  }
+  return (NULL);
+}
+
+// checks that the three properties are consecutive and of the same type
+static bool arePlyPropertiesPacked(const PlyProperty *pX, const PlyProperty *pY,
+                                   const PlyProperty *pZ) {
+  return (pX != NULL && pY != NULL && pZ != NULL && pX->size == pY->size &&
+          pX->size == pZ->size && pX->isFloat == pY->isFloat &&
+          pX->isFloat == pZ->isFloat && pY->offset == pX->offset + pX->size &&
+          pZ->offset == pY->offset + pY->size);
+}
+
+typedef struct {
+  const uint8_t *pFaces;
+  uint64_t firstFace;
+  uint64_t faceCount;
+  uint32_t faceSize;
+  uint32_t countSize;
+  bool allTriangles;
+} PlyCheckTask;
+
+// checks that every face in a range is a triangle
+static void checkPlyFaces(void *pArg) {
+  PlyCheckTask *pTask = pArg;
+  pTask->allTriangles = true;
+  for (uint64_t i = pTask->firstFace; i < pTask->firstFace + pTask->faceCount;
+       i++) {
+    const uint8_t *pCount = pTask->pFaces + i * pTask->faceSize;
+    MeshComponentType countType = pTask->countSize == 1 ? MESH_COMPONENT_UINT8
+                                  : pTask->countSize == 2
+                                      ? MESH_COMPONENT_UINT16
+                                      : MESH_COMPONENT_UINT32;
+    if (readIndex(pCount, countType) != 3) {
+      pTask->allTriangles = false;
+      return;
+    }
+  }
+}
+
+// reads the header into `pElements`, and returns where the data starts
+static ErrVal parsePlyHeader(PlyElement *pElements, uint32_t *pElementCount,
+                             size_t *pHeaderSize, const MappedFile *pFile) {
+  const char *pBegin = (const char *)pFile->pData;
+  const char *pEnd = pBegin + pFile->size;
+  if (pFile->size < 4 || memcmp(pBegin, "ply", 3) != 0) {
+    LOG_ERROR(ERR_LEVEL_ERROR, "not a PLY file");
+    return (ERR_BADARGS);
+  }
+
+  *pElementCount = 0;
+  bool binaryLittleEndian = false;
+  for (const char *p = nextLine(pBegin, pEnd); p < pEnd;
+       p = nextLine(p, pEnd)) {
+    char line[256];
+    size_t length = (size_t)(nextLine(p, pEnd) - p);
+    if (length >= sizeof(line)) {
+      LOG_ERROR(ERR_LEVEL_ERROR, "PLY header line too long");
+      return (ERR_BADARGS);
+    }
+    memcpy(line, p, length);
+    line[length] = '\0';
+
+    char word[32];
+    char type[32];
+    char itemType[32];
+    char name[32];
+    unsigned long long count;
+    if (strncmp(line, "end_header", 10) == 0) {
+      if (!binaryLittleEndian) {
+        LOG_ERROR(ERR_LEVEL_ERROR,
+                  "only binary little endian PLY is supported");
+        return (ERR_NOTSUPPORTED);
+      }
+      *pHeaderSize = (size_t)(nextLine(p, pEnd) - pBegin);
+      return (ERR_OK);
+    } else if (sscanf(line, "format %31s", word) == 1) {
+      binaryLittleEndian = strcmp(word, "binary_little_endian") == 0;
+    } else if (sscanf(line, "element %31s %llu", name, &count) == 2) {
+      if (*pElementCount == MESH_LOADER_MAX_PLY_ELEMENTS) {
+        LOG_ERROR(ERR_LEVEL_ERROR, "PLY has too many elements");
+        return (ERR_NOTSUPPORTED);
+      }
+      PlyElement *pElement = &pElements[(*pElementCount)++];
+      *pElement = (PlyElement){.count = count};
+      strcpy(pElement->name, name);
+    } else if (sscanf(line, "property list %31s %31s %31s", type, itemType,
+                      name) == 3 ||
+               sscanf(line, "property %31s %31s", type, name) == 2) {
+      if (*pElementCount == 0 ||
+          pElements[*pElementCount - 1].propertyCount ==
+              MESH_LOADER_MAX_PLY_PROPERTIES) {
+        LOG_ERROR(ERR_LEVEL_ERROR, "unexpected PLY property");
+        return (ERR_NOTSUPPORTED);
+      }
+      PlyElement *pElement = &pElements[*pElementCount - 1];
+      PlyProperty *pProperty =
+          &pElement->pProperties[pElement->propertyCount++];
+      *pProperty = (PlyProperty){.offset = pElement->stride};
+      strcpy(pProperty->name, name);
+      pProperty->isList = strncmp(line, "property list", 13) == 0;
+      MeshComponentType indexType;
+      bool isFloat;
+      if (pProperty->isList) {
+        pProperty->countSize = getPlyTypeSize(type, &indexType, &isFloat);
+        pProperty->itemSize = getPlyTypeSize(itemType, &pProperty->type,
+                                             &pProperty->isFloat);
+        if (pProperty->countSize == 0 || pProperty->itemSize == 0) {
+          LOG_ERROR(ERR_LEVEL_ERROR, "unknown PLY property type");
+          return (ERR_BADARGS);
+        }
+      } else {
+        pProperty->size =
+            getPlyTypeSize(type, &pProperty->type, &pProperty->isFloat);
+        if (pProperty->size == 0) {
+          LOG_ERROR(ERR_LEVEL_ERROR, "unknown PLY property type");
+          return (ERR_BADARGS);
+        }
+        pElement->stride += pProperty->size;
+      }
+    }
+  }
+  LOG_ERROR(ERR_LEVEL_ERROR, "PLY header never ends");
+  return (ERR_BADARGS);
+}
+
+static ErrVal loadPly(Vertex **ppVertices, uint32_t *pVertexCount,
+                      const MappedFile *pFile, const uint32_t threadCount) {
+  PlyElement pElements[MESH_LOADER_MAX_PLY_ELEMENTS];
+  uint32_t elementCount;
+  size_t headerSize;
+  ErrVal retVal =
+      parsePlyHeader(pElements, &elementCount, &headerSize, pFile);
+  if (retVal != ERR_OK) {
+    return (retVal);
+  }
+
+  // anything after the faces can be ignored, but nothing may come before them
+  if (elementCount < 2 || strcmp(pElements[0].name, "vertex") != 0 ||
+      strcmp(pElements[1].name, "face") != 0 ||
+      pElements[1].propertyCount != 1 ||
+      !pElements[1].pProperties[0].isList) {
+    LOG_ERROR(ERR_LEVEL_ERROR,
+              "PLY must have vertices, then faces with only a list of indices");
+    return (ERR_NOTSUPPORTED);
+  }
+  PlyElement *pVertexElement = &pElements[0];
+  PlyElement *pFaceElement = &pElements[1];
+  for (uint32_t i = 0; i < pVertexElement->propertyCount; i++) {
+    if (pVertexElement->pProperties[i].isList) {
+      LOG_ERROR(ERR_LEVEL_ERROR, "PLY vertices can't have lists");
+      return (ERR_NOTSUPPORTED);
+    }
+  }
+  if (pVertexElement->count > UINT32_MAX ||
+      pFaceElement->count > MESH_LOADER_MAX_TRIANGLE_COUNT) {
+    LOG_ERROR(ERR_LEVEL_ERROR, "PLY has too many vertices or faces");
+    return (ERR_NOTSUPPORTED);
+  }
+
+  const PlyProperty *pX = findPlyProperty(pVertexElement, "x");
+  const PlyProperty *pRed = findPlyProperty(pVertexElement, "red");
+  if (!arePlyPropertiesPacked(pX, findPlyProperty(pVertexElement, "y"),
+                              findPlyProperty(pVertexElement, "z")) ||
+      !pX->isFloat || pX->size != sizeof(float)) {
+    LOG_ERROR(ERR_LEVEL_ERROR, "PLY positions must be consecutive floats");
+    return (ERR_NOTSUPPORTED);
+  }
+
+  const uint8_t *pVertexData = pFile->pData + headerSize;
+  uint64_t vertexBytes = pVertexElement->count * pVertexElement->stride;
+  if (headerSize + vertexBytes > pFile->size) {
+    LOG_ERROR(ERR_LEVEL_ERROR, "PLY is truncated");
+    return (ERR_BADARGS);
+  }
+
+  MeshPrimitive primitive = {
+      .positions = {.pData = pVertexData + pX->offset,
+                    .stride = pVertexElement->stride,
+                    .type = MESH_COMPONENT_FLOAT,
+                    .count = (uint32_t)pVertexElement->count},
+  };
+  if (arePlyPropertiesPacked(pRed, findPlyProperty(pVertexElement, "green"),
+                             findPlyProperty(pVertexElement, "blue")) &&
+      (pRed->size == 1 || (pRed->isFloat && pRed->size == sizeof(float)))) {
+    primitive.colors = primitive.positions;
+    primitive.colors.pData = pVertexData + pRed->offset;
+    primitive.colors.type =
+        pRed->size == 1 ? MESH_COMPONENT_UNORM8 : MESH_COMPONENT_FLOAT;
+  }
+
+  // when every face is a triangle, faces are read in place
+  const PlyProperty *pList = &pFaceElement->pProperties[0];
+  const uint8_t *pFaces = pVertexData + vertexBytes;
+  const uint64_t faceCount = pFaceElement->count;
+  const uint64_t faceBytes = pFile->size - headerSize - vertexBytes;
+  const uint32_t triangleSize = pList->countSize + 3 * pList->itemSize;
+  bool allTriangles = faceBytes >= faceCount * triangleSize;
+  if (allTriangles && faceCount != 0) {
+    uint64_t taskCount = (uint64_t)threadCount * MESH_LOADER_TASKS_PER_THREAD;
+    PlyCheckTask pTasks[MESH_LOADER_MAX_THREADS * MESH_LOADER_TASKS_PER_THREAD];
+    for (uint64_t i = 0; i < taskCount; i++) {
+      uint64_t first = faceCount * i / taskCount;
+      pTasks[i] = (PlyCheckTask){
+          .pFaces = pFaces,
+          .firstFace = first,
+          .faceCount = faceCount * (i + 1) / taskCount - first,
+          .faceSize = triangleSize,
+          .countSize = pList->countSize,
+      };
+    }
+    runTasks(pTasks, sizeof(PlyCheckTask), (uint32_t)taskCount, checkPlyFaces,
+             threadCount);
+    for (uint64_t i = 0; i < taskCount; i++) {
+      allTriangles = allTriangles && pTasks[i].allTriangles;
+    }
+  }
+
+  uint32_t *pIndices = NULL;
+  if (allTriangles) {
+    primitive.pIndices = pFaces + pList->countSize;
+    primitive.triangleStride = triangleSize;
+    primitive.indexStride = pList->itemSize;
+    primitive.indexType = pList->type;
+    primitive.triangleCount = (uint32_t)faceCount;
+  } else {
+    // faces have different sizes, so they have to be walked one by one
+    MeshComponentType countType = pList->countSize == 1 ? MESH_COMPONENT_UINT8
+                                  : pList->countSize == 2
+                                      ? MESH_COMPONENT_UINT16
+                                      : MESH_COMPONENT_UINT32;
+    uint64_t triangleCount = 0;
+    const uint8_t *p = pFaces;
+    const uint8_t *pEnd = pFaces + faceBytes;
+    for (uint64_t i = 0; i < faceCount; i++) {
+      if (p + pList->countSize > pEnd) {
+        LOG_ERROR(ERR_LEVEL_ERROR, "PLY is truncated");
+        return (ERR_BADARGS);
+      }
+      uint32_t cornerCount = readIndex(p, countType);
+      p += pList->countSize + (uint64_t)cornerCount * pList->itemSize;
+      triangleCount += cornerCount >= 3 ? cornerCount - 2 : 0;
+    }
+    if (p > pEnd || triangleCount > MESH_LOADER_MAX_TRIANGLE_COUNT) {
+      LOG_ERROR(ERR_LEVEL_ERROR, "PLY is truncated or has too many faces");
+      return (p > pEnd ? ERR_BADARGS : ERR_NOTSUPPORTED);
+    }
+
+    pIndices = malloc((size_t)triangleCount * 3 * sizeof(uint32_t));
+    if (!pIndices && triangleCount != 0) {
+      LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "could not allocate PLY faces: %s",
+                     strerror(errno));
+      return (ERR_ALLOCFAIL);
+    }
+    uint32_t *pIndex = pIndices;
+    p = pFaces;
+    for (uint64_t i = 0; i < faceCount; i++) {
+      uint32_t cornerCount = readIndex(p, countType);
+      p += pList->countSize;
+      for (uint32_t j = 2; j < cornerCount; j++) {
+        *pIndex++ = readIndex(p, pList->type);
+        *pIndex++ = readIndex(p + (j - 1) * pList->itemSize, pList->type);
+        *pIndex++ = readIndex(p + j * pList->itemSize, pList->type);
+      }
+      p += (uint64_t)cornerCount * pList->itemSize;
+    }
+    primitive.pIndices = (const uint8_t *)pIndices;
+    primitive.triangleStride = 3 * sizeof(uint32_t);
+    primitive.indexStride = sizeof(uint32_t);
+    primitive.indexType = MESH_COMPONENT_UINT32;
+    primitive.triangleCount = (uint32_t)triangleCount;
+  }
+
+  retVal =
+      expandPrimitives(ppVertices, pVertexCount, &primitive, 1, threadCount);
+  free(pIndices);
+  return (retVal);
+}
+
+// glTF
+
+typedef enum {
+  JSON_OBJECT,
+  JSON_ARRAY,
+  JSON_STRING,
+  JSON_PRIMITIVE,
+} JsonType;
+
+// A JSON value, tokens are stored in document order
+typedef struct {
+  JsonType type;
+  // for strings, excludes the quotes
+  uint32_t start;
+  uint32_t end;
+  // members of an object or elements of an array
+  uint32_t size;
+  // the token after this value and everything in it
+  uint32_t next;
+} JsonToken;
+
+typedef struct {
+  const char *pText;
+  uint32_t length;
+  uint32_t position;
+  JsonToken *pTokens;
+  uint32_t tokenCount;
+  uint32_t tokenCapacity;
+} JsonDocument;
+
+static void skipJsonSpace(JsonDocument *pDoc) {
+  while (pDoc->position < pDoc->length &&
+         (pDoc->pText[pDoc->position] == ' ' ||
+          pDoc->pText[pDoc->position] == '\t' ||
+          pDoc->pText[pDoc->position] == '\n' ||
+          pDoc->pText[pDoc->position] == '\r')) {
+    pDoc->position++;
+  }
+}
+
+static ErrVal pushJsonToken(JsonDocument *pDoc, const JsonType type,
+                            uint32_t *pIndex) {
+  if (pDoc->tokenCount == pDoc->tokenCapacity) {
+    uint32_t capacity =
+        pDoc->tokenCapacity == 0 ? 256 : pDoc->tokenCapacity * 2;
+    JsonToken *pTokens = realloc(pDoc->pTokens, capacity * sizeof(JsonToken));
+    if (!pTokens) {
+      return (ERR_ALLOCFAIL);
+    }
+    pDoc->pTokens = pTokens;
+    pDoc->tokenCapacity = capacity;
+  }
+  *pIndex = pDoc->tokenCount++;
+  pDoc->pTokens[*pIndex] =
+      (JsonToken){.type = type, .start = pDoc->position};
+  return (ERR_OK);
+}
+
+static ErrVal parseJsonValue(JsonDocument *pDoc, const uint32_t depth);
+
+static ErrVal parseJsonString(JsonDocument *pDoc) {
+  uint32_t index;
+  pDoc->position++;
+  if (pushJsonToken(pDoc, JSON_STRING, &index) != ERR_OK) {
+    return (ERR_ALLOCFAIL);
+  }
+  while (pDoc->position < pDoc->length && pDoc->pText[pDoc->position] != '"') {
+    pDoc->position += pDoc->pText[pDoc->position] == '\\' ? 2 : 1;
+  }
+  if (pDoc->position >= pDoc->length) {
+    return (ERR_BADARGS);
+  }
+  pDoc->pTokens[index].end = pDoc->position++;
+  pDoc->pTokens[index].next = pDoc->tokenCount;
+  return (ERR_OK);
+}
+
+static ErrVal parseJsonContainer(JsonDocument *pDoc, const uint32_t depth) {
+  bool isObject = pDoc->pText[pDoc->position] == '{';
+  char close = isObject ? '}' : ']';
+  uint32_t index;
+  if (pushJsonToken(pDoc, isObject ? JSON_OBJECT : JSON_ARRAY, &index) !=
+      ERR_OK) {
+    return (ERR_ALLOCFAIL);
+  }
+  pDoc->position++;
+  skipJsonSpace(pDoc);
+  uint32_t size = 0;
+  while (pDoc->position < pDoc->length &&
+         pDoc->pText[pDoc->position] != close) {
+    if (isObject) {
+      if (pDoc->pText[pDoc->position] != '"' ||
+          parseJsonString(pDoc) != ERR_OK) {
+        return (ERR_BADARGS);
+      }
+      skipJsonSpace(pDoc);
+      if (pDoc->position >= pDoc->length ||
+          pDoc->pText[pDoc->position] != ':') {
+        return (ERR_BADARGS);
+      }
+      pDoc->position++;
+    }
+    ErrVal retVal = parseJsonValue(pDoc, depth + 1);
+    if (retVal != ERR_OK) {
+      return (retVal);
+    }
+    size++;
+    skipJsonSpace(pDoc);
+    if (pDoc->position < pDoc->length && pDoc->pText[pDoc->position] == ',') {
+      pDoc->position++;
+      skipJsonSpace(pDoc);
+    }
+  }
+  if (pDoc->position >= pDoc->length) {
+    return (ERR_BADARGS);
+  }
+  pDoc->position++;
+  pDoc->pTokens[index].end = pDoc->position;
+  pDoc->pTokens[index].size = size;
+  pDoc->pTokens[index].next = pDoc->tokenCount;
+  return (ERR_OK);
+}
+
+static ErrVal parseJsonValue(JsonDocument *pDoc, const uint32_t depth) {
+  if (depth > MESH_LOADER_MAX_JSON_DEPTH) {
+    return (ERR_NOTSUPPORTED);
+  }
+  skipJsonSpace(pDoc);
+  if (pDoc->position >= pDoc->length) {
+    return (ERR_BADARGS);
+  }
+  switch (pDoc->pText[pDoc->position]) {
+  case '{':
+  case '[':
+    return (parseJsonContainer(pDoc, depth));
+  case '"':
+    return (parseJsonString(pDoc));
+  default: {
+    // numbers, true, false and null
+    uint32_t index;
+    if (pushJsonToken(pDoc, JSON_PRIMITIVE, &index) != ERR_OK) {
+      return (ERR_ALLOCFAIL);
+    }
+    while (pDoc->position < pDoc->length &&
+           strchr(",}] \t\r\n", pDoc->pText[pDoc->position]) == NULL) {
+      pDoc->position++;
+    }
+    pDoc->pTokens[index].end = pDoc->position;
+    pDoc->pTokens[index].next = pDoc->tokenCount;
+    return (ERR_OK);
+  }
+  }
+}
+
+// gets the value of `key` in the object at `object`, or UINT32_MAX
+static uint32_t getJsonMember(const JsonDocument *pDoc, const uint32_t object,
+                              const char *key) {
+  if (object >= pDoc->tokenCount || pDoc->pTokens[object].type != JSON_OBJECT) {
+    return (UINT32_MAX);
+  }
+  size_t keyLength = strlen(key);
+  uint32_t i = object + 1;
+  for (uint32_t member = 0; member < pDoc->pTokens[object].size; member++) {
+    const JsonToken *pKey = &pDoc->pTokens[i];
+    if (pKey->end - pKey->start == keyLength &&
+        memcmp(pDoc->pText + pKey->start, key, keyLength) == 0) {
+      return (i + 1);
+    }
+    i = pDoc->pTokens[i + 1].next;
+  }
+  return (UINT32_MAX);
+}
+
+// gets element `n` of the array at `array`, or UINT32_MAX
+static uint32_t getJsonElement(const JsonDocument *pDoc, const uint32_t array,
+                               const uint64_t n) {
+  if (array >= pDoc->tokenCount || pDoc->pTokens[array].type != JSON_ARRAY ||
+      n >= pDoc->pTokens[array].size) {
+    return (UINT32_MAX);
+  }
+  uint32_t i = array + 1;
+  for (uint64_t element = 0; element < n; element++) {
+    i = pDoc->pTokens[i].next;
+  }
+  return (i);
+}
+
+// reads the integer at `token`, or returns `fallback` if there is none
+static uint64_t getJsonUint(const JsonDocument *pDoc, const uint32_t token,
+                            const uint64_t fallback) {
+  if (token >= pDoc->tokenCount ||
+      pDoc->pTokens[token].type != JSON_PRIMITIVE) {
+    return (fallback);
+  }
+  const JsonToken *pToken = &pDoc->pTokens[token];
+  int64_t value;
+  const char *pEnd = parseObjInt(pDoc->pText + pToken->start,
+                                 pDoc->pText + pToken->end, &value);
+  return (pEnd != NULL && value >= 0 ? (uint64_t)value : fallback);
+}
+
+static bool isJsonString(const JsonDocument *pDoc, const uint32_t token,
+                         const char *value) {
+  if (token >= pDoc->tokenCount || pDoc->pTokens[token].type != JSON_STRING) {
+    return (false);
+  }
+  const JsonToken *pToken = &pDoc->pTokens[token];
+  size_t length = strlen(value);
+  return (pToken->end - pToken->start == length &&
+          memcmp(pDoc->pText + pToken->start, value, length) == 0);
+}
+
+// the data of a glTF and the buffers it refers to
+typedef struct {
+  JsonDocument json;
+  MappedFile pBuffers[MESH_LOADER_MAX_BUFFERS];
+  uint32_t bufferCount;
+} GltfAsset;
+
+// gltf componentType values
+#define GLTF_UNSIGNED_BYTE 5121
+#define GLTF_UNSIGNED_SHORT 5123
+#define GLTF_UNSIGNED_INT 5125
+#define GLTF_FLOAT 5126
+#define GLTF_MODE_TRIANGLES 4
+// largest byteStride a bufferView may have
+#define GLTF_MAX_BYTE_STRIDE 252
+
+// resolves accessor `accessor` into `pAttribute`, checking it fits its buffer
+static ErrVal getGltfAttribute(MeshAttribute *pAttribute,
+                               const GltfAsset *pAsset, const uint64_t accessor,
+                               const bool isIndex) {
+  const JsonDocument *pDoc = &pAsset->json;
+  uint32_t accessorToken = getJsonElement(
+      pDoc, getJsonMember(pDoc, 0, "accessors"), accessor);
+  if (accessorToken == UINT32_MAX) {
+    return (ERR_BADARGS);
+  }
+  uint64_t bufferViewIndex = getJsonUint(
+      pDoc, getJsonMember(pDoc, accessorToken, "bufferView"), UINT64_MAX);
+  uint32_t bufferViewToken = getJsonElement(
+      pDoc, getJsonMember(pDoc, 0, "bufferViews"), bufferViewIndex);
+  if (bufferViewToken == UINT32_MAX) {
+    // sparse accessors and accessors without data are all zeros
+    return (ERR_NOTSUPPORTED);
+  }
+  uint64_t buffer = getJsonUint(
+      pDoc, getJsonMember(pDoc, bufferViewToken, "buffer"), UINT64_MAX);
+  if (buffer >= pAsset->bufferCount) {
+    return (ERR_BADARGS);
+  }
+
+  uint64_t componentType =
+      getJsonUint(pDoc, getJsonMember(pDoc, accessorToken, "componentType"), 0);
+  uint64_t count =
+      getJsonUint(pDoc, getJsonMember(pDoc, accessorToken, "count"), 0);
+  bool normalized = false;
+  uint32_t normalizedToken = getJsonMember(pDoc, accessorToken, "normalized");
+  if (normalizedToken != UINT32_MAX &&
+      pDoc->pTokens[normalizedToken].type == JSON_PRIMITIVE) {
+    normalized = pDoc->pText[pDoc->pTokens[normalizedToken].start] == 't';
+  }
+  uint32_t type = getJsonMember(pDoc, accessorToken, "type");
+  uint32_t componentCount = isJsonString(pDoc, type, "SCALAR") ? 1
+                            : isJsonString(pDoc, type, "VEC3") ? 3
+                            : isJsonString(pDoc, type, "VEC4") ? 4
+                                                               : 0;
+
+  uint32_t componentSize;
+  switch (componentType) {
+  case GLTF_FLOAT:
+    pAttribute->type = MESH_COMPONENT_FLOAT;
+    componentSize = 4;
+    break;
+  case GLTF_UNSIGNED_BYTE:
+    pAttribute->type = isIndex ? MESH_COMPONENT_UINT8 : MESH_COMPONENT_UNORM8;
+    componentSize = 1;
+    break;
+  case GLTF_UNSIGNED_SHORT:
+    pAttribute->type =
+        isIndex ? MESH_COMPONENT_UINT16 : MESH_COMPONENT_UNORM16;
+    componentSize = 2;
+    break;
+  case GLTF_UNSIGNED_INT:
+    pAttribute->type = MESH_COMPONENT_UINT32;
+    componentSize = 4;
+    break;
+  default:
+    return (ERR_NOTSUPPORTED);
+  }
+  // indices are scalars, everything else has at least 3 components, and
+  // non float vertex data is only understood if it is normalized
+  if (count > UINT32_MAX ||
+      (isIndex ? componentCount != 1 || componentType == GLTF_FLOAT
+               : componentCount < 3 ||
+                     (componentType != GLTF_FLOAT && !normalized) ||
+                     componentType == GLTF_UNSIGNED_INT)) {
+    return (ERR_NOTSUPPORTED);
+  }
+
+  uint64_t elementSize = (uint64_t)componentSize * componentCount;
+  uint32_t strideToken = getJsonMember(pDoc, bufferViewToken, "byteStride");
+  uint64_t stride = elementSize;
+  if (strideToken != UINT32_MAX) {
+    // the spec bounds the stride, which also keeps the checks below small
+    stride = getJsonUint(pDoc, strideToken, 0);
+    if (stride < elementSize || stride > GLTF_MAX_BYTE_STRIDE) {
+      return (ERR_BADARGS);
+    }
+  }
+
+  // every value comes from the file, so each step is checked on its own
+  // rather than in a single sum that could wrap
+  const MappedFile *pBuffer = &pAsset->pBuffers[buffer];
+  uint64_t viewOffset =
+      getJsonUint(pDoc, getJsonMember(pDoc, bufferViewToken, "byteOffset"), 0);
+  uint64_t viewLength =
+      getJsonUint(pDoc, getJsonMember(pDoc, bufferViewToken, "byteLength"), 0);
+  uint64_t accessorOffset =
+      getJsonUint(pDoc, getJsonMember(pDoc, accessorToken, "byteOffset"), 0);
+  if (viewOffset > pBuffer->size || viewLength > pBuffer->size - viewOffset ||
+      accessorOffset > viewLength) {
+    return (ERR_BADARGS);
+  }
+  uint64_t offset = viewOffset + accessorOffset;
+  uint64_t viewEnd = viewOffset + viewLength;
+  if (count != 0 && (elementSize > viewEnd - offset ||
+                     count - 1 > (viewEnd - offset - elementSize) / stride)) {
+    return (ERR_BADARGS);
+  }
+
+  pAttribute->pData = pBuffer->pData + offset;
+  pAttribute->stride = (size_t)stride;
+  pAttribute->count = (uint32_t)count;
+  return (ERR_OK);
+}
+
+// maps the buffers a .gltf refers to, relative to the .gltf
+static ErrVal mapGltfBuffers(GltfAsset *pAsset, const char *path,
+                             uint64_t *pFileBytes) {
+  const JsonDocument *pDoc = &pAsset->json;
+  uint32_t buffers = getJsonMember(pDoc, 0, "buffers");
+  uint32_t bufferCount =
+      buffers != UINT32_MAX ? pDoc->pTokens[buffers].size : 0;
+  if (bufferCount > MESH_LOADER_MAX_BUFFERS) {
+    LOG_ERROR(ERR_LEVEL_ERROR, "glTF has too many buffers");
+    return (ERR_NOTSUPPORTED);
+  }
+
+  const char *pSlash = strrchr(path, '/');
+  size_t directoryLength = pSlash != NULL ? (size_t)(pSlash - path) + 1 : 0;
+  for (uint32_t i = 0; i < bufferCount; i++) {
+    uint32_t uri = getJsonMember(pDoc, getJsonElement(pDoc, buffers, i), "uri");
+    if (uri == UINT32_MAX || pDoc->pTokens[uri].type != JSON_STRING) {
+      LOG_ERROR(ERR_LEVEL_ERROR, "glTF buffer has no uri");
+      return (ERR_BADARGS);
+    }
+    const JsonToken *pUri = &pDoc->pTokens[uri];
+    size_t uriLength = pUri->end - pUri->start;
+    if (uriLength >= 5 && memcmp(pDoc->pText + pUri->start, "data:", 5) == 0) {
+      LOG_ERROR(ERR_LEVEL_ERROR, "embedded glTF buffers aren't supported");
+      return (ERR_NOTSUPPORTED);
+    }
+    char bufferPath[MESH_LOADER_MAX_PATH_LENGTH];
+    if (directoryLength + uriLength >= sizeof(bufferPath)) {
+      return (ERR_BADARGS);
+    }
+    memcpy(bufferPath, path, directoryLength);
+    memcpy(bufferPath + directoryLength, pDoc->pText + pUri->start, uriLength);
+    bufferPath[directoryLength + uriLength] = '\0';
+
+    ErrVal retVal = new_MappedFile(&pAsset->pBuffers[i], bufferPath);
+    if (retVal != ERR_OK) {
+      return (retVal);
+    }
+    pAsset->bufferCount++;
+    *pFileBytes += pAsset->pBuffers[i].size;
+  }
+  return (ERR_OK);
+}
+
+static ErrVal loadGltf(Vertex **ppVertices, uint32_t *pVertexCount,
+                       const MappedFile *pFile, const char *path,
+                       const bool isBinary, const uint32_t threadCount,
+                       uint64_t *pFileBytes) {
+  GltfAsset asset = {0};
+  const char *pJson = (const char *)pFile->pData;
+  uint64_t jsonLength = pFile->size;
+
+  // a .glb is a header, a JSON chunk, then the binary chunk used as buffer 0
+  if (isBinary) {
+    uint32_t pHeader[5];
+    if (pFile->size < sizeof(pHeader)) {
+      LOG_ERROR(ERR_LEVEL_ERROR, "glb is truncated");
+      return (ERR_BADARGS);
+    }
+    memcpy(pHeader, pFile->pData, sizeof(pHeader));
+    // "glTF" and "JSON"
+    if (pHeader[0] != 0x46546C67 || pHeader[1] != 2 ||
+        pHeader[4] != 0x4E4F534A ||
+        sizeof(pHeader) + (uint64_t)pHeader[3] > pFile->size) {
+      LOG_ERROR(ERR_LEVEL_ERROR, "not a glTF 2 glb file");
+      return (ERR_BADARGS);
+    }
+    pJson = (const char *)pFile->pData + sizeof(pHeader);
+    jsonLength = pHeader[3];
+
+    uint64_t binaryChunk = sizeof(pHeader) + (uint64_t)pHeader[3];
+    uint32_t pChunkHeader[2];
+    // "BIN\0"
+    if (binaryChunk + sizeof(pChunkHeader) <= pFile->size) {
+      memcpy(pChunkHeader, pFile->pData + binaryChunk, sizeof(pChunkHeader));
+      if (pChunkHeader[1] == 0x004E4942 &&
+          binaryChunk + sizeof(pChunkHeader) + pChunkHeader[0] <=
+              pFile->size) {
+        asset.pBuffers[0].pData =
+            pFile->pData + binaryChunk + sizeof(pChunkHeader);
+        asset.pBuffers[0].size = pChunkHeader[0];
+        asset.bufferCount = 1;
+      }
+    }
+  }
+  if (jsonLength > UINT32_MAX) {
+    LOG_ERROR(ERR_LEVEL_ERROR, "glTF JSON is too long");
+    return (ERR_NOTSUPPORTED);
+  }
+
+  asset.json.pText = pJson;
+  asset.json.length = (uint32_t)jsonLength;
+  ErrVal retVal = parseJsonValue(&asset.json, 0);
+  if (retVal == ERR_OK && asset.json.pTokens[0].type != JSON_OBJECT) {
+    retVal = ERR_BADARGS;
+  }
+  if (retVal != ERR_OK) {
+    LOG_ERROR(ERR_LEVEL_ERROR, "malformed glTF JSON");
+  }
+  if (retVal == ERR_OK && !isBinary) {
+    retVal = mapGltfBuffers(&asset, path, pFileBytes);
+  }
+
+  // count the triangle primitives first, so they can go in one array
+  const JsonDocument *pDoc = &asset.json;
+  uint32_t meshes = getJsonMember(pDoc, 0, "meshes");
+  uint32_t meshCount = meshes != UINT32_MAX ? pDoc->pTokens[meshes].size : 0;
+  uint32_t primitiveCount = 0;
+  for (uint32_t m = 0; retVal == ERR_OK && m < meshCount; m++) {
+    uint32_t primitives =
+        getJsonMember(pDoc, getJsonElement(pDoc, meshes, m), "primitives");
+    primitiveCount +=
+        primitives != UINT32_MAX ? pDoc->pTokens[primitives].size : 0;
+  }
+  MeshPrimitive *pPrimitives = NULL;
+  if (retVal == ERR_OK) {
+    pPrimitives = calloc(primitiveCount + 1, sizeof(MeshPrimitive));
+    if (!pPrimitives) {
+      retVal = ERR_ALLOCFAIL;
+    }
+  }
+
+  uint32_t triangleListCount = 0;
+  for (uint32_t m = 0; retVal == ERR_OK && m < meshCount; m++) {
+    uint32_t primitives =
+        getJsonMember(pDoc, getJsonElement(pDoc, meshes, m), "primitives");
+    uint32_t count =
+        primitives != UINT32_MAX ? pDoc->pTokens[primitives].size : 0;
+    for (uint32_t p = 0; retVal == ERR_OK && p < count; p++) {
+      uint32_t primitive = getJsonElement(pDoc, primitives, p);
+      if (getJsonUint(pDoc, getJsonMember(pDoc, primitive, "mode"),
+                      GLTF_MODE_TRIANGLES) != GLTF_MODE_TRIANGLES) {
+        continue;
+      }
+      uint32_t attributes = getJsonMember(pDoc, primitive, "attributes");
+      MeshPrimitive *pPrimitive = &pPrimitives[triangleListCount];
+      retVal = getGltfAttribute(
+          &pPrimitive->positions, &asset,
+          getJsonUint(pDoc, getJsonMember(pDoc, attributes, "POSITION"),
+                      UINT64_MAX),
+          false);
+      if (retVal == ERR_OK &&
+          pPrimitive->positions.type != MESH_COMPONENT_FLOAT) {
+        retVal = ERR_NOTSUPPORTED;
+      }
+      uint64_t colors = getJsonUint(
+          pDoc, getJsonMember(pDoc, attributes, "COLOR_0"), UINT64_MAX);
+      if (retVal == ERR_OK && colors != UINT64_MAX) {
+        retVal = getGltfAttribute(&pPrimitive->colors, &asset, colors, false);
+      }
+      uint64_t indices = getJsonUint(
+          pDoc, getJsonMember(pDoc, primitive, "indices"), UINT64_MAX);
+      if (retVal == ERR_OK && indices != UINT64_MAX) {
+        MeshAttribute indexAttribute;
+        retVal = getGltfAttribute(&indexAttribute, &asset, indices, true);
+        pPrimitive->pIndices = indexAttribute.pData;
+        pPrimitive->indexStride = indexAttribute.stride;
+        pPrimitive->triangleStride = indexAttribute.stride * 3;
+        pPrimitive->indexType = indexAttribute.type;
+        pPrimitive->triangleCount = indexAttribute.count / 3;
+      } else {
+        pPrimitive->triangleCount = pPrimitive->positions.count / 3;
+      }
+      if (retVal != ERR_OK) {
+        LOG_ERROR_ARGS(ERR_LEVEL_ERROR,
+                       "unsupported or malformed glTF primitive %u of mesh %u",
+                       p, m);
+      }
+      triangleListCount++;
+    }
+  }
+
+  if (retVal == ERR_OK) {
+    retVal = expandPrimitives(ppVertices, pVertexCount, pPrimitives,
+                              triangleListCount, threadCount);
+  }
+
+  free(pPrimitives);
+  free(asset.json.pTokens);
+  // in a .glb, buffer 0 is part of the file itself
+  for (uint32_t i = isBinary ? 1 : 0; i < asset.bufferCount; i++) {
+    delete_MappedFile(&asset.pBuffers[i]);
+  }
+  return (retVal);
+}
+
+static bool hasExtension(const char *path, const char *extension) {
+  size_t pathLength = strlen(path);
+  size_t extensionLength = strlen(extension);
+  return (pathLength >= extensionLength &&
+          strcasecmp(path + pathLength - extensionLength, extension) == 0);
+}
+
+ErrVal new_MeshFileVertices(Vertex **ppVertices, uint32_t *pVertexCount,
+                            const char *path, const uint32_t threadCount,
+                            MeshLoadStats *pStats) {
+  uint32_t threads = threadCount;
+  if (threads == 0) {
+    long processorCount = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = 1;
+    if (processorCount > MESH_LOADER_MAX_THREADS) {
+      threads = MESH_LOADER_MAX_THREADS;
+    } else if (processorCount > 1) {
+      threads = (uint32_t)processorCount;
+    }
+  }
+
+  uint64_t start = getTimeNs();
+  MappedFile file;
+  ErrVal retVal = new_MappedFile(&file, path);
+  if (retVal != ERR_OK) {
+    return (retVal);
+  }
+  uint64_t fileBytes = file.size;
+
+  if (hasExtension(path, ".obj")) {
+    retVal = loadObj(ppVertices, pVertexCount, &file, threads);
+  } else if (hasExtension(path, ".ply")) {
+    retVal = loadPly(ppVertices, pVertexCount, &file, threads);
+  } else if (hasExtension(path, ".gltf") || hasExtension(path, ".glb")) {
+    retVal = loadGltf(ppVertices, pVertexCount, &file, path,
+                      hasExtension(path, ".glb"), threads, &fileBytes);
+  } else {
+    LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "unknown mesh format: %s", path);
+    retVal = ERR_NOTSUPPORTED;
+  }
+  delete_MappedFile(&file);
+
+  if (retVal == ERR_OK && pStats != NULL) {
+    *pStats = (MeshLoadStats){.fileBytes = fileBytes,
+                              .elapsedNs = getTimeNs() - start,
+                              .threadCount = threads};
+  }
+  return (retVal);
+}
+
+void delete_MeshFileVertices(Vertex **ppVertices) {
+  free(*ppVertices);
+  *ppVertices = NULL;
+}
+
+void printMeshLoadStats(const char *path, const uint32_t vertexCount,
+                        const MeshLoadStats *pStats) {
+  double seconds = (double)pStats->elapsedNs / 1e9;
+  double megabytes = (double)pStats->fileBytes / (1024.0 * 1024.0);
+  printf("loaded %s: %u triangles, %.1f MiB in %.1f ms with %u threads, "
+         "%.1f MiB/s\n",
+         path, vertexCount / 3, megabytes, seconds * 1e3, pStats->threadCount,
+         seconds > 0.0 ? megabytes / seconds : 0.0);
+}
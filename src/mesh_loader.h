@@ -0,0 +1,56 @@
+#ifndef SRC_MESH_LOADER_H_
+#define SRC_MESH_LOADER_H_
+
+#include <stdint.h>
+
+#include "errors.h"
+#include "vulkan_utils.h"
+
+// most threads a file is parsed with
+#define MESH_LOADER_MAX_THREADS 64
+// work is split into about this many tasks per thread, so threads that finish
+// early can help out the rest
+#define MESH_LOADER_TASKS_PER_THREAD 4
+
+// How long loading a file took
+typedef struct {
+  // bytes mapped, including the buffers a .gltf refers to
+  uint64_t fileBytes;
+  uint64_t elapsedNs;
+  uint32_t threadCount;
+} MeshLoadStats;
+
+/// Loads a mesh file as a non indexed triangle list, picking the format by
+/// extension:
+/// * .obj, with polygons triangulated as fans and optional vertex colors
+/// written after the position
+/// * .ply, binary little endian with float positions and optional uchar
+/// colors
+/// * .gltf with external buffers, or .glb, with every triangle primitive of
+/// every mesh in mesh space, ignoring the node hierarchy
+/// Files are mapped into memory and parsed by `threadCount` threads. Without
+/// vertex colors, triangles are colored by the absolute value of their normal.
+/// --- PRECONDITIONS ---
+/// * `ppVertices` and `pVertexCount` are valid pointers
+/// * `threadCount` is at most MESH_LOADER_MAX_THREADS, or 0 to use one per
+/// online processor
+/// --- POSTCONDITIONS ---
+/// * returns error status
+/// * returns ERR_NOTSUPPORTED if the file uses a feature that isn't supported,
+/// ERR_BADARGS if it is malformed and ERR_ALLOCFAIL if there isn't enough
+/// memory
+/// * on success, `*ppVertices` points to `*pVertexCount` vertices
+/// * if `pStats` is not NULL, it is set to how long loading took
+/// --- CLEANUP ---
+/// * call `delete_MeshFileVertices`
+ErrVal new_MeshFileVertices(Vertex **ppVertices, uint32_t *pVertexCount,
+                            const char *path, const uint32_t threadCount,
+                            MeshLoadStats *pStats);
+
+void delete_MeshFileVertices(Vertex **ppVertices);
+
+/// Prints the size of a loaded file and how fast it was parsed
+void printMeshLoadStats(const char *path, const uint32_t vertexCount,
+                        const MeshLoadStats *pStats);
+
+#endif // SRC_MESH_LOADER_H_
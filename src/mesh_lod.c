@@ -0,0 +1,616 @@
+#include "mesh_lod.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// a level is only kept if it has at most this fraction of the triangles of
+// the one before, so a mesh that can hardly be simplified doesn't get copies
+#define MESH_LOD_MIN_PROGRESS 0.9
+// most collapse passes spent on one level
+#define MESH_LOD_MAX_PASSES 32
+// distances are clamped to this, so a camera inside a bounding sphere gets
+// the full mesh
+#define MESH_LOD_MIN_DISTANCE 1e-4f
+
+#define MESH_LOD_NO_VERTEX UINT32_MAX
+
+// A symmetric 4x4 matrix, the upper triangle by rows, that sums the squared
+// distances of a point to a set of planes, weighted by their triangles' areas
+typedef struct {
+  double q[10];
+  double area;
+} Quadric;
+
+// Moving vertex `from` onto vertex `to`
+typedef struct {
+  double cost;
+  uint32_t from;
+  uint32_t to;
+} Collapse;
+
+// Working memory of `meshBuildLods`, indexed by vertex unless noted
+typedef struct {
+  const Vertex *pVertices;
+  uint32_t vertexCount;
+  // the first vertex at the same position, so seams between vertices that
+  // only differ in color don't open up
+  uint32_t *pCanonical;
+  Quadric *pQuadrics;
+  // set for vertices on open or non manifold edges, which never move
+  uint8_t *pLocked;
+  // set for vertices whose neighborhood already changed this pass
+  uint8_t *pTouched;
+  // where each vertex went this pass
+  uint32_t *pRemap;
+  // the triangles using each vertex, pAdjacency[pOffsets[v]..pOffsets[v+1]]
+  uint32_t *pOffsets;
+  uint32_t *pAdjacency;
+  uint32_t *pFill;
+  // by index: the candidate collapses, and the level being simplified
+  Collapse *pCollapses;
+  uint32_t *pIndices;
+} Simplifier;
+
+static void quadricAddPlane(Quadric *pQuadric, const double a, const double b,
+                            const double c, const double d,
+                            const double area) {
+  double *q = pQuadric->q;
+  q[0] += area * a * a;
+  q[1] += area * a * b;
+  q[2] += area * a * c;
+  q[3] += area * a * d;
+  q[4] += area * b * b;
+  q[5] += area * b * c;
+  q[6] += area * b * d;
+  q[7] += area * c * c;
+  q[8] += area * c * d;
+  q[9] += area * d * d;
+  pQuadric->area += area;
+}
+
+static void quadricAdd(Quadric *pDst, const Quadric *pSrc) {
+  for (uint32_t i = 0; i < 10; i++) {
+    pDst->q[i] += pSrc->q[i];
+  }
+  pDst->area += pSrc->area;
+}
+
+// the mean squared distance of `p` to the planes of both quadrics
+static double quadricError(const Quadric *pA, const Quadric *pB,
+                           const vec3 p) {
+  double q[10];
+  for (uint32_t i = 0; i < 10; i++) {
+    q[i] = pA->q[i] + pB->q[i];
+  }
+  const double x = p[0];
+  const double y = p[1];
+  const double z = p[2];
+  const double error = x * x * q[0] + 2 * x * y * q[1] + 2 * x * z * q[2] +
+                       2 * x * q[3] + y * y * q[4] + 2 * y * z * q[5] +
+                       2 * y * q[6] + z * z * q[7] + 2 * z * q[8] + q[9];
+  const double area = pA->area + pB->area;
+  // rounding can take it just under 0
+  return (area > 0.0 ? fmax(error, 0.0) / area : 0.0);
+}
+
+static void triangleNormal(double normal[3], const vec3 p0, const vec3 p1,
+                           const vec3 p2) {
+  double e1[3];
+  double e2[3];
+  for (uint32_t j = 0; j < 3; j++) {
+    e1[j] = (double)p1[j] - (double)p0[j];
+    e2[j] = (double)p2[j] - (double)p0[j];
+  }
+  normal[0] = e1[1] * e2[2] - e1[2] * e2[1];
+  normal[1] = e1[2] * e2[0] - e1[0] * e2[2];
+  normal[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+static int compareCollapses(const void *pA, const void *pB) {
+  const Collapse *pCollapseA = pA;
+  const Collapse *pCollapseB = pB;
+  return ((pCollapseA->cost > pCollapseB->cost) -
+          (pCollapseA->cost < pCollapseB->cost));
+}
+
+// FNV-1a over the bytes of the position
+static uint32_t hashPosition(const vec3 position) {
+  const uint8_t *pBytes = (const uint8_t *)position;
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < sizeof(vec3); i++) {
+    hash = (hash ^ pBytes[i]) * 16777619u;
+  }
+  return (hash);
+}
+
+static void delete_Simplifier(Simplifier *pSimplifier) {
+  free(pSimplifier->pCanonical);
+  free(pSimplifier->pQuadrics);
+  free(pSimplifier->pLocked);
+  free(pSimplifier->pTouched);
+  free(pSimplifier->pRemap);
+  free(pSimplifier->pOffsets);
+  free(pSimplifier->pAdjacency);
+  free(pSimplifier->pFill);
+  free(pSimplifier->pCollapses);
+  free(pSimplifier->pIndices);
+}
+
+static ErrVal new_Simplifier(Simplifier *pSimplifier, const Mesh *pMesh) {
+  const size_t vertexCount = pMesh->vertexCount;
+  const size_t indexCount = pMesh->indexCount;
+  *pSimplifier = (Simplifier){0};
+  pSimplifier->pVertices = pMesh->pVertices;
+  pSimplifier->vertexCount = pMesh->vertexCount;
+  pSimplifier->pCanonical = malloc(vertexCount * sizeof(uint32_t));
+  pSimplifier->pQuadrics = calloc(vertexCount, sizeof(Quadric));
+  pSimplifier->pLocked = calloc(vertexCount, sizeof(uint8_t));
+  pSimplifier->pTouched = malloc(vertexCount * sizeof(uint8_t));
+  pSimplifier->pRemap = malloc(vertexCount * sizeof(uint32_t));
+  pSimplifier->pOffsets = malloc((vertexCount + 1) * sizeof(uint32_t));
+  pSimplifier->pAdjacency = malloc(indexCount * sizeof(uint32_t));
+  pSimplifier->pFill = malloc(vertexCount * sizeof(uint32_t));
+  pSimplifier->pCollapses = malloc(indexCount * sizeof(Collapse));
+  pSimplifier->pIndices = malloc(indexCount * sizeof(uint32_t));
+  if (!pSimplifier->pCanonical || !pSimplifier->pQuadrics ||
+      !pSimplifier->pLocked || !pSimplifier->pTouched ||
+      !pSimplifier->pRemap || !pSimplifier->pOffsets ||
+      !pSimplifier->pAdjacency || !pSimplifier->pFill ||
+      !pSimplifier->pCollapses || !pSimplifier->pIndices) {
+    LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "could not allocate simplifier: %s",
+                   strerror(errno));
+    delete_Simplifier(pSimplifier);
+    return (ERR_ALLOCFAIL);
+  }
+  return (ERR_OK);
+}
+
+// points every vertex at the first vertex with the same position
+static ErrVal findCanonicalVertices(Simplifier *pSimplifier) {
+  size_t tableSize = 1;
+  while (tableSize < (size_t)pSimplifier->vertexCount * 2) {
+    tableSize *= 2;
+  }
+  uint32_t *pTable = malloc(tableSize * sizeof(uint32_t));
+  if (!pTable) {
+    LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "could not allocate position table: %s",
+                   strerror(errno));
+    return (ERR_ALLOCFAIL);
+  }
+  memset(pTable, 0xFF, tableSize * sizeof(uint32_t));
+
+  const Vertex *pVertices = pSimplifier->pVertices;
+  for (uint32_t v = 0; v < pSimplifier->vertexCount; v++) {
+    size_t slot = hashPosition(pVertices[v].position) & (tableSize - 1);
+    while (pTable[slot] != MESH_LOD_NO_VERTEX &&
+           memcmp(pVertices[pTable[slot]].position, pVertices[v].position,
+                  sizeof(vec3))) {
+      slot = (slot + 1) & (tableSize - 1);
+    }
+    if (pTable[slot] == MESH_LOD_NO_VERTEX) {
+      pTable[slot] = v;
+    }
+    pSimplifier->pCanonical[v] = pTable[slot];
+  }
+  free(pTable);
+  return (ERR_OK);
+}
+
+static void buildAdjacency(Simplifier *pSimplifier, const uint32_t indexCount) {
+  const uint32_t *pIndices = pSimplifier->pIndices;
+  uint32_t *pOffsets = pSimplifier->pOffsets;
+  memset(pSimplifier->pFill, 0, pSimplifier->vertexCount * sizeof(uint32_t));
+  for (uint32_t i = 0; i < indexCount; i++) {
+    pSimplifier->pFill[pIndices[i]]++;
+  }
+  pOffsets[0] = 0;
+  for (uint32_t v = 0; v < pSimplifier->vertexCount; v++) {
+    pOffsets[v + 1] = pOffsets[v] + pSimplifier->pFill[v];
+    pSimplifier->pFill[v] = 0;
+  }
+  for (uint32_t t = 0; t < indexCount / 3; t++) {
+    for (uint32_t j = 0; j < 3; j++) {
+      uint32_t v = pIndices[t * 3 + j];
+      pSimplifier->pAdjacency[pOffsets[v] + pSimplifier->pFill[v]++] = t;
+    }
+  }
+}
+
+// the number of triangles around `a` that also use `b`
+static uint32_t countEdgeTriangles(const Simplifier *pSimplifier,
+                                   const uint32_t a, const uint32_t b) {
+  uint32_t count = 0;
+  for (uint32_t i = pSimplifier->pOffsets[a]; i < pSimplifier->pOffsets[a + 1];
+       i++) {
+    const uint32_t *pTriangle =
+        &pSimplifier->pIndices[pSimplifier->pAdjacency[i] * 3];
+    count += pTriangle[0] == b || pTriangle[1] == b || pTriangle[2] == b;
+  }
+  return (count);
+}
+
+// sums the planes of the full mesh into its vertices, and locks the edges
+// that don't have exactly two triangles
+static void initializeQuadrics(Simplifier *pSimplifier,
+                               const uint32_t indexCount) {
+  const uint32_t *pIndices = pSimplifier->pIndices;
+  const Vertex *pVertices = pSimplifier->pVertices;
+  for (uint32_t t = 0; t < indexCount / 3; t++) {
+    const uint32_t *pTriangle = &pIndices[t * 3];
+    const float *p0 = pVertices[pTriangle[0]].position;
+    double normal[3];
+    triangleNormal(normal, p0, pVertices[pTriangle[1]].position,
+                   pVertices[pTriangle[2]].position);
+    const double length = sqrt(normal[0] * normal[0] + normal[1] * normal[1] +
+                               normal[2] * normal[2]);
+    if (length == 0.0) {
+      continue;
+    }
+    const double a = normal[0] / length;
+    const double b = normal[1] / length;
+    const double c = normal[2] / length;
+    const double d =
+        -(a * (double)p0[0] + b * (double)p0[1] + c * (double)p0[2]);
+    for (uint32_t j = 0; j < 3; j++) {
+      quadricAddPlane(&pSimplifier->pQuadrics[pTriangle[j]], a, b, c, d,
+                      length / 2.0);
+    }
+  }
+
+  buildAdjacency(pSimplifier, indexCount);
+  for (uint32_t i = 0; i < indexCount; i++) {
+    const uint32_t a = pIndices[i];
+    const uint32_t b = pIndices[i - i % 3 + (i + 1) % 3];
+    if (countEdgeTriangles(pSimplifier, a, b) != 2) {
+      pSimplifier->pLocked[a] = 1;
+      pSimplifier->pLocked[b] = 1;
+    }
+  }
+}
+
+// whether moving `from` onto `to` keeps every triangle around `from` facing
+// the same way, and if so, how many triangles it removes
+static bool isCollapseValid(const Simplifier *pSimplifier, const uint32_t from,
+                            const uint32_t to, uint32_t *pRemovedCount) {
+  const Vertex *pVertices = pSimplifier->pVertices;
+  uint32_t removedCount = 0;
+  for (uint32_t i = pSimplifier->pOffsets[from];
+       i < pSimplifier->pOffsets[from + 1]; i++) {
+    const uint32_t *pTriangle =
+        &pSimplifier->pIndices[pSimplifier->pAdjacency[i] * 3];
+    if (pTriangle[0] == to || pTriangle[1] == to || pTriangle[2] == to) {
+      removedCount++;
+      continue;
+    }
+    const float *pPositions[3];
+    for (uint32_t j = 0; j < 3; j++) {
+      pPositions[j] = pVertices[pTriangle[j]].position;
+    }
+    double before[3];
+    triangleNormal(before, pPositions[0], pPositions[1], pPositions[2]);
+    for (uint32_t j = 0; j < 3; j++) {
+      if (pTriangle[j] == from) {
+        pPositions[j] = pVertices[to].position;
+      }
+    }
+    double after[3];
+    triangleNormal(after, pPositions[0], pPositions[1], pPositions[2]);
+    if (before[0] * after[0] + before[1] * after[1] + before[2] * after[2] <=
+        0.0) {
+      return (false);
+    }
+  }
+  *pRemovedCount = removedCount;
+  return (true);
+}
+
+// collapses the cheapest edges whose neighborhoods don't overlap, until the
+// level is down to `targetIndexCount` indices, and returns its new size
+static uint32_t collapsePass(Simplifier *pSimplifier, const uint32_t indexCount,
+                             const uint32_t targetIndexCount,
+                             double *pMaxCost) {
+  uint32_t *pIndices = pSimplifier->pIndices;
+  const Vertex *pVertices = pSimplifier->pVertices;
+  const Quadric *pQuadrics = pSimplifier->pQuadrics;
+  const uint8_t *pLocked = pSimplifier->pLocked;
+  buildAdjacency(pSimplifier, indexCount);
+
+  // every edge inside the mesh shows up once in each direction, so only the
+  // increasing one is taken, moving whichever end costs less
+  uint32_t collapseCount = 0;
+  for (uint32_t i = 0; i < indexCount; i++) {
+    const uint32_t a = pIndices[i];
+    const uint32_t b = pIndices[i - i % 3 + (i + 1) % 3];
+    if (a > b || (pLocked[a] && pLocked[b])) {
+      continue;
+    }
+    const double costAB =
+        pLocked[a] ? HUGE_VAL
+                   : quadricError(&pQuadrics[a], &pQuadrics[b],
+                                  pVertices[b].position);
+    const double costBA =
+        pLocked[b] ? HUGE_VAL
+                   : quadricError(&pQuadrics[a], &pQuadrics[b],
+                                  pVertices[a].position);
+    pSimplifier->pCollapses[collapseCount++] =
+        costAB <= costBA ? (Collapse){costAB, a, b} : (Collapse){costBA, b, a};
+  }
+  qsort(pSimplifier->pCollapses, collapseCount, sizeof(Collapse),
+        compareCollapses);
+
+  for (uint32_t v = 0; v < pSimplifier->vertexCount; v++) {
+    pSimplifier->pRemap[v] = v;
+  }
+  memset(pSimplifier->pTouched, 0, pSimplifier->vertexCount);
+
+  const uint32_t goal = (indexCount - targetIndexCount) / 3;
+  uint32_t removedCount = 0;
+  for (uint32_t c = 0; c < collapseCount && removedCount < goal; c++) {
+    const Collapse collapse = pSimplifier->pCollapses[c];
+    uint32_t collapseRemovedCount;
+    if (pSimplifier->pTouched[collapse.from] ||
+        pSimplifier->pTouched[collapse.to] ||
+        !isCollapseValid(pSimplifier, collapse.from, collapse.to,
+                         &collapseRemovedCount)) {
+      continue;
+    }
+    pSimplifier->pRemap[collapse.from] = collapse.to;
+    quadricAdd(&pSimplifier->pQuadrics[collapse.to],
+               &pSimplifier->pQuadrics[collapse.from]);
+    *pMaxCost = fmax(*pMaxCost, collapse.cost);
+    removedCount += collapseRemovedCount;
+    // the triangles around `from` changed shape, so nothing else in them may
+    // move until the next pass checks them again
+    for (uint32_t i = pSimplifier->pOffsets[collapse.from];
+         i < pSimplifier->pOffsets[collapse.from + 1]; i++) {
+      const uint32_t *pTriangle = &pIndices[pSimplifier->pAdjacency[i] * 3];
+      for (uint32_t j = 0; j < 3; j++) {
+        pSimplifier->pTouched[pTriangle[j]] = 1;
+      }
+    }
+  }
+
+  uint32_t newIndexCount = 0;
+  for (uint32_t t = 0; t < indexCount / 3; t++) {
+    const uint32_t v0 = pSimplifier->pRemap[pIndices[t * 3 + 0]];
+    const uint32_t v1 = pSimplifier->pRemap[pIndices[t * 3 + 1]];
+    const uint32_t v2 = pSimplifier->pRemap[pIndices[t * 3 + 2]];
+    if (v0 == v1 || v1 == v2 || v2 == v0) {
+      continue;
+    }
+    pIndices[newIndexCount++] = v0;
+    pIndices[newIndexCount++] = v1;
+    pIndices[newIndexCount++] = v2;
+  }
+  return (newIndexCount);
+}
+
+void getMeshLodChainFull(MeshLodChain *pChain, const uint32_t indexCount) {
+  *pChain = (MeshLodChain){0};
+  pChain->pLevels[0] =
+      (MeshLod){.firstIndex = 0, .indexCount = indexCount, .error = 0.0f};
+  pChain->levelCount = 1;
+}
+
+ErrVal meshBuildLods(Mesh *pMesh, MeshLodChain *pChain) {
+  getMeshLodChainFull(pChain, pMesh->indexCount);
+
+  Simplifier simplifier;
+  ErrVal retVal = new_Simplifier(&simplifier, pMesh);
+  if (retVal != ERR_OK) {
+    return (retVal);
+  }
+  retVal = findCanonicalVertices(&simplifier);
+  if (retVal != ERR_OK) {
+    delete_Simplifier(&simplifier);
+    return (retVal);
+  }
+
+  // simplify the full mesh as if the vertices at each position were one,
+  // dropping triangles that fold up when they are
+  uint32_t indexCount = 0;
+  for (uint32_t t = 0; t < pMesh->indexCount / 3; t++) {
+    const uint32_t v0 = simplifier.pCanonical[pMesh->pIndices[t * 3 + 0]];
+    const uint32_t v1 = simplifier.pCanonical[pMesh->pIndices[t * 3 + 1]];
+    const uint32_t v2 = simplifier.pCanonical[pMesh->pIndices[t * 3 + 2]];
+    if (v0 == v1 || v1 == v2 || v2 == v0) {
+      continue;
+    }
+    simplifier.pIndices[indexCount++] = v0;
+    simplifier.pIndices[indexCount++] = v1;
+    simplifier.pIndices[indexCount++] = v2;
+  }
+  initializeQuadrics(&simplifier, indexCount);
+
+  uint32_t *ppLevelIndices[MESH_LOD_MAX_LEVELS] = {0};
+  uint32_t levelCount = 1;
+  uint32_t previousIndexCount = pMesh->indexCount;
+  double maxCost = 0.0;
+  for (; levelCount < MESH_LOD_MAX_LEVELS; levelCount++) {
+    const uint32_t targetIndexCount =
+        (uint32_t)((float)(previousIndexCount / 3) * MESH_LOD_REDUCTION) * 3;
+    for (uint32_t pass = 0;
+         pass < MESH_LOD_MAX_PASSES && indexCount > targetIndexCount; pass++) {
+      const uint32_t passIndexCount =
+          collapsePass(&simplifier, indexCount, targetIndexCount, &maxCost);
+      if (passIndexCount == indexCount) {
+        break;
+      }
+      indexCount = passIndexCount;
+    }
+    if (indexCount == 0 ||
+        indexCount > MESH_LOD_MIN_PROGRESS * previousIndexCount) {
+      break;
+    }
+
+    Mesh level = {
+        .pVertices = pMesh->pVertices,
+        .vertexCount = pMesh->vertexCount,
+        .pIndices = malloc((size_t)indexCount * sizeof(uint32_t)),
+        .indexCount = indexCount,
+    };
+    if (!level.pIndices) {
+      LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "could not allocate LOD %u: %s",
+                     levelCount, strerror(errno));
+      break;
+    }
+    memcpy(level.pIndices, simplifier.pIndices,
+           (size_t)indexCount * sizeof(uint32_t));
+    // a level that isn't cache optimized still draws correctly
+    meshOptimizeVertexCache(&level);
+    ppLevelIndices[levelCount] = level.pIndices;
+    pChain->pLevels[levelCount] = (MeshLod){
+        .firstIndex = 0,
+        .indexCount = indexCount,
+        .error = (float)sqrt(maxCost),
+    };
+    previousIndexCount = indexCount;
+  }
+  delete_Simplifier(&simplifier);
+
+  // append the levels after the full mesh
+  size_t totalIndexCount = pMesh->indexCount;
+  for (uint32_t i = 1; i < levelCount; i++) {
+    totalIndexCount += pChain->pLevels[i].indexCount;
+  }
+  uint32_t *pIndices =
+      totalIndexCount > UINT32_MAX
+          ? NULL
+          : realloc(pMesh->pIndices, totalIndexCount * sizeof(uint32_t));
+  if (!pIndices) {
+    LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "could not allocate %zu LOD indices: %s",
+                   totalIndexCount, strerror(errno));
+    for (uint32_t i = 1; i < levelCount; i++) {
+      free(ppLevelIndices[i]);
+    }
+    getMeshLodChainFull(pChain, pMesh->indexCount);
+    return (ERR_ALLOCFAIL);
+  }
+  pMesh->pIndices = pIndices;
+  for (uint32_t i = 1; i < levelCount; i++) {
+    MeshLod *pLevel = &pChain->pLevels[i];
+    pLevel->firstIndex = pMesh->indexCount;
+    memcpy(&pIndices[pLevel->firstIndex], ppLevelIndices[i],
+           (size_t)pLevel->indexCount * sizeof(uint32_t));
+    pMesh->indexCount += pLevel->indexCount;
+    free(ppLevelIndices[i]);
+  }
+  pChain->levelCount = levelCount;
+  return (ERR_OK);
+}
+
+void printMeshLodChain(const MeshLodChain *pChain) {
+  for (uint32_t i = 0; i < pChain->levelCount; i++) {
+    const MeshLod *pLevel = &pChain->pLevels[i];
+    printf("lod %u: %u triangles, error %g\n", i, pLevel->indexCount / 3,
+           (double)pLevel->error);
+  }
+}
+
+uint32_t selectMeshLod(const MeshLodChain *pChain, const float distance,
+                       const float scale, const float pixelsPerUnit,
+                       const float threshold) {
+  const float pixelsPerError =
+      scale * pixelsPerUnit / fmaxf(distance, MESH_LOD_MIN_DISTANCE);
+  // errors only grow down the chain, so stop at the first one too large
+  uint32_t level = 0;
+  for (uint32_t i = 1; i < pChain->levelCount; i++) {
+    if (pChain->pLevels[i].error * pixelsPerError > threshold) {
+      break;
+    }
+    level = i;
+  }
+  return (level);
+}
+
+uint32_t getInstanceLodDraws(IndexedDraw *pDraws, InstanceData *pSorted,
+                             uint8_t *pLevels, const InstanceData *pInstances,
+                             const uint32_t instanceCount,
+                             const MeshLodChain *pChain, const vec4 sphere,
+                             const vec3 eye, const float pixelsPerUnit,
+                             const float threshold) {
+  const vec4 center = {sphere[0], sphere[1], sphere[2], 1.0f};
+  uint32_t pCounts[MESH_LOD_MAX_LEVELS] = {0};
+  for (uint32_t i = 0; i < instanceCount; i++) {
+    vec4 worldCenter;
+    mat4x4_mul_vec4(worldCenter, pInstances[i].model, center);
+    float scale = 0.0f;
+    for (uint32_t j = 0; j < 3; j++) {
+      scale = fmaxf(scale, vec3_len(pInstances[i].model[j]));
+    }
+    // measured to the nearest point of the bounding sphere, so no part of the
+    // mesh is closer than assumed
+    vec3 offset;
+    vec3_sub(offset, worldCenter, eye);
+    const float distance = vec3_len(offset) - sphere[3] * scale;
+    const uint32_t level =
+        selectMeshLod(pChain, distance, scale, pixelsPerUnit, threshold);
+    pLevels[i] = (uint8_t)level;
+    pCounts[level]++;
+  }
+
+  // counting sort, so each level's instances are contiguous
+  uint32_t pOffsets[MESH_LOD_MAX_LEVELS];
+  uint32_t drawCount = 0;
+  uint32_t offset = 0;
+  for (uint32_t level = 0; level < pChain->levelCount; level++) {
+    pOffsets[level] = offset;
+    if (pCounts[level] != 0) {
+      pDraws[drawCount++] = (IndexedDraw){
+          .firstIndex = pChain->pLevels[level].firstIndex,
+          .indexCount = pChain->pLevels[level].indexCount,
+          .firstInstance = offset,
+          .instanceCount = pCounts[level],
+      };
+    }
+    offset += pCounts[level];
+  }
+  for (uint32_t i = 0; i < instanceCount; i++) {
+    pSorted[pOffsets[pLevels[i]]++] = pInstances[i];
+  }
+  return (drawCount);
+}
+
+void meshLodStatsRecord(MeshLodStats *pStats, const MeshLodChain *pChain,
+                        const IndexedDraw *pDraws, const uint32_t drawCount) {
+  uint64_t triangleCount = 0;
+  for (uint32_t i = 0; i < drawCount; i++) {
+    triangleCount += (uint64_t)(pDraws[i].indexCount / 3) *
+                     pDraws[i].instanceCount;
+    // draws are matched to levels by where their indices start
+    for (uint32_t level = 0; level < pChain->levelCount; level++) {
+      if (pChain->pLevels[level].firstIndex == pDraws[i].firstIndex) {
+        pStats->pLevelInstanceCounts[level] += pDraws[i].instanceCount;
+        break;
+      }
+    }
+  }
+  if (pStats->frameCount == 0 || triangleCount < pStats->minTriangleCount) {
+    pStats->minTriangleCount = triangleCount;
+  }
+  if (triangleCount > pStats->maxTriangleCount) {
+    pStats->maxTriangleCount = triangleCount;
+  }
+  pStats->triangleCount += triangleCount;
+  pStats->frameCount++;
+}
+
+void printMeshLodStats(const MeshLodStats *pStats,
+                       const MeshLodChain *pChain) {
+  if (pStats->frameCount == 0) {
+    return;
+  }
+  printf("lod: %.0f triangles per frame on average, min %llu, max %llu\n",
+         (double)pStats->triangleCount / (double)pStats->frameCount,
+         (unsigned long long)pStats->minTriangleCount,
+         (unsigned long long)pStats->maxTriangleCount);
+  for (uint32_t level = 0; level < pChain->levelCount; level++) {
+    printf("lod %u: %.1f instances per frame\n", level,
+           (double)pStats->pLevelInstanceCounts[level] /
+               (double)pStats->frameCount);
+  }
+}
@@ -0,0 +1,96 @@
+#ifndef SRC_MESH_LOD_H_
+#define SRC_MESH_LOD_H_
+
+#include <stdint.h>
+
+#include <linmath.h>
+
+#include "errors.h"
+#include "mesh.h"
+#include "vulkan_utils.h"
+
+// most levels of detail kept for a mesh, including the full mesh
+#define MESH_LOD_MAX_LEVELS 8
+// each level aims for this fraction of the triangles of the one before
+#define MESH_LOD_REDUCTION 0.5f
+
+// One level of detail, a range of the mesh's index buffer
+typedef struct {
+  uint32_t firstIndex;
+  uint32_t indexCount;
+  // about how far the level's surface is from the full mesh, in model units
+  float error;
+} MeshLod;
+
+// The levels of detail of one mesh, from the full mesh down, with growing
+// errors
+typedef struct {
+  MeshLod pLevels[MESH_LOD_MAX_LEVELS];
+  uint32_t levelCount;
+} MeshLodChain;
+
+// Totals over every frame drawn with levels of detail, for tuning the error
+// threshold
+typedef struct {
+  uint64_t frameCount;
+  uint64_t triangleCount;
+  uint64_t minTriangleCount;
+  uint64_t maxTriangleCount;
+  // instances drawn at each level, over every frame
+  uint64_t pLevelInstanceCounts[MESH_LOD_MAX_LEVELS];
+} MeshLodStats;
+
+/// Sets `pChain` to a single level drawing the first `indexCount` indices
+void getMeshLodChainFull(MeshLodChain *pChain, const uint32_t indexCount);
+
+/// Simplifies the mesh into a chain of levels of detail, and appends their
+/// indices to the mesh's index buffer
+/// Edges are collapsed onto one of their vertices in order of their quadric
+/// error (Garland and Heckbert 1997), so every level draws from the same
+/// vertices. Vertices on open edges stay put, and collapses that would flip a
+/// triangle are skipped. Each level is then optimized for the vertex cache.
+/// --- PRECONDITIONS ---
+/// * `pMesh` is a valid mesh, whose index buffer is the full mesh
+/// --- POSTCONDITIONS ---
+/// * returns error status
+/// * on success, level 0 is the full mesh, and simplification stops early once
+/// a level can't lose enough triangles
+/// * returns ERR_ALLOCFAIL if there isn't enough memory, leaving the mesh as
+/// it was with a single level
+ErrVal meshBuildLods(Mesh *pMesh, MeshLodChain *pChain);
+
+/// Prints the triangle count and error of every level
+void printMeshLodChain(const MeshLodChain *pChain);
+
+/// Returns the coarsest level whose error, scaled by `scale` and seen from
+/// `distance` away, covers at most `threshold` pixels
+/// `pixelsPerUnit` is how many pixels one unit spans at a distance of one
+uint32_t selectMeshLod(const MeshLodChain *pChain, const float distance,
+                       const float scale, const float pixelsPerUnit,
+                       const float threshold);
+
+/// Picks a level for every instance, and sorts the instances by level so that
+/// each level is drawn by one instanced draw
+/// --- PRECONDITIONS ---
+/// * `pDraws` has room for MESH_LOD_MAX_LEVELS draws
+/// * `pSorted` and `pLevels` have room for `instanceCount` elements
+/// * `sphere` bounds the mesh in model space, with the radius in w
+/// --- POSTCONDITIONS ---
+/// * returns the number of draws, levels without instances are left out
+uint32_t getInstanceLodDraws(IndexedDraw *pDraws, InstanceData *pSorted,
+                             uint8_t *pLevels, const InstanceData *pInstances,
+                             const uint32_t instanceCount,
+                             const MeshLodChain *pChain, const vec4 sphere,
+                             const vec3 eye, const float pixelsPerUnit,
+                             const float threshold);
+
+/// Adds one frame's draws to `pStats`
+void meshLodStatsRecord(MeshLodStats *pStats, const MeshLodChain *pChain,
+                        const IndexedDraw *pDraws, const uint32_t drawCount);
+
+/// Prints the triangles submitted per frame, and how often each level was
+/// drawn
+void printMeshLodStats(const MeshLodStats *pStats,
+                       const MeshLodChain *pChain);
+
+#endif // SRC_MESH_LOD_H_
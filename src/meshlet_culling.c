@@ -0,0 +1,357 @@
+#include "meshlet_culling.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_alloc.h"
+#include "vulkan_utils.h"
+
+// what a dispatch of meshlet_cull.comp does, its PASS_ defines
+typedef enum {
+  MESHLET_CULL_PASS_TEST = 0,
+  MESHLET_CULL_PASS_SCAN = 1,
+  MESHLET_CULL_PASS_COPY = 2,
+} MeshletCullPass;
+
+// laid out like the push constants of meshlet_cull.comp
+typedef struct {
+  mat4x4 viewProjection;
+  // w is unused
+  vec4 cameraPosition;
+  uint32_t meshletCount;
+  uint32_t pass;
+  uint32_t coneCulling;
+} MeshletCullConstants;
+
+static void delete_MeshletCullFrame(MeshletCullFrame *pFrame,
+                                    Allocator *pAllocator,
+                                    const VkDevice device) {
+  delete_Buffer(&pFrame->indexBuffer, device);
+  delete_Allocation(&pFrame->indexAllocation, pAllocator);
+  delete_Buffer(&pFrame->drawBuffer, device);
+  delete_Allocation(&pFrame->drawAllocation, pAllocator);
+  delete_Buffer(&pFrame->offsetBuffer, device);
+  delete_Allocation(&pFrame->offsetAllocation, pAllocator);
+}
+
+static ErrVal new_MeshletCullFrame(MeshletCullFrame *pFrame,
+                                   const MeshletCuller *pCuller) {
+  // every meshlet may be visible
+  const VkDeviceSize indexSize =
+      (VkDeviceSize)pCuller->indexCount * sizeof(uint32_t);
+  const VkDeviceSize drawSize = sizeof(VkDrawIndexedIndirectCommand);
+  const VkDeviceSize offsetSize =
+      (VkDeviceSize)pCuller->meshletCount * sizeof(uint32_t);
+
+  ErrVal retVal = new_Buffer_Allocation(
+      &pFrame->indexBuffer, &pFrame->indexAllocation, pCuller->pAllocator,
+      indexSize,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0);
+  if (retVal != ERR_OK) {
+    return (retVal);
+  }
+  retVal = new_Buffer_Allocation(
+      &pFrame->drawBuffer, &pFrame->drawAllocation, pCuller->pAllocator,
+      drawSize,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0);
+  if (retVal != ERR_OK) {
+    delete_Buffer(&pFrame->indexBuffer, pCuller->device);
+    delete_Allocation(&pFrame->indexAllocation, pCuller->pAllocator);
+    return (retVal);
+  }
+  retVal = new_Buffer_Allocation(
+      &pFrame->offsetBuffer, &pFrame->offsetAllocation, pCuller->pAllocator,
+      offsetSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0);
+  if (retVal != ERR_OK) {
+    delete_Buffer(&pFrame->indexBuffer, pCuller->device);
+    delete_Allocation(&pFrame->indexAllocation, pCuller->pAllocator);
+    delete_Buffer(&pFrame->drawBuffer, pCuller->device);
+    delete_Allocation(&pFrame->drawAllocation, pCuller->pAllocator);
+    return (retVal);
+  }
+
+  const VkBuffer pBuffers[3] = {pFrame->indexBuffer, pFrame->drawBuffer,
+                                pFrame->offsetBuffer};
+  const VkDeviceSize pSizes[3] = {indexSize, drawSize, offsetSize};
+  for (uint32_t i = 0; i < 3; i++) {
+    retVal = new_ComputeBufferDescriptorSet(
+        &pFrame->pDescriptorSets[i], pBuffers[i], pSizes[i],
+        pCuller->descriptorSetLayout, pCuller->descriptorPool,
+        pCuller->device);
+    if (retVal != ERR_OK) {
+      delete_MeshletCullFrame(pFrame, pCuller->pAllocator, pCuller->device);
+      return (retVal);
+    }
+  }
+  return (ERR_OK);
+}
+
+static void delete_MeshletCullPipeline(MeshletCuller *pCuller) {
+  // the descriptor sets are freed along with their pool
+  delete_DescriptorPool(&pCuller->descriptorPool, pCuller->device);
+  delete_Pipeline(&pCuller->pipeline, pCuller->device);
+  delete_PipelineLayout(&pCuller->pipelineLayout, pCuller->device);
+  delete_DescriptorSetLayout(&pCuller->descriptorSetLayout, pCuller->device);
+}
+
+static void delete_MeshletBuffers(MeshletCuller *pCuller) {
+  delete_Buffer(&pCuller->meshletBuffer, pCuller->device);
+  delete_Allocation(&pCuller->meshletAllocation, pCuller->pAllocator);
+  delete_Buffer(&pCuller->meshletIndexBuffer, pCuller->device);
+  delete_Allocation(&pCuller->meshletIndexAllocation, pCuller->pAllocator);
+}
+
+// creates the pipeline and the descriptor pool, cleaning up after itself on
+// failure
+static ErrVal new_MeshletCullPipeline(MeshletCuller *pCuller,
+                                      const uint32_t frameCount,
+                                      const VkShaderModule shaderModule) {
+  const VkDevice device = pCuller->device;
+  ErrVal retVal = new_ComputeStorageDescriptorSetLayout(
+      &pCuller->descriptorSetLayout, device);
+  if (retVal != ERR_OK) {
+    return (retVal);
+  }
+
+  // every set holds a single storage buffer, so one layout serves all five
+  VkDescriptorSetLayout pSetLayouts[5] = {
+      pCuller->descriptorSetLayout, pCuller->descriptorSetLayout,
+      pCuller->descriptorSetLayout, pCuller->descriptorSetLayout,
+      pCuller->descriptorSetLayout};
+  VkPushConstantRange pushConstantRange = {0};
+  pushConstantRange.offset = 0;
+  pushConstantRange.size = sizeof(MeshletCullConstants);
+  pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+  VkPipelineLayoutCreateInfo pipelineLayoutInfo = {0};
+  pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pipelineLayoutInfo.setLayoutCount = 5;
+  pipelineLayoutInfo.pSetLayouts = pSetLayouts;
+  pipelineLayoutInfo.pushConstantRangeCount = 1;
+  pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+  VkResult res = vkCreatePipelineLayout(device, &pipelineLayoutInfo,
+                                        pVulkanAllocationCallbacks,
+                                        &pCuller->pipelineLayout);
+  if (res != VK_SUCCESS) {
+    LOG_ERROR_ARGS(ERR_LEVEL_ERROR,
+                   "failed to create meshlet culling pipeline layout: %s",
+                   vkstrerror(res));
+    delete_DescriptorSetLayout(&pCuller->descriptorSetLayout, device);
+    return (ERR_UNKNOWN);
+  }
+
+  retVal = new_ComputePipeline(&pCuller->pipeline, pCuller->pipelineLayout,
+                               shaderModule, device);
+  if (retVal != ERR_OK) {
+    delete_PipelineLayout(&pCuller->pipelineLayout, device);
+    delete_DescriptorSetLayout(&pCuller->descriptorSetLayout, device);
+    return (retVal);
+  }
+
+  // the two meshlet sets, then three per frame
+  retVal = new_DescriptorPool(&pCuller->descriptorPool,
+                              VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                              2 + 3 * frameCount, device);
+  if (retVal != ERR_OK) {
+    delete_Pipeline(&pCuller->pipeline, device);
+    delete_PipelineLayout(&pCuller->pipelineLayout, device);
+    delete_DescriptorSetLayout(&pCuller->descriptorSetLayout, device);
+    return (retVal);
+  }
+  return (ERR_OK);
+}
+
+ErrVal new_MeshletCuller(              //
+    MeshletCuller *pCuller,            //
+    const uint32_t frameCount,         //
+    const Meshlets *pMeshlets,         //
+    const VkShaderModule shaderModule, //
+    const VkCullModeFlags cullMode,    //
+    Allocator *pAllocator,             //
+    AsyncUploader *pUploader,          //
+    const VkDevice device              //
+) {
+  pCuller->device = device;
+  pCuller->pAllocator = pAllocator;
+  pCuller->currentFrame = 0;
+  pCuller->meshletCount = pMeshlets->meshletCount;
+  pCuller->indexCount = pMeshlets->indexCount;
+  pCuller->coneCulling = (cullMode & VK_CULL_MODE_BACK_BIT) != 0;
+
+  ErrVal retVal = new_MeshletCullPipeline(pCuller, frameCount, shaderModule);
+  if (retVal != ERR_OK) {
+    return (retVal);
+  }
+
+  // only ever read by the culling pass
+  const VkDeviceSize meshletSize =
+      (VkDeviceSize)pMeshlets->meshletCount * sizeof(Meshlet);
+  const VkDeviceSize meshletIndexSize =
+      (VkDeviceSize)pMeshlets->indexCount * sizeof(uint32_t);
+  retVal = new_Buffer_Upload(
+      &pCuller->meshletBuffer, &pCuller->meshletAllocation, pAllocator,
+      pUploader, pMeshlets->pMeshlets, meshletSize,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      VK_ACCESS_SHADER_READ_BIT, NULL);
+  if (retVal != ERR_OK) {
+    LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "could not upload %u meshlets",
+                   pMeshlets->meshletCount);
+    delete_MeshletCullPipeline(pCuller);
+    return (retVal);
+  }
+  retVal = new_Buffer_Upload(
+      &pCuller->meshletIndexBuffer, &pCuller->meshletIndexAllocation,
+      pAllocator, pUploader, pMeshlets->pIndices, meshletIndexSize,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      VK_ACCESS_SHADER_READ_BIT, NULL);
+  if (retVal != ERR_OK) {
+    LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "could not upload %u meshlet indices",
+                   pMeshlets->indexCount);
+    delete_Buffer(&pCuller->meshletBuffer, device);
+    delete_Allocation(&pCuller->meshletAllocation, pAllocator);
+    delete_MeshletCullPipeline(pCuller);
+    return (retVal);
+  }
+
+  const VkBuffer pBuffers[2] = {pCuller->meshletBuffer,
+                                pCuller->meshletIndexBuffer};
+  const VkDeviceSize pSizes[2] = {meshletSize, meshletIndexSize};
+  for (uint32_t i = 0; i < 2; i++) {
+    retVal = new_ComputeBufferDescriptorSet(
+        &pCuller->pMeshletDescriptorSets[i], pBuffers[i], pSizes[i],
+        pCuller->descriptorSetLayout, pCuller->descriptorPool, device);
+    if (retVal != ERR_OK) {
+      delete_MeshletBuffers(pCuller);
+      delete_MeshletCullPipeline(pCuller);
+      return (retVal);
+    }
+  }
+
+  pCuller->pFrames = malloc(frameCount * sizeof(MeshletCullFrame));
+  if (!pCuller->pFrames) {
+    LOG_ERROR_ARGS(ERR_LEVEL_FATAL, "failed to create meshlet culler: %s",
+                   strerror(errno));
+    PANIC();
+  }
+  for (uint32_t i = 0; i < frameCount; i++) {
+    retVal = new_MeshletCullFrame(&pCuller->pFrames[i], pCuller);
+    if (retVal != ERR_OK) {
+      LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "could not cull %u indices",
+                     pCuller->indexCount);
+      pCuller->frameCount = i;
+      delete_MeshletCuller(pCuller);
+      return (retVal);
+    }
+  }
+  pCuller->frameCount = frameCount;
+  return (ERR_OK);
+}
+
+void delete_MeshletCuller(MeshletCuller *pCuller) {
+  for (uint32_t i = 0; i < pCuller->frameCount; i++) {
+    delete_MeshletCullFrame(&pCuller->pFrames[i], pCuller->pAllocator,
+                            pCuller->device);
+  }
+  free(pCuller->pFrames);
+  pCuller->pFrames = NULL;
+  pCuller->frameCount = 0;
+  delete_MeshletBuffers(pCuller);
+  delete_MeshletCullPipeline(pCuller);
+}
+
+void meshletCullerBeginFrame(MeshletCuller *pCuller,
+                             const uint32_t frameIndex) {
+  pCuller->currentFrame = frameIndex;
+}
+
+// makes the writes of one pass visible to the next
+static void recordMeshletCullPassBarrier(const VkCommandBuffer commandBuffer) {
+  VkMemoryBarrier passBarrier = {0};
+  passBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  passBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  passBarrier.dstAccessMask =
+      VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+                       &passBarrier, 0, NULL, 0, NULL);
+}
+
+void meshletCullerRecordCull(MeshletCuller *pCuller,
+                             const VkCommandBuffer commandBuffer,
+                             const mat4x4 viewProjection,
+                             const vec3 cameraPosition) {
+  MeshletCullFrame *pFrame = &pCuller->pFrames[pCuller->currentFrame];
+
+  MeshletCullConstants constants = {0};
+  memcpy(constants.viewProjection, viewProjection, sizeof(mat4x4));
+  memcpy(constants.cameraPosition, cameraPosition, sizeof(vec3));
+  constants.meshletCount = pCuller->meshletCount;
+  constants.coneCulling = pCuller->coneCulling;
+
+  VkDescriptorSet pDescriptorSets[5] = {
+      pCuller->pMeshletDescriptorSets[0], pCuller->pMeshletDescriptorSets[1],
+      pFrame->pDescriptorSets[0], pFrame->pDescriptorSets[1],
+      pFrame->pDescriptorSets[2]};
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                    pCuller->pipeline);
+  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                          pCuller->pipelineLayout, 0, 5, pDescriptorSets, 0,
+                          NULL);
+
+  // one thread per meshlet, as far as a dispatch goes
+  const uint32_t testGroupCount =
+      (pCuller->meshletCount + MESHLET_CULL_WORKGROUP_SIZE - 1) /
+      MESHLET_CULL_WORKGROUP_SIZE;
+  constants.pass = MESHLET_CULL_PASS_TEST;
+  vkCmdPushConstants(commandBuffer, pCuller->pipelineLayout,
+                     VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants),
+                     &constants);
+  vkCmdDispatch(commandBuffer,
+                testGroupCount < MESHLET_CULL_MAX_WORKGROUPS
+                    ? testGroupCount
+                    : MESHLET_CULL_MAX_WORKGROUPS,
+                1, 1);
+  recordMeshletCullPassBarrier(commandBuffer);
+
+  // the scan also writes the draw, so nothing needs resetting beforehand
+  constants.pass = MESHLET_CULL_PASS_SCAN;
+  vkCmdPushConstants(commandBuffer, pCuller->pipelineLayout,
+                     VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants),
+                     &constants);
+  vkCmdDispatch(commandBuffer, 1, 1, 1);
+  recordMeshletCullPassBarrier(commandBuffer);
+
+  // one workgroup per meshlet, as far as a dispatch goes
+  constants.pass = MESHLET_CULL_PASS_COPY;
+  vkCmdPushConstants(commandBuffer, pCuller->pipelineLayout,
+                     VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants),
+                     &constants);
+  vkCmdDispatch(commandBuffer,
+                pCuller->meshletCount < MESHLET_CULL_MAX_WORKGROUPS
+                    ? pCuller->meshletCount
+                    : MESHLET_CULL_MAX_WORKGROUPS,
+                1, 1);
+
+  VkMemoryBarrier cullBarrier = {0};
+  cullBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  cullBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  cullBarrier.dstAccessMask =
+      VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+                           VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                       0, 1, &cullBarrier, 0, NULL, 0, NULL);
+}
+
+void meshletCullerRecordDraw(MeshletCuller *pCuller,
+                             const VkCommandBuffer commandBuffer) {
+  MeshletCullFrame *pFrame = &pCuller->pFrames[pCuller->currentFrame];
+  vkCmdBindIndexBuffer(commandBuffer, pFrame->indexBuffer, 0,
+                       VK_INDEX_TYPE_UINT32);
+  vkCmdDrawIndexedIndirect(commandBuffer, pFrame->drawBuffer, 0, 1,
+                           sizeof(VkDrawIndexedIndirectCommand));
+}
@@ -0,0 +1,152 @@
+#ifndef SRC_MESHLET_CULLING_H_
+#define SRC_MESHLET_CULLING_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+#include <linmath.h>
+
+#include "allocator.h"
+#include "async_upload.h"
+#include "errors.h"
+
+// most vertices and triangles in a meshlet, what mesh shading hardware
+// favors, so the same clusters would suit it
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+// A cluster of nearby triangles, culled as a whole
+// laid out like Meshlet in meshlet_cull.comp
+typedef struct {
+  // bounds the meshlet's vertices, radius in w
+  vec4 sphere;
+  // the average facing of the triangles in xyz, and in w the sine of how far
+  // the camera has to be behind it for every triangle to face away, or 1 if
+  // it can never be culled that way
+  vec4 cone;
+  uint32_t firstIndex;
+  uint32_t indexCount;
+  uint32_t padding[2];
+} Meshlet;
+
+// A mesh's triangles split into meshlets, see `new_Meshlets` in `mesh.h`
+typedef struct {
+  Meshlet *pMeshlets;
+  uint32_t meshletCount;
+  // the mesh's triangles, each meshlet's a contiguous range
+  uint32_t *pIndices;
+  uint32_t indexCount;
+  // total over every meshlet, counting shared vertices once per meshlet
+  uint64_t vertexCount;
+} Meshlets;
+
+// threads per workgroup of meshlet_cull.comp, which tests a meshlet per
+// thread, then scans the results with a single workgroup and copies the
+// indices of a meshlet per workgroup
+#define MESHLET_CULL_WORKGROUP_SIZE 64
+// most workgroups dispatched along x, the least every device supports;
+// workgroups loop over the meshlets past it
+#define MESHLET_CULL_MAX_WORKGROUPS 65535
+
+// The buffers one frame in flight culls into
+typedef struct {
+  // the indices of the visible meshlets, compacted, read as the index buffer
+  VkBuffer indexBuffer;
+  Allocation indexAllocation;
+  // a single command drawing every visible index
+  VkBuffer drawBuffer;
+  Allocation drawAllocation;
+  // where each meshlet's visible indices go, a prefix sum over the meshlets
+  // so they stay in order from frame to frame
+  VkBuffer offsetBuffer;
+  Allocation offsetAllocation;
+  // sets 2 to 4 of meshlet_cull.comp: the visible indices, the draw and the
+  // offsets
+  VkDescriptorSet pDescriptorSets[3];
+} MeshletCullFrame;
+
+// Culls the meshlets of a mesh that are off screen or facing away from the
+// camera in a compute pass, and draws the rest with one indirect draw
+// Only needs compute shaders and vkCmdDrawIndexedIndirect, no mesh shaders
+typedef struct {
+  VkDevice device;
+  Allocator *pAllocator;
+  VkDescriptorSetLayout descriptorSetLayout;
+  VkDescriptorPool descriptorPool;
+  VkPipelineLayout pipelineLayout;
+  VkPipeline pipeline;
+  // the meshlets and their indices, sets 0 and 1, shared by every frame
+  VkBuffer meshletBuffer;
+  Allocation meshletAllocation;
+  VkBuffer meshletIndexBuffer;
+  Allocation meshletIndexAllocation;
+  VkDescriptorSet pMeshletDescriptorSets[2];
+  MeshletCullFrame *pFrames;
+  uint32_t frameCount;
+  // the frame in flight being recorded
+  uint32_t currentFrame;
+  uint32_t meshletCount;
+  uint32_t indexCount;
+  // only when back faces aren't drawn can a meshlet facing away be skipped
+  bool coneCulling;
+} MeshletCuller;
+
+/// Uploads the meshlets, and creates the culling pipeline and the buffers for
+/// every frame in flight
+/// --- PRECONDITIONS ---
+/// * `pCuller` is a valid pointer
+/// * `pMeshlets` split the mesh bound as vertex binding 0 when drawing, in the
+/// same space as the camera transform, into at least one meshlet
+/// * `shaderModule` holds meshlet_cull.comp
+/// * `cullMode` is the cull mode the meshlets are drawn with, they are only
+/// culled by their normal cone if it includes `VK_CULL_MODE_BACK_BIT`
+/// * `pAllocator` and `pUploader` were created from `device`
+/// --- POSTCONDITIONS ---
+/// * returns error status
+/// * the meshlets are uploaded through `new_Buffer_Upload`, so they may only
+/// be culled in a frame that records the uploader's acquires
+/// * `pMeshlets` may be deleted right away
+/// --- CLEANUP ---
+/// * call `delete_MeshletCuller` once no frame in flight uses it
+ErrVal new_MeshletCuller(              //
+    MeshletCuller *pCuller,            //
+    const uint32_t frameCount,         //
+    const Meshlets *pMeshlets,         //
+    const VkShaderModule shaderModule, //
+    const VkCullModeFlags cullMode,    //
+    Allocator *pAllocator,             //
+    AsyncUploader *pUploader,          //
+    const VkDevice device              //
+);
+
+void delete_MeshletCuller(MeshletCuller *pCuller);
+
+/// Makes `frameIndex` the frame in flight that the next cull is recorded into
+/// --- PRECONDITIONS ---
+/// * that frame's fence has been waited on
+void meshletCullerBeginFrame(MeshletCuller *pCuller, const uint32_t frameIndex);
+
+/// Records the culling passes against the clip volume of `viewProjection`,
+/// and the back faces seen from `cameraPosition` when they aren't drawn
+/// The visible meshlets keep their order, so the same view draws the same
+/// triangles in the same order every frame
+/// --- PRECONDITIONS ---
+/// * `commandBuffer` is recording and is not inside a render pass
+/// --- POSTCONDITIONS ---
+/// * the results are made visible to indirect draws and index fetches
+void meshletCullerRecordCull(MeshletCuller *pCuller,
+                             const VkCommandBuffer commandBuffer,
+                             const mat4x4 viewProjection,
+                             const vec3 cameraPosition);
+
+/// Binds the visible indices as the index buffer and draws them
+/// --- PRECONDITIONS ---
+/// * `meshletCullerRecordCull` was recorded earlier in `commandBuffer`
+/// * `commandBuffer` is inside a render pass with the mesh bound to vertex
+/// binding 0
+void meshletCullerRecordDraw(MeshletCuller *pCuller,
+                             const VkCommandBuffer commandBuffer);
+
+#endif // SRC_MESHLET_CULLING_H_
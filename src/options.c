@@ -0,0 +1,372 @@
+#include "options.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mesh_loader.h"
+
+// number of frames rendered in headless mode when --frames is not given
+#define DEFAULT_HEADLESS_FRAME_COUNT 300
+// number of frames run before measuring when --bench-warmup is not given
+#define DEFAULT_BENCH_WARMUP_FRAME_COUNT 60
+// defaults for the generated stress scene
+#define DEFAULT_WORKLOAD_TRIANGLE_SIZE 0.1f
+#define DEFAULT_WORKLOAD_LAYER_COUNT 4
+#define DEFAULT_WORKLOAD_SEED 1
+// largest error in pixels a level of detail may have on screen
+#define DEFAULT_LOD_THRESHOLD 1.0f
+
+static void printUsage(const char *argv0) {
+  printf("usage: %s [options]\n", argv0);
+  printf("  --headless           render offscreen without a window\n");
+  printf("  --frames=<n>         exit after rendering n frames\n");
+  printf("  --dump-frames=<dir>  write each frame to <dir> (headless only)\n");
+  printf("  --bench=<n>          time n frames, then print a report and exit\n");
+  printf("  --bench-warmup=<n>   frames to run before timing (default %u)\n",
+         DEFAULT_BENCH_WARMUP_FRAME_COUNT);
+  printf("  --bench-report=<f>   write the report to f, as CSV if f ends in\n"
+         "                       .csv and JSON otherwise\n");
+  printf("  --gpu-profile        print GPU time per scope on exit\n");
+  printf("  --gpu-profile-stream=<f>\n"
+         "                       also write GPU time per frame to f as CSV\n");
+  printf("  --pipeline-stats     also count shader invocations and primitives\n");
+  printf("  --pipeline-stats-stream=<f>\n"
+         "                       also write the counts per frame to f as CSV\n");
+  printf("  --trace=<f>          write a chrome://tracing JSON trace to f\n");
+  printf("  --record-input=<f>   record the keys held each frame to f\n");
+  printf("  --replay-input=<f>   replay keys recorded by --record-input\n");
+  printf("  --workload=<n>       draw a generated scene of n triangles\n");
+  printf("  --workload-layout=<l>\n"
+         "                       'uniform' to scatter triangles randomly, or\n"
+         "                       'layers' to stack screen filling layers\n");
+  printf("  --workload-size=<s>  edge length of scattered triangles (%.2f)\n",
+         (double)DEFAULT_WORKLOAD_TRIANGLE_SIZE);
+  printf("  --workload-layers=<n>\n"
+         "                       overdraw depth of the layers layout (%u)\n",
+         DEFAULT_WORKLOAD_LAYER_COUNT);
+  printf("  --workload-seed=<n>  random seed of the scene (%u)\n",
+         DEFAULT_WORKLOAD_SEED);
+  printf("  --mesh=<f>           draw the mesh in f, an .obj, .ply, .gltf,\n"
+         "                       .glb or cooked .vtmesh file\n");
+  printf("  --cook=<f>           write the mesh to f, ready to load with\n"
+         "                       --mesh=<f> without any processing\n");
+  printf("  --loader-threads=<n> threads to parse the mesh with (one per\n"
+         "                       processor)\n");
+  printf("  --instances=<n>      draw n copies of the mesh with one instanced\n"
+         "                       draw call\n");
+  printf("  --animate-instances  turn the copies, uploading them each frame\n");
+  printf("  --gpu-cull           frustum cull the copies on the GPU and draw\n"
+         "                       the visible ones indirectly\n");
+  printf("  --cpu-cull           frustum cull the copies on the CPU and upload\n"
+         "                       the visible ones each frame\n");
+  printf("  --cull-boxes         cull with bounding boxes instead of spheres,\n"
+         "                       needs --cpu-cull\n");
+  printf("  --lod                simplify the mesh into levels of detail and\n"
+         "                       draw each copy at the coarsest one that fits\n"
+         "                       the threshold\n");
+  printf("  --lod-threshold=<px> largest error a level may show on screen, in\n"
+         "                       pixels (default %.1f)\n",
+         (double)DEFAULT_LOD_THRESHOLD);
+  printf("  --meshlets           split the mesh into meshlets and cull the ones\n"
+         "                       off screen or facing away on the GPU\n");
+  printf("  --backface-cull      skip faces pointing away from the camera,\n"
+         "                       which only closed meshes can do without holes\n");
+  printf("  --mesh-stats         print vertex counts and ACMR of the mesh before\n"
+         "                       and after optimizing it\n");
+  printf("  --packed-vertices    store 12 byte quantized vertices instead of 24\n"
+         "                       byte float ones\n");
+  printf("  --memory-stats       print device memory usage per heap on exit\n");
+  printf("  --memory-budget=<n>  print the memory budget of each heap every n\n"
+         "                       frames\n");
+  printf("  --host-allocs=<n>    track host memory allocated by the driver, and\n"
+         "                       print it every n frames and on exit\n");
+  printf("  --help               print this message\n");
+}
+
+// if `arg` starts with `prefix`, returns a pointer to the rest of arg
+static const char *matchPrefix(const char *arg, const char *prefix) {
+  size_t len = strlen(prefix);
+  if (strncmp(arg, prefix, len) == 0) {
+    return (arg + len);
+  }
+  return (NULL);
+}
+
+static ErrVal parseFloat(float *pValue, const char *str) {
+  char *end;
+  errno = 0;
+  float value = strtof(str, &end);
+  if (errno != 0 || end == str || *end != '\0') {
+    return (ERR_BADARGS);
+  }
+  *pValue = value;
+  return (ERR_OK);
+}
+
+static ErrVal parseUint32(uint32_t *pValue, const char *str) {
+  char *end;
+  errno = 0;
+  unsigned long value = strtoul(str, &end, 10);
+  if (errno != 0 || end == str || *end != '\0' || value > UINT32_MAX) {
+    return (ERR_BADARGS);
+  }
+  *pValue = (uint32_t)value;
+  return (ERR_OK);
+}
+
+ErrVal parseAppOptions(AppOptions *pOptions, const int argc,
+                       char *const *argv) {
+  AppOptions options = {0};
+  options.benchWarmupFrameCount = DEFAULT_BENCH_WARMUP_FRAME_COUNT;
+  options.workloadTriangleSize = DEFAULT_WORKLOAD_TRIANGLE_SIZE;
+  options.workloadLayerCount = DEFAULT_WORKLOAD_LAYER_COUNT;
+  options.workloadSeed = DEFAULT_WORKLOAD_SEED;
+  options.lodThreshold = DEFAULT_LOD_THRESHOLD;
+
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    const char *value;
+    if (strcmp(arg, "--headless") == 0) {
+      options.headless = true;
+    } else if ((value = matchPrefix(arg, "--frames="))) {
+      if (parseUint32(&options.frameCount, value) != ERR_OK) {
+        LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "invalid frame count: %s", value);
+        printUsage(argv[0]);
+        return (ERR_BADARGS);
+      }
+    } else if ((value = matchPrefix(arg, "--dump-frames="))) {
+      options.pFrameDumpDir = value;
+    } else if ((value = matchPrefix(arg, "--bench="))) {
+      if (parseUint32(&options.benchFrameCount, value) != ERR_OK ||
+          options.benchFrameCount == 0) {
+        LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "invalid bench frame count: %s", value);
+        printUsage(argv[0]);
+        return (ERR_BADARGS);
+      }
+    } else if ((value = matchPrefix(arg, "--bench-warmup="))) {
+      if (parseUint32(&options.benchWarmupFrameCount, value) != ERR_OK) {
+        LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "invalid warmup frame count: %s",
+                       value);
+        printUsage(argv[0]);
+        return (ERR_BADARGS);
+      }
+    } else if ((value = matchPrefix(arg, "--bench-report="))) {
+      options.pBenchReportPath = value;
+    } else if (strcmp(arg, "--gpu-profile") == 0) {
+      options.gpuProfile = true;
+    } else if ((value = matchPrefix(arg, "--gpu-profile-stream="))) {
+      options.gpuProfile = true;
+      options.pGpuProfileStreamPath = value;
+    } else if (strcmp(arg, "--pipeline-stats") == 0) {
+      options.gpuProfile = true;
+      options.pipelineStatistics = true;
+    } else if ((value = matchPrefix(arg, "--pipeline-stats-stream="))) {
+      options.gpuProfile = true;
+      options.pipelineStatistics = true;
+      options.pPipelineStatisticsStreamPath = value;
+    } else if ((value = matchPrefix(arg, "--trace="))) {
+      options.pTracePath = value;
+    } else if ((value = matchPrefix(arg, "--record-input="))) {
+      options.pRecordInputPath = value;
+    } else if ((value = matchPrefix(arg, "--replay-input="))) {
+      options.pReplayInputPath = value;
+    } else if ((value = matchPrefix(arg, "--workload="))) {
+      if (parseUint32(&options.workloadTriangleCount, value) != ERR_OK ||
+          options.workloadTriangleCount > UINT32_MAX / 3) {
+        LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "invalid triangle count: %s", value);
+        printUsage(argv[0]);
+        return (ERR_BADARGS);
+      }
+    } else if ((value = matchPrefix(arg, "--workload-layout="))) {
+      if (strcmp(value, "uniform") == 0) {
+        options.workloadLayered = false;
+      } else if (strcmp(value, "layers") == 0) {
+        options.workloadLayered = true;
+      } else {
+        LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "invalid workload layout: %s", value);
+        printUsage(argv[0]);
+        return (ERR_BADARGS);
+      }
+    } else if ((value = matchPrefix(arg, "--workload-size="))) {
+      if (parseFloat(&options.workloadTriangleSize, value) != ERR_OK ||
+          !(options.workloadTriangleSize > 0.0f)) {
+        LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "invalid triangle size: %s", value);
+        printUsage(argv[0]);
+        return (ERR_BADARGS);
+      }
+    } else if ((value = matchPrefix(arg, "--workload-layers="))) {
+      if (parseUint32(&options.workloadLayerCount, value) != ERR_OK ||
+          options.workloadLayerCount == 0) {
+        LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "invalid layer count: %s", value);
+        printUsage(argv[0]);
+        return (ERR_BADARGS);
+      }
+    } else if ((value = matchPrefix(arg, "--workload-seed="))) {
+      uint32_t seed;
+      if (parseUint32(&seed, value) != ERR_OK) {
+        LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "invalid seed: %s", value);
+        printUsage(argv[0]);
+        return (ERR_BADARGS);
+      }
+      options.workloadSeed = seed;
+    } else if ((value = matchPrefix(arg, "--mesh="))) {
+      options.pMeshPath = value;
+    } else if ((value = matchPrefix(arg, "--cook="))) {
+      options.pCookPath = value;
+    } else if ((value = matchPrefix(arg, "--loader-threads="))) {
+      if (parseUint32(&options.meshLoaderThreadCount, value) != ERR_OK ||
+          options.meshLoaderThreadCount == 0 ||
+          options.meshLoaderThreadCount > MESH_LOADER_MAX_THREADS) {
+        LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "invalid thread count: %s", value);
+        printUsage(argv[0]);
+        return (ERR_BADARGS);
+      }
+    } else if ((value = matchPrefix(arg, "--instances="))) {
+      if (parseUint32(&options.instanceCount, value) != ERR_OK ||
+          options.instanceCount == 0) {
+        LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "invalid instance count: %s", value);
+        printUsage(argv[0]);
+        return (ERR_BADARGS);
+      }
+    } else if (strcmp(arg, "--animate-instances") == 0) {
+      options.animateInstances = true;
+    } else if (strcmp(arg, "--gpu-cull") == 0) {
+      options.gpuCull = true;
+    } else if (strcmp(arg, "--cpu-cull") == 0) {
+      options.cpuCull = true;
+    } else if (strcmp(arg, "--cull-boxes") == 0) {
+      options.cullBoxes = true;
+    } else if (strcmp(arg, "--meshlets") == 0) {
+      options.meshlets = true;
+    } else if (strcmp(arg, "--backface-cull") == 0) {
+      options.backfaceCull = true;
+    } else if (strcmp(arg, "--lod") == 0) {
+      options.lod = true;
+    } else if ((value = matchPrefix(arg, "--lod-threshold="))) {
+      if (parseFloat(&options.lodThreshold, value) != ERR_OK ||
+          !(options.lodThreshold > 0.0f)) {
+        LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "invalid LOD threshold: %s", value);
+        printUsage(argv[0]);
+        return (ERR_BADARGS);
+      }
+    } else if (strcmp(arg, "--mesh-stats") == 0) {
+      options.meshStats = true;
+    } else if (strcmp(arg, "--packed-vertices") == 0) {
+      options.packedVertices = true;
+    } else if (strcmp(arg, "--memory-stats") == 0) {
+      options.memoryStats = true;
+    } else if ((value = matchPrefix(arg, "--memory-budget="))) {
+      if (parseUint32(&options.memoryBudgetInterval, value) != ERR_OK) {
+        LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "invalid budget interval: %s", value);
+        printUsage(argv[0]);
+        return (ERR_BADARGS);
+      }
+    } else if ((value = matchPrefix(arg, "--host-allocs="))) {
+      if (parseUint32(&options.hostAllocInterval, value) != ERR_OK) {
+        LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "invalid host allocation interval: %s",
+                       value);
+        printUsage(argv[0]);
+        return (ERR_BADARGS);
+      }
+    } else if (strcmp(arg, "--help") == 0) {
+      printUsage(argv[0]);
+      return (ERR_BADARGS);
+    } else {
+      LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "unknown option: %s", arg);
+      printUsage(argv[0]);
+      return (ERR_BADARGS);
+    }
+  }
+
+  if (options.pFrameDumpDir != NULL && !options.headless) {
+    LOG_ERROR(ERR_LEVEL_ERROR, "--dump-frames requires --headless");
+    printUsage(argv[0]);
+    return (ERR_BADARGS);
+  }
+
+  if (options.animateInstances && options.instanceCount == 0) {
+    LOG_ERROR(ERR_LEVEL_ERROR, "--animate-instances requires --instances");
+    printUsage(argv[0]);
+    return (ERR_BADARGS);
+  }
+
+  if (options.gpuCull && options.instanceCount == 0) {
+    LOG_ERROR(ERR_LEVEL_ERROR, "--gpu-cull requires --instances");
+    printUsage(argv[0]);
+    return (ERR_BADARGS);
+  }
+
+  if (options.cpuCull && options.instanceCount == 0) {
+    LOG_ERROR(ERR_LEVEL_ERROR, "--cpu-cull requires --instances");
+    printUsage(argv[0]);
+    return (ERR_BADARGS);
+  }
+
+  if (options.cullBoxes && !options.cpuCull) {
+    LOG_ERROR(ERR_LEVEL_ERROR, "--cull-boxes requires --cpu-cull");
+    printUsage(argv[0]);
+    return (ERR_BADARGS);
+  }
+
+  if (options.cpuCull && options.gpuCull) {
+    LOG_ERROR(ERR_LEVEL_ERROR, "--cpu-cull and --gpu-cull can't be combined");
+    printUsage(argv[0]);
+    return (ERR_BADARGS);
+  }
+
+  if (options.lod && options.gpuCull) {
+    LOG_ERROR(ERR_LEVEL_ERROR, "--lod and --gpu-cull can't be combined");
+    printUsage(argv[0]);
+    return (ERR_BADARGS);
+  }
+
+  if (options.meshlets && options.instanceCount != 0) {
+    LOG_ERROR(ERR_LEVEL_ERROR, "--meshlets and --instances can't be combined");
+    printUsage(argv[0]);
+    return (ERR_BADARGS);
+  }
+
+  if (options.meshlets && options.lod) {
+    LOG_ERROR(ERR_LEVEL_ERROR, "--meshlets and --lod can't be combined");
+    printUsage(argv[0]);
+    return (ERR_BADARGS);
+  }
+
+  if (options.pMeshPath != NULL && options.workloadTriangleCount != 0) {
+    LOG_ERROR(ERR_LEVEL_ERROR, "--mesh and --workload can't be combined");
+    printUsage(argv[0]);
+    return (ERR_BADARGS);
+  }
+
+  if (options.pRecordInputPath != NULL && options.pReplayInputPath != NULL &&
+      strcmp(options.pRecordInputPath, options.pReplayInputPath) == 0) {
+    LOG_ERROR(ERR_LEVEL_ERROR, "cannot record over the input being replayed");
+    printUsage(argv[0]);
+    return (ERR_BADARGS);
+  }
+
+  // a benchmark runs for exactly as long as it needs to
+  if (options.benchFrameCount != 0) {
+    if (options.frameCount != 0) {
+      LOG_ERROR(ERR_LEVEL_WARN, "--frames is ignored when benchmarking");
+    }
+    uint64_t total =
+        (uint64_t)options.benchFrameCount + options.benchWarmupFrameCount;
+    if (total > UINT32_MAX) {
+      LOG_ERROR(ERR_LEVEL_ERROR, "too many benchmark frames");
+      return (ERR_BADARGS);
+    }
+    options.frameCount = (uint32_t)total;
+  }
+
+  // there's no window to close in headless mode, so it must stop by itself
+  if (options.headless && options.frameCount == 0) {
+    options.frameCount = DEFAULT_HEADLESS_FRAME_COUNT;
+  }
+
+  *pOptions = options;
+  return (ERR_OK);
+}
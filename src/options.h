@@ -0,0 +1,102 @@
+#ifndef SRC_OPTIONS_H_
+#define SRC_OPTIONS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "errors.h"
+
+// Options controlling how the app runs, set from the command line
+typedef struct {
+  // render into a ring of offscreen images instead of a window
+  bool headless;
+  // number of frames to render before exiting, 0 means run until closed
+  uint32_t frameCount;
+  // if not NULL, every rendered frame is written into this directory
+  const char *pFrameDumpDir;
+  // number of frames to benchmark, 0 if not benchmarking
+  uint32_t benchFrameCount;
+  // number of frames to run before benchmarking starts
+  uint32_t benchWarmupFrameCount;
+  // if not NULL, the benchmark report is written here instead of stdout
+  const char *pBenchReportPath;
+  // time render passes and copies on the GPU with timestamp queries
+  bool gpuProfile;
+  // if not NULL, every GPU timing is written here as CSV
+  const char *pGpuProfileStreamPath;
+  // also count shader invocations and primitives, implies gpuProfile
+  bool pipelineStatistics;
+  // if not NULL, every frame's pipeline statistics are written here as CSV
+  const char *pPipelineStatisticsStreamPath;
+  // if not NULL, CPU main loop phases are traced and written here as JSON
+  const char *pTracePath;
+  // if not NULL, the keys held in each frame are recorded to this file
+  const char *pRecordInputPath;
+  // if not NULL, the keys held in each frame are read from this file instead
+  // of the keyboard
+  const char *pReplayInputPath;
+  // number of triangles in a generated stress scene, 0 to draw the default one
+  uint32_t workloadTriangleCount;
+  // stack the triangles in overdraw layers instead of scattering them
+  bool workloadLayered;
+  // edge length of scattered triangles in world units
+  float workloadTriangleSize;
+  // number of overdraw layers
+  uint32_t workloadLayerCount;
+  // the same seed always generates the same scene
+  uint64_t workloadSeed;
+  // if not NULL, draw the mesh in this .obj, .ply, .gltf, .glb or cooked
+  // .vtmesh file
+  const char *pMeshPath;
+  // if not NULL, write the mesh as it is uploaded to this cooked mesh file
+  const char *pCookPath;
+  // threads the mesh file is parsed with, 0 for one per processor
+  uint32_t meshLoaderThreadCount;
+  // draw this many copies of the mesh in one instanced draw, 0 to draw it
+  // once without instancing
+  uint32_t instanceCount;
+  // turn the copies every frame, uploading new instance data each time
+  bool animateInstances;
+  // frustum cull the copies in a compute pass and draw the visible ones with
+  // indirect draws
+  bool gpuCull;
+  // frustum cull the copies on the CPU every frame, and upload the visible ones
+  bool cpuCull;
+  // cull with the copies' world space bounding boxes instead of spheres
+  bool cullBoxes;
+  // simplify the mesh into levels of detail, and draw each copy at the
+  // coarsest one whose error stays under lodThreshold pixels
+  bool lod;
+  float lodThreshold;
+  // split the mesh into meshlets, and cull the ones off screen or facing away
+  // in a compute pass before drawing
+  bool meshlets;
+  // leave out faces pointing away from the camera, which only closed meshes
+  // can do without holes
+  bool backfaceCull;
+  // print vertex counts and cache efficiency of the mesh as it is optimized
+  bool meshStats;
+  // store vertices as 16 bit positions and 8 bit colors
+  bool packedVertices;
+  // print live bytes and fragmentation of every memory heap on exit
+  bool memoryStats;
+  // print the memory budget of every heap every this many frames, 0 to never
+  uint32_t memoryBudgetInterval;
+  // track host memory the driver allocates, print it every this many frames
+  // and on exit, 0 to not track it
+  uint32_t hostAllocInterval;
+} AppOptions;
+
+/// Parses the command line into an AppOptions struct
+/// --- PRECONDITIONS ---
+/// * `pOptions` is a valid pointer
+/// * `argv` contains `argc` null terminated strings
+/// --- POSTCONDITIONS ---
+/// * returns error status
+/// * on success, `*pOptions` contains the requested options, with defaults
+/// for anything not specified
+/// * on failure, prints a usage message
+ErrVal parseAppOptions(AppOptions *pOptions, const int argc,
+                       char *const *argv);
+
+#endif // SRC_OPTIONS_H_
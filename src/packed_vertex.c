@@ -0,0 +1,120 @@
+#include "packed_vertex.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define PACKED_POSITION_MAX 65535.0f
+#define PACKED_COLOR_MAX 255.0f
+
+void getVertexQuantization(VertexQuantization *pQuantization,
+                           const Vertex *pVertices,
+                           const uint32_t vertexCount) {
+  vec3 min = {0.0f, 0.0f, 0.0f};
+  vec3 max = {0.0f, 0.0f, 0.0f};
+  if (vertexCount > 0) {
+    memcpy(min, pVertices[0].position, sizeof(vec3));
+    memcpy(max, pVertices[0].position, sizeof(vec3));
+  }
+  for (uint32_t i = 1; i < vertexCount; i++) {
+    for (uint32_t j = 0; j < 3; j++) {
+      float p = pVertices[i].position[j];
+      min[j] = p < min[j] ? p : min[j];
+      max[j] = p > max[j] ? p : max[j];
+    }
+  }
+  for (uint32_t j = 0; j < 3; j++) {
+    pQuantization->offset[j] = min[j];
+    pQuantization->scale[j] = max[j] - min[j];
+  }
+  pQuantization->offset[3] = 0.0f;
+  pQuantization->scale[3] = 0.0f;
+}
+
+#ifdef __SSE2__
+
+void packVertices(PackedVertex *pPacked, const Vertex *pVertices,
+                  const uint32_t vertexCount,
+                  const VertexQuantization *pQuantization) {
+  __m128 offset = _mm_loadu_ps(pQuantization->offset);
+  // flat axes get a multiplier of 0, so everything maps to 0 on them
+  vec4 multiplier = {0.0f, 0.0f, 0.0f, 0.0f};
+  for (uint32_t j = 0; j < 3; j++) {
+    if (pQuantization->scale[j] > 0.0f) {
+      multiplier[j] = PACKED_POSITION_MAX / pQuantization->scale[j];
+    }
+  }
+  __m128 positionMultiplier = _mm_loadu_ps(multiplier);
+  __m128 colorMultiplier = _mm_set1_ps(PACKED_COLOR_MAX);
+  __m128 half = _mm_set1_ps(0.5f);
+  __m128 zero = _mm_setzero_ps();
+  __m128 positionMax = _mm_set1_ps(PACKED_POSITION_MAX);
+  __m128 colorMax = _mm_set1_ps(PACKED_COLOR_MAX);
+  // SSE2 can only pack to signed 16 bits, so shift into range and back
+  __m128i bias32 = _mm_set1_epi32(32768);
+  __m128i bias16 = _mm_set1_epi16(INT16_MIN);
+
+  for (uint32_t i = 0; i < vertexCount; i++) {
+    // both loads stay inside the vertex: x y z r, and z r g b
+    const float *pFloats = pVertices[i].position;
+    __m128 position = _mm_loadu_ps(pFloats);
+    __m128 color = _mm_loadu_ps(pFloats + 2);
+    // r g b r, the fourth lane is overwritten by alpha below
+    color = _mm_shuffle_ps(color, color, _MM_SHUFFLE(1, 3, 2, 1));
+
+    position = _mm_mul_ps(_mm_sub_ps(position, offset), positionMultiplier);
+    position = _mm_min_ps(_mm_max_ps(_mm_add_ps(position, half), zero),
+                          positionMax);
+    __m128i position32 = _mm_sub_epi32(_mm_cvttps_epi32(position), bias32);
+    __m128i position16 =
+        _mm_xor_si128(_mm_packs_epi32(position32, position32), bias16);
+    _mm_storel_epi64((__m128i *)pPacked[i].position, position16);
+
+    color = _mm_mul_ps(color, colorMultiplier);
+    color = _mm_min_ps(_mm_max_ps(_mm_add_ps(color, half), zero), colorMax);
+    __m128i color32 = _mm_cvttps_epi32(color);
+    __m128i color16 = _mm_packs_epi32(color32, color32);
+    uint32_t color8 =
+        (uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(color16, color16));
+    memcpy(pPacked[i].color, &color8, sizeof(color8));
+    // padding and alpha
+    pPacked[i].position[3] = 0;
+    pPacked[i].color[3] = UINT8_MAX;
+  }
+}
+
+#else
+
+static float clampRound(const float value, const float max) {
+  float rounded = value + 0.5f;
+  return (rounded < 0.0f ? 0.0f : rounded > max ? max : rounded);
+}
+
+void packVertices(PackedVertex *pPacked, const Vertex *pVertices,
+                  const uint32_t vertexCount,
+                  const VertexQuantization *pQuantization) {
+  vec3 multiplier = {0.0f, 0.0f, 0.0f};
+  for (uint32_t j = 0; j < 3; j++) {
+    if (pQuantization->scale[j] > 0.0f) {
+      multiplier[j] = PACKED_POSITION_MAX / pQuantization->scale[j];
+    }
+  }
+
+  for (uint32_t i = 0; i < vertexCount; i++) {
+    for (uint32_t j = 0; j < 3; j++) {
+      float position = (pVertices[i].position[j] - pQuantization->offset[j]) *
+                       multiplier[j];
+      pPacked[i].position[j] =
+          (uint16_t)clampRound(position, PACKED_POSITION_MAX);
+      pPacked[i].color[j] = (uint8_t)clampRound(
+          pVertices[i].color[j] * PACKED_COLOR_MAX, PACKED_COLOR_MAX);
+    }
+    pPacked[i].position[3] = 0;
+    pPacked[i].color[3] = UINT8_MAX;
+  }
+}
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef SRC_PACKED_VERTEX_H_
+#define SRC_PACKED_VERTEX_H_
+
+#include <stdint.h>
+
+#include "errors.h"
+#include "vulkan_utils.h"
+
+/// Computes the quantization that spreads the 16 bit positions over the
+/// bounding box of `pVertices`
+/// --- PRECONDITIONS ---
+/// * `pQuantization` is a valid pointer
+/// --- POSTCONDITIONS ---
+/// * axes the vertices don't extend along get a scale of 0
+void getVertexQuantization(VertexQuantization *pQuantization,
+                           const Vertex *pVertices, const uint32_t vertexCount);
+
+/// Packs `vertexCount` vertices into `pPacked`, using SSE2 where available
+/// --- PRECONDITIONS ---
+/// * `pPacked` points to at least `vertexCount` elements
+/// * `pQuantization` was computed from vertices containing these
+/// * colors are in [0, 1], anything outside is clamped
+/// --- POSTCONDITIONS ---
+/// * positions are off by at most half a step, scale / 65535 / 2 per axis
+void packVertices(PackedVertex *pPacked, const Vertex *pVertices,
+                  const uint32_t vertexCount,
+                  const VertexQuantization *pQuantization);
+
+#endif // SRC_PACKED_VERTEX_H_
@@ -0,0 +1,55 @@
+#include "staging_ring.h"
+
+#include <stdint.h>
+
+#include "vulkan_utils.h"
+
+ErrVal new_StagingRing(StagingRing *pRing, Allocator *pAllocator,
+                       const VkDeviceSize size) {
+  ErrVal retVal = new_Buffer_Allocation(
+      &pRing->buffer, &pRing->allocation, pAllocator, size,
+      VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+      0);
+  if (retVal != ERR_OK) {
+    LOG_ERROR(ERR_LEVEL_ERROR, "failed to create staging ring");
+    return (retVal);
+  }
+
+  pRing->size = size;
+  pRing->head = 0;
+  pRing->tail = 0;
+  return (ERR_OK);
+}
+
+void delete_StagingRing(StagingRing *pRing, Allocator *pAllocator) {
+  delete_Buffer(&pRing->buffer, pAllocator->device);
+  delete_Allocation(&pRing->allocation, pAllocator);
+}
+
+void stagingRingRetireTo(StagingRing *pRing, const uint64_t position) {
+  // work finishes in order, so the tail only moves forward
+  if (position > pRing->tail) {
+    pRing->tail = position;
+  }
+}
+
+void stagingRingRetireAll(StagingRing *pRing) { pRing->tail = pRing->head; }
+
+ErrVal stagingRingAllocate(StagingRing *pRing, const VkDeviceSize size,
+                           const VkDeviceSize alignment, VkDeviceSize *pOffset,
+                           void **ppMapped) {
+  uint64_t start = (pRing->head + alignment - 1) & ~(alignment - 1);
+  // allocations can't wrap around, so skip to the start of the ring instead
+  if (start % pRing->size + size > pRing->size) {
+    start += pRing->size - start % pRing->size;
+  }
+  if (start + size - pRing->tail > pRing->size) {
+    return (ERR_ALLOCFAIL);
+  }
+  pRing->head = start + size;
+  *pOffset = start % pRing->size;
+  *ppMapped = (uint8_t *)pRing->allocation.pMapped + *pOffset;
+  return (ERR_OK);
+}
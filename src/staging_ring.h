@@ -0,0 +1,62 @@
+#ifndef SRC_STAGING_RING_H_
+#define SRC_STAGING_RING_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+#include "allocator.h"
+#include "errors.h"
+
+// A persistently mapped host visible buffer that uploads are written into
+// in a circle. The owner remembers the head after each submission that reads
+// from the ring, and gives the space before it back once that submission has
+// finished.
+typedef struct {
+  VkBuffer buffer;
+  Allocation allocation;
+  VkDeviceSize size;
+  // positions grow forever, the byte offset is position % size
+  // everything in [tail, head) may still be read by the GPU
+  uint64_t head;
+  uint64_t tail;
+} StagingRing;
+
+/// Creates a new staging ring
+/// --- PRECONDITIONS ---
+/// * `pRing` is a valid pointer
+/// * `pAllocator` was created by `new_Allocator`
+/// --- POSTCONDITIONS ---
+/// * returns error status
+/// --- CLEANUP ---
+/// * call `delete_StagingRing` once the GPU is idle
+ErrVal new_StagingRing(StagingRing *pRing, Allocator *pAllocator,
+                       const VkDeviceSize size);
+
+void delete_StagingRing(StagingRing *pRing, Allocator *pAllocator);
+
+/// Frees the space allocated before ring position `position`
+/// --- PRECONDITIONS ---
+/// * every submission that read from before `position` has finished
+void stagingRingRetireTo(StagingRing *pRing, const uint64_t position);
+
+/// Frees all space
+/// --- PRECONDITIONS ---
+/// * every submission that read from the ring has finished, e.g. a fence was
+/// waited on for a submission made after all of them on the same queue
+void stagingRingRetireAll(StagingRing *pRing);
+
+/// Reserves `size` bytes aligned to `alignment`
+/// --- PRECONDITIONS ---
+/// * `alignment` is a power of two
+/// --- POSTCONDITIONS ---
+/// * returns ERR_ALLOCFAIL if the ring doesn't have `size` free contiguous
+/// bytes, in which case an earlier submission must finish first
+/// * on success, `*pOffset` is the offset into `pRing->buffer` and `*ppMapped`
+/// points to the same bytes in host memory
+ErrVal stagingRingAllocate(StagingRing *pRing, const VkDeviceSize size,
+                           const VkDeviceSize alignment, VkDeviceSize *pOffset,
+                           void **ppMapped);
+
+#endif // SRC_STAGING_RING_H_
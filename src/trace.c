@@ -0,0 +1,135 @@
+#include "trace.h"
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+
+typedef struct {
+  const char *name;
+  uint64_t timeNs;
+  // 'B' for begin or 'E' for end, as in the trace event format
+  char phase;
+} TraceEvent;
+
+// Events recorded by a single thread
+typedef struct TraceBuffer {
+  struct TraceBuffer *pNext;
+  uint32_t threadId;
+  // total events ever recorded, the next one goes in at
+  // eventCount % TRACE_BUFFER_EVENT_COUNT
+  uint64_t eventCount;
+  TraceEvent pEvents[TRACE_BUFFER_EVENT_COUNT];
+} TraceBuffer;
+
+bool traceEnabled = false;
+
+// every thread's buffer, so they can be written out at the end
+static _Atomic(TraceBuffer *) pTraceBuffers = NULL;
+static atomic_uint_fast32_t nextThreadId = 1;
+
+// the calling thread's buffer, created on its first event
+static _Thread_local TraceBuffer *pLocalTraceBuffer = NULL;
+
+// the time all events are relative to
+static uint64_t traceStartNs = 0;
+
+void traceEnable(void) {
+  traceStartNs = getTimeNs();
+  traceEnabled = true;
+}
+
+static TraceBuffer *getLocalTraceBuffer(void) {
+  if (pLocalTraceBuffer != NULL) {
+    return (pLocalTraceBuffer);
+  }
+  TraceBuffer *pBuffer = malloc(sizeof(TraceBuffer));
+  if (!pBuffer) {
+    LOG_ERROR_ARGS(ERR_LEVEL_FATAL, "could not allocate trace buffer: %s",
+                   strerror(errno));
+    PANIC();
+  }
+  pBuffer->threadId = (uint32_t)atomic_fetch_add(&nextThreadId, 1);
+  pBuffer->eventCount = 0;
+
+  // push onto the list of buffers without locking
+  pBuffer->pNext = atomic_load(&pTraceBuffers);
+  while (!atomic_compare_exchange_weak(&pTraceBuffers, &pBuffer->pNext,
+                                       pBuffer)) {
+  }
+  pLocalTraceBuffer = pBuffer;
+  return (pBuffer);
+}
+
+static void recordEvent(const char *name, const char phase) {
+  TraceBuffer *pBuffer = getLocalTraceBuffer();
+  TraceEvent *pEvent =
+      &pBuffer->pEvents[pBuffer->eventCount % TRACE_BUFFER_EVENT_COUNT];
+  pEvent->name = name;
+  pEvent->timeNs = getTimeNs();
+  pEvent->phase = phase;
+  pBuffer->eventCount++;
+}
+
+void traceBegin(const char *name) { recordEvent(name, 'B'); }
+
+void traceEnd(const char *name) { recordEvent(name, 'E'); }
+
+ErrVal writeTrace(const char *path) {
+  FILE *fp = fopen(path, "w");
+  if (!fp) {
+    LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "could not open %s: %s", path,
+                   strerror(errno));
+    return (ERR_UNKNOWN);
+  }
+
+  fprintf(fp, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+  bool first = true;
+  for (TraceBuffer *pBuffer = atomic_load(&pTraceBuffers); pBuffer != NULL;
+       pBuffer = pBuffer->pNext) {
+    uint64_t start = 0;
+    if (pBuffer->eventCount > TRACE_BUFFER_EVENT_COUNT) {
+      start = pBuffer->eventCount - TRACE_BUFFER_EVENT_COUNT;
+    }
+    // once the buffer wraps, the ends of overwritten begins are skipped
+    uint32_t depth = 0;
+    for (uint64_t i = start; i < pBuffer->eventCount; i++) {
+      const TraceEvent *pEvent =
+          &pBuffer->pEvents[i % TRACE_BUFFER_EVENT_COUNT];
+      if (pEvent->phase == 'B') {
+        depth++;
+      } else if (depth == 0) {
+        continue;
+      } else {
+        depth--;
+      }
+      fprintf(fp,
+              "%s\n{\"name\": \"%s\", \"ph\": \"%c\", \"ts\": %.3f, "
+              "\"pid\": 1, \"tid\": %u}",
+              first ? "" : ",", pEvent->name, pEvent->phase,
+              (double)(pEvent->timeNs - traceStartNs) / 1e3,
+              pBuffer->threadId);
+      first = false;
+    }
+  }
+  fprintf(fp, "\n]}\n");
+
+  fclose(fp);
+  return (ERR_OK);
+}
+
+void traceCleanup(void) {
+  traceEnabled = false;
+  TraceBuffer *pBuffer = atomic_exchange(&pTraceBuffers, NULL);
+  while (pBuffer != NULL) {
+    TraceBuffer *pNext = pBuffer->pNext;
+    free(pBuffer);
+    pBuffer = pNext;
+  }
+  // only the calling thread's pointer can be cleared
+  pLocalTraceBuffer = NULL;
+}
@@ -0,0 +1,60 @@
+#ifndef SRC_TRACE_H_
+#define SRC_TRACE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "errors.h"
+
+// number of events kept per thread, once full the oldest are overwritten
+#define TRACE_BUFFER_EVENT_COUNT 65536
+
+// set by traceEnable, only read through the TRACE_ macros
+extern bool traceEnabled;
+
+// Begins a named scope on the calling thread
+// When tracing is off this costs a single, well predicted branch
+#define TRACE_BEGIN(name)                                                      \
+  do {                                                                         \
+    if (__builtin_expect(traceEnabled, 0)) {                                   \
+      traceBegin(name);                                                        \
+    }                                                                          \
+  } while (0)
+
+// Ends the scope most recently begun on the calling thread
+#define TRACE_END(name)                                                        \
+  do {                                                                         \
+    if (__builtin_expect(traceEnabled, 0)) {                                   \
+      traceEnd(name);                                                          \
+    }                                                                          \
+  } while (0)
+
+/// Starts recording trace events on every thread
+/// --- PRECONDITIONS ---
+/// * called before any other thread is started
+void traceEnable(void);
+
+/// Records the start of a scope, use TRACE_BEGIN instead
+/// --- PRECONDITIONS ---
+/// * `name` is a string literal or otherwise outlives the trace
+/// --- PANICS ---
+/// * panics if this is the first event on a thread and allocation fails
+void traceBegin(const char *name);
+
+/// Records the end of a scope, use TRACE_END instead
+void traceEnd(const char *name);
+
+/// Writes every recorded event as Trace Event Format JSON, which can be opened
+/// in Perfetto or chrome://tracing
+/// --- PRECONDITIONS ---
+/// * no other thread is recording events
+/// --- POSTCONDITIONS ---
+/// * returns error status
+ErrVal writeTrace(const char *path);
+
+/// Frees every thread's event buffer and disables tracing
+/// --- PRECONDITIONS ---
+/// * no other thread is recording events
+void traceCleanup(void);
+
+#endif // SRC_TRACE_H_
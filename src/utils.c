@@ -5,11 +5,19 @@
  *      Author: gpi
  */
 
+// needed for clock_gettime, mmap and posix_madvise
+#define _POSIX_C_SOURCE 200809L
+
 #include <errno.h>
+#include <fcntl.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
 #include <vulkan/vulkan.h>
 #define GLFW_INCLUDE_VULKAN
@@ -30,6 +38,12 @@ uint64_t getLength(FILE *f) {
   return ((uint64_t)size);
 }
 
+uint64_t getTimeNs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec);
+}
+
 /**
  * Mallocs
  */
@@ -66,3 +80,76 @@ void readShaderFile(const char *filename, uint32_t *length, uint32_t **code) {
   *code = (uint32_t *)((void *)str);
   return;
 }
+
+ErrVal writePPM(const char *filename, const uint8_t *pPixels,
+                const uint32_t width, const uint32_t height) {
+  FILE *fp = fopen(filename, "wb");
+  if (!fp) {
+    LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "could not open %s: %s", filename,
+                   strerror(errno));
+    return (ERR_UNKNOWN);
+  }
+  fprintf(fp, "P6\n%u %u\n255\n", width, height);
+
+  /* convert one row at a time from BGRA to RGB */
+  uint8_t *row = malloc((size_t)width * 3);
+  if (!row) {
+    LOG_ERROR_ARGS(ERR_LEVEL_FATAL, "could not write image: %s",
+                   strerror(errno));
+    fclose(fp);
+    PANIC();
+  }
+  for (uint32_t y = 0; y < height; y++) {
+    const uint8_t *src = pPixels + (size_t)y * width * 4;
+    for (uint32_t x = 0; x < width; x++) {
+      row[x * 3 + 0] = src[x * 4 + 2];
+      row[x * 3 + 1] = src[x * 4 + 1];
+      row[x * 3 + 2] = src[x * 4 + 0];
+    }
+    fwrite(row, 3, width, fp);
+  }
+  free(row);
+  fclose(fp);
+  return (ERR_OK);
+}
+
+ErrVal new_MappedFile(MappedFile *pFile, const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "could not open %s: %s", path,
+                   strerror(errno));
+    return (ERR_BADARGS);
+  }
+  struct stat fileStat;
+  if (fstat(fd, &fileStat) != 0) {
+    LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "could not stat %s: %s", path,
+                   strerror(errno));
+    close(fd);
+    return (ERR_BADARGS);
+  }
+
+  pFile->pData = NULL;
+  pFile->size = (size_t)fileStat.st_size;
+  if (pFile->size != 0) {
+    void *pData = mmap(NULL, pFile->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (pData == MAP_FAILED) {
+      LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "could not map %s: %s", path,
+                     strerror(errno));
+      close(fd);
+      return (ERR_MEMORY);
+    }
+    // every byte is read, so start reading all of it ahead of the reader
+    posix_madvise(pData, pFile->size, POSIX_MADV_WILLNEED);
+    pFile->pData = pData;
+  }
+  // the mapping keeps the file alive on its own
+  close(fd);
+  return (ERR_OK);
+}
+
+void delete_MappedFile(MappedFile *pFile) {
+  if (pFile->pData != NULL) {
+    munmap((void *)(uintptr_t)pFile->pData, pFile->size);
+  }
+  pFile->pData = NULL;
+}
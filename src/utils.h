@@ -8,6 +8,7 @@
 #ifndef SRC_UTILS_H_
 #define SRC_UTILS_H_
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 
@@ -15,8 +16,30 @@
 
 uint64_t getLength(FILE *f);
 
+/* Returns a monotonic timestamp in nanoseconds, for measuring intervals */
+uint64_t getTimeNs(void);
+
 void readShaderFile(const char *filename, uint32_t *length, uint32_t **code);
 
+/* Writes tightly packed 8 bit BGRA pixels to a binary PPM file, dropping
+ * alpha */
+ErrVal writePPM(const char *filename, const uint8_t *pPixels,
+                const uint32_t width, const uint32_t height);
+
+/* A read only mapping of a whole file */
+typedef struct {
+  /* NULL if the file is empty */
+  const uint8_t *pData;
+  size_t size;
+} MappedFile;
+
+/* Maps `path` into memory, and starts reading all of it in ahead of use.
+ * Returns ERR_BADARGS if it can't be opened and ERR_MEMORY if it can't be
+ * mapped. Call `delete_MappedFile` to unmap it */
+ErrVal new_MappedFile(MappedFile *pFile, const char *path);
+
+void delete_MappedFile(MappedFile *pFile);
+
 
 
 #endif /* SRC_UTILS_H_ */
@@ -8,6 +8,8 @@
 
 #include <vulkan/vulkan.h>
 
+#include "host_alloc.h"
+
 static VKAPI_ATTR VkBool32 VKAPI_CALL
 debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
               UNUSED VkDebugUtilsMessageTypeFlagsEXT messageType,
@@ -125,7 +127,8 @@ ErrVal new_Instance(                            //
   createInfo.enabledLayerCount = enabledLayerCount;
   createInfo.ppEnabledLayerNames = ppEnabledLayerNames;
   /* Actually create instance */
-  VkResult result = vkCreateInstance(&createInfo, NULL, pInstance);
+  VkResult result = vkCreateInstance(&createInfo, pVulkanAllocationCallbacks,
+                                     pInstance);
   if (result != VK_SUCCESS) {
     LOG_ERROR_ARGS(ERR_LEVEL_FATAL, "Failed to create instance, error code: %s",
                    vkstrerror(result));
@@ -140,7 +143,7 @@ ErrVal new_Instance(                            //
 
 /* Destroys instance created in new_Instance */
 void delete_Instance(VkInstance *pInstance) {
-  vkDestroyInstance(*pInstance, NULL);
+  vkDestroyInstance(*pInstance, pVulkanAllocationCallbacks);
   *pInstance = VK_NULL_HANDLE;
 }
 
@@ -170,7 +173,8 @@ ErrVal new_DebugCallback(VkDebugUtilsMessengerEXT *pCallback,
     LOG_ERROR(ERR_LEVEL_FATAL, "Failed to find extension function");
     PANIC();
   }
-  VkResult result = func(instance, &createInfo, NULL, pCallback);
+  VkResult result = func(instance, &createInfo, pVulkanAllocationCallbacks,
+                         pCallback);
   if (result != VK_SUCCESS) {
     LOG_ERROR_ARGS(ERR_LEVEL_FATAL,
                    "Failed to create debug callback, error code: %s",
@@ -190,7 +194,7 @@ void delete_DebugCallback(VkDebugUtilsMessengerEXT *pCallback,
       (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(
           instance, "vkDestroyDebugUtilsMessengerEXT");
   if (func != NULL) {
-    func(instance, *pCallback, NULL);
+    func(instance, *pCallback, pVulkanAllocationCallbacks);
   }
 }
 /**
@@ -239,7 +243,7 @@ ErrVal getPhysicalDevice(VkPhysicalDevice *pDevice, const VkInstance instance) {
  * Deletes VkDevice created in new_Device
  */
 void delete_Device(VkDevice *pDevice) {
-  vkDestroyDevice(*pDevice, NULL);
+  vkDestroyDevice(*pDevice, pVulkanAllocationCallbacks);
   *pDevice = VK_NULL_HANDLE;
 }
 
@@ -268,7 +272,7 @@ ErrVal getQueueFamilyIndexByCapability(uint32_t *pQueueFamilyIndex,
                                            pFamilyProperties);
   for (uint32_t i = 0; i < queueFamilyCount; i++) {
     if (pFamilyProperties[i].queueCount > 0 &&
-        (pFamilyProperties[0].queueFlags & bit)) {
+        (pFamilyProperties[i].queueFlags & bit) == bit) {
       free(pFamilyProperties);
       *pQueueFamilyIndex = i;
       return (ERR_OK);
@@ -279,6 +283,36 @@ ErrVal getQueueFamilyIndexByCapability(uint32_t *pQueueFamilyIndex,
   return (ERR_NOTSUPPORTED);
 }
 
+ErrVal getTransferQueueFamilyIndex(uint32_t *pQueueFamilyIndex,
+                                   const VkPhysicalDevice physicalDevice) {
+  uint32_t queueFamilyCount = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount,
+                                           NULL);
+  VkQueueFamilyProperties *pFamilyProperties =
+      (VkQueueFamilyProperties *)malloc(queueFamilyCount *
+                                        sizeof(VkQueueFamilyProperties));
+  if (!pFamilyProperties) {
+    LOG_ERROR_ARGS(ERR_LEVEL_FATAL, "Failed to get transfer queue index: %s",
+                   strerror(errno));
+    PANIC();
+  }
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount,
+                                           pFamilyProperties);
+  // families without graphics or compute are usually backed by a DMA engine
+  for (uint32_t i = 0; i < queueFamilyCount; i++) {
+    VkQueueFlags flags = pFamilyProperties[i].queueFlags;
+    if (pFamilyProperties[i].queueCount > 0 &&
+        (flags & VK_QUEUE_TRANSFER_BIT) &&
+        !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+      free(pFamilyProperties);
+      *pQueueFamilyIndex = i;
+      return (ERR_OK);
+    }
+  }
+  free(pFamilyProperties);
+  return (ERR_NOTSUPPORTED);
+}
+
 ErrVal getPresentQueueFamilyIndex(uint32_t *pQueueFamilyIndex,
                                   const VkPhysicalDevice physicalDevice,
                                   const VkSurfaceKHR surface) {
@@ -313,27 +347,72 @@ ErrVal getPresentQueueFamilyIndex(uint32_t *pQueueFamilyIndex,
 }
 
 ErrVal new_Device(VkDevice *pDevice, const VkPhysicalDevice physicalDevice,
-                  const uint32_t queueFamilyIndex,
+                  const uint32_t queueFamilyIndexCount,
+                  const uint32_t *pQueueFamilyIndices,
                   const uint32_t enabledExtensionCount,
                   const char *const *ppEnabledExtensionNames) {
+  // only enable the optional features we use, and only if they're supported
+  VkPhysicalDeviceVulkan12Features supportedFeatures12 = {0};
+  supportedFeatures12.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+  VkPhysicalDeviceFeatures2 supportedFeatures = {0};
+  supportedFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+  supportedFeatures.pNext = &supportedFeatures12;
+  vkGetPhysicalDeviceFeatures2(physicalDevice, &supportedFeatures);
+  if (!supportedFeatures12.timelineSemaphore) {
+    LOG_ERROR(ERR_LEVEL_ERROR, "device doesn't support timeline semaphores");
+    return (ERR_NOTSUPPORTED);
+  }
+
+  VkPhysicalDeviceVulkan12Features deviceFeatures12 = {0};
+  deviceFeatures12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+  deviceFeatures12.timelineSemaphore = VK_TRUE;
   VkPhysicalDeviceFeatures deviceFeatures = {0};
-  VkDeviceQueueCreateInfo queueCreateInfo = {0};
-  queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-  queueCreateInfo.queueFamilyIndex = queueFamilyIndex;
-  queueCreateInfo.queueCount = 1;
+  deviceFeatures.pipelineStatisticsQuery =
+      supportedFeatures.features.pipelineStatisticsQuery;
+  // the GPU culling pass skips its draw when nothing is visible
+  if (isDrawIndirectCountSupported(physicalDevice)) {
+    deviceFeatures12.drawIndirectCount = VK_TRUE;
+  }
+
+  // one queue from each distinct family
+  VkDeviceQueueCreateInfo pQueueCreateInfos[VULKAN_MAX_QUEUE_FAMILIES];
+  uint32_t queueCreateInfoCount = 0;
   float queuePriority = 1.0f;
-  queueCreateInfo.pQueuePriorities = &queuePriority;
+  for (uint32_t i = 0; i < queueFamilyIndexCount; i++) {
+    bool duplicate = false;
+    for (uint32_t j = 0; j < queueCreateInfoCount; j++) {
+      if (pQueueCreateInfos[j].queueFamilyIndex == pQueueFamilyIndices[i]) {
+        duplicate = true;
+      }
+    }
+    if (duplicate) {
+      continue;
+    }
+    if (queueCreateInfoCount == VULKAN_MAX_QUEUE_FAMILIES) {
+      LOG_ERROR(ERR_LEVEL_ERROR, "too many queue families requested");
+      return (ERR_BADARGS);
+    }
+    VkDeviceQueueCreateInfo queueCreateInfo = {0};
+    queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queueCreateInfo.queueFamilyIndex = pQueueFamilyIndices[i];
+    queueCreateInfo.queueCount = 1;
+    queueCreateInfo.pQueuePriorities = &queuePriority;
+    pQueueCreateInfos[queueCreateInfoCount++] = queueCreateInfo;
+  }
 
   VkDeviceCreateInfo createInfo = {0};
   createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-  createInfo.pQueueCreateInfos = &queueCreateInfo;
-  createInfo.queueCreateInfoCount = 1;
+  createInfo.pNext = &deviceFeatures12;
+  createInfo.pQueueCreateInfos = pQueueCreateInfos;
+  createInfo.queueCreateInfoCount = queueCreateInfoCount;
   createInfo.pEnabledFeatures = &deviceFeatures;
   createInfo.enabledExtensionCount = enabledExtensionCount;
   createInfo.ppEnabledExtensionNames = ppEnabledExtensionNames;
   createInfo.enabledLayerCount = 0;
 
-  VkResult res = vkCreateDevice(physicalDevice, &createInfo, NULL, pDevice);
+  VkResult res = vkCreateDevice(physicalDevice, &createInfo,
+                                pVulkanAllocationCallbacks, pDevice);
   if (res != VK_SUCCESS) {
     LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "Failed to create device, error code: %s",
                    vkstrerror(res));
@@ -342,6 +421,41 @@ ErrVal new_Device(VkDevice *pDevice, const VkPhysicalDevice physicalDevice,
   return (ERR_OK);
 }
 
+bool isDrawIndirectCountSupported(const VkPhysicalDevice physicalDevice) {
+  VkPhysicalDeviceVulkan12Features features12 = {0};
+  features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+  VkPhysicalDeviceFeatures2 features = {0};
+  features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+  features.pNext = &features12;
+  vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+  return (features12.drawIndirectCount);
+}
+
+bool isDeviceExtensionSupported(const VkPhysicalDevice physicalDevice,
+                                const char *pExtensionName) {
+  uint32_t extensionCount = 0;
+  vkEnumerateDeviceExtensionProperties(physicalDevice, NULL, &extensionCount,
+                                       NULL);
+  VkExtensionProperties *pExtensions =
+      malloc(extensionCount * sizeof(VkExtensionProperties));
+  if (!pExtensions) {
+    LOG_ERROR_ARGS(ERR_LEVEL_FATAL, "failed to get device extensions: %s",
+                   strerror(errno));
+    PANIC();
+  }
+  vkEnumerateDeviceExtensionProperties(physicalDevice, NULL, &extensionCount,
+                                       pExtensions);
+  bool supported = false;
+  for (uint32_t i = 0; i < extensionCount; i++) {
+    if (strcmp(pExtensions[i].extensionName, pExtensionName) == 0) {
+      supported = true;
+      break;
+    }
+  }
+  free(pExtensions);
+  return (supported);
+}
+
 ErrVal getQueue(VkQueue *pQueue, const VkDevice device,
                 const uint32_t deviceQueueIndex) {
   vkGetDeviceQueue(device, deviceQueueIndex, 0, pQueue);
@@ -388,7 +502,8 @@ ErrVal new_Swapchain(VkSwapchainKHR *pSwapchain, uint32_t *pImageCount,
   createInfo.presentMode = VK_PRESENT_MODE_FIFO_KHR;
   createInfo.clipped = VK_TRUE;
   createInfo.oldSwapchain = oldSwapchain;
-  VkResult res = vkCreateSwapchainKHR(device, &createInfo, NULL, pSwapchain);
+  VkResult res = vkCreateSwapchainKHR(device, &createInfo,
+                                      pVulkanAllocationCallbacks, pSwapchain);
   if (res != VK_SUCCESS) {
     LOG_ERROR_ARGS(ERR_LEVEL_ERROR,
                    "Failed to create swap chain, error code: %s",
@@ -409,7 +524,7 @@ ErrVal new_Swapchain(VkSwapchainKHR *pSwapchain, uint32_t *pImageCount,
 }
 
 void delete_Swapchain(VkSwapchainKHR *pSwapchain, const VkDevice device) {
-  vkDestroySwapchainKHR(device, *pSwapchain, NULL);
+  vkDestroySwapchainKHR(device, *pSwapchain, pVulkanAllocationCallbacks);
   *pSwapchain = VK_NULL_HANDLE;
 }
 
@@ -506,7 +621,8 @@ ErrVal new_ImageView(VkImageView *pImageView, const VkDevice device,
   createInfo.subresourceRange.levelCount = 1;
   createInfo.subresourceRange.baseArrayLayer = 0;
   createInfo.subresourceRange.layerCount = 1;
-  VkResult ret = vkCreateImageView(device, &createInfo, NULL, pImageView);
+  VkResult ret = vkCreateImageView(device, &createInfo,
+                                   pVulkanAllocationCallbacks, pImageView);
   if (ret != VK_SUCCESS) {
     LOG_ERROR_ARGS(ERR_LEVEL_FATAL,
                    "could not create image view, error code: %s",
@@ -517,7 +633,7 @@ ErrVal new_ImageView(VkImageView *pImageView, const VkDevice device,
 }
 
 void delete_ImageView(VkImageView *pImageView, VkDevice device) {
-  vkDestroyImageView(device, *pImageView, NULL);
+  vkDestroyImageView(device, *pImageView, pVulkanAllocationCallbacks);
   *pImageView = VK_NULL_HANDLE;
 }
 
@@ -556,7 +672,9 @@ ErrVal new_ShaderModule(VkShaderModule *pShaderModule, const VkDevice device,
   createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
   createInfo.codeSize = codeSize;
   createInfo.pCode = pCode;
-  VkResult res = vkCreateShaderModule(device, &createInfo, NULL, pShaderModule);
+  VkResult res = vkCreateShaderModule(device, &createInfo,
+                                      pVulkanAllocationCallbacks,
+                                      pShaderModule);
   if (res != VK_SUCCESS) {
     LOG_ERROR(ERR_LEVEL_FATAL, "failed to create shader module");
     return (ERR_UNKNOWN);
@@ -565,13 +683,14 @@ ErrVal new_ShaderModule(VkShaderModule *pShaderModule, const VkDevice device,
 }
 
 void delete_ShaderModule(VkShaderModule *pShaderModule, const VkDevice device) {
-  vkDestroyShaderModule(device, *pShaderModule, NULL);
+  vkDestroyShaderModule(device, *pShaderModule, pVulkanAllocationCallbacks);
   *pShaderModule = VK_NULL_HANDLE;
 }
 
 ErrVal new_VertexDisplayRenderPass(VkRenderPass *pRenderPass,
                                    const VkDevice device,
-                                   const VkFormat swapchainImageFormat) {
+                                   const VkFormat swapchainImageFormat,
+                                   const VkImageLayout finalLayout) {
   VkAttachmentDescription colorAttachment = {0};
   colorAttachment.format = swapchainImageFormat;
   colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
@@ -580,7 +699,7 @@ ErrVal new_VertexDisplayRenderPass(VkRenderPass *pRenderPass,
   colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
   colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
   colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-  colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  colorAttachment.finalLayout = finalLayout;
 
   VkAttachmentDescription depthAttachment = {0};
   getDepthFormat(&depthAttachment.format);
@@ -618,19 +737,30 @@ ErrVal new_VertexDisplayRenderPass(VkRenderPass *pRenderPass,
   renderPassInfo.subpassCount = 1;
   renderPassInfo.pSubpasses = &subpass;
 
-  VkSubpassDependency dependency = {0};
-  dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-  dependency.dstSubpass = 0;
-  dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-  dependency.srcAccessMask = 0;
-  dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-  dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
-                             VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
-  renderPassInfo.dependencyCount = 1;
-  renderPassInfo.pDependencies = &dependency;
-
-  VkResult res = vkCreateRenderPass(device, &renderPassInfo, NULL, pRenderPass);
+  VkSubpassDependency pDependencies[2] = {0};
+  pDependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+  pDependencies[0].dstSubpass = 0;
+  pDependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  pDependencies[0].srcAccessMask = 0;
+  pDependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  pDependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
+                                   VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+  // if the image is going to be copied out afterwards, make sure later
+  // transfers wait for the color writes
+  pDependencies[1].srcSubpass = 0;
+  pDependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+  pDependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  pDependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  pDependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+  pDependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+  renderPassInfo.dependencyCount =
+      finalLayout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL ? 2 : 1;
+  renderPassInfo.pDependencies = pDependencies;
+
+  VkResult res = vkCreateRenderPass(device, &renderPassInfo,
+                                    pVulkanAllocationCallbacks, pRenderPass);
   if (res != VK_SUCCESS) {
     LOG_ERROR_ARGS(ERR_LEVEL_FATAL, "Could not create render pass, error: %s",
                    vkstrerror(res));
@@ -640,7 +770,7 @@ ErrVal new_VertexDisplayRenderPass(VkRenderPass *pRenderPass,
 }
 
 void delete_RenderPass(VkRenderPass *pRenderPass, const VkDevice device) {
-  vkDestroyRenderPass(device, *pRenderPass, NULL);
+  vkDestroyRenderPass(device, *pRenderPass, pVulkanAllocationCallbacks);
   *pRenderPass = VK_NULL_HANDLE;
 }
 
@@ -648,7 +778,8 @@ ErrVal new_VertexDisplayPipelineLayout(VkPipelineLayout *pPipelineLayout,
                                        const VkDevice device) {
   VkPushConstantRange pushConstantRange = {0};
   pushConstantRange.offset = 0;
-  pushConstantRange.size = sizeof(mat4x4);
+  // the quantization is only read by the packed vertex shader
+  pushConstantRange.size = sizeof(mat4x4) + sizeof(VertexQuantization);
   pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
   VkPipelineLayoutCreateInfo pipelineLayoutInfo = {0};
@@ -656,7 +787,8 @@ ErrVal new_VertexDisplayPipelineLayout(VkPipelineLayout *pPipelineLayout,
   pipelineLayoutInfo.setLayoutCount = 0;
   pipelineLayoutInfo.pushConstantRangeCount = 1;
   pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
-  VkResult res = vkCreatePipelineLayout(device, &pipelineLayoutInfo, NULL,
+  VkResult res = vkCreatePipelineLayout(device, &pipelineLayoutInfo,
+                                        pVulkanAllocationCallbacks,
                                         pPipelineLayout);
   if (res != VK_SUCCESS) {
     LOG_ERROR_ARGS(ERR_LEVEL_FATAL,
@@ -669,7 +801,7 @@ ErrVal new_VertexDisplayPipelineLayout(VkPipelineLayout *pPipelineLayout,
 
 void delete_PipelineLayout(VkPipelineLayout *pPipelineLayout,
                            const VkDevice device) {
-  vkDestroyPipelineLayout(device, *pPipelineLayout, NULL);
+  vkDestroyPipelineLayout(device, *pPipelineLayout, pVulkanAllocationCallbacks);
   *pPipelineLayout = VK_NULL_HANDLE;
 }
 
@@ -677,9 +809,11 @@ ErrVal new_VertexDisplayPipeline(VkPipeline *pGraphicsPipeline,
                                  const VkDevice device,
                                  const VkShaderModule vertShaderModule,
                                  const VkShaderModule fragShaderModule,
-                                 const VkExtent2D extent,
                                  const VkRenderPass renderPass,
-                                 const VkPipelineLayout pipelineLayout) {
+                                 const VkPipelineLayout pipelineLayout,
+                                 const VertexFormat vertexFormat,
+                                 const bool instanced,
+                                 const VkCullModeFlags cullMode) {
   VkPipelineShaderStageCreateInfo vertShaderStageInfo = {0};
   vertShaderStageInfo.sType =
       VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -697,29 +831,55 @@ ErrVal new_VertexDisplayPipeline(VkPipeline *pGraphicsPipeline,
   VkPipelineShaderStageCreateInfo shaderStages[2] = {vertShaderStageInfo,
                                                      fragShaderStageInfo};
 
-  VkVertexInputBindingDescription bindingDescription = {0};
-  bindingDescription.binding = 0;
-  bindingDescription.stride = sizeof(Vertex);
-  bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+  VkVertexInputBindingDescription pBindingDescriptions[2] = {0};
+  pBindingDescriptions[0].binding = 0;
+  pBindingDescriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
-  VkVertexInputAttributeDescription attributeDescriptions[2];
+  // the model matrix takes a location per column, then comes the color
+  VkVertexInputAttributeDescription attributeDescriptions[7] = {0};
 
   attributeDescriptions[0].binding = 0;
   attributeDescriptions[0].location = 0;
-  attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-  attributeDescriptions[0].offset = offsetof(Vertex, position);
-
   attributeDescriptions[1].binding = 0;
   attributeDescriptions[1].location = 1;
-  attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-  attributeDescriptions[1].offset = offsetof(Vertex, color);
+
+  // unorm attributes arrive in the shader as floats in [0, 1]
+  if (vertexFormat == VERTEX_FORMAT_PACKED) {
+    pBindingDescriptions[0].stride = sizeof(PackedVertex);
+    attributeDescriptions[0].format = VK_FORMAT_R16G16B16A16_UNORM;
+    attributeDescriptions[0].offset = offsetof(PackedVertex, position);
+    attributeDescriptions[1].format = VK_FORMAT_R8G8B8A8_UNORM;
+    attributeDescriptions[1].offset = offsetof(PackedVertex, color);
+  } else {
+    pBindingDescriptions[0].stride = sizeof(Vertex);
+    attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
+    attributeDescriptions[0].offset = offsetof(Vertex, position);
+    attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
+    attributeDescriptions[1].offset = offsetof(Vertex, color);
+  }
+
+  uint32_t bindingCount = 1;
+  uint32_t attributeCount = 2;
+  if (instanced) {
+    pBindingDescriptions[1].binding = 1;
+    pBindingDescriptions[1].stride = sizeof(InstanceData);
+    pBindingDescriptions[1].inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+    for (uint32_t i = 0; i < 5; i++) {
+      attributeDescriptions[2 + i].binding = 1;
+      attributeDescriptions[2 + i].location = 2 + i;
+      attributeDescriptions[2 + i].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+      attributeDescriptions[2 + i].offset = i * sizeof(vec4);
+    }
+    bindingCount = 2;
+    attributeCount = 7;
+  }
 
   VkPipelineVertexInputStateCreateInfo vertexInputInfo = {0};
   vertexInputInfo.sType =
       VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-  vertexInputInfo.vertexBindingDescriptionCount = 1;
-  vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-  vertexInputInfo.vertexAttributeDescriptionCount = 2;
+  vertexInputInfo.vertexBindingDescriptionCount = bindingCount;
+  vertexInputInfo.pVertexBindingDescriptions = pBindingDescriptions;
+  vertexInputInfo.vertexAttributeDescriptionCount = attributeCount;
   vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions;
 
   VkPipelineInputAssemblyStateCreateInfo inputAssembly = {0};
@@ -728,19 +888,6 @@ ErrVal new_VertexDisplayPipeline(VkPipeline *pGraphicsPipeline,
   inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
   inputAssembly.primitiveRestartEnable = VK_FALSE;
 
-  VkViewport viewport = {0};
-  viewport.x = 0.0f;
-  viewport.y = 0.0f;
-  viewport.width = (float)extent.width;
-  viewport.height = (float)extent.height;
-  viewport.minDepth = 0.0f;
-  viewport.maxDepth = 1.0f;
-
-  VkRect2D scissor = {0};
-  scissor.offset.x = 0;
-  scissor.offset.y = 0;
-  scissor.extent = extent;
-
   VkPipelineDepthStencilStateCreateInfo depthStencil = {0};
   depthStencil.sType =
       VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
@@ -753,9 +900,16 @@ ErrVal new_VertexDisplayPipeline(VkPipeline *pGraphicsPipeline,
   VkPipelineViewportStateCreateInfo viewportState = {0};
   viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
   viewportState.viewportCount = 1;
-  viewportState.pViewports = &viewport;
   viewportState.scissorCount = 1;
-  viewportState.pScissors = &scissor;
+
+  // the viewport and scissor are set while recording, so the pipeline
+  // survives swapchain resizes
+  VkDynamicState pDynamicStates[2] = {VK_DYNAMIC_STATE_VIEWPORT,
+                                      VK_DYNAMIC_STATE_SCISSOR};
+  VkPipelineDynamicStateCreateInfo dynamicState = {0};
+  dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+  dynamicState.dynamicStateCount = 2;
+  dynamicState.pDynamicStates = pDynamicStates;
 
   VkPipelineRasterizationStateCreateInfo rasterizer = {0};
   rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
@@ -763,8 +917,10 @@ ErrVal new_VertexDisplayPipeline(VkPipeline *pGraphicsPipeline,
   rasterizer.rasterizerDiscardEnable = VK_FALSE;
   rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
   rasterizer.lineWidth = 1.0f;
-  rasterizer.cullMode = VK_CULL_MODE_NONE; /* VK_CULL_MODE_BACK_BIT; */
-  rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+  rasterizer.cullMode = cullMode;
+  // the projection doesn't flip y, so a face winding counter clockwise in
+  // world space winds clockwise in Vulkan's y down framebuffer
+  rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
   rasterizer.depthBiasEnable = VK_FALSE;
 
   VkPipelineMultisampleStateCreateInfo multisampling = {0};
@@ -802,12 +958,14 @@ ErrVal new_VertexDisplayPipeline(VkPipeline *pGraphicsPipeline,
   pipelineInfo.pMultisampleState = &multisampling;
   pipelineInfo.pColorBlendState = &colorBlending;
   pipelineInfo.pDepthStencilState = &depthStencil;
+  pipelineInfo.pDynamicState = &dynamicState;
   pipelineInfo.layout = pipelineLayout;
   pipelineInfo.renderPass = renderPass;
   pipelineInfo.subpass = 0;
   pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
-  if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, NULL,
+  if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo,
+                                pVulkanAllocationCallbacks,
                                 pGraphicsPipeline) != VK_SUCCESS) {
     LOG_ERROR(ERR_LEVEL_FATAL, "failed to create graphics pipeline!");
     PANIC();
@@ -816,7 +974,7 @@ ErrVal new_VertexDisplayPipeline(VkPipeline *pGraphicsPipeline,
 }
 
 void delete_Pipeline(VkPipeline *pPipeline, const VkDevice device) {
-  vkDestroyPipeline(device, *pPipeline, NULL);
+  vkDestroyPipeline(device, *pPipeline, pVulkanAllocationCallbacks);
 }
 
 ErrVal new_Framebuffer(VkFramebuffer *pFramebuffer, const VkDevice device,
@@ -833,7 +991,8 @@ ErrVal new_Framebuffer(VkFramebuffer *pFramebuffer, const VkDevice device,
   framebufferInfo.height = swapchainExtent.height;
   framebufferInfo.layers = 1;
   VkResult res =
-      vkCreateFramebuffer(device, &framebufferInfo, NULL, pFramebuffer);
+      vkCreateFramebuffer(device, &framebufferInfo, pVulkanAllocationCallbacks,
+                          pFramebuffer);
   if (res == VK_SUCCESS) {
     return (ERR_OK);
   } else {
@@ -844,7 +1003,7 @@ ErrVal new_Framebuffer(VkFramebuffer *pFramebuffer, const VkDevice device,
 }
 
 void delete_Framebuffer(VkFramebuffer *pFramebuffer, VkDevice device) {
-  vkDestroyFramebuffer(device, *pFramebuffer, NULL);
+  vkDestroyFramebuffer(device, *pFramebuffer, pVulkanAllocationCallbacks);
   *pFramebuffer = VK_NULL_HANDLE;
 }
 
@@ -876,13 +1035,33 @@ void delete_SwapchainFramebuffers(VkFramebuffer *pFramebuffers,
   }
 }
 
+ErrVal new_OffscreenFramebuffers(VkFramebuffer *pFramebuffers,
+                                 const VkDevice device,
+                                 const VkRenderPass renderPass,
+                                 const VkExtent2D extent,
+                                 const uint32_t imageCount,
+                                 const VkImageView *pDepthImageViews,
+                                 const VkImageView *pImageViews) {
+  for (uint32_t i = 0; i < imageCount; i++) {
+    ErrVal retVal = new_Framebuffer(&pFramebuffers[i], device, renderPass,
+                                    pImageViews[i], pDepthImageViews[i], extent);
+    if (retVal != ERR_OK) {
+      LOG_ERROR(ERR_LEVEL_ERROR, "could not create offscreen framebuffers");
+      delete_SwapchainFramebuffers(pFramebuffers, i, device);
+      return (retVal);
+    }
+  }
+  return (ERR_OK);
+}
+
 ErrVal new_CommandPool(VkCommandPool *pCommandPool, const VkDevice device,
                        const uint32_t queueFamilyIndex) {
   VkCommandPoolCreateInfo poolInfo = {0};
   poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
   poolInfo.queueFamilyIndex = queueFamilyIndex;
   poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-  VkResult ret = vkCreateCommandPool(device, &poolInfo, NULL, pCommandPool);
+  VkResult ret = vkCreateCommandPool(device, &poolInfo,
+                                     pVulkanAllocationCallbacks, pCommandPool);
   if (ret != VK_SUCCESS) {
     LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "failed to create command pool %s",
                    vkstrerror(ret));
@@ -892,7 +1071,7 @@ ErrVal new_CommandPool(VkCommandPool *pCommandPool, const VkDevice device,
 }
 
 void delete_CommandPool(VkCommandPool *pCommandPool, const VkDevice device) {
-  vkDestroyCommandPool(device, *pCommandPool, NULL);
+  vkDestroyCommandPool(device, *pCommandPool, pVulkanAllocationCallbacks);
 }
 
 ErrVal recordVertexDisplayCommandBuffer(                //
@@ -900,12 +1079,24 @@ ErrVal recordVertexDisplayCommandBuffer(                //
     const VkFramebuffer swapchainFramebuffer,           //
     const VkBuffer vertexBuffer,                        //
     const uint32_t vertexCount,                         //
+    const VkBuffer indexBuffer,                         //
+    const uint32_t indexCount,                          //
+    const VkBuffer instanceBuffer,                      //
+    const uint32_t instanceCount,                       //
     const VkRenderPass renderPass,                      //
     const VkPipelineLayout vertexDisplayPipelineLayout, //
     const VkPipeline vertexDisplayPipeline,             //
     const VkExtent2D swapchainExtent,                   //
     const mat4x4 cameraTransform,                       //
-    const VkClearColorValue clearColor                  //
+    const VertexQuantization *pQuantization,            //
+    const VkClearColorValue clearColor,                 //
+    GpuProfiler *pProfiler,                             //
+    AsyncUploader *pUploader,                           //
+    GpuCuller *pCuller,                                 //
+    const IndexedDraw *pDraws,                          //
+    const uint32_t drawCount,                           //
+    MeshletCuller *pMeshletCuller,                      //
+    const vec3 cameraPosition                           //
 ) {
   VkCommandBufferBeginInfo beginInfo = {0};
   beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -920,6 +1111,25 @@ ErrVal recordVertexDisplayCommandBuffer(                //
     PANIC();
   }
 
+  // take ownership of anything uploaded since the last frame
+  asyncUploaderRecordAcquires(pUploader, commandBuffer);
+
+  // the visible instances are compacted before the render pass starts
+  if (pCuller != NULL) {
+    uint32_t cullScope =
+        gpuProfilerBeginScope(pProfiler, commandBuffer, "gpu_cull");
+    gpuCullerRecordCull(pCuller, commandBuffer, instanceBuffer, instanceCount,
+                        cameraTransform);
+    gpuProfilerEndScope(pProfiler, commandBuffer, cullScope);
+  }
+  if (pMeshletCuller != NULL) {
+    uint32_t cullScope =
+        gpuProfilerBeginScope(pProfiler, commandBuffer, "meshlet_cull");
+    meshletCullerRecordCull(pMeshletCuller, commandBuffer, cameraTransform,
+                            cameraPosition);
+    gpuProfilerEndScope(pProfiler, commandBuffer, cullScope);
+  }
+
   VkRenderPassBeginInfo renderPassInfo = {0};
   renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
   renderPassInfo.renderPass = renderPass;
@@ -935,21 +1145,78 @@ ErrVal recordVertexDisplayCommandBuffer(                //
   renderPassInfo.clearValueCount = 2;
   renderPassInfo.pClearValues = pClearColors;
 
+  uint32_t renderPassScope =
+      gpuProfilerBeginScope(pProfiler, commandBuffer, "render_pass");
+  // queries begun outside a render pass count everything inside it
+  gpuProfilerBeginStatistics(pProfiler, commandBuffer);
+
   vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
                        VK_SUBPASS_CONTENTS_INLINE);
   vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
                     vertexDisplayPipeline);
+
+  VkViewport viewport = {0};
+  viewport.x = 0.0f;
+  viewport.y = 0.0f;
+  viewport.width = (float)swapchainExtent.width;
+  viewport.height = (float)swapchainExtent.height;
+  viewport.minDepth = 0.0f;
+  viewport.maxDepth = 1.0f;
+  vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+  VkRect2D scissor = {0};
+  scissor.offset.x = 0;
+  scissor.offset.y = 0;
+  scissor.extent = swapchainExtent;
+  vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
   vkCmdPushConstants(commandBuffer, vertexDisplayPipelineLayout,
                      VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(mat4x4),
                      cameraTransform);
-
-  VkBuffer vertexBuffers[] = {vertexBuffer};
-  VkDeviceSize offsets[] = {0};
-  vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
-
-  vkCmdDraw(commandBuffer, vertexCount, 1, 0, 0);
+  if (pQuantization != NULL) {
+    vkCmdPushConstants(commandBuffer, vertexDisplayPipelineLayout,
+                       VK_SHADER_STAGE_VERTEX_BIT, sizeof(mat4x4),
+                       sizeof(VertexQuantization), pQuantization);
+  }
+
+  // every instance is drawn by the same call, reading its transform from
+  // the second binding
+  VkBuffer vertexBuffers[] = {vertexBuffer, instanceBuffer};
+  VkDeviceSize offsets[] = {0, 0};
+  uint32_t drawInstanceCount = 1;
+  if (instanceBuffer != VK_NULL_HANDLE && pCuller == NULL) {
+    vkCmdBindVertexBuffers(commandBuffer, 0, 2, vertexBuffers, offsets);
+    drawInstanceCount = instanceCount;
+  } else {
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+  }
+
+  if (pCuller != NULL) {
+    // the culling pass wrote the visible instances and the draws
+    vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+    gpuCullerRecordDraw(pCuller, commandBuffer);
+  } else if (pMeshletCuller != NULL) {
+    // the culling pass wrote the visible indices and their draw
+    meshletCullerRecordDraw(pMeshletCuller, commandBuffer);
+  } else if (pDraws != NULL) {
+    // one draw per level of detail, each over its own range of instances
+    vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+    for (uint32_t i = 0; i < drawCount; i++) {
+      vkCmdDrawIndexed(commandBuffer, pDraws[i].indexCount,
+                       pDraws[i].instanceCount, pDraws[i].firstIndex, 0,
+                       pDraws[i].firstInstance);
+    }
+  } else if (indexBuffer != VK_NULL_HANDLE) {
+    vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+    vkCmdDrawIndexed(commandBuffer, indexCount, drawInstanceCount, 0, 0, 0);
+  } else {
+    vkCmdDraw(commandBuffer, vertexCount, drawInstanceCount, 0, 0);
+  }
   vkCmdEndRenderPass(commandBuffer);
 
+  gpuProfilerEndStatistics(pProfiler, commandBuffer);
+  gpuProfilerEndScope(pProfiler, commandBuffer, renderPassScope);
+
   VkResult endCommandBufferRetVal = vkEndCommandBuffer(commandBuffer);
   if (endCommandBufferRetVal != VK_SUCCESS) {
     LOG_ERROR_ARGS(ERR_LEVEL_FATAL,
@@ -963,7 +1230,8 @@ ErrVal recordVertexDisplayCommandBuffer(                //
 ErrVal new_Semaphore(VkSemaphore *pSemaphore, const VkDevice device) {
   VkSemaphoreCreateInfo semaphoreInfo = {0};
   semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-  VkResult ret = vkCreateSemaphore(device, &semaphoreInfo, NULL, pSemaphore);
+  VkResult ret = vkCreateSemaphore(device, &semaphoreInfo,
+                                   pVulkanAllocationCallbacks, pSemaphore);
   if (ret != VK_SUCCESS) {
     LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "failed to create semaphore: %s",
                    vkstrerror(ret));
@@ -972,8 +1240,45 @@ ErrVal new_Semaphore(VkSemaphore *pSemaphore, const VkDevice device) {
   return (ERR_OK);
 }
 
+ErrVal new_TimelineSemaphore(VkSemaphore *pSemaphore,
+                             const uint64_t initialValue,
+                             const VkDevice device) {
+  VkSemaphoreTypeCreateInfo typeInfo = {0};
+  typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+  typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+  typeInfo.initialValue = initialValue;
+
+  VkSemaphoreCreateInfo semaphoreInfo = {0};
+  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  semaphoreInfo.pNext = &typeInfo;
+  VkResult ret = vkCreateSemaphore(device, &semaphoreInfo,
+                                   pVulkanAllocationCallbacks, pSemaphore);
+  if (ret != VK_SUCCESS) {
+    LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "failed to create timeline semaphore: %s",
+                   vkstrerror(ret));
+    return (ERR_UNKNOWN);
+  }
+  return (ERR_OK);
+}
+
+ErrVal waitTimelineSemaphore(const VkSemaphore semaphore, const uint64_t value,
+                             const VkDevice device) {
+  VkSemaphoreWaitInfo waitInfo = {0};
+  waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+  waitInfo.semaphoreCount = 1;
+  waitInfo.pSemaphores = &semaphore;
+  waitInfo.pValues = &value;
+  VkResult ret = vkWaitSemaphores(device, &waitInfo, UINT64_MAX);
+  if (ret != VK_SUCCESS) {
+    LOG_ERROR_ARGS(ERR_LEVEL_FATAL, "failed to wait for semaphore: %s",
+                   vkstrerror(ret));
+    PANIC();
+  }
+  return (ERR_OK);
+}
+
 void delete_Semaphore(VkSemaphore *pSemaphore, const VkDevice device) {
-  vkDestroySemaphore(device, *pSemaphore, NULL);
+  vkDestroySemaphore(device, *pSemaphore, pVulkanAllocationCallbacks);
   *pSemaphore = VK_NULL_HANDLE;
 }
 
@@ -1003,7 +1308,8 @@ ErrVal new_Fence(VkFence *pFence, const VkDevice device, const bool signaled) {
   if (signaled) {
     fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
   }
-  VkResult ret = vkCreateFence(device, &fenceInfo, NULL, pFence);
+  VkResult ret = vkCreateFence(device, &fenceInfo, pVulkanAllocationCallbacks,
+                               pFence);
   if (ret != VK_SUCCESS) {
     LOG_ERROR_ARGS(ERR_LEVEL_FATAL, "failed to create fence: %s",
                    vkstrerror(ret));
@@ -1013,7 +1319,7 @@ ErrVal new_Fence(VkFence *pFence, const VkDevice device, const bool signaled) {
 }
 
 void delete_Fence(VkFence *pFence, const VkDevice device) {
-  vkDestroyFence(device, *pFence, NULL);
+  vkDestroyFence(device, *pFence, pVulkanAllocationCallbacks);
   *pFence = VK_NULL_HANDLE;
 }
 
@@ -1093,18 +1399,36 @@ ErrVal drawFrame(                        //
     VkSemaphore renderFinishedSemaphore, //
     VkFence inFlightFence,               //
     const VkQueue graphicsQueue,         //
-    const VkQueue presentQueue           //
+    const VkQueue presentQueue,          //
+    const AsyncUploader *pUploader       //
 ) {
 
   // Sets up for next frame
+  VkSemaphore waitSemaphores[] = {imageAvailableSemaphore, VK_NULL_HANDLE};
   VkPipelineStageFlags waitStages[] = {
-      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0};
+  // the value for the binary semaphore is ignored
+  uint64_t waitValues[] = {0, 0};
 
   VkSubmitInfo submitInfo = {0};
   submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
   submitInfo.waitSemaphoreCount = 1;
-  submitInfo.pWaitSemaphores = &imageAvailableSemaphore;
+  submitInfo.pWaitSemaphores = waitSemaphores;
   submitInfo.pWaitDstStageMask = waitStages;
+
+  // wait for uploads this frame acquired, but only where they're first used
+  VkTimelineSemaphoreSubmitInfo timelineInfo = {0};
+  if (pUploader != NULL && pUploader->acquiredTicket != 0) {
+    waitSemaphores[1] = pUploader->timeline;
+    waitStages[1] = pUploader->acquiredStageMask;
+    waitValues[1] = pUploader->acquiredTicket;
+    submitInfo.waitSemaphoreCount = 2;
+
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount = 2;
+    timelineInfo.pWaitSemaphoreValues = waitValues;
+    submitInfo.pNext = &timelineInfo;
+  }
   submitInfo.commandBufferCount = 1;
   submitInfo.pCommandBuffers = &commandBuffer;
 
@@ -1132,9 +1456,48 @@ ErrVal drawFrame(                        //
   return (ERR_OK);
 }
 
+// Submits a frame rendered into an offscreen image. There is nothing to
+// present, so the only synchronization is the in flight fence
+ErrVal drawOffscreenFrame(         //
+    VkCommandBuffer commandBuffer, //
+    VkFence inFlightFence,         //
+    const VkQueue graphicsQueue,   //
+    const AsyncUploader *pUploader //
+) {
+  VkSubmitInfo submitInfo = {0};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submitInfo.waitSemaphoreCount = 0;
+
+  VkTimelineSemaphoreSubmitInfo timelineInfo = {0};
+  VkPipelineStageFlags waitStage;
+  if (pUploader != NULL && pUploader->acquiredTicket != 0) {
+    waitStage = pUploader->acquiredStageMask;
+    submitInfo.waitSemaphoreCount = 1;
+    submitInfo.pWaitSemaphores = &pUploader->timeline;
+    submitInfo.pWaitDstStageMask = &waitStage;
+
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount = 1;
+    timelineInfo.pWaitSemaphoreValues = &pUploader->acquiredTicket;
+    submitInfo.pNext = &timelineInfo;
+  }
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &commandBuffer;
+  submitInfo.signalSemaphoreCount = 0;
+
+  VkResult queueSubmitResult =
+      vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFence);
+  if (queueSubmitResult != VK_SUCCESS) {
+    LOG_ERROR_ARGS(ERR_LEVEL_FATAL, "failed to submit queue: %s",
+                   vkstrerror(queueSubmitResult));
+    PANIC();
+  }
+  return (ERR_OK);
+}
+
 // Deletes a VkSurfaceKHR
 void delete_Surface(VkSurfaceKHR *pSurface, const VkInstance instance) {
-  vkDestroySurfaceKHR(instance, *pSurface, NULL);
+  vkDestroySurfaceKHR(instance, *pSurface, pVulkanAllocationCallbacks);
   *pSurface = VK_NULL_HANDLE;
 }
 
@@ -1167,7 +1530,8 @@ ErrVal new_GlfwWindow(GLFWwindow **ppGlfwWindow, const char *name,
  * with the delete_Surface function*/
 ErrVal new_SurfaceFromGLFW(VkSurfaceKHR *pSurface, GLFWwindow *pWindow,
                            const VkInstance instance) {
-  VkResult res = glfwCreateWindowSurface(instance, pWindow, NULL, pSurface);
+  VkResult res = glfwCreateWindowSurface(instance, pWindow,
+                                         pVulkanAllocationCallbacks, pSurface);
   if (res != VK_SUCCESS) {
     LOG_ERROR(ERR_LEVEL_FATAL, "failed to create surface, quitting");
     PANIC();
@@ -1180,81 +1544,113 @@ ErrVal new_SurfaceFromGLFW(VkSurfaceKHR *pSurface, GLFWwindow *pWindow,
  * requested. */
 ErrVal getMemoryTypeIndex(uint32_t *memoryTypeIndex,
                           const uint32_t memoryTypeBits,
-                          const VkMemoryPropertyFlags memoryPropertyFlags,
+                          const VkMemoryPropertyFlags requiredFlags,
+                          const VkMemoryPropertyFlags preferredFlags,
                           const VkPhysicalDevice physicalDevice) {
 
   /* Retrieve memory properties */
   VkPhysicalDeviceMemoryProperties memProperties;
   vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
-  /* Check each memory type to see if it conforms to our requirements */
-  for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-    if ((memoryTypeBits &
-         (1 << i)) && /* TODO figure out what's going on over here */
-        (memProperties.memoryTypes[i].propertyFlags & memoryPropertyFlags) ==
-            memoryPropertyFlags) {
-      *memoryTypeIndex = i;
-      return (ERR_OK);
-    }
-  }
-  LOG_ERROR(ERR_LEVEL_ERROR, "failed to find suitable memory type");
-  return (ERR_MEMORY);
-}
-
-ErrVal new_VertexBuffer(VkBuffer *pBuffer, VkDeviceMemory *pBufferMemory,
-                        const Vertex *pVertices, const uint32_t vertexCount,
-                        const VkDevice device,
-                        const VkPhysicalDevice physicalDevice,
-                        const VkCommandPool commandPool, const VkQueue queue) {
-  /* Construct staging buffers */
-  VkDeviceSize bufferSize = sizeof(Vertex) * vertexCount;
-  VkBuffer stagingBuffer;
-  VkDeviceMemory stagingBufferMemory;
-  ErrVal stagingBufferCreateResult = new_Buffer_DeviceMemory(
-      &stagingBuffer, &stagingBufferMemory, bufferSize, physicalDevice, device,
-      VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+  return (selectMemoryType(memoryTypeIndex, &memProperties, memoryTypeBits,
+                           requiredFlags, preferredFlags));
+}
+
+bool isAllocationHostWritable(const Allocation *pAllocation,
+                              const Allocator *pAllocator) {
+  VkMemoryPropertyFlags flags =
+      pAllocator->memoryProperties.memoryTypes[pAllocation->memoryTypeIndex]
+          .propertyFlags;
+  return (pAllocation->pMapped != NULL &&
+          (flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT));
+}
+
+ErrVal new_Buffer_Upload(VkBuffer *pBuffer, Allocation *pAllocation,
+                         Allocator *pAllocator, AsyncUploader *pUploader,
+                         const void *pData, const VkDeviceSize size,
+                         const VkBufferUsageFlags usage,
+                         const VkPipelineStageFlags dstStageMask,
+                         const VkAccessFlags dstAccessMask, uint64_t *pTicket) {
+  // on UMA and resizable BAR systems device local memory can be written
+  // directly, saving a copy; the small BAR heap may run out though
+  ErrVal retVal = new_Buffer_Allocation(
+      pBuffer, pAllocation, pAllocator, size,
+      usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
           VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-  if (stagingBufferCreateResult != ERR_OK) {
-    LOG_ERROR(
-        ERR_LEVEL_ERROR,
-        "failed to create vertex buffer: failed to create staging buffer");
-    return (stagingBufferCreateResult);
+  if (retVal == ERR_ALLOCFAIL) {
+    retVal = new_Buffer_Allocation(pBuffer, pAllocation, pAllocator, size,
+                                   usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0);
   }
-
-  /* Copy data to staging buffer, making sure to clean up leaks */
-  ErrVal copyResult =
-      copyToDeviceMemory(&stagingBufferMemory, bufferSize, pVertices, device);
-  if (copyResult != ERR_OK) {
-    LOG_ERROR(ERR_LEVEL_ERROR,
-              "failed to create vertex buffer: could not map memory");
-    delete_Buffer(&stagingBuffer, device);
-    delete_DeviceMemory(&stagingBufferMemory, device);
-    return (copyResult);
+  if (retVal != ERR_OK) {
+    return (retVal);
   }
 
-  /* Create vertex buffer and allocate memory for it */
-  ErrVal vertexBufferCreateResult = new_Buffer_DeviceMemory(
-      pBuffer, pBufferMemory, bufferSize, physicalDevice, device,
-      VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-  /* Handle errors */
-  if (vertexBufferCreateResult != ERR_OK) {
-    /* Delete the temporary staging buffers */
-    LOG_ERROR(ERR_LEVEL_ERROR, "failed to create vertex buffer");
-    delete_Buffer(&stagingBuffer, device);
-    delete_DeviceMemory(&stagingBufferMemory, device);
-    return (vertexBufferCreateResult);
+  if (isAllocationHostWritable(pAllocation, pAllocator)) {
+    // the GPU hasn't seen the buffer, and host writes are visible to every
+    // later submission, so there is nothing to wait for
+    copyToAllocation(pAllocation, pData, size);
+    if (pTicket != NULL) {
+      *pTicket = 0;
+    }
+    return (ERR_OK);
   }
+  return (asyncUploadBuffer(pUploader, *pBuffer, 0, pData, size, dstStageMask,
+                            dstAccessMask, pTicket));
+}
 
-  /* Copy the data over from the staging buffer to the vertex buffer */
-  copyBuffer(*pBuffer, stagingBuffer, bufferSize, commandPool, queue, device);
+ErrVal new_Buffer_Allocation(VkBuffer *pBuffer, Allocation *pAllocation,
+                             Allocator *pAllocator, const VkDeviceSize size,
+                             const VkBufferUsageFlags usage,
+                             const VkMemoryPropertyFlags properties,
+                             const VkMemoryPropertyFlags preferredProperties) {
+  VkBufferCreateInfo bufferInfo = {0};
+  bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferInfo.size = size;
+  bufferInfo.usage = usage;
+  bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  VkResult bufferCreateResult =
+      vkCreateBuffer(pAllocator->device, &bufferInfo,
+                     pVulkanAllocationCallbacks, pBuffer);
+  if (bufferCreateResult != VK_SUCCESS) {
+    LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "failed to create buffer: %s",
+                   vkstrerror(bufferCreateResult));
+    return (ERR_UNKNOWN);
+  }
 
-  /* Delete the temporary staging buffers */
-  delete_Buffer(&stagingBuffer, device);
-  delete_DeviceMemory(&stagingBufferMemory, device);
+  VkMemoryRequirements memoryRequirements;
+  vkGetBufferMemoryRequirements(pAllocator->device, *pBuffer,
+                                &memoryRequirements);
+  ErrVal allocateResult =
+      new_Allocation(pAllocation, pAllocator, memoryRequirements, properties,
+                     preferredProperties);
+  if (allocateResult != ERR_OK) {
+    LOG_ERROR(ERR_LEVEL_ERROR, "failed to allocate memory for buffer");
+    delete_Buffer(pBuffer, pAllocator->device);
+    return (allocateResult);
+  }
+
+  VkResult bindResult = vkBindBufferMemory(
+      pAllocator->device, *pBuffer, pAllocation->memory, pAllocation->offset);
+  if (bindResult != VK_SUCCESS) {
+    LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "failed to bind buffer memory: %s",
+                   vkstrerror(bindResult));
+    delete_Buffer(pBuffer, pAllocator->device);
+    delete_Allocation(pAllocation, pAllocator);
+    return (ERR_UNKNOWN);
+  }
+  return (ERR_OK);
+}
 
+ErrVal copyToAllocation(const Allocation *pAllocation, const void *source,
+                        const VkDeviceSize size) {
+  if (pAllocation->pMapped == NULL) {
+    LOG_ERROR(ERR_LEVEL_ERROR,
+              "failed to copy to allocation: memory is not host visible");
+    return (ERR_MEMORY);
+  }
+  memcpy(pAllocation->pMapped, source, (size_t)size);
   return (ERR_OK);
 }
 
@@ -1271,7 +1667,7 @@ ErrVal new_Buffer_DeviceMemory(VkBuffer *pBuffer, VkDeviceMemory *pBufferMemory,
   bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
   /* Create buffer */
   VkResult bufferCreateResult =
-      vkCreateBuffer(device, &bufferInfo, NULL, pBuffer);
+      vkCreateBuffer(device, &bufferInfo, pVulkanAllocationCallbacks, pBuffer);
   if (bufferCreateResult != VK_SUCCESS) {
     LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "failed to create buffer: %s",
                    vkstrerror(bufferCreateResult));
@@ -1287,7 +1683,7 @@ ErrVal new_Buffer_DeviceMemory(VkBuffer *pBuffer, VkDeviceMemory *pBufferMemory,
   /* Get the type of memory required, handle errors */
   ErrVal getMemoryTypeRetVal = getMemoryTypeIndex(
       &allocateInfo.memoryTypeIndex, memoryRequirements.memoryTypeBits,
-      properties, physicalDevice);
+      properties, 0, physicalDevice);
   if (getMemoryTypeRetVal != ERR_OK) {
     LOG_ERROR(ERR_LEVEL_ERROR, "failed to get type of memory to allocate");
     return (ERR_MEMORY);
@@ -1295,7 +1691,8 @@ ErrVal new_Buffer_DeviceMemory(VkBuffer *pBuffer, VkDeviceMemory *pBufferMemory,
 
   /* Actually allocate memory */
   VkResult memoryAllocateResult =
-      vkAllocateMemory(device, &allocateInfo, NULL, pBufferMemory);
+      vkAllocateMemory(device, &allocateInfo, pVulkanAllocationCallbacks,
+                       pBufferMemory);
   if (memoryAllocateResult != VK_SUCCESS) {
     LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "failed to allocate memory for buffer: %s",
                    vkstrerror(memoryAllocateResult));
@@ -1305,19 +1702,18 @@ ErrVal new_Buffer_DeviceMemory(VkBuffer *pBuffer, VkDeviceMemory *pBufferMemory,
   return (ERR_OK);
 }
 
-// submits a copy to the queue, you'll later need to wait for idle
-ErrVal copyBuffer(VkBuffer destinationBuffer, const VkBuffer sourceBuffer,
-                  const VkDeviceSize size, const VkCommandPool commandPool,
-                  const VkQueue queue, const VkDevice device) {
+// copies a color image in the TRANSFER_SRC_OPTIMAL layout into a tightly
+// packed buffer, and waits for the copy to finish
+ErrVal copyImageToBuffer(VkBuffer destinationBuffer, const VkImage sourceImage,
+                         const VkExtent2D extent,
+                         const VkCommandPool commandPool, const VkQueue queue,
+                         const VkDevice device) {
   VkCommandBuffer copyCommandBuffer;
-  ErrVal createResult =
-      new_CommandBuffers(&copyCommandBuffer, 1, commandPool, device);
-  if (createResult != ERR_OK) {
-  }
+  new_CommandBuffers(&copyCommandBuffer, 1, commandPool, device);
 
   VkCommandBufferBeginInfo beginInfo = {0};
   beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
   VkResult beginRet = vkBeginCommandBuffer(copyCommandBuffer, &beginInfo);
   if (beginRet != VK_SUCCESS) {
@@ -1326,25 +1722,44 @@ ErrVal copyBuffer(VkBuffer destinationBuffer, const VkBuffer sourceBuffer,
     PANIC();
   }
 
-  VkBufferCopy copyRegion = {.size = size, .srcOffset = 0, .dstOffset = 0};
-  vkCmdCopyBuffer(copyCommandBuffer, sourceBuffer, destinationBuffer, 1,
-                  &copyRegion);
+  VkBufferImageCopy copyRegion = {0};
+  copyRegion.bufferOffset = 0;
+  copyRegion.bufferRowLength = 0;
+  copyRegion.bufferImageHeight = 0;
+  copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  copyRegion.imageSubresource.mipLevel = 0;
+  copyRegion.imageSubresource.baseArrayLayer = 0;
+  copyRegion.imageSubresource.layerCount = 1;
+  copyRegion.imageOffset = (VkOffset3D){0, 0, 0};
+  copyRegion.imageExtent =
+      (VkExtent3D){.width = extent.width, .height = extent.height, .depth = 1};
+  vkCmdCopyImageToBuffer(copyCommandBuffer, sourceImage,
+                         VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                         destinationBuffer, 1, &copyRegion);
+
+  // waiting on the fence alone doesn't make the copy visible to the host
+  VkBufferMemoryBarrier readbackBarrier = {0};
+  readbackBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  readbackBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  readbackBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+  readbackBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  readbackBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  readbackBarrier.buffer = destinationBuffer;
+  readbackBarrier.offset = 0;
+  readbackBarrier.size = VK_WHOLE_SIZE;
+  vkCmdPipelineBarrier(copyCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_HOST_BIT, 0, 0, NULL, 1,
+                       &readbackBarrier, 0, NULL);
 
-  // End buffer
   VkResult bufferEndResult = vkEndCommandBuffer(copyCommandBuffer);
   if (bufferEndResult != VK_SUCCESS) {
-    /* Clean up resources */
     LOG_ERROR_ARGS(ERR_LEVEL_FATAL, "failed to end command buffer: %s",
                    vkstrerror(bufferEndResult));
     PANIC();
   }
 
-  // wait for completion with a fence
   VkFence fence;
-  if (new_Fence(&fence, device, false) != ERR_OK) {
-    LOG_ERROR(ERR_LEVEL_FATAL, "Failed to make copy fence");
-    PANIC();
-  }
+  new_Fence(&fence, device, false);
 
   VkSubmitInfo submitInfo = {0};
   submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
@@ -1367,17 +1782,17 @@ ErrVal copyBuffer(VkBuffer destinationBuffer, const VkBuffer sourceBuffer,
   }
 
   delete_Fence(&fence, device);
-
+  delete_CommandBuffers(&copyCommandBuffer, 1, commandPool, device);
   return (ERR_OK);
 }
 
 void delete_Buffer(VkBuffer *pBuffer, const VkDevice device) {
-  vkDestroyBuffer(device, *pBuffer, NULL);
+  vkDestroyBuffer(device, *pBuffer, pVulkanAllocationCallbacks);
   *pBuffer = VK_NULL_HANDLE;
 }
 
 void delete_DeviceMemory(VkDeviceMemory *pDeviceMemory, const VkDevice device) {
-  vkFreeMemory(device, *pDeviceMemory, NULL);
+  vkFreeMemory(device, *pDeviceMemory, pVulkanAllocationCallbacks);
   *pDeviceMemory = VK_NULL_HANDLE;
 }
 
@@ -1418,38 +1833,15 @@ void delete_CommandBuffers(            //
   }
 }
 
-ErrVal copyToDeviceMemory(VkDeviceMemory *pDeviceMemory,
-                          const VkDeviceSize deviceSize, const void *source,
-                          const VkDevice device) {
-  void *data;
-  VkResult mapMemoryResult =
-      vkMapMemory(device, *pDeviceMemory, 0, deviceSize, 0, &data);
-
-  /* On failure */
-  if (mapMemoryResult != VK_SUCCESS) {
-    LOG_ERROR_ARGS(ERR_LEVEL_ERROR,
-                   "failed to copy to device memory: failed to map memory: %s",
-                   vkstrerror(mapMemoryResult));
-    return (ERR_MEMORY);
-  }
-
-  /* If it was successful, go on and actually copy it, making sure to unmap once
-   * done */
-  memcpy(data, source, (size_t)deviceSize);
-  vkUnmapMemory(device, *pDeviceMemory);
-  return (ERR_OK);
-}
-
-ErrVal new_Image(                           //
+ErrVal new_Image_Allocation(                //
     VkImage *pImage,                        //
-    VkDeviceMemory *pImageMemory,           //
+    Allocation *pAllocation,                //
+    Allocator *pAllocator,                  //
     const VkExtent2D dimensions,            //
     const VkFormat format,                  //
     const VkImageTiling tiling,             //
     const VkImageUsageFlags usage,          //
-    const VkMemoryPropertyFlags properties, //
-    const VkPhysicalDevice physicalDevice,  //
-    const VkDevice device                   //
+    const VkMemoryPropertyFlags properties  //
 ) {
   VkImageCreateInfo imageInfo = {0};
   imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -1466,7 +1858,9 @@ ErrVal new_Image(                           //
   imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
   imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-  VkResult createImageResult = vkCreateImage(device, &imageInfo, NULL, pImage);
+  VkResult createImageResult =
+      vkCreateImage(pAllocator->device, &imageInfo, pVulkanAllocationCallbacks,
+                    pImage);
   if (createImageResult != VK_SUCCESS) {
     LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "failed to create image: %s",
                    vkstrerror(createImageResult));
@@ -1474,40 +1868,29 @@ ErrVal new_Image(                           //
   }
 
   VkMemoryRequirements memRequirements;
-  vkGetImageMemoryRequirements(device, *pImage, &memRequirements);
-
-  VkMemoryAllocateInfo allocInfo = {0};
-  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  allocInfo.allocationSize = memRequirements.size;
-
-  ErrVal memGetResult = getMemoryTypeIndex(&allocInfo.memoryTypeIndex,
-                                           memRequirements.memoryTypeBits,
-                                           properties, physicalDevice);
-
-  if (memGetResult != ERR_OK) {
+  vkGetImageMemoryRequirements(pAllocator->device, *pImage, &memRequirements);
+  ErrVal allocateResult =
+      new_Allocation(pAllocation, pAllocator, memRequirements, properties, 0);
+  if (allocateResult != ERR_OK) {
     LOG_ERROR(ERR_LEVEL_ERROR, "failed to create image: allocation failed");
-    return (ERR_MEMORY);
+    delete_Image(pImage, pAllocator->device);
+    return (allocateResult);
   }
 
-  VkResult allocateResult =
-      vkAllocateMemory(device, &allocInfo, NULL, pImageMemory);
-  if (allocateResult != VK_SUCCESS) {
-    LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "failed to create image: %s",
-                   vkstrerror(allocateResult));
-    return (ERR_MEMORY);
-  }
-
-  VkResult bindResult = vkBindImageMemory(device, *pImage, *pImageMemory, 0);
+  VkResult bindResult = vkBindImageMemory(
+      pAllocator->device, *pImage, pAllocation->memory, pAllocation->offset);
   if (bindResult != VK_SUCCESS) {
     LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "failed to create image: %s",
                    vkstrerror(bindResult));
+    delete_Image(pImage, pAllocator->device);
+    delete_Allocation(pAllocation, pAllocator);
     return (ERR_UNKNOWN);
   }
   return (ERR_OK);
 }
 
 void delete_Image(VkImage *pImage, const VkDevice device) {
-  vkDestroyImage(device, *pImage, NULL);
+  vkDestroyImage(device, *pImage, pVulkanAllocationCallbacks);
 }
 
 /* Gets image format of depth */
@@ -1516,16 +1899,15 @@ void getDepthFormat(VkFormat *pFormat) {
   *pFormat = VK_FORMAT_D32_SFLOAT;
 }
 
-ErrVal new_DepthImage(VkImage *pImage, VkDeviceMemory *pImageMemory,
+ErrVal new_DepthImage(VkImage *pImage, Allocation *pAllocation,
                       const VkExtent2D swapchainExtent,
-                      const VkPhysicalDevice physicalDevice,
-                      const VkDevice device) {
+                      Allocator *pAllocator) {
   VkFormat depthFormat = {0};
   getDepthFormat(&depthFormat);
-  ErrVal retVal = new_Image(
-      pImage, pImageMemory, swapchainExtent, depthFormat,
+  ErrVal retVal = new_Image_Allocation(
+      pImage, pAllocation, pAllocator, swapchainExtent, depthFormat,
       VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, physicalDevice, device);
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
   if (retVal != ERR_OK) {
     LOG_ERROR(ERR_LEVEL_ERROR, "failed to create depth image");
     return (retVal);
@@ -1534,6 +1916,26 @@ ErrVal new_DepthImage(VkImage *pImage, VkDeviceMemory *pImageMemory,
   return (ERR_OK);
 }
 
+bool resizeDepthImageCapacity(VkExtent2D *pCapacity, const VkExtent2D extent,
+                              const VkPhysicalDevice physicalDevice) {
+  uint64_t capacityArea = (uint64_t)pCapacity->width * pCapacity->height;
+  uint64_t area = (uint64_t)extent.width * extent.height;
+  if (extent.width <= pCapacity->width && extent.height <= pCapacity->height &&
+      area * 4 >= capacityArea) {
+    return (false);
+  }
+
+  // leave some headroom so that dragging the window edge doesn't reallocate
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+  uint64_t maxDimension = properties.limits.maxImageDimension2D;
+  uint64_t width = (uint64_t)extent.width * DEPTH_IMAGE_GROWTH_PERCENT / 100;
+  uint64_t height = (uint64_t)extent.height * DEPTH_IMAGE_GROWTH_PERCENT / 100;
+  pCapacity->width = (uint32_t)(width < maxDimension ? width : maxDimension);
+  pCapacity->height = (uint32_t)(height < maxDimension ? height : maxDimension);
+  return (true);
+}
+
 ErrVal new_DepthImageView(VkImageView *pImageView, const VkDevice device,
                           const VkImage depthImage) {
   VkFormat depthFormat;
@@ -1546,6 +1948,32 @@ ErrVal new_DepthImageView(VkImageView *pImageView, const VkDevice device,
   return (retVal);
 }
 
+ErrVal new_OffscreenImages(VkImage *pImages, Allocation *pAllocations,
+                           const uint32_t imageCount, const VkExtent2D extent,
+                           const VkFormat format, Allocator *pAllocator) {
+  for (uint32_t i = 0; i < imageCount; i++) {
+    ErrVal retVal = new_Image_Allocation(
+        &pImages[i], &pAllocations[i], pAllocator, extent, format,
+        VK_IMAGE_TILING_OPTIMAL,
+        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    if (retVal != ERR_OK) {
+      LOG_ERROR(ERR_LEVEL_ERROR, "failed to create offscreen images");
+      delete_OffscreenImages(pImages, pAllocations, i, pAllocator);
+      return (retVal);
+    }
+  }
+  return (ERR_OK);
+}
+
+void delete_OffscreenImages(VkImage *pImages, Allocation *pAllocations,
+                            const uint32_t imageCount, Allocator *pAllocator) {
+  for (uint32_t i = 0; i < imageCount; i++) {
+    delete_Image(&pImages[i], pAllocator->device);
+    delete_Allocation(&pAllocations[i], pAllocator);
+  }
+}
+
 ErrVal new_ComputePipeline(VkPipeline *pPipeline,
                            const VkPipelineLayout pipelineLayout,
                            const VkShaderModule shaderModule,
@@ -1565,7 +1993,8 @@ ErrVal new_ComputePipeline(VkPipeline *pPipeline,
   computePipelineCreateInfo.stage = shaderStageCreateInfo;
 
   VkResult ret = vkCreateComputePipelines(
-      device, VK_NULL_HANDLE, 1, &computePipelineCreateInfo, NULL, pPipeline);
+      device, VK_NULL_HANDLE, 1, &computePipelineCreateInfo,
+      pVulkanAllocationCallbacks, pPipeline);
   if (ret != VK_SUCCESS) {
     LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "failed to create compute pipelines %s",
                    vkstrerror(ret));
@@ -1586,7 +2015,8 @@ ErrVal new_ComputeStorageDescriptorSetLayout(
   layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
   layoutInfo.bindingCount = 1;
   layoutInfo.pBindings = &storageLayoutBinding;
-  VkResult retVal = vkCreateDescriptorSetLayout(device, &layoutInfo, NULL,
+  VkResult retVal = vkCreateDescriptorSetLayout(device, &layoutInfo,
+                                                pVulkanAllocationCallbacks,
                                                 pDescriptorSetLayout);
   if (retVal != VK_SUCCESS) {
     LOG_ERROR_ARGS(ERR_LEVEL_ERROR,
@@ -1599,7 +2029,8 @@ ErrVal new_ComputeStorageDescriptorSetLayout(
 
 void delete_DescriptorSetLayout(VkDescriptorSetLayout *pDescriptorSetLayout,
                                 const VkDevice device) {
-  vkDestroyDescriptorSetLayout(device, *pDescriptorSetLayout, NULL);
+  vkDestroyDescriptorSetLayout(device, *pDescriptorSetLayout,
+                               pVulkanAllocationCallbacks);
   *pDescriptorSetLayout = VK_NULL_HANDLE;
 }
 
@@ -1618,7 +2049,8 @@ ErrVal new_DescriptorPool(VkDescriptorPool *pDescriptorPool,
 
   /* Actually create descriptor pool */
   VkResult ret =
-      vkCreateDescriptorPool(device, &poolInfo, NULL, pDescriptorPool);
+      vkCreateDescriptorPool(device, &poolInfo, pVulkanAllocationCallbacks,
+                             pDescriptorPool);
 
   if (ret != VK_SUCCESS) {
     LOG_ERROR_ARGS(ERR_LEVEL_ERROR, "failed to create descriptor pool; %s",
@@ -1631,7 +2063,7 @@ ErrVal new_DescriptorPool(VkDescriptorPool *pDescriptorPool,
 
 void delete_DescriptorPool(VkDescriptorPool *pDescriptorPool,
                            const VkDevice device) {
-  vkDestroyDescriptorPool(device, *pDescriptorPool, NULL);
+  vkDestroyDescriptorPool(device, *pDescriptorPool, pVulkanAllocationCallbacks);
   *pDescriptorPool = VK_NULL_HANDLE;
 }
 
@@ -1654,14 +2086,23 @@ ErrVal new_ComputeBufferDescriptorSet(
     return (ERR_MEMORY);
   }
 
+  updateComputeBufferDescriptorSet(*pDescriptorSet, computeBufferDescriptorSet,
+                                   computeBufferSize, device);
+  return (ERR_OK);
+}
+
+void updateComputeBufferDescriptorSet(const VkDescriptorSet descriptorSet,
+                                      const VkBuffer buffer,
+                                      const VkDeviceSize size,
+                                      const VkDevice device) {
   VkDescriptorBufferInfo bufferInfo = {0};
-  bufferInfo.buffer = computeBufferDescriptorSet;
-  bufferInfo.range = computeBufferSize;
+  bufferInfo.buffer = buffer;
+  bufferInfo.range = size;
   bufferInfo.offset = 0;
 
   VkWriteDescriptorSet descriptorWrites = {0};
   descriptorWrites.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-  descriptorWrites.dstSet = *pDescriptorSet;
+  descriptorWrites.dstSet = descriptorSet;
   descriptorWrites.dstBinding = 0;
   descriptorWrites.dstArrayElement = 0;
   descriptorWrites.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
@@ -1670,7 +2111,6 @@ ErrVal new_ComputeBufferDescriptorSet(
   descriptorWrites.pImageInfo = NULL;
   descriptorWrites.pTexelBufferView = NULL;
   vkUpdateDescriptorSets(device, 1, &descriptorWrites, 0, NULL);
-  return (ERR_OK);
 }
 
 void delete_DescriptorSets(VkDescriptorSet **ppDescriptorSets) {
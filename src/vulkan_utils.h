@@ -19,13 +19,62 @@
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 
+#include "allocator.h"
+#include "async_upload.h"
 #include "errors.h"
+#include "gpu_culling.h"
+#include "gpu_profiler.h"
+#include "meshlet_culling.h"
+
+// most queue families new_Device will create queues from
+#define VULKAN_MAX_QUEUE_FAMILIES 8
+// depth images are allocated this much larger than the swapchain, in percent,
+// and only shrink once the swapchain needs less than a quarter of their area
+#define DEPTH_IMAGE_GROWTH_PERCENT 125
 
 typedef struct {
   vec3 position;
   vec3 color;
 } Vertex;
 
+// A vertex in half the space, see `packed_vertex.h`
+// positions are 16 bit unorm within the bounds of their mesh, the fourth
+// component is padding, and colors are 8 bit unorm
+typedef struct {
+  uint16_t position[4];
+  uint8_t color[4];
+} PackedVertex;
+
+// Per instance data of an instanced draw, read from a second vertex binding
+// that advances once per instance, see `instances.h`
+typedef struct {
+  // applied before the camera transform
+  mat4x4 model;
+  // multiplies the vertex color, alpha is unused
+  vec4 color;
+} InstanceData;
+
+// Turns packed positions back into model space, offset + position * scale
+// vec4s so it has the same layout as in the shader's push constants
+typedef struct {
+  vec4 offset;
+  vec4 scale;
+} VertexQuantization;
+
+// An indexed draw of a range of indices and instances, with the fields in
+// the order of `vkCmdDrawIndexed`
+typedef struct {
+  uint32_t indexCount;
+  uint32_t instanceCount;
+  uint32_t firstIndex;
+  uint32_t firstInstance;
+} IndexedDraw;
+
+typedef enum {
+  VERTEX_FORMAT_FLOAT = 0,
+  VERTEX_FORMAT_PACKED = 1,
+} VertexFormat;
+
 /// Creates a new VkInstance with the specified extensions and layers
 /// --- PRECONDITIONS ---
 /// * `ppEnabledExtensionNames` must be a pointer to at least
@@ -124,22 +173,40 @@ ErrVal getPhysicalDevice(VkPhysicalDevice *pDevice, const VkInstance instance);
 /// --- PRECONDITIONS ---
 /// * `pDevice` must be a valid pointer
 /// * `physicalDevice` must be a valid physical device created from
-/// * `getPhysicalDevice` `queueFamilyIndex` must be the index of the queue
-/// family to use `ppEnabledExtensionNames` must be a pointer to at least
-/// * `enabledExtensionCount` extensions
+/// `getPhysicalDevice`
+/// * `pQueueFamilyIndices` must be a pointer to at least
+/// `queueFamilyIndexCount` queue family indices, duplicates are allowed
+/// * `ppEnabledExtensionNames` must be a pointer to at least
+/// `enabledExtensionCount` extensions
 /// --- POSTCONDITIONS ---
 /// returns error status
-/// on success, `*pDevice` will be a new logical device
+/// returns ERR_NOTSUPPORTED if `physicalDevice` lacks timeline semaphores
+/// on success, `*pDevice` will be a new logical device with one queue in each
+/// distinct family of `pQueueFamilyIndices`
+/// `timelineSemaphore` is enabled
+/// `pipelineStatisticsQuery` is enabled if `physicalDevice` supports it
+/// `drawIndirectCount` is enabled if `isDrawIndirectCountSupported` returns
+/// true
 /// --- CLEANUP ---
 /// call delete_Device
 ErrVal new_Device(                             //
     VkDevice *pDevice,                         //
     const VkPhysicalDevice physicalDevice,     //
-    const uint32_t queueFamilyIndex,           //
+    const uint32_t queueFamilyIndexCount,      //
+    const uint32_t *pQueueFamilyIndices,       //
     const uint32_t enabledExtensionCount,      //
     const char *const *ppEnabledExtensionNames //
 );
 
+/// Returns true if `physicalDevice` can draw a count of indirect commands read
+/// from a buffer
+bool isDrawIndirectCountSupported(const VkPhysicalDevice physicalDevice);
+
+/// Returns true if `physicalDevice` supports the device extension
+/// `pExtensionName`
+bool isDeviceExtensionSupported(const VkPhysicalDevice physicalDevice,
+                                const char *pExtensionName);
+
 /// Deletes a logical device created from new_Device
 /// --- PRECONDITIONS ---
 /// * `pDevice` must be a valid pointer to a logical device created from
@@ -155,13 +222,23 @@ void delete_Device(VkDevice *pDevice);
 /// `device` must be created by getPhysicalDevice
 /// --- POSTCONDITIONS ---
 /// sets `*pQueueFamilyIndex` contains the index of the first queue family
-/// supporting `bit`
+/// supporting every flag in `bit`
 ErrVal getQueueFamilyIndexByCapability( //
     uint32_t *pQueueFamilyIndex,        //
     const VkPhysicalDevice device,      //
     const VkQueueFlags bit              //
 );
 
+/// Gets the first queue family that only supports transfers, such as a DMA
+/// engine on a discrete GPU
+/// --- PRECONDITIONS ---
+/// * `pQueueFamilyIndex` must be a valid pointer
+/// --- POSTCONDITIONS ---
+/// * returns ERR_NOTSUPPORTED if there is no such family, in which case the
+/// graphics family should be used for transfers instead
+ErrVal getTransferQueueFamilyIndex(uint32_t *pQueueFamilyIndex,
+                                   const VkPhysicalDevice physicalDevice);
+
 /// Gets the first queue family index which can support rendering to `surface`
 /// --- PRECONDITIONS ---
 /// * `pQueueFamilyIndex` must be a valid pointer
@@ -259,21 +336,27 @@ ErrVal getSwapchainImages(         //
     const VkSwapchainKHR swapchain //
 );
 
-ErrVal new_Image(                           //
+/// Creates a 2D image, and binds memory sub-allocated from `pAllocator`
+/// --- POSTCONDITIONS ---
+/// * returns error status
+/// * images bigger than half a block get their own VkDeviceMemory
+/// --- CLEANUP ---
+/// * call `delete_Image`, then `delete_Allocation`
+ErrVal new_Image_Allocation(                //
     VkImage *pImage,                        //
-    VkDeviceMemory *pImageMemory,           //
+    Allocation *pAllocation,                //
+    Allocator *pAllocator,                  //
     const VkExtent2D dimensions,            //
     const VkFormat format,                  //
     const VkImageTiling tiling,             //
     const VkImageUsageFlags usage,          //
-    const VkMemoryPropertyFlags properties, //
-    const VkPhysicalDevice physicalDevice,  //
-    const VkDevice device                   //
+    const VkMemoryPropertyFlags properties  //
 );
 
-/// Deletes a image created from new_Image
+/// Deletes a image created from new_Image_Allocation
 /// --- PRECONDITIONS ---
-/// * `pImage` must be a valid pointer to a image created from new_Image
+/// * `pImage` must be a valid pointer to a image created from
+/// new_Image_Allocation
 /// * `device` must be the logical device from which `*pImage` was allocated
 /// --- POSTCONDITIONS ---
 /// * Resources associated with `*pImage` have been released
@@ -329,9 +412,21 @@ ErrVal new_ShaderModule(VkShaderModule *pShaderModule, const VkDevice device,
 /// * `*pShaderModule` is set to VK_NULL_HANDLE
 void delete_ShaderModule(VkShaderModule *pShaderModule, const VkDevice device);
 
+/// Creates a render pass with one color and one depth attachment
+/// --- PRECONDITIONS ---
+/// * `pRenderPass` is a valid pointer
+/// * `finalLayout` is the layout the color attachment is left in, so
+/// VK_IMAGE_LAYOUT_PRESENT_SRC_KHR for swapchain images, or
+/// VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL for offscreen images that are read back
+/// --- POSTCONDITIONS ---
+/// * returns error status
+/// * on success, `*pRenderPass` is a new render pass
+/// --- CLEANUP ---
+/// * call `delete_RenderPass`
 ErrVal new_VertexDisplayRenderPass(VkRenderPass *pRenderPass,
                                    const VkDevice device,
-                                   const VkFormat swapchainImageFormat);
+                                   const VkFormat swapchainImageFormat,
+                                   const VkImageLayout finalLayout);
 
 void delete_RenderPass(VkRenderPass *pRenderPass, const VkDevice device);
 
@@ -341,13 +436,25 @@ ErrVal new_VertexDisplayPipelineLayout(VkPipelineLayout *pPipelineLayout,
 void delete_PipelineLayout(VkPipelineLayout *pPipelineLayout,
                            const VkDevice device);
 
+/// Creates the pipeline that draws meshes
+/// --- PRECONDITIONS ---
+/// * `pVertexDisplayPipeline` is a valid pointer
+/// * `cullMode` is the faces left out, where front faces wind counter
+/// clockwise around their normal in world space
+/// --- POSTCONDITIONS ---
+/// * returns error status
+/// * on success, `*pVertexDisplayPipeline` is a new pipeline
+/// --- CLEANUP ---
+/// * call `delete_Pipeline`
 ErrVal new_VertexDisplayPipeline(VkPipeline *pVertexDisplayPipeline,
                                  const VkDevice device,
                                  const VkShaderModule vertShaderModule,
                                  const VkShaderModule fragShaderModule,
-                                 const VkExtent2D extent,
                                  const VkRenderPass renderPass,
-                                 const VkPipelineLayout pipelineLayout);
+                                 const VkPipelineLayout pipelineLayout,
+                                 const VertexFormat vertexFormat,
+                                 const bool instanced,
+                                 const VkCullModeFlags cullMode);
 
 void delete_Pipeline(VkPipeline *pPipeline, const VkDevice device);
 
@@ -371,6 +478,23 @@ void delete_SwapchainFramebuffers(VkFramebuffer *pFramebuffers,
                                   const uint32_t imageCount,
                                   const VkDevice device);
 
+/// Creates one framebuffer per offscreen image, each with its own depth image
+/// --- PRECONDITIONS ---
+/// * `pFramebuffers` points to at least `imageCount` framebuffers
+/// * `pDepthImageViews` and `pImageViews` each hold `imageCount` views
+/// --- POSTCONDITIONS ---
+/// * returns error status
+/// * on success, `pFramebuffers[i]` renders to `pImageViews[i]`
+/// --- CLEANUP ---
+/// * call `delete_SwapchainFramebuffers`
+ErrVal new_OffscreenFramebuffers(VkFramebuffer *pFramebuffers,
+                                 const VkDevice device,
+                                 const VkRenderPass renderPass,
+                                 const VkExtent2D extent,
+                                 const uint32_t imageCount,
+                                 const VkImageView *pDepthImageViews,
+                                 const VkImageView *pImageViews);
+
 ErrVal new_CommandPool(             //
     VkCommandPool *pCommandPool,    //
     const VkDevice device,          //
@@ -393,23 +517,61 @@ void delete_CommandBuffers(            //
     const VkDevice device              //
 );
 
+/// Records a render pass drawing a vertex buffer
+/// If `indexBuffer` is VK_NULL_HANDLE, draws `vertexCount` vertices as a
+/// triangle list, otherwise draws `indexCount` 32 bit indices from it
+/// `pQuantization` must be given when the pipeline takes packed vertices, and
+/// is NULL otherwise
+/// If `instanceBuffer` is not VK_NULL_HANDLE, the pipeline must be instanced,
+/// and `instanceCount` instances of InstanceData are drawn in one call
+/// If `pCuller` is not NULL, the instances are frustum culled by it first, and
+/// only the visible ones are drawn from `indexBuffer` with indirect draws
+/// If `pDraws` is not NULL, `indexCount` and `instanceCount` are ignored, and
+/// each of the `drawCount` draws is recorded instead
+/// If `pMeshletCuller` is not NULL, its meshlets are culled against the camera
+/// at `cameraPosition` first, and only the visible indices are drawn
 ErrVal recordVertexDisplayCommandBuffer(                //
     VkCommandBuffer commandBuffer,                      //
     const VkFramebuffer swapchainFramebuffer,           //
     const VkBuffer vertexBuffer,                        //
     const uint32_t vertexCount,                         //
+    const VkBuffer indexBuffer,                         //
+    const uint32_t indexCount,                          //
+    const VkBuffer instanceBuffer,                      //
+    const uint32_t instanceCount,                       //
     const VkRenderPass renderPass,                      //
     const VkPipelineLayout vertexDisplayPipelineLayout, //
     const VkPipeline vertexDisplayPipeline,             //
     const VkExtent2D swapchainExtent,                   //
     const mat4x4 cameraTransform,                       //
-    const VkClearColorValue clearColor                  //
+    const VertexQuantization *pQuantization,            //
+    const VkClearColorValue clearColor,                 //
+    GpuProfiler *pProfiler,                             //
+    AsyncUploader *pUploader,                           //
+    GpuCuller *pCuller,                                 //
+    const IndexedDraw *pDraws,                          //
+    const uint32_t drawCount,                           //
+    MeshletCuller *pMeshletCuller,                      //
+    const vec3 cameraPosition                           //
 );
 
 ErrVal new_Semaphore(VkSemaphore *pSemaphore, const VkDevice device);
 
 void delete_Semaphore(VkSemaphore *pSemaphore, const VkDevice device);
 
+/// Creates a timeline semaphore starting at `initialValue`
+/// --- CLEANUP ---
+/// * call `delete_Semaphore`
+ErrVal new_TimelineSemaphore(VkSemaphore *pSemaphore,
+                             const uint64_t initialValue,
+                             const VkDevice device);
+
+/// Blocks until `semaphore` reaches at least `value`
+/// --- PANICS ---
+/// * panics if the wait fails
+ErrVal waitTimelineSemaphore(const VkSemaphore semaphore, const uint64_t value,
+                             const VkDevice device);
+
 ErrVal new_Semaphores(VkSemaphore *pSemaphores, const uint32_t semaphoreCount,
                       const VkDevice device);
 
@@ -439,6 +601,9 @@ ErrVal getNextSwapchainImage(           //
     VkSemaphore imageAvailableSemaphore //
 );
 
+/// Submits a command buffer rendering to a swapchain image, and presents it
+/// If `pUploader` is not NULL, the submission waits for the uploads whose
+/// ownership `commandBuffer` acquired
 ErrVal drawFrame(                        //
     VkCommandBuffer commandBuffer,       //
     VkSwapchainKHR swapchain,            //
@@ -447,7 +612,25 @@ ErrVal drawFrame(                        //
     VkSemaphore renderFinishedSemaphore, //
     VkFence inFlightFence,               //
     const VkQueue graphicsQueue,         //
-    const VkQueue presentQueue           //
+    const VkQueue presentQueue,          //
+    const AsyncUploader *pUploader       //
+);
+
+/// Submits a command buffer rendering to an offscreen image
+/// --- PRECONDITIONS ---
+/// * `commandBuffer` was recorded with a framebuffer from
+/// `new_OffscreenFramebuffers`
+/// * `inFlightFence` is unsignaled
+/// --- POSTCONDITIONS ---
+/// * returns error status
+/// * `inFlightFence` is signaled once rendering completes
+/// * nothing is presented
+/// * waits for uploads the same way as `drawFrame`
+ErrVal drawOffscreenFrame(         //
+    VkCommandBuffer commandBuffer, //
+    VkFence inFlightFence,         //
+    const VkQueue graphicsQueue,   //
+    const AsyncUploader *pUploader //
 );
 
 ErrVal new_SurfaceFromGLFW(VkSurfaceKHR *pSurface, GLFWwindow *pWindow,
@@ -455,12 +638,6 @@ ErrVal new_SurfaceFromGLFW(VkSurfaceKHR *pSurface, GLFWwindow *pWindow,
 
 void delete_Surface(VkSurfaceKHR *pSurface, const VkInstance instance);
 
-ErrVal new_VertexBuffer(VkBuffer *pBuffer, VkDeviceMemory *pBufferMemory,
-                        const Vertex *pVertices, const uint32_t vertexCount,
-                        const VkDevice device,
-                        const VkPhysicalDevice physicalDevice,
-                        const VkCommandPool commandPool, const VkQueue queue);
-
 ErrVal new_Buffer_DeviceMemory(VkBuffer *pBuffer, VkDeviceMemory *pBufferMemory,
                                const VkDeviceSize size,
                                const VkPhysicalDevice physicalDevice,
@@ -468,31 +645,115 @@ ErrVal new_Buffer_DeviceMemory(VkBuffer *pBuffer, VkDeviceMemory *pBufferMemory,
                                const VkBufferUsageFlags usage,
                                const VkMemoryPropertyFlags properties);
 
-ErrVal copyBuffer(VkBuffer destinationBuffer, const VkBuffer sourceBuffer,
-                  const VkDeviceSize size, const VkCommandPool commandPool,
-                  const VkQueue queue, const VkDevice device);
+/// Creates a buffer bound to memory sub-allocated from `pAllocator`
+/// --- PRECONDITIONS ---
+/// * `pAllocator` was created by `new_Allocator`
+/// --- POSTCONDITIONS ---
+/// * returns error status
+/// * the memory has all of `properties`, and as many of `preferredProperties`
+/// as any memory type allows
+/// * on success, `pAllocation->pMapped` points to the buffer's contents if
+/// the memory is host visible
+/// --- CLEANUP ---
+/// * call `delete_Buffer`, then `delete_Allocation`
+ErrVal new_Buffer_Allocation(VkBuffer *pBuffer, Allocation *pAllocation,
+                             Allocator *pAllocator, const VkDeviceSize size,
+                             const VkBufferUsageFlags usage,
+                             const VkMemoryPropertyFlags properties,
+                             const VkMemoryPropertyFlags preferredProperties);
+
+/// Returns true if the CPU can write `pAllocation` without flushing
+bool isAllocationHostWritable(const Allocation *pAllocation,
+                              const Allocator *pAllocator);
+
+/// Creates a device local buffer holding `size` bytes of `pData`
+/// --- PRECONDITIONS ---
+/// * `pAllocator` and `pUploader` were created from the same device
+/// * `dstStageMask` and `dstAccessMask` describe the buffer's first use, as in
+/// `asyncUploadBuffer`
+/// --- POSTCONDITIONS ---
+/// * returns error status
+/// * if host visible device local memory is available, the data is written
+/// into it directly and `*pTicket` is set to 0
+/// * otherwise the data is uploaded with `asyncUploadBuffer`
+/// * `pTicket` may be NULL
+/// --- CLEANUP ---
+/// * call `delete_Buffer`, then `delete_Allocation`
+ErrVal new_Buffer_Upload(VkBuffer *pBuffer, Allocation *pAllocation,
+                         Allocator *pAllocator, AsyncUploader *pUploader,
+                         const void *pData, const VkDeviceSize size,
+                         const VkBufferUsageFlags usage,
+                         const VkPipelineStageFlags dstStageMask,
+                         const VkAccessFlags dstAccessMask, uint64_t *pTicket);
+
+/// Copies `size` bytes into a host visible allocation
+/// --- POSTCONDITIONS ---
+/// * returns ERR_MEMORY if the allocation isn't mapped
+ErrVal copyToAllocation(const Allocation *pAllocation, const void *source,
+                        const VkDeviceSize size);
+
+/// Copies a color image into a buffer, blocking until finished
+/// --- PRECONDITIONS ---
+/// * `sourceImage` is in VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL and was created
+/// with VK_IMAGE_USAGE_TRANSFER_SRC_BIT
+/// * `destinationBuffer` holds at least 4 * width * height bytes
+/// --- POSTCONDITIONS ---
+/// * returns error status
+/// * on success, `destinationBuffer` contains the tightly packed pixels, and
+/// the copy is visible to host reads of host coherent memory
+ErrVal copyImageToBuffer(VkBuffer destinationBuffer, const VkImage sourceImage,
+                         const VkExtent2D extent,
+                         const VkCommandPool commandPool, const VkQueue queue,
+                         const VkDevice device);
 
 void delete_Buffer(VkBuffer *pBuffer, const VkDevice device);
 
 void delete_DeviceMemory(VkDeviceMemory *pDeviceMemory, const VkDevice device);
 
-ErrVal copyToDeviceMemory(VkDeviceMemory *pDeviceMemory,
-                          const VkDeviceSize deviceSize, const void *source,
-                          const VkDevice device);
-
 void getDepthFormat(VkFormat *pFormat);
 
 ErrVal new_DepthImageView(VkImageView *pImageView, const VkDevice device,
                           const VkImage depthImage);
 
-ErrVal new_DepthImage(VkImage *pImage, VkDeviceMemory *pImageMemory,
+/// Creates a depth image of `swapchainExtent` with `new_Image_Allocation`
+/// --- CLEANUP ---
+/// * call `delete_Image`, then `delete_Allocation`
+ErrVal new_DepthImage(VkImage *pImage, Allocation *pAllocation,
                       const VkExtent2D swapchainExtent,
-                      const VkPhysicalDevice physicalDevice,
-                      const VkDevice device);
+                      Allocator *pAllocator);
 
+/// Decides if a depth image of `*pCapacity` can still be used with a swapchain
+/// of `extent`, so that resizing a window doesn't reallocate every time
+/// --- POSTCONDITIONS ---
+/// * returns true if the depth image must be recreated, in which case
+/// `*pCapacity` is set to the extent to create it with
+/// * otherwise `*pCapacity` is unchanged, and is at least `extent`
+/// * framebuffers may be smaller than their attachments, so the depth image
+/// can be used as is with a framebuffer of `extent`
+bool resizeDepthImageCapacity(VkExtent2D *pCapacity, const VkExtent2D extent,
+                              const VkPhysicalDevice physicalDevice);
+
+/// Creates color images that can be rendered to and then copied out
+/// --- PRECONDITIONS ---
+/// * `pImages` and `pAllocations` point to at least `imageCount` elements
+/// --- POSTCONDITIONS ---
+/// * returns error status
+/// * on success, each image is backed by device local memory from
+/// `pAllocator`
+/// --- CLEANUP ---
+/// * call `delete_OffscreenImages`
+ErrVal new_OffscreenImages(VkImage *pImages, Allocation *pAllocations,
+                           const uint32_t imageCount, const VkExtent2D extent,
+                           const VkFormat format, Allocator *pAllocator);
+
+void delete_OffscreenImages(VkImage *pImages, Allocation *pAllocations,
+                            const uint32_t imageCount, Allocator *pAllocator);
+
+/// Picks a memory type with `selectMemoryType`
 ErrVal getMemoryTypeIndex(uint32_t *memoryTypeIndex,
                           const uint32_t memoryTypeBits,
-                          const VkMemoryPropertyFlags memoryPropertyFlags,
+                          const VkMemoryPropertyFlags requiredFlags,
+                          const VkMemoryPropertyFlags preferredFlags,
                           const VkPhysicalDevice physicalDevice);
 
 ErrVal new_ComputePipeline(VkPipeline *pPipeline,
@@ -519,6 +780,15 @@ ErrVal new_ComputeBufferDescriptorSet(
     const VkDescriptorSetLayout descriptorSetLayout,
     const VkDescriptorPool descriptorPool, const VkDevice device);
 
+/// Points binding 0 of a set from `new_ComputeBufferDescriptorSet` at the
+/// first `size` bytes of `buffer`
+/// --- PRECONDITIONS ---
+/// * no pending command buffer uses `descriptorSet`
+void updateComputeBufferDescriptorSet(const VkDescriptorSet descriptorSet,
+                                      const VkBuffer buffer,
+                                      const VkDeviceSize size,
+                                      const VkDevice device);
+
 void delete_DescriptorSets(VkDescriptorSet **ppDescriptorSets);
 
 #endif /* SRC_VULKAN_UTILS_H_ */
@@ -0,0 +1,183 @@
+#include "workload.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// the camera starts at the origin looking down +z, so the scene lies between
+// these depths
+#define WORKLOAD_NEAR_Z 2.0f
+#define WORKLOAD_FAR_Z 10.0f
+// the uniform distribution fills x and y in [-WORKLOAD_HALF_WIDTH,
+// WORKLOAD_HALF_WIDTH]
+#define WORKLOAD_HALF_WIDTH 4.0f
+
+// xorshift64*, so scenes are identical on every platform
+static uint64_t nextRandom(uint64_t *pState) {
+  uint64_t x = *pState;
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  *pState = x;
+  return (x * 0x2545F4914F6CDD1DULL);
+}
+
+// uniformly distributed in [0, 1)
+static float randomFloat(uint64_t *pState) {
+  return ((float)(nextRandom(pState) >> 40) / (float)(1 << 24));
+}
+
+static void randomColor(vec3 color, uint64_t *pState) {
+  color[0] = randomFloat(pState);
+  color[1] = randomFloat(pState);
+  color[2] = randomFloat(pState);
+}
+
+static void generateUniform(Vertex *pVertices, const WorkloadParams *pParams,
+                            uint64_t *pRandom) {
+  // distance from the center of an equilateral triangle to its corners
+  const float radius = pParams->triangleSize / sqrtf(3.0f);
+  for (uint32_t i = 0; i < pParams->triangleCount; i++) {
+    vec3 center = {
+        (randomFloat(pRandom) * 2.0f - 1.0f) * WORKLOAD_HALF_WIDTH,
+        (randomFloat(pRandom) * 2.0f - 1.0f) * WORKLOAD_HALF_WIDTH,
+        WORKLOAD_NEAR_Z +
+            randomFloat(pRandom) * (WORKLOAD_FAR_Z - WORKLOAD_NEAR_Z),
+    };
+    float angle = randomFloat(pRandom) * 2.0f * PI;
+    vec3 color;
+    randomColor(color, pRandom);
+
+    for (uint32_t k = 0; k < 3; k++) {
+      Vertex *pVertex = &pVertices[i * 3 + k];
+      float cornerAngle = angle + (float)k * 2.0f * PI / 3.0f;
+      pVertex->position[0] = center[0] + radius * cosf(cornerAngle);
+      pVertex->position[1] = center[1] + radius * sinf(cornerAngle);
+      pVertex->position[2] = center[2];
+      vec3_dup(pVertex->color, color);
+    }
+  }
+}
+
+static void generateLayers(Vertex *pVertices, const WorkloadParams *pParams,
+                           uint64_t *pRandom) {
+  const uint32_t layerCount = pParams->layerCount;
+  const float spacing =
+      layerCount > 1 ? (WORKLOAD_FAR_Z - WORKLOAD_NEAR_Z) / (float)(layerCount - 1)
+                     : 0.0f;
+
+  uint32_t triangle = 0;
+  for (uint32_t layer = 0; layer < layerCount; layer++) {
+    // spread the remainder over the first layers
+    uint32_t layerTriangles = pParams->triangleCount / layerCount +
+                              (layer < pParams->triangleCount % layerCount);
+    if (layerTriangles == 0) {
+      continue;
+    }
+
+    // farthest layer first, so the depth test never rejects anything
+    float z = WORKLOAD_FAR_Z - spacing * (float)layer;
+    // with a 90 degree fov the view is exactly 2z across at depth z
+    float halfWidth = z;
+
+    uint32_t quadCount = (layerTriangles + 1) / 2;
+    uint32_t columns = (uint32_t)ceil(sqrt((double)quadCount));
+    uint32_t rows = (quadCount + columns - 1) / columns;
+    float cellWidth = 2.0f * halfWidth / (float)columns;
+    float cellHeight = 2.0f * halfWidth / (float)rows;
+
+    vec3 color;
+    randomColor(color, pRandom);
+
+    for (uint32_t i = 0; i < layerTriangles; i++) {
+      uint32_t quad = i / 2;
+      float x0 = -halfWidth + cellWidth * (float)(quad % columns);
+      float y0 = -halfWidth + cellHeight * (float)(quad / columns);
+      float x1 = x0 + cellWidth;
+      float y1 = y0 + cellHeight;
+
+      // each quad is split along its diagonal
+      float corners[2][3][2] = {
+          {{x0, y0}, {x1, y0}, {x1, y1}},
+          {{x0, y0}, {x1, y1}, {x0, y1}},
+      };
+      for (uint32_t k = 0; k < 3; k++) {
+        Vertex *pVertex = &pVertices[triangle * 3 + k];
+        pVertex->position[0] = corners[i % 2][k][0];
+        pVertex->position[1] = corners[i % 2][k][1];
+        pVertex->position[2] = z;
+        vec3_dup(pVertex->color, color);
+      }
+      triangle++;
+    }
+  }
+}
+
+ErrVal new_WorkloadVertices(Vertex **ppVertices, uint32_t *pVertexCount,
+                            const WorkloadParams *pParams) {
+  if (pParams->triangleCount > WORKLOAD_MAX_TRIANGLE_COUNT ||
+      pParams->layerCount == 0) {
+    LOG_ERROR(ERR_LEVEL_ERROR, "invalid workload parameters");
+    return (ERR_BADARGS);
+  }
+
+  uint32_t vertexCount = pParams->triangleCount * 3;
+  Vertex *pVertices = malloc((size_t)vertexCount * sizeof(Vertex));
+  if (!pVertices) {
+    LOG_ERROR_ARGS(ERR_LEVEL_ERROR,
+                   "could not allocate %u workload vertices: %s", vertexCount,
+                   strerror(errno));
+    return (ERR_ALLOCFAIL);
+  }
+
+  // xorshift must never be seeded with 0
+  uint64_t random = pParams->seed != 0 ? pParams->seed : 1;
+  switch (pParams->distribution) {
+  case WORKLOAD_DISTRIBUTION_UNIFORM:
+    generateUniform(pVertices, pParams, &random);
+    break;
+  case WORKLOAD_DISTRIBUTION_LAYERS:
+    generateLayers(pVertices, pParams, &random);
+    break;
+  }
+
+  *ppVertices = pVertices;
+  *pVertexCount = vertexCount;
+  return (ERR_OK);
+}
+
+void delete_WorkloadVertices(Vertex **ppVertices) {
+  free(*ppVertices);
+  *ppVertices = NULL;
+}
+
+void printWorkloadThroughput(const uint64_t triangleCount,
+                             const uint32_t frameCount,
+                             const uint64_t elapsedNs, const VkExtent2D extent,
+                             const GpuProfiler *pProfiler) {
+  if (frameCount == 0 || elapsedNs == 0) {
+    return;
+  }
+  double seconds = (double)elapsedNs / 1e9;
+  double triangles = (double)triangleCount * frameCount;
+  double pixels = (double)extent.width * extent.height * frameCount;
+
+  printf("workload: %llu triangles, %u frames in %.3f s\n",
+         (unsigned long long)triangleCount, frameCount, seconds);
+  printf("  %.2f Mtris/s\n", triangles / seconds / 1e6);
+  printf("  %.2f Mpixels/s written\n", pixels / seconds / 1e6);
+
+  // fragment invocations include overdraw, unlike the pixels written
+  if (pProfiler != NULL && pProfiler->statisticsFrameCount != 0) {
+    double fragmentsPerFrame =
+        (double)pProfiler
+            ->pStatisticsTotals[GPU_STATISTIC_FRAGMENT_SHADER_INVOCATIONS] /
+        (double)pProfiler->statisticsFrameCount;
+    printf("  %.2f Mfragments/s shaded (%.2fx overdraw)\n",
+           fragmentsPerFrame * frameCount / seconds / 1e6,
+           fragmentsPerFrame / ((double)extent.width * extent.height));
+  }
+}
@@ -0,0 +1,64 @@
+#ifndef SRC_WORKLOAD_H_
+#define SRC_WORKLOAD_H_
+
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+#include "errors.h"
+#include "gpu_profiler.h"
+#include "vulkan_utils.h"
+
+// the most triangles whose vertices can be counted in a uint32_t
+#define WORKLOAD_MAX_TRIANGLE_COUNT (UINT32_MAX / 3)
+
+// How the triangles of a workload are laid out in front of the camera
+typedef enum {
+  // randomly placed and rotated in a box, each `triangleSize` across
+  WORKLOAD_DISTRIBUTION_UNIFORM = 0,
+  // `layerCount` grids of triangles that each fill a square view, drawn back
+  // to front so every pixel is shaded `layerCount` times
+  WORKLOAD_DISTRIBUTION_LAYERS = 1,
+} WorkloadDistribution;
+
+// Parameters of a generated stress scene
+typedef struct {
+  uint32_t triangleCount;
+  WorkloadDistribution distribution;
+  // edge length in world units, only used by WORKLOAD_DISTRIBUTION_UNIFORM
+  float triangleSize;
+  // overdraw depth, only used by WORKLOAD_DISTRIBUTION_LAYERS
+  uint32_t layerCount;
+  // the same seed always generates the same scene
+  uint64_t seed;
+} WorkloadParams;
+
+/// Generates a non indexed triangle list for the workload
+/// --- PRECONDITIONS ---
+/// * `ppVertices` and `pVertexCount` are valid pointers
+/// * `pParams->triangleCount` is at most WORKLOAD_MAX_TRIANGLE_COUNT
+/// * `pParams->layerCount` is at least 1
+/// --- POSTCONDITIONS ---
+/// * returns error status
+/// * on success, `*ppVertices` points to `*pVertexCount` vertices, taking up
+/// 72 bytes per triangle
+/// * returns ERR_ALLOCFAIL if there isn't enough memory
+/// --- CLEANUP ---
+/// * call `delete_WorkloadVertices`
+ErrVal new_WorkloadVertices(Vertex **ppVertices, uint32_t *pVertexCount,
+                            const WorkloadParams *pParams);
+
+void delete_WorkloadVertices(Vertex **ppVertices);
+
+/// Prints triangles per second and pixels per second over a run
+/// --- PRECONDITIONS ---
+/// * `frameCount` frames drawing `triangleCount` triangles each took
+/// `elapsedNs` nanoseconds in total
+/// * `pProfiler` is NULL or collected pipeline statistics during those frames,
+/// in which case shaded fragments per second are printed as well
+void printWorkloadThroughput(const uint64_t triangleCount,
+                             const uint32_t frameCount,
+                             const uint64_t elapsedNs, const VkExtent2D extent,
+                             const GpuProfiler *pProfiler);
+
+#endif // SRC_WORKLOAD_H_